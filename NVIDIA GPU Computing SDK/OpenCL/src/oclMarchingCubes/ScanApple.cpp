@@ -1,4 +1,6 @@
 #include "ScanApple.h" 
+#include "mc_profile.h"
+#include "mc_programCache.h"
 
 namespace MeshProc {
 	namespace scanApple {
@@ -12,6 +14,7 @@ namespace MeshProc {
 		unsigned int            ElementsAllocated = 0;
 		unsigned int            LevelsAllocated = 0;
 		int                     GROUP_SIZE = 256;
+		int                     MAX_GROUP_SIZE = 1024;
 		////////////////////////////////////////////////////////////////////////////////////////////////////
 
 		enum KernelMethods
@@ -20,7 +23,12 @@ namespace MeshProc {
 			PRESCAN_STORE_SUM = 1,
 			PRESCAN_STORE_SUM_NON_POWER_OF_TWO = 2,
 			PRESCAN_NON_POWER_OF_TWO = 3,
-			UNIFORM_ADD = 4
+			UNIFORM_ADD = 4,
+			// uchar input, first level only
+			PRESCAN_U8 = 5,
+			PRESCAN_STORE_SUM_U8 = 6,
+			PRESCAN_STORE_SUM_NON_POWER_OF_TWO_U8 = 7,
+			PRESCAN_NON_POWER_OF_TWO_U8 = 8
 		};
 
 		static const char* KernelNames[] =
@@ -29,11 +37,29 @@ namespace MeshProc {
 			"PreScanStoreSumKernel",
 			"PreScanStoreSumNonPowerOfTwoKernel",
 			"PreScanNonPowerOfTwoKernel",
-			"UniformAddKernel"
+			"UniformAddKernel",
+			"PreScanKernelU8",
+			"PreScanStoreSumKernelU8",
+			"PreScanStoreSumNonPowerOfTwoKernelU8",
+			"PreScanNonPowerOfTwoKernelU8"
 		};
 
 		static const unsigned int KernelCount = sizeof(KernelNames) / sizeof(char *);
 
+		// recursion level of the launches that follow, for the profiler's stage names
+		static int ProfileLevel = 0;
+
+		// MC_PROFILE event named like "scan verts L1 UniformAddKernel", every work-item
+		// reads and writes two elements
+		static cl_event *ProfileEvent(unsigned int k, const size_t *global, size_t inputSize)
+		{
+			if (!MC_PROFILE::recording())
+				return NULL;
+			char name[256];
+			sprintf(name, "%s L%d %s", MC_PROFILE::scope().c_str(), ProfileLevel, KernelNames[k]);
+			return MC_PROFILE::event(name, 2.0 * global[0] * (inputSize + sizeof(cl_uint)));
+		}
+
 		bool IsPowerOfTwo(int n)
 		{
 			return ((n&(n - 1)) == 0);
@@ -146,14 +172,15 @@ namespace MeshProc {
 				cl_mem input_data,
 				unsigned int n,
 				int group_index,
-				int base_index)
+				int base_index,
+				bool narrow_input)
 		{
 #if DEBUG_INFO
 			printf("PreScan: Global[%4d] Local[%4d] Shared[%4d] BlockIndex[%4d] BaseIndex[%4d] Entries[%d]\n",
 				(int)global[0], (int)local[0], (int)shared, group_index, base_index, n);
 #endif
 
-			unsigned int k = PRESCAN;
+			unsigned int k = narrow_input ? PRESCAN_U8 : PRESCAN;
 			unsigned int a = 0;
 
 			int err = CL_SUCCESS;
@@ -170,7 +197,8 @@ namespace MeshProc {
 			}
 
 			err = CL_SUCCESS;
-			err |= clEnqueueNDRangeKernel(ComputeCommands, ComputeKernels[k], 1, NULL, global, local, 0, NULL, NULL);
+			err |= clEnqueueNDRangeKernel(ComputeCommands, ComputeKernels[k], 1, NULL, global, local, 0, NULL,
+				ProfileEvent(k, global, narrow_input ? sizeof(cl_uchar) : sizeof(cl_uint)));
 			if (err != CL_SUCCESS)
 			{
 				printf("Error: %s: Failed to execute kernel!\n", KernelNames[k]);
@@ -190,14 +218,15 @@ namespace MeshProc {
 				cl_mem partial_sums,
 				unsigned int n,
 				int group_index,
-				int base_index)
+				int base_index,
+				bool narrow_input)
 		{
 #if DEBUG_INFO
 			printf("PreScan: Global[%4d] Local[%4d] Shared[%4d] BlockIndex[%4d] BaseIndex[%4d] Entries[%d]\n",
 				(int)global[0], (int)local[0], (int)shared, group_index, base_index, n);
 #endif
 
-			unsigned int k = PRESCAN_STORE_SUM;
+			unsigned int k = narrow_input ? PRESCAN_STORE_SUM_U8 : PRESCAN_STORE_SUM;
 			unsigned int a = 0;
 
 			int err = CL_SUCCESS;
@@ -215,7 +244,8 @@ namespace MeshProc {
 			}
 
 			err = CL_SUCCESS;
-			err |= clEnqueueNDRangeKernel(ComputeCommands, ComputeKernels[k], 1, NULL, global, local, 0, NULL, NULL);
+			err |= clEnqueueNDRangeKernel(ComputeCommands, ComputeKernels[k], 1, NULL, global, local, 0, NULL,
+				ProfileEvent(k, global, narrow_input ? sizeof(cl_uchar) : sizeof(cl_uint)));
 			if (err != CL_SUCCESS)
 			{
 				printf("Error: %s: Failed to execute kernel!\n", KernelNames[k]);
@@ -235,14 +265,15 @@ namespace MeshProc {
 				cl_mem partial_sums,
 				unsigned int n,
 				int group_index,
-				int base_index)
+				int base_index,
+				bool narrow_input)
 		{
 #if DEBUG_INFO
 			printf("PreScanStoreSumNonPowerOfTwo: Global[%4d] Local[%4d] BlockIndex[%4d] BaseIndex[%4d] Entries[%d]\n",
 				(int)global[0], (int)local[0], group_index, base_index, n);
 #endif
 
-			unsigned int k = PRESCAN_STORE_SUM_NON_POWER_OF_TWO;
+			unsigned int k = narrow_input ? PRESCAN_STORE_SUM_NON_POWER_OF_TWO_U8 : PRESCAN_STORE_SUM_NON_POWER_OF_TWO;
 			unsigned int a = 0;
 
 			int err = CL_SUCCESS;
@@ -260,7 +291,8 @@ namespace MeshProc {
 			}
 
 			err = CL_SUCCESS;
-			err |= clEnqueueNDRangeKernel(ComputeCommands, ComputeKernels[k], 1, NULL, global, local, 0, NULL, NULL);
+			err |= clEnqueueNDRangeKernel(ComputeCommands, ComputeKernels[k], 1, NULL, global, local, 0, NULL,
+				ProfileEvent(k, global, narrow_input ? sizeof(cl_uchar) : sizeof(cl_uint)));
 			if (err != CL_SUCCESS)
 			{
 				printf("Error: %s: Failed to execute kernel!\n", KernelNames[k]);
@@ -279,14 +311,15 @@ namespace MeshProc {
 				cl_mem input_data,
 				unsigned int n,
 				int group_index,
-				int base_index)
+				int base_index,
+				bool narrow_input)
 		{
 #if DEBUG_INFO
 			printf("PreScanNonPowerOfTwo: Global[%4d] Local[%4d] BlockIndex[%4d] BaseIndex[%4d] Entries[%d]\n",
 				(int)global[0], (int)local[0], group_index, base_index, n);
 #endif
 
-			unsigned int k = PRESCAN_NON_POWER_OF_TWO;
+			unsigned int k = narrow_input ? PRESCAN_NON_POWER_OF_TWO_U8 : PRESCAN_NON_POWER_OF_TWO;
 			unsigned int a = 0;
 
 			int err = CL_SUCCESS;
@@ -303,7 +336,8 @@ namespace MeshProc {
 			}
 
 			err = CL_SUCCESS;
-			err |= clEnqueueNDRangeKernel(ComputeCommands, ComputeKernels[k], 1, NULL, global, local, 0, NULL, NULL);
+			err |= clEnqueueNDRangeKernel(ComputeCommands, ComputeKernels[k], 1, NULL, global, local, 0, NULL,
+				ProfileEvent(k, global, narrow_input ? sizeof(cl_uchar) : sizeof(cl_uint)));
 			if (err != CL_SUCCESS)
 			{
 				printf("Error: %s: Failed to execute kernel!\n", KernelNames[k]);
@@ -344,7 +378,8 @@ namespace MeshProc {
 			}
 
 			err = CL_SUCCESS;
-			err |= clEnqueueNDRangeKernel(ComputeCommands, ComputeKernels[k], 1, NULL, global, local, 0, NULL, NULL);
+			err |= clEnqueueNDRangeKernel(ComputeCommands, ComputeKernels[k], 1, NULL, global, local, 0, NULL,
+				ProfileEvent(k, global, sizeof(cl_uint)));
 			if (err != CL_SUCCESS)
 			{
 				printf("Error: %s: Failed to execute kernel!\n", KernelNames[k]);
@@ -355,7 +390,7 @@ namespace MeshProc {
 		}
 
 		int
-			PreScanBufferRecursive(cl_mem output_data, cl_mem input_data, int max_group_size, unsigned int max_work_item_count, int element_count, int level)
+			PreScanBufferRecursive(cl_mem output_data, cl_mem input_data, int max_group_size, unsigned int max_work_item_count, int element_count, int level, bool narrow_input)
 		{
 			unsigned int group_size = max_group_size;
 			unsigned int group_count = (int)fmax(1.0f, (int)ceil((float)element_count / (2.0f * group_size)));//еܷΪٸgroup
@@ -399,10 +434,11 @@ namespace MeshProc {
 
 			cl_mem partial_sums = ScanPartialSums[level];
 			int err = CL_SUCCESS;
+			ProfileLevel = level;
 
 			if (group_count > 1)
 			{
-				err = PreScanStoreSum(global, local, shared, output_data, input_data, partial_sums, work_item_count * 2, 0, 0);
+				err = PreScanStoreSum(global, local, shared, output_data, input_data, partial_sums, work_item_count * 2, 0, 0, narrow_input);
 				if (err != CL_SUCCESS)
 					return err;
 
@@ -416,16 +452,18 @@ namespace MeshProc {
 						output_data, input_data, partial_sums,
 						last_group_element_count,
 						group_count - 1,
-						element_count - last_group_element_count);
+						element_count - last_group_element_count,
+						narrow_input);
 
 					if (err != CL_SUCCESS)
 						return err;
 
 				}
 
-				err = PreScanBufferRecursive(partial_sums, partial_sums, max_group_size, max_work_item_count, group_count, level + 1);
+				err = PreScanBufferRecursive(partial_sums, partial_sums, max_group_size, max_work_item_count, group_count, level + 1, false);
 				if (err != CL_SUCCESS)
 					return err;
+				ProfileLevel = level;
 
 				err = UniformAdd(global, local, output_data, partial_sums, element_count - last_group_element_count, 0, 0);
 				if (err != CL_SUCCESS)
@@ -449,13 +487,13 @@ namespace MeshProc {
 			}
 			else if (IsPowerOfTwo(element_count))
 			{
-				err = PreScan(global, local, shared, output_data, input_data, work_item_count * 2, 0, 0);
+				err = PreScan(global, local, shared, output_data, input_data, work_item_count * 2, 0, 0, narrow_input);
 				if (err != CL_SUCCESS)
 					return err;
 			}
 			else
 			{
-				err = PreScanNonPowerOfTwo(global, local, shared, output_data, input_data, element_count, 0, 0);
+				err = PreScanNonPowerOfTwo(global, local, shared, output_data, input_data, element_count, 0, 0, narrow_input);
 				if (err != CL_SUCCESS)
 					return err;
 			}
@@ -469,9 +507,10 @@ namespace MeshProc {
 				cl_mem input_data,
 				unsigned int max_group_size,
 				unsigned int max_work_item_count,
-				unsigned int element_count)
+				unsigned int element_count,
+				bool narrow_input = false)
 		{
-			PreScanBufferRecursive(output_data, input_data, max_group_size, max_work_item_count, element_count, 0);
+			PreScanBufferRecursive(output_data, input_data, max_group_size, max_work_item_count, element_count, 0, narrow_input);
 		}
 
 		//extern "C" 
@@ -501,17 +540,15 @@ namespace MeshProc {
 			string srcStdStr = oss.str();
 			const char *srcStr = srcStdStr.c_str();
 			size_t src_size = srcStdStr.length();
-			ComputeProgram = clCreateProgramWithSource(ScanContext, 1, &srcStr, &src_size, &err);
-			if (!ComputeProgram || err != CL_SUCCESS)
+			// Create and build the program executable, from the binary cache if possible
+			//
+			ComputeProgram = MC_PROGRAMCACHE::build(ScanContext, device, "scan_kernel_MP", srcStr, src_size, NULL, &err);
+			if (!ComputeProgram)
 			{
 				printf("%s\n", source);
 				printf("Error: Failed to create compute program!\n");
 				return EXIT_FAILURE;
 			}
-
-			// Build the program executable
-			//
-			err = clBuildProgram(ComputeProgram, 1, &device, NULL, NULL, NULL);
 			if (err != CL_SUCCESS)
 			{
 				size_t length;
@@ -543,11 +580,26 @@ namespace MeshProc {
 					return EXIT_FAILURE;
 				}
 				GROUP_SIZE = min(GROUP_SIZE, wgSize);
+				MAX_GROUP_SIZE = min(MAX_GROUP_SIZE, wgSize);
 			}
 			free(source);
 			return 1;
 		}
 
+		int SetScanGroupSize(int groupSize)
+		{
+			// the prescan kernels need a power of two, bounded by the kernel work-group limit
+			if (groupSize < 2 || !IsPowerOfTwo(groupSize))
+				return GROUP_SIZE;
+			GROUP_SIZE = min(groupSize, MAX_GROUP_SIZE);
+			return GROUP_SIZE;
+		}
+
+		int GetScanGroupSize(void)
+		{
+			return GROUP_SIZE;
+		}
+
 		//extern "C" 
 		void closeScanAPPLE(void)
 		{
@@ -582,5 +634,12 @@ namespace MeshProc {
 			ReleasePartialSums();
 		}
 
+		void ScanAPPLEProcessU8(cl_mem d_Dst, cl_mem d_Src, int Ccount)
+		{
+			CreatePartialSumBuffers(Ccount);
+			PreScanBuffer(d_Dst, d_Src, GROUP_SIZE, GROUP_SIZE, Ccount, true);
+			ReleasePartialSums();
+		}
+
 	};
 };
\ No newline at end of file
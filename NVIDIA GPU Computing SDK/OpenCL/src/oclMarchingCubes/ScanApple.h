@@ -56,8 +56,14 @@ namespace MeshProc {
 			void closeScanAPPLE(void);
 		//extern "C" 
 			void ScanAPPLEProcess(cl_mem d_Dst, cl_mem d_Src, int Ccount);
+			// same exclusive scan of uchar elements, the output is still uint
+			void ScanAPPLEProcessU8(cl_mem d_Dst, cl_mem d_Src, int Ccount);
 			
 			void ReleasePartialSums(void);
+
+			// work-group size of the prescan kernels, returns the size actually used
+			int SetScanGroupSize(int groupSize);
+			int GetScanGroupSize(void);
 	};
 };
 #endif // !_SCAN_APPLE_H_
\ No newline at end of file
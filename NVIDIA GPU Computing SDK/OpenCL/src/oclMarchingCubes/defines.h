@@ -16,6 +16,23 @@ typedef unsigned int uint;
 typedef unsigned char uchar;
 
 // The number of threads to use for triangle generation (limited by shared memory size)
+// Passed to marchingCubes_kernel.cl as a build option
 #define NTHREADS 32
 
+// Default work-group sizes, replaced by the tuning cache when one exists (see mc_tuner.h)
+#define CLASSIFY_THREADS 128
+#define COMPACT_THREADS  128
+#define SCAN_GROUP_SIZE  256
+
+// Work-group size of classifyVoxelTiled, each group loads a (n+1)^3 tile of samples
+#define CLASSIFY_TILE_X 8
+#define CLASSIFY_TILE_Y 8
+#define CLASSIFY_TILE_Z 4
+
+// Work-group size of computeCornerSigns, one work-item per bit (multiple of 32)
+#define CORNER_SIGN_THREADS 128
+
+// Work-group size of generateTrianglesPerTri, one work-item per output triangle
+#define EMIT_THREADS 128
+
 #endif
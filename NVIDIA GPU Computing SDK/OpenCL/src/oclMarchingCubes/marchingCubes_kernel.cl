@@ -14,11 +14,164 @@
 
 
 // The number of threads to use for triangle generation (limited by shared memory size)
+// Set by the host with -D NTHREADS=<n>, see defines.h
+#ifndef NTHREADS
 #define NTHREADS 32
+#endif
 
-// volume data
-sampler_t volumeSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+// Work-group size of classifyVoxelTiled, also set by the host
+#ifndef CLASSIFY_TILE_X
+#define CLASSIFY_TILE_X 8
+#define CLASSIFY_TILE_Y 8
+#define CLASSIFY_TILE_Z 4
+#endif
+
+// a work-group of n^3 cells needs (n+1)^3 samples
+#define TILE_SX (CLASSIFY_TILE_X + 1)
+#define TILE_SY (CLASSIFY_TILE_Y + 1)
+#define TILE_SZ (CLASSIFY_TILE_Z + 1)
+
+// lookup table storage, chosen by the host (see mc_tables.h)
+// default: uchar images numVertsTex (256 x 1) and triTex (16 x 256)
+// MC_TABLES_CONSTANT: the uchar tables as __constant arrays, prepended to this source
+// MC_TABLES_PACKED: nibble tables, 8 vertex counts per uint and the 16 edges of a cube in one ulong
+// the table arguments stay in the signatures and are unused by the __constant variants,
+// they are plain buffers there so the program builds on devices without images
+#if defined(MC_TABLES_CONSTANT) || defined(MC_TABLES_PACKED)
+#define TABLE_ARG __global const uchar *
+#else
+#define TABLE_ARG __read_only image2d_t
 sampler_t tableSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+#endif
+
+#if defined(MC_TABLES_CONSTANT)
+#define NUM_VERTS(numVertsTex, cubeindex) ((uint)mcNumVertsTable[cubeindex])
+#define TRI_EDGE(triTex, cubeindex, i) ((uint)mcTriTable[(cubeindex) * 16 + (i)])
+#elif defined(MC_TABLES_PACKED)
+#define NUM_VERTS(numVertsTex, cubeindex) ((mcNumVertsPacked[(cubeindex) >> 3] >> (((cubeindex) & 7) * 4)) & 0xf)
+#define TRI_EDGE(triTex, cubeindex, i) ((uint)(mcTriPacked[cubeindex] >> ((i) * 4)) & 0xf)
+#else
+#define NUM_VERTS(numVertsTex, cubeindex) read_imageui(numVertsTex, tableSampler, (int2)(cubeindex, 0)).x
+#define TRI_EDGE(triTex, cubeindex, i) read_imageui(triTex, tableSampler, (int2)((int)(i), cubeindex)).x
+#endif
+
+// volume storage, chosen by the host (see mc_volume.h)
+// default: UNORM_INT8 image3d read through volumeSampler
+// MC_VOLUME_BUFFER: __global buffer of VOLUME_ELEM holding the MC_VOLUME_X x MC_VOLUME_Y x MC_VOLUME_Z
+// samples x fastest, or in Morton order with MC_VOLUME_MORTON. Samples are scaled to the [0, 1]
+// range of the image and coordinates are clamped to the grid like CLAMP_TO_EDGE.
+// MC_VOLUME_IMPLICIT: no samples, the host prepends a field function
+//   float mcField(float3 p)
+// of world positions to this source and the volume argument holds the world position of grid
+// point (0, 0, 0) in [0] and the voxel size in [1], so a slab of a larger grid is just another origin
+#if defined(MC_VOLUME_IMPLICIT)
+
+#define VOLUME_ARG __global const float4 *
+#define SAMPLE(volume, p) mcField(volume[0].xyz + convert_float3((p).xyz) * volume[1].xyz)
+
+#elif defined(MC_VOLUME_BUFFER)
+
+#if defined(MC_VOLUME_USHORT)
+#define VOLUME_ELEM ushort
+#define VOLUME_SCALE (1.0f / 65535.0f)
+#elif defined(MC_VOLUME_FLOAT)
+#define VOLUME_ELEM float
+#define VOLUME_SCALE 1.0f
+#else
+#define VOLUME_ELEM uchar
+#define VOLUME_SCALE (1.0f / 255.0f)
+#endif
+
+#define VOLUME_ARG __global const VOLUME_ELEM *
+#define SAMPLE(volume, p) sampleVolume(volume, p)
+
+#ifdef MC_VOLUME_MORTON
+// one bit of x, y and z per level while the axis has bits left, so the longer axes
+// continue alone above the shorter ones; matches MC_VOLUME::mortonIndex
+uint volumeIndex(int x, int y, int z)
+{
+    uint index = 0;
+    uint shift = 0;
+    for (uint b = 0; b < MC_MORTON_BITS; b++) {
+        if (b < MC_MORTON_BITS_X) index |= (((uint)x >> b) & 1) << shift++;
+        if (b < MC_MORTON_BITS_Y) index |= (((uint)y >> b) & 1) << shift++;
+        if (b < MC_MORTON_BITS_Z) index |= (((uint)z >> b) & 1) << shift++;
+    }
+    return index;
+}
+#else
+uint volumeIndex(int x, int y, int z)
+{
+    return ((uint)z * MC_VOLUME_Y + (uint)y) * MC_VOLUME_X + (uint)x;
+}
+#endif
+
+float sampleVolume(__global const VOLUME_ELEM *volume, int4 p)
+{
+    int x = clamp(p.x, 0, MC_VOLUME_X - 1);
+    int y = clamp(p.y, 0, MC_VOLUME_Y - 1);
+    int z = clamp(p.z, 0, MC_VOLUME_Z - 1);
+    return (float)volume[volumeIndex(x, y, z)] * VOLUME_SCALE;
+}
+
+// samples x and x + 1 of a row, a single vector load in the linear layout
+float2 sampleVolumePair(__global const VOLUME_ELEM *volume, int x, int y, int z)
+{
+#ifndef MC_VOLUME_MORTON
+    if (x >= 0 && x + 1 < MC_VOLUME_X) {
+        y = clamp(y, 0, MC_VOLUME_Y - 1);
+        z = clamp(z, 0, MC_VOLUME_Z - 1);
+        return convert_float2(vload2(0, volume + volumeIndex(x, y, z))) * VOLUME_SCALE;
+    }
+#endif
+    return (float2)(sampleVolume(volume, (int4)(x, y, z, 0)), sampleVolume(volume, (int4)(x + 1, y, z, 0)));
+}
+
+#else
+
+#define VOLUME_ARG __read_only image3d_t
+#define SAMPLE(volume, p) read_imagef(volume, volumeSampler, p).x
+sampler_t volumeSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+#endif
+
+// read the field values at the 8 corners of a cell
+void sampleCorners(VOLUME_ARG volume, int4 gridPos, float field[8])
+{
+#if defined(MC_VOLUME_IMPLICIT)
+    // same positions as SAMPLE, so every classify variant agrees with generate
+    field[0] = SAMPLE(volume, gridPos);
+    field[1] = SAMPLE(volume, gridPos + (int4)(1, 0, 0, 0));
+    field[2] = SAMPLE(volume, gridPos + (int4)(1, 1, 0, 0));
+    field[3] = SAMPLE(volume, gridPos + (int4)(0, 1, 0, 0));
+    field[4] = SAMPLE(volume, gridPos + (int4)(0, 0, 1, 0));
+    field[5] = SAMPLE(volume, gridPos + (int4)(1, 0, 1, 0));
+    field[6] = SAMPLE(volume, gridPos + (int4)(1, 1, 1, 0));
+    field[7] = SAMPLE(volume, gridPos + (int4)(0, 1, 1, 0));
+#elif defined(MC_VOLUME_BUFFER)
+    float2 r00 = sampleVolumePair(volume, gridPos.x, gridPos.y, gridPos.z);
+    float2 r10 = sampleVolumePair(volume, gridPos.x, gridPos.y + 1, gridPos.z);
+    float2 r01 = sampleVolumePair(volume, gridPos.x, gridPos.y, gridPos.z + 1);
+    float2 r11 = sampleVolumePair(volume, gridPos.x, gridPos.y + 1, gridPos.z + 1);
+    field[0] = r00.x;
+    field[1] = r00.y;
+    field[2] = r10.y;
+    field[3] = r10.x;
+    field[4] = r01.x;
+    field[5] = r01.y;
+    field[6] = r11.y;
+    field[7] = r11.x;
+#else
+    field[0] = read_imagef(volume, volumeSampler, gridPos).x;
+    field[1] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 0, 0 ,0)).x;
+    field[2] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 1, 0,0)).x;
+    field[3] = read_imagef(volume, volumeSampler, gridPos + (int4)(0, 1, 0,0)).x;
+    field[4] = read_imagef(volume, volumeSampler, gridPos + (int4)(0, 0, 1,0)).x;
+    field[5] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 0, 1,0)).x;
+    field[6] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 1, 1,0)).x;
+    field[7] = read_imagef(volume, volumeSampler, gridPos + (int4)(0, 1, 1,0)).x;
+#endif
+}
 
 
 // compute position in 3d grid from 1d index
@@ -32,22 +185,44 @@ int4 calcGridPos(uint i, uint4 gridSizeShift, uint4 gridSizeMask)
     return gridPos;
 }
 
+// Specialized build (-specialize): the host bakes the grid of the current volume into the
+// program as MC_GRID_* / MC_VOXEL_*, overwriting the kernel arguments with them lets the
+// compiler fold the index math (div/mod by constants) and the vertex positions.
+// The arguments stay in the signatures so the launchers are the same for both builds.
+#ifdef MC_SPECIALIZED
+#define SPECIALIZE_GRID(gridSize, gridSizeShift, gridSizeMask) \
+    gridSize = (uint4)(MC_GRID_X, MC_GRID_Y, MC_GRID_Z, 0); \
+    gridSizeShift = (uint4)(1, MC_GRID_X, MC_GRID_X * MC_GRID_Y, 0); \
+    gridSizeMask = gridSize
+#define SPECIALIZE_VOXEL(voxelSize) \
+    voxelSize = (float4)(MC_VOXEL_X, MC_VOXEL_Y, MC_VOXEL_Z, 0.0f)
+#define CLASSIFY_GROUP_SIZE __attribute__((reqd_work_group_size(MC_CLASSIFY_THREADS, 1, 1)))
+#define GENERATE_GROUP_SIZE __attribute__((reqd_work_group_size(NTHREADS, 1, 1)))
+#else
+#define SPECIALIZE_GRID(gridSize, gridSizeShift, gridSizeMask)
+#define SPECIALIZE_VOXEL(voxelSize)
+#define CLASSIFY_GROUP_SIZE
+#define GENERATE_GROUP_SIZE
+#endif
+
 // classify voxel based on number of vertices it will generate
 // one thread per voxel
 __kernel
+CLASSIFY_GROUP_SIZE
 void
-classifyVoxel(__global uint* voxelVerts, __global uint *voxelOccupied, __read_only image3d_t volume,
+classifyVoxel(__global uint* voxelVerts, __global uint *voxelOccupied, VOLUME_ARG volume,
               uint4 gridSize, uint4 gridSizeShift, uint4 gridSizeMask, uint numVoxels,
-              float4 voxelSize, float isoValue,  __read_only image2d_t numVertsTex)
+              float4 voxelSize, float isoValue,  TABLE_ARG numVertsTex)
 {
+    SPECIALIZE_GRID(gridSize, gridSizeShift, gridSizeMask);
     uint blockId = get_group_id(0);
     uint i = get_global_id(0);
 
-    int4 gridPos = calcGridPos(i, gridSizeShift, gridSize);
-	// not more than num of voxels
-	if (i > numVoxels) {
+	// not more than num of voxels (the launch is rounded up to whole work-groups)
+	if (i >= numVoxels) {
 		return;
 	}
+    int4 gridPos = calcGridPos(i, gridSizeShift, gridSize);
 	// MC in last point (for each axis) don't generate triangles --(n points, n-1 voxels)
 	if (gridPos.x+1 == gridSize.x || gridPos.y+1 == gridSize.y || gridPos.z+1 == gridSize.z) {
 		voxelVerts[i] = 0;
@@ -57,14 +232,7 @@ classifyVoxel(__global uint* voxelVerts, __global uint *voxelOccupied, __read_on
 
     // read field values at neighbouring grid vertices
     float field[8];
-    field[0] = read_imagef(volume, volumeSampler, gridPos).x;
-    field[1] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 0, 0 ,0)).x;
-    field[2] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 1, 0,0)).x;
-    field[3] = read_imagef(volume, volumeSampler, gridPos + (int4)(0, 1, 0,0)).x;
-    field[4] = read_imagef(volume, volumeSampler, gridPos + (int4)(0, 0, 1,0)).x;
-    field[5] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 0, 1,0)).x;
-    field[6] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 1, 1,0)).x;
-    field[7] = read_imagef(volume, volumeSampler, gridPos + (int4)(0, 1, 1,0)).x;
+    sampleCorners(volume, gridPos, field);
 
     // calculate flag indicating if each vertex is inside or outside isosurface
     int cubeindex;
@@ -78,7 +246,75 @@ classifyVoxel(__global uint* voxelVerts, __global uint *voxelOccupied, __read_on
 	cubeindex += (field[7] < isoValue)*128;
 
     // read number of vertices from texture
-    uint numVerts = read_imageui(numVertsTex, tableSampler, (int2)(cubeindex,0)).x;
+    uint numVerts = NUM_VERTS(numVertsTex, cubeindex);
+
+    voxelVerts[i] = numVerts;
+    voxelOccupied[i] = (numVerts > 0);
+}
+
+// classify voxel, 3D launch over the grid
+// each work-group loads the samples of its tile plus a one voxel halo into local
+// memory once, so every sample is fetched once instead of up to 8 times
+__kernel
+__attribute__((reqd_work_group_size(CLASSIFY_TILE_X, CLASSIFY_TILE_Y, CLASSIFY_TILE_Z)))
+void
+classifyVoxelTiled(__global uint* voxelVerts, __global uint *voxelOccupied, VOLUME_ARG volume,
+                   uint4 gridSize, uint4 gridSizeShift, uint4 gridSizeMask, uint numVoxels,
+                   float4 voxelSize, float isoValue,  TABLE_ARG numVertsTex)
+{
+    __local float tile[TILE_SZ][TILE_SY][TILE_SX];
+    SPECIALIZE_GRID(gridSize, gridSizeShift, gridSizeMask);
+
+    int4 tileOrigin = (int4)((int)get_group_id(0) * CLASSIFY_TILE_X, (int)get_group_id(1) * CLASSIFY_TILE_Y, (int)get_group_id(2) * CLASSIFY_TILE_Z, 0);
+    int lx = get_local_id(0);
+    int ly = get_local_id(1);
+    int lz = get_local_id(2);
+    int lid = (lz * CLASSIFY_TILE_Y + ly) * CLASSIFY_TILE_X + lx;
+
+    // cooperative load, samples outside the volume are clamped by the sampler
+    for (int t = lid; t < TILE_SX * TILE_SY * TILE_SZ; t += CLASSIFY_TILE_X * CLASSIFY_TILE_Y * CLASSIFY_TILE_Z) {
+        int tx = t % TILE_SX;
+        int ty = (t / TILE_SX) % TILE_SY;
+        int tz = t / (TILE_SX * TILE_SY);
+        tile[tz][ty][tx] = SAMPLE(volume, tileOrigin + (int4)(tx, ty, tz, 0));
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // the NDRange is rounded up to whole tiles, drop the cells outside the grid
+    int4 gridPos = tileOrigin + (int4)(lx, ly, lz, 0);
+    if (gridPos.x >= gridSize.x || gridPos.y >= gridSize.y || gridPos.z >= gridSize.z) {
+        return;
+    }
+    uint i = gridPos.x * gridSizeShift.x + gridPos.y * gridSizeShift.y + gridPos.z * gridSizeShift.z;
+
+	// MC in last point (for each axis) don't generate triangles --(n points, n-1 voxels)
+	if (gridPos.x+1 == gridSize.x || gridPos.y+1 == gridSize.y || gridPos.z+1 == gridSize.z) {
+		voxelVerts[i] = 0;
+		voxelOccupied[i] = 0;
+		return;
+	}
+
+    float field[8];
+    field[0] = tile[lz][ly][lx];
+    field[1] = tile[lz][ly][lx+1];
+    field[2] = tile[lz][ly+1][lx+1];
+    field[3] = tile[lz][ly+1][lx];
+    field[4] = tile[lz+1][ly][lx];
+    field[5] = tile[lz+1][ly][lx+1];
+    field[6] = tile[lz+1][ly+1][lx+1];
+    field[7] = tile[lz+1][ly+1][lx];
+
+    int cubeindex;
+	cubeindex =  (field[0] < isoValue); 
+	cubeindex += (field[1] < isoValue)*2; 
+	cubeindex += (field[2] < isoValue)*4; 
+	cubeindex += (field[3] < isoValue)*8; 
+	cubeindex += (field[4] < isoValue)*16; 
+	cubeindex += (field[5] < isoValue)*32; 
+	cubeindex += (field[6] < isoValue)*64; 
+	cubeindex += (field[7] < isoValue)*128;
+
+    uint numVerts = NUM_VERTS(numVertsTex, cubeindex);
 
     voxelVerts[i] = numVerts;
     voxelOccupied[i] = (numVerts > 0);
@@ -92,7 +328,7 @@ compactVoxels(__global uint *compactedVoxelArray, __global uint *voxelOccupied,
 {
     uint i = get_global_id(0);
 
-    if (voxelOccupied[i] && (i < numVoxels)) {
+    if ((i < numVoxels) && voxelOccupied[i]) {
         compactedVoxelArray[ voxelOccupiedScan[i] ] = i;
     }
 }
@@ -128,28 +364,30 @@ float4 calcNormal(float4 v0, float4 v1, float4 v2)
     return cross(edge0, edge1);
 }
 
-// version that calculates flat surface normal for each triangle
-__kernel
-void
-generateTriangles2(__global float4 *pos, __global float4 *norm, __global uint *compactedVoxelArray, __global uint *numVertsScanned, 
-                   __read_only image3d_t volume,
-                   uint4 gridSize, uint4 gridSizeShift, uint4 gridSizeMask,
-                   float4 voxelSize, float4 upperLeftPos, float isoValue, uint activeVoxels, uint maxVerts, 
-                   __read_only image2d_t numVertsTex, __read_only image2d_t triTex, __global uint *vertexHash)
+// calculate flag indicating if each vertex is inside or outside isosurface
+int cubeIndexOf(float field[8], float isoValue)
 {
-    uint i = get_global_id(0);
-    uint tid = get_local_id(0);
-
-    if (i + 1 > activeVoxels) {
-		return;
-    }
-
-    uint voxel = compactedVoxelArray[i];
-
-    // compute position in 3d grid
-    int4 gridPos = calcGridPos(voxel, gridSizeShift, gridSizeMask);
-	if (gridPos.x + 1 >= gridSize.x || gridPos.y + 1 >= gridSize.y || gridPos.z + 1 >= gridSize.z) return;
+    int cubeindex;
+	cubeindex =  (field[0] < isoValue); 
+	cubeindex += (field[1] < isoValue)*2; 
+	cubeindex += (field[2] < isoValue)*4; 
+	cubeindex += (field[3] < isoValue)*8; 
+	cubeindex += (field[4] < isoValue)*16; 
+	cubeindex += (field[5] < isoValue)*32; 
+	cubeindex += (field[6] < isoValue)*64; 
+	cubeindex += (field[7] < isoValue)*128;
+    return cubeindex;
+}
 
+// write the triangles of one voxel starting at vertex "vertexBase"
+// vertlist and edgeHash are the kernel's local arrays, each work-item only touches its own "tid" column
+void generateVoxelTriangles(__global float4 *pos, __global float4 *norm, __global uint *vertexHash,
+                            int4 gridPos, uint voxel, int cubeindex, float field[8],
+                            uint4 gridSize, uint4 gridSizeShift, float4 voxelSize, float4 upperLeftPos,
+                            float isoValue, uint vertexBase, uint maxVerts,
+                            TABLE_ARG numVertsTex, TABLE_ARG triTex,
+                            __local float4 *vertlist, __local uint *edgeHash, uint tid)
+{
     float4 p;
     //p.x = -1.0f + (gridPos.x * voxelSize.x);
     //p.y = -1.0f + (gridPos.y * voxelSize.y);
@@ -172,30 +410,7 @@ generateTriangles2(__global float4 *pos, __global float4 *norm, __global uint *c
     v[6] = p + (float4)(voxelSize.x, voxelSize.y, voxelSize.z,0);
     v[7] = p + (float4)(0, voxelSize.y, voxelSize.z,0);
 
-    float field[8];
-    field[0] = read_imagef(volume, volumeSampler, gridPos).x;
-    field[1] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 0, 0 ,0)).x;
-    field[2] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 1, 0,0)).x;
-    field[3] = read_imagef(volume, volumeSampler, gridPos + (int4)(0, 1, 0,0)).x;
-    field[4] = read_imagef(volume, volumeSampler, gridPos + (int4)(0, 0, 1,0)).x;
-    field[5] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 0, 1,0)).x;
-    field[6] = read_imagef(volume, volumeSampler, gridPos + (int4)(1, 1, 1,0)).x;
-    field[7] = read_imagef(volume, volumeSampler, gridPos + (int4)(0, 1, 1,0)).x;
-
-    // recalculate flag
-    int cubeindex;
-	cubeindex =  (field[0] < isoValue); 
-	cubeindex += (field[1] < isoValue)*2; 
-	cubeindex += (field[2] < isoValue)*4; 
-	cubeindex += (field[3] < isoValue)*8; 
-	cubeindex += (field[4] < isoValue)*16; 
-	cubeindex += (field[5] < isoValue)*32; 
-	cubeindex += (field[6] < isoValue)*64; 
-	cubeindex += (field[7] < isoValue)*128;
-
 	// find the vertices where the surface intersects the cube 
-	__local float4 vertlist[12*NTHREADS];
-
 	vertlist[tid] = vertexInterp(isoValue, v[0], v[1], field[0], field[1]);
     vertlist[NTHREADS+tid] = vertexInterp(isoValue, v[1], v[2], field[1], field[2]);
     vertlist[(NTHREADS*2)+tid] = vertexInterp(isoValue, v[2], v[3], field[2], field[3]);
@@ -208,11 +423,9 @@ generateTriangles2(__global float4 *pos, __global float4 *norm, __global uint *c
     vertlist[(NTHREADS*9)+tid] = vertexInterp(isoValue, v[1], v[5], field[1], field[5]);
     vertlist[(NTHREADS*10)+tid] = vertexInterp(isoValue, v[2], v[6], field[2], field[6]);
     vertlist[(NTHREADS*11)+tid] = vertexInterp(isoValue, v[3], v[7], field[3], field[7]);
-    barrier(CLK_LOCAL_MEM_FENCE);
 
 	//compute the hash_id of edge
-	__local uint edgeHash[12 * NTHREADS];
-	__local uint edgeHashShift[2];
+	uint edgeHashShift[2];
 	edgeHashShift[0] = gridSize.x * gridSize.y * gridSize.z;
 	edgeHashShift[1] = edgeHashShift[0] << 1;
 	edgeHash[tid] = voxel;
@@ -227,33 +440,32 @@ generateTriangles2(__global float4 *pos, __global float4 *norm, __global uint *c
 	edgeHash[(NTHREADS * 9) + tid] = voxel + 1 + edgeHashShift[1];
 	edgeHash[(NTHREADS * 10) + tid] = voxel + 1 + (gridSizeShift.y) + edgeHashShift[1];
 	edgeHash[(NTHREADS * 11) + tid] = voxel + (gridSizeShift.y) + edgeHashShift[1];
-	barrier(CLK_LOCAL_MEM_FENCE);
 
     // output triangle vertices
-    uint numVerts = read_imageui(numVertsTex, tableSampler, (int2)(cubeindex,0)).x;
+    uint numVerts = NUM_VERTS(numVertsTex, cubeindex);
 
     for(int i=0; i<numVerts; i+=3) {
-        uint index = numVertsScanned[voxel] + i;
+        uint index = vertexBase + i;
 
         float4 v[3];
         uint vHash[3];
 		uint edge;
-        edge = read_imageui(triTex, tableSampler, (int2)(i,cubeindex)).x;
+        edge = TRI_EDGE(triTex, cubeindex, i);
         v[0] = vertlist[(edge*NTHREADS)+tid];
 		vHash[0] = edgeHash[(edge*NTHREADS) + tid];
 
-        edge = read_imageui(triTex, tableSampler, (int2)(i+1,cubeindex)).x;
+        edge = TRI_EDGE(triTex, cubeindex, i+1);
         v[1] = vertlist[(edge*NTHREADS)+tid];
 		vHash[1] = edgeHash[(edge*NTHREADS) + tid];
 
-        edge = read_imageui(triTex, tableSampler, (int2)(i+2,cubeindex)).x;
+        edge = TRI_EDGE(triTex, cubeindex, i+2);
         v[2] = vertlist[(edge*NTHREADS)+tid];
 		vHash[2] = edgeHash[(edge*NTHREADS) + tid];
 
         // calculate triangle surface normal
         float4 n = calcNormal(v[0], v[1], v[2]);
 
-        if (index < (maxVerts - 3)) {
+        if (index + 3 <= maxVerts) {
             pos[index] = v[0];
             norm[index] = n;
 			vertexHash[index] = vHash[0];
@@ -269,3 +481,1270 @@ generateTriangles2(__global float4 *pos, __global float4 *norm, __global uint *c
     }
 }
 
+// version that calculates flat surface normal for each triangle
+__kernel
+GENERATE_GROUP_SIZE
+void
+generateTriangles2(__global float4 *pos, __global float4 *norm, __global uint *compactedVoxelArray, __global uint *numVertsScanned, 
+                   VOLUME_ARG volume,
+                   uint4 gridSize, uint4 gridSizeShift, uint4 gridSizeMask,
+                   float4 voxelSize, float4 upperLeftPos, float isoValue, uint activeVoxels, uint maxVerts, 
+                   TABLE_ARG numVertsTex, TABLE_ARG triTex, __global uint *vertexHash)
+{
+	__local float4 vertlist[12*NTHREADS];
+	__local uint edgeHash[12 * NTHREADS];
+    SPECIALIZE_GRID(gridSize, gridSizeShift, gridSizeMask);
+    SPECIALIZE_VOXEL(voxelSize);
+
+    uint i = get_global_id(0);
+    uint tid = get_local_id(0);
+
+    if (i + 1 > activeVoxels) {
+		return;
+    }
+
+    uint voxel = compactedVoxelArray[i];
+
+    // compute position in 3d grid
+    int4 gridPos = calcGridPos(voxel, gridSizeShift, gridSizeMask);
+	if (gridPos.x + 1 >= gridSize.x || gridPos.y + 1 >= gridSize.y || gridPos.z + 1 >= gridSize.z) return;
+
+    float field[8];
+    sampleCorners(volume, gridPos, field);
+
+    // recalculate flag
+    int cubeindex = cubeIndexOf(field, isoValue);
+
+    generateVoxelTriangles(pos, norm, vertexHash, gridPos, voxel, cubeindex, field,
+                           gridSize, gridSizeShift, voxelSize, upperLeftPos, isoValue,
+                           numVertsScanned[voxel], maxVerts, numVertsTex, triTex, vertlist, edgeHash, tid);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Per-triangle emission
+// One work-item per output triangle instead of one per voxel, so work-items
+// don't diverge on the number of triangles of their cube case.
+////////////////////////////////////////////////////////////////////////////////
+
+// corner offsets of a cell, in the vertex order of the tables
+__constant float4 cornerOffset[8] = {
+    (float4)(0, 0, 0, 0), (float4)(1, 0, 0, 0), (float4)(1, 1, 0, 0), (float4)(0, 1, 0, 0),
+    (float4)(0, 0, 1, 0), (float4)(1, 0, 1, 0), (float4)(1, 1, 1, 0), (float4)(0, 1, 1, 0)
+};
+
+// end corners of each edge, same order as the vertlist of generateVoxelTriangles
+__constant uchar edgeCorner0[12] = {0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3};
+__constant uchar edgeCorner1[12] = {1, 2, 3, 0, 5, 6, 7, 4, 4, 5, 6, 7};
+
+// grid point an edge starts at (x, y, z offset from the voxel) and its axis, for the edge hash
+__constant uchar4 edgeOrigin[12] = {
+    (uchar4)(0, 0, 0, 0), (uchar4)(1, 0, 0, 1), (uchar4)(0, 1, 0, 0), (uchar4)(0, 0, 0, 1),
+    (uchar4)(0, 0, 1, 0), (uchar4)(1, 0, 1, 1), (uchar4)(0, 1, 1, 0), (uchar4)(0, 0, 1, 1),
+    (uchar4)(0, 0, 0, 2), (uchar4)(1, 0, 0, 2), (uchar4)(1, 1, 0, 2), (uchar4)(0, 1, 0, 2)
+};
+
+// write triangle "tri" of a voxel as the three vertices starting at "index",
+// positions, normal and hashes match generateVoxelTriangles
+void emitTriangle(__global float4 *pos, __global float4 *norm, __global uint *vertexHash, uint index,
+                  int4 gridPos, uint voxel, int cubeindex, uint tri, float field[8],
+                  uint4 gridSize, uint4 gridSizeShift, float4 voxelSize, float4 upperLeftPos, float isoValue,
+                  TABLE_ARG triTex)
+{
+    float4 p;
+	p.x = gridPos.x * voxelSize.x;
+	p.y = gridPos.y * voxelSize.y;
+	p.z = gridPos.z * voxelSize.z;
+	p += upperLeftPos;
+	p.w = 1.0f;
+
+    uint numPoints = gridSize.x * gridSize.y * gridSize.z;
+    float4 v[3];
+    uint vHash[3];
+    for (int m = 0; m < 3; m++) {
+        uint edge = TRI_EDGE(triTex, cubeindex, (int)(tri * 3) + m);
+        uint c0 = edgeCorner0[edge];
+        uint c1 = edgeCorner1[edge];
+        v[m] = vertexInterp(isoValue, p + cornerOffset[c0] * voxelSize, p + cornerOffset[c1] * voxelSize, field[c0], field[c1]);
+
+        uchar4 o = edgeOrigin[edge];
+        vHash[m] = voxel + o.x + o.y * gridSizeShift.y + o.z * gridSizeShift.z + o.w * numPoints;
+    }
+
+    float4 n = calcNormal(v[0], v[1], v[2]);
+
+    pos[index] = v[0];
+    norm[index] = n;
+    vertexHash[index] = vHash[0];
+
+    pos[index+1] = v[1];
+    norm[index+1] = n;
+    vertexHash[index+1] = vHash[1];
+
+    pos[index+2] = v[2];
+    norm[index+2] = n;
+    vertexHash[index+2] = vHash[2];
+}
+
+// generateTriangles2 arguments plus the number of triangles, one work-item per triangle
+// the source voxel is found by a binary search over the compacted voxels, whose
+// first vertex numVertsScanned[voxel] increases with the compacted index
+__kernel
+void
+generateTrianglesPerTri(__global float4 *pos, __global float4 *norm, __global uint *compactedVoxelArray, __global uint *numVertsScanned, 
+                        VOLUME_ARG volume,
+                        uint4 gridSize, uint4 gridSizeShift, uint4 gridSizeMask,
+                        float4 voxelSize, float4 upperLeftPos, float isoValue, uint activeVoxels, uint maxVerts, 
+                        TABLE_ARG numVertsTex, TABLE_ARG triTex, __global uint *vertexHash,
+                        uint numTris)
+{
+    SPECIALIZE_GRID(gridSize, gridSizeShift, gridSizeMask);
+    SPECIALIZE_VOXEL(voxelSize);
+    uint t = get_global_id(0);
+    uint index = t * 3;
+    if (t >= numTris || index + 3 > maxVerts) {
+        return;
+    }
+
+    // last compacted voxel starting at or before this triangle
+    uint lo = 0;
+    uint hi = activeVoxels - 1;
+    while (lo < hi) {
+        uint mid = (lo + hi + 1) >> 1;
+        if (numVertsScanned[compactedVoxelArray[mid]] <= index) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    uint voxel = compactedVoxelArray[lo];
+    uint tri = (index - numVertsScanned[voxel]) / 3;
+
+    int4 gridPos = calcGridPos(voxel, gridSizeShift, gridSizeMask);
+    float field[8];
+    sampleCorners(volume, gridPos, field);
+    int cubeindex = cubeIndexOf(field, isoValue);
+
+    emitTriangle(pos, norm, vertexHash, index, gridPos, voxel, cubeindex, tri, field,
+                 gridSize, gridSizeShift, voxelSize, upperLeftPos, isoValue, triTex);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Corner sign bitfield
+// One inside/outside bit per grid point, packed 32 points per word along x.
+// Rows are padded to whole words: word (y, z, w) holds points x = 32w .. 32w+31.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CORNER_SIGN_THREADS
+#define CORNER_SIGN_THREADS 128
+#endif
+
+// one work-item per bit, each group of 32 packs a word
+__kernel
+__attribute__((reqd_work_group_size(CORNER_SIGN_THREADS, 1, 1)))
+void
+computeCornerSigns(__global uint *cornerSigns, VOLUME_ARG volume,
+                   uint4 gridSize, uint wordsPerRow, uint numWords, float isoValue)
+{
+    __local uint inside[CORNER_SIGN_THREADS];
+
+    uint i = get_global_id(0);
+    uint tid = get_local_id(0);
+    uint word = i >> 5;
+    uint bit = i & 31;
+
+    uint row = word / wordsPerRow;
+    int4 gridPos;
+    gridPos.x = (word - row * wordsPerRow) * 32 + bit;
+    gridPos.y = row % gridSize.y;
+    gridPos.z = row / gridSize.y;
+    gridPos.w = 0;
+
+    inside[tid] = 0;
+    if (word < numWords && gridPos.x < gridSize.x) {
+        inside[tid] = (SAMPLE(volume, gridPos) < isoValue);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (bit == 0 && word < numWords) {
+        uint bits = 0;
+        for (int b = 0; b < 32; b++) {
+            bits |= inside[tid + b] << b;
+        }
+        cornerSigns[word] = bits;
+    }
+}
+
+// bits x and x+1 of a row, the pair may straddle two words
+uint cornerPair(__global const uint *cornerSigns, uint row, uint x, uint wordsPerRow)
+{
+    uint w = row * wordsPerRow + (x >> 5);
+    uint b = x & 31;
+    uint bits = cornerSigns[w] >> b;
+    if (b == 31) {
+        bits |= cornerSigns[w + 1] << 1;
+    }
+    return bits & 3;
+}
+
+// cube index from the inside bits of the four x-rows around a cell,
+// rows (y,z) (y+1,z) (y,z+1) (y+1,z+1), bit 0 of each is corner x, bit 1 corner x+1
+int cubeIndexFromRows(uint r00, uint r10, uint r01, uint r11)
+{
+    // corners 0,1 | 3,2 | 4,5 | 7,6
+    return r00 | ((r10 & 1) << 3) | ((r10 & 2) << 1) | (r01 << 4) | ((r11 & 1) << 7) | ((r11 & 2) << 5);
+}
+
+// classify voxel from the sign bitfield, no volume reads
+// also stores the cube index for generateTrianglesCubeIndex
+__kernel
+void
+classifyVoxelSigns(__global uint* voxelVerts, __global uint *voxelOccupied, __global uchar *voxelCubeIndex,
+                   __global const uint *cornerSigns, uint4 gridSize, uint4 gridSizeShift, uint numVoxels,
+                   uint wordsPerRow, TABLE_ARG numVertsTex)
+{
+    uint i = get_global_id(0);
+	if (i >= numVoxels) {
+		return;
+	}
+    int4 gridPos = calcGridPos(i, gridSizeShift, gridSize);
+
+	if (gridPos.x+1 == gridSize.x || gridPos.y+1 == gridSize.y || gridPos.z+1 == gridSize.z) {
+		voxelVerts[i] = 0;
+		voxelOccupied[i] = 0;
+		voxelCubeIndex[i] = 0;
+		return;
+	}
+
+    uint row = gridPos.z * gridSize.y + gridPos.y;
+    uint r00 = cornerPair(cornerSigns, row, gridPos.x, wordsPerRow);
+    uint r10 = cornerPair(cornerSigns, row + 1, gridPos.x, wordsPerRow);
+    uint r01 = cornerPair(cornerSigns, row + gridSize.y, gridPos.x, wordsPerRow);
+    uint r11 = cornerPair(cornerSigns, row + gridSize.y + 1, gridPos.x, wordsPerRow);
+
+    int cubeindex = cubeIndexFromRows(r00, r10, r01, r11);
+
+    uint numVerts = NUM_VERTS(numVertsTex, cubeindex);
+
+    voxelVerts[i] = numVerts;
+    voxelOccupied[i] = (numVerts > 0);
+    voxelCubeIndex[i] = cubeindex;
+}
+
+// compact voxel array and the stored cube indices
+__kernel
+void
+compactVoxelsCubeIndex(__global uint *compactedVoxelArray, __global uchar *compactedCubeIndex,
+                       __global uint *voxelOccupied, __global uint *voxelOccupiedScan,
+                       __global const uchar *voxelCubeIndex, uint numVoxels)
+{
+    uint i = get_global_id(0);
+
+    if ((i < numVoxels) && voxelOccupied[i]) {
+        uint j = voxelOccupiedScan[i];
+        compactedVoxelArray[j] = i;
+        compactedCubeIndex[j] = voxelCubeIndex[i];
+    }
+}
+
+// generateTriangles2 with the cube index taken from classifyVoxelSigns,
+// the corner values are only read for edge interpolation
+__kernel
+GENERATE_GROUP_SIZE
+void
+generateTrianglesCubeIndex(__global float4 *pos, __global float4 *norm, __global uint *compactedVoxelArray,
+                           __global uchar *compactedCubeIndex, __global uint *numVertsScanned, 
+                           VOLUME_ARG volume,
+                           uint4 gridSize, uint4 gridSizeShift, uint4 gridSizeMask,
+                           float4 voxelSize, float4 upperLeftPos, float isoValue, uint activeVoxels, uint maxVerts, 
+                           TABLE_ARG numVertsTex, TABLE_ARG triTex, __global uint *vertexHash)
+{
+	__local float4 vertlist[12*NTHREADS];
+	__local uint edgeHash[12 * NTHREADS];
+    SPECIALIZE_GRID(gridSize, gridSizeShift, gridSizeMask);
+    SPECIALIZE_VOXEL(voxelSize);
+
+    uint i = get_global_id(0);
+    uint tid = get_local_id(0);
+
+    if (i >= activeVoxels) {
+		return;
+    }
+
+    uint voxel = compactedVoxelArray[i];
+    int cubeindex = compactedCubeIndex[i];
+    int4 gridPos = calcGridPos(voxel, gridSizeShift, gridSizeMask);
+
+    float field[8];
+    sampleCorners(volume, gridPos, field);
+
+    generateVoxelTriangles(pos, norm, vertexHash, gridPos, voxel, cubeindex, field,
+                           gridSize, gridSizeShift, voxelSize, upperLeftPos, isoValue,
+                           numVertsScanned[voxel], maxVerts, numVertsTex, triTex, vertlist, edgeHash, tid);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Flying Edges (Schroeder, Maynard, Geveci 2015)
+// Work is split by x-rows of grid points, row r = z * gridSize.y + y.
+// Row r owns the x-edges along it and the y/z-edges leaving its points, so each
+// intersection is computed once and its id comes from an exclusive scan over rows:
+// ids of row r are [x-edges | y-edges | z-edges] starting at vertBase[r].
+// Cells between rows r, r+1, r+gy, r+gy+1 are handled by row r.
+////////////////////////////////////////////////////////////////////////////////
+
+// x-edge case: bit 0 = point i inside, bit 1 = point i+1 inside
+#define FE_CUT(ec) ((ec) == 1 || (ec) == 2)
+
+// inside flag of point i of a row, from the row's edge cases
+uint fePointInside(__global const uchar *edgeCases, uint i, uint nx)
+{
+    return (i < nx - 1) ? (edgeCases[i] & 1) : (edgeCases[nx - 2] >> 1);
+}
+
+// range of points [x, y] where edges between the given rows can be cut, cells are [x, y)
+// outside the x-edge trims every row is constant, so only the ends have to be compared
+uint2 feTrim(__global const uchar *edgeCases, __global const uint2 *rowTrim, const uint *rows, int n, uint nx)
+{
+    __global const uchar *ec0 = edgeCases + rows[0] * (nx - 1);
+    uint2 t = rowTrim[rows[0]];
+    bool left = false, right = false;
+    for (int m = 1; m < n; m++) {
+        __global const uchar *ec = edgeCases + rows[m] * (nx - 1);
+        uint2 tm = rowTrim[rows[m]];
+        t.x = min(t.x, tm.x);
+        t.y = max(t.y, tm.y);
+        left |= ((ec[0] ^ ec0[0]) & 1) != 0;
+        right |= ((ec[nx - 2] ^ ec0[nx - 2]) & 2) != 0;
+    }
+    if (left) t.x = 0;
+    if (right) t.y = nx - 1;
+    return t;
+}
+
+float feSample(VOLUME_ARG volume, uint x, uint y, uint z)
+{
+    return SAMPLE(volume, (int4)((int)x, (int)y, (int)z, 0));
+}
+
+// pass 1: x-edge cases, x intersection count and trim of every row
+__kernel
+void
+feXEdges(__global uchar *edgeCases, __global uint2 *rowTrim, __global uint4 *rowEdges,
+         VOLUME_ARG volume, uint4 gridSize, float isoValue)
+{
+    uint r = get_global_id(0);
+    if (r >= gridSize.y * gridSize.z) {
+        return;
+    }
+    uint nx = gridSize.x;
+    uint y = r % gridSize.y;
+    uint z = r / gridSize.y;
+    __global uchar *ec = edgeCases + r * (nx - 1);
+
+    uint inside0 = (feSample(volume, 0, y, z) < isoValue);
+    uint xl = nx - 1, xr = 0, numX = 0;
+    for (uint i = 0; i < nx - 1; i++) {
+        uint inside1 = (feSample(volume, i + 1, y, z) < isoValue);
+        uchar c = inside0 | (inside1 << 1);
+        ec[i] = c;
+        if (FE_CUT(c)) {
+            numX++;
+            xl = min(xl, i);
+            xr = i + 1;
+        }
+        inside0 = inside1;
+    }
+    rowTrim[r] = (uint2)(xl, xr);
+    rowEdges[r] = (uint4)(numX, 0, 0, 0);
+}
+
+// pass 2: y/z intersections and triangles of every row, the cell trim is kept for pass 4
+__kernel
+void
+feYZEdges(__global const uchar *edgeCases, __global const uint2 *rowTrim, __global uint4 *rowEdges,
+          __global uint2 *cellTrim, __global uint *rowVerts, __global uint *rowTris,
+          uint4 gridSize, TABLE_ARG numVertsTex)
+{
+    uint r = get_global_id(0);
+    if (r >= gridSize.y * gridSize.z) {
+        return;
+    }
+    uint nx = gridSize.x;
+    uint ny = gridSize.y;
+    uint y = r % ny;
+    uint z = r / ny;
+    __global const uchar *ec0 = edgeCases + r * (nx - 1);
+
+    uint4 counts = rowEdges[r];
+    uint rows[4];
+    rows[0] = r;
+
+    if (y + 1 < ny) {
+        rows[1] = r + 1;
+        uint2 t = feTrim(edgeCases, rowTrim, rows, 2, nx);
+        __global const uchar *ec1 = edgeCases + rows[1] * (nx - 1);
+        for (uint i = t.x; i <= t.y; i++) {
+            counts.y += (fePointInside(ec0, i, nx) != fePointInside(ec1, i, nx));
+        }
+    }
+    if (z + 1 < gridSize.z) {
+        rows[1] = r + ny;
+        uint2 t = feTrim(edgeCases, rowTrim, rows, 2, nx);
+        __global const uchar *ec1 = edgeCases + rows[1] * (nx - 1);
+        for (uint i = t.x; i <= t.y; i++) {
+            counts.z += (fePointInside(ec0, i, nx) != fePointInside(ec1, i, nx));
+        }
+    }
+
+    uint2 cells = (uint2)(0, 0);
+    if (y + 1 < ny && z + 1 < gridSize.z) {
+        rows[1] = r + 1;
+        rows[2] = r + ny;
+        rows[3] = r + ny + 1;
+        cells = feTrim(edgeCases, rowTrim, rows, 4, nx);
+        __global const uchar *ec10 = edgeCases + rows[1] * (nx - 1);
+        __global const uchar *ec01 = edgeCases + rows[2] * (nx - 1);
+        __global const uchar *ec11 = edgeCases + rows[3] * (nx - 1);
+        for (uint i = cells.x; i < cells.y; i++) {
+            int cubeindex = cubeIndexFromRows(ec0[i], ec10[i], ec01[i], ec11[i]);
+            counts.w += NUM_VERTS(numVertsTex, cubeindex) / 3;
+        }
+    }
+
+    cellTrim[r] = cells;
+    rowEdges[r] = counts;
+    rowVerts[r] = counts.x + counts.y + counts.z;
+    rowTris[r] = counts.w;
+}
+
+// pass 4: interpolate the intersections owned by the row and write the triangles of its cells
+// as indices into "points"; vertBase/triBase are the exclusive scans of rowVerts/rowTris
+__kernel
+void
+feGenerate(__global float4 *points, __global uint *pointHash, __global uint *triIndices,
+           __global const uchar *edgeCases, __global const uint2 *rowTrim, __global const uint2 *cellTrim,
+           __global const uint4 *rowEdges, __global const uint *vertBase, __global const uint *triBase,
+           VOLUME_ARG volume, uint4 gridSize, float4 voxelSize, float4 upperLeftPos, float isoValue,
+           TABLE_ARG numVertsTex, TABLE_ARG triTex)
+{
+    uint r = get_global_id(0);
+    if (r >= gridSize.y * gridSize.z) {
+        return;
+    }
+    uint nx = gridSize.x;
+    uint ny = gridSize.y;
+    uint y = r % ny;
+    uint z = r / ny;
+
+    uint4 counts = rowEdges[r];
+    if (counts.x + counts.y + counts.z + counts.w == 0) {
+        return;
+    }
+
+    // edge hashes follow generateTriangles2: point index + axis * number of points
+    uint numPoints = nx * ny * gridSize.z;
+    uint rowPoint = r * nx;
+    float4 p0 = upperLeftPos + (float4)(0.0f, y * voxelSize.y, z * voxelSize.z, 0.0f);
+    p0.w = 1.0f;
+
+    __global const uchar *ec0 = edgeCases + r * (nx - 1);
+    uint rows[4];
+    rows[0] = r;
+
+    // x intersections
+    uint id = vertBase[r];
+    uint2 t = rowTrim[r];
+    for (uint i = t.x; i < t.y; i++) {
+        if (FE_CUT(ec0[i])) {
+            float4 v = p0 + (float4)(i * voxelSize.x, 0.0f, 0.0f, 0.0f);
+            points[id] = vertexInterp(isoValue, v, v + (float4)(voxelSize.x, 0.0f, 0.0f, 0.0f),
+                                      feSample(volume, i, y, z), feSample(volume, i + 1, y, z));
+            pointHash[id] = rowPoint + i;
+            id++;
+        }
+    }
+
+    // y intersections
+    if (y + 1 < ny) {
+        rows[1] = r + 1;
+        t = feTrim(edgeCases, rowTrim, rows, 2, nx);
+        __global const uchar *ec1 = edgeCases + rows[1] * (nx - 1);
+        for (uint i = t.x; i <= t.y; i++) {
+            if (fePointInside(ec0, i, nx) != fePointInside(ec1, i, nx)) {
+                float4 v = p0 + (float4)(i * voxelSize.x, 0.0f, 0.0f, 0.0f);
+                points[id] = vertexInterp(isoValue, v, v + (float4)(0.0f, voxelSize.y, 0.0f, 0.0f),
+                                          feSample(volume, i, y, z), feSample(volume, i, y + 1, z));
+                pointHash[id] = rowPoint + i + numPoints;
+                id++;
+            }
+        }
+    }
+
+    // z intersections
+    if (z + 1 < gridSize.z) {
+        rows[1] = r + ny;
+        t = feTrim(edgeCases, rowTrim, rows, 2, nx);
+        __global const uchar *ec1 = edgeCases + rows[1] * (nx - 1);
+        for (uint i = t.x; i <= t.y; i++) {
+            if (fePointInside(ec0, i, nx) != fePointInside(ec1, i, nx)) {
+                float4 v = p0 + (float4)(i * voxelSize.x, 0.0f, 0.0f, 0.0f);
+                points[id] = vertexInterp(isoValue, v, v + (float4)(0.0f, 0.0f, voxelSize.z, 0.0f),
+                                          feSample(volume, i, y, z), feSample(volume, i, y, z + 1));
+                pointHash[id] = rowPoint + i + 2 * numPoints;
+                id++;
+            }
+        }
+    }
+
+    if (counts.w == 0) {
+        return;
+    }
+
+    // triangles, walking the cells with one running counter per edge list of the four rows
+    uint r10 = r + 1, r01 = r + ny, r11 = r + ny + 1;
+    __global const uchar *ec10 = edgeCases + r10 * (nx - 1);
+    __global const uchar *ec01 = edgeCases + r01 * (nx - 1);
+    __global const uchar *ec11 = edgeCases + r11 * (nx - 1);
+
+    uint4 e10 = rowEdges[r10];
+    uint4 e01 = rowEdges[r01];
+    uint x00 = vertBase[r];
+    uint x10 = vertBase[r10];
+    uint x01 = vertBase[r01];
+    uint x11 = vertBase[r11];
+    uint y00 = x00 + counts.x;
+    uint y01 = x01 + e01.x;
+    uint z00 = y00 + counts.y;
+    uint z10 = x10 + e10.x + e10.y;
+
+    uint tri = triBase[r];
+    uint2 cells = cellTrim[r];
+    for (uint i = cells.x; i < cells.y; i++) {
+        uint c00 = ec0[i], c10 = ec10[i], c01 = ec01[i], c11 = ec11[i];
+
+        // y/z cuts at point i, the edges at point i + 1 come right after them
+        uint yAt00 = ((c00 ^ c10) & 1);
+        uint yAt01 = ((c01 ^ c11) & 1);
+        uint zAt00 = ((c00 ^ c01) & 1);
+        uint zAt10 = ((c10 ^ c11) & 1);
+
+        int cubeindex = cubeIndexFromRows(c00, c10, c01, c11);
+        uint numVerts = NUM_VERTS(numVertsTex, cubeindex);
+        if (numVerts > 0) {
+            uint edgeId[12];
+            edgeId[0] = x00;
+            edgeId[1] = y00 + yAt00;
+            edgeId[2] = x10;
+            edgeId[3] = y00;
+            edgeId[4] = x01;
+            edgeId[5] = y01 + yAt01;
+            edgeId[6] = x11;
+            edgeId[7] = y01;
+            edgeId[8] = z00;
+            edgeId[9] = z00 + zAt00;
+            edgeId[10] = z10 + zAt10;
+            edgeId[11] = z10;
+
+            for (uint v = 0; v < numVerts; v++) {
+                uint edge = TRI_EDGE(triTex, cubeindex, (int)v);
+                triIndices[tri * 3 + v] = edgeId[edge];
+            }
+            tri += numVerts / 3;
+        }
+
+        x00 += FE_CUT(c00);
+        x10 += FE_CUT(c10);
+        x01 += FE_CUT(c01);
+        x11 += FE_CUT(c11);
+        y00 += yAt00;
+        y01 += yAt01;
+        z00 += zAt00;
+        z10 += zAt10;
+    }
+}
+
+// expand the indexed triangles to the flat shaded vertex soup generateTriangles2 writes
+__kernel
+void
+feExpandTriangles(__global float4 *pos, __global float4 *norm, __global uint *vertexHash,
+                  __global const float4 *points, __global const uint *pointHash, __global const uint *triIndices,
+                  uint numTris, uint maxVerts)
+{
+    uint t = get_global_id(0);
+    uint index = t * 3;
+    if (t >= numTris || index + 3 > maxVerts) {
+        return;
+    }
+
+    uint i0 = triIndices[index];
+    uint i1 = triIndices[index + 1];
+    uint i2 = triIndices[index + 2];
+    float4 v0 = points[i0];
+    float4 v1 = points[i1];
+    float4 v2 = points[i2];
+    float4 n = calcNormal(v0, v1, v2);
+
+    pos[index] = v0;
+    pos[index + 1] = v1;
+    pos[index + 2] = v2;
+    norm[index] = n;
+    norm[index + 1] = n;
+    norm[index + 2] = n;
+    vertexHash[index] = pointHash[i0];
+    vertexHash[index + 1] = pointHash[i1];
+    vertexHash[index + 2] = pointHash[i2];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// HistoPyramid (Dyken et al. 2008)
+// Level 0 is the per-voxel vertex count from classify, level l + 1 sums 2x2x2
+// cells of level l (sizes rounded up, missing children count 0). levels[l] holds
+// the size of level l in x/y/z and its offset into the pyramid buffer in w.
+////////////////////////////////////////////////////////////////////////////////
+
+// one work-item per cell of the destination level
+__kernel
+void
+hpReduce(__global uint *dst, uint dstOffset, __global const uint *src, uint srcOffset, uint4 dstDims, uint4 srcDims)
+{
+    uint i = get_global_id(0);
+    if (i >= dstDims.x * dstDims.y * dstDims.z) {
+        return;
+    }
+    uint x = (i % dstDims.x) * 2;
+    uint y = ((i / dstDims.x) % dstDims.y) * 2;
+    uint z = (i / (dstDims.x * dstDims.y)) * 2;
+
+    uint sum = 0;
+    for (int k = 0; k < 8; k++) {
+        uint sx = x + (k & 1);
+        uint sy = y + ((k >> 1) & 1);
+        uint sz = z + (k >> 2);
+        if (sx < srcDims.x && sy < srcDims.y && sz < srcDims.z) {
+            sum += src[srcOffset + (sz * srcDims.y + sy) * srcDims.x + sx];
+        }
+    }
+    dst[dstOffset + i] = sum;
+}
+
+// one work-item per triangle: walk down from the top cell, at each level stepping over
+// the children (x fastest) whose counts lie before the triangle's first vertex
+__kernel
+void
+hpGenerateTriangles(__global float4 *pos, __global float4 *norm, __global uint *vertexHash,
+                    __global const uint *voxelVerts, __global const uint *pyramid, __constant uint4 *levels, uint numLevels,
+                    VOLUME_ARG volume, uint4 gridSize, uint4 gridSizeShift,
+                    float4 voxelSize, float4 upperLeftPos, float isoValue, uint maxVerts,
+                    TABLE_ARG triTex, uint numTris)
+{
+    uint t = get_global_id(0);
+    uint index = t * 3;
+    if (t >= numTris || index + 3 > maxVerts) {
+        return;
+    }
+
+    uint key = index;
+    uint4 cell = (uint4)(0, 0, 0, 0);
+    for (int l = (int)numLevels - 1; l > 0; l--) {
+        uint4 child = levels[l - 1];
+        uint4 first = cell * 2;
+        for (int k = 0; k < 8; k++) {
+            uint4 c = first + (uint4)(k & 1, (k >> 1) & 1, k >> 2, 0);
+            if (c.x >= child.x || c.y >= child.y || c.z >= child.z) {
+                continue;
+            }
+            uint i = (c.z * child.y + c.y) * child.x + c.x;
+            uint count = (l == 1) ? voxelVerts[i] : pyramid[child.w + i];
+            if (key < count) {
+                cell = c;
+                break;
+            }
+            key -= count;
+        }
+    }
+
+    // key is now the vertex offset inside the voxel
+    uint voxel = (cell.z * gridSize.y + cell.y) * gridSize.x + cell.x;
+    int4 gridPos = (int4)((int)cell.x, (int)cell.y, (int)cell.z, 0);
+    float field[8];
+    sampleCorners(volume, gridPos, field);
+    int cubeindex = cubeIndexOf(field, isoValue);
+
+    emitTriangle(pos, norm, vertexHash, index, gridPos, voxel, cubeindex, key / 3, field,
+                 gridSize, gridSizeShift, voxelSize, upperLeftPos, isoValue, triTex);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Append compaction
+// Classify appends the id and vertex count of each active voxel through a global
+// counter, so the scan runs over the active voxels only instead of all of them.
+// Built with -D MC_SUBGROUPS for -compact=append when the device has cl_khr_subgroups
+// and OpenCL C 2.0, otherwise one local atomic per work-item aggregates the group.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef MC_SUBGROUPS
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#endif
+
+// classify voxel and append it to compactedVoxelArray / compactedVerts if it has
+// triangles, one global atomic per sub-group (or work-group) reserves the slots
+__kernel
+void
+classifyVoxelAppend(__global uint *compactedVoxelArray, __global uint *compactedVerts, volatile __global uint *appendCount,
+                    VOLUME_ARG volume,
+                    uint4 gridSize, uint4 gridSizeShift, uint numVoxels,
+                    float isoValue, TABLE_ARG numVertsTex)
+{
+    uint i = get_global_id(0);
+
+    // no early return, every work-item has to reach the aggregation below
+    uint numVerts = 0;
+    if (i < numVoxels) {
+        int4 gridPos = calcGridPos(i, gridSizeShift, gridSize);
+        if (gridPos.x+1 < gridSize.x && gridPos.y+1 < gridSize.y && gridPos.z+1 < gridSize.z) {
+            float field[8];
+            sampleCorners(volume, gridPos, field);
+            int cubeindex = cubeIndexOf(field, isoValue);
+            numVerts = NUM_VERTS(numVertsTex, cubeindex);
+        }
+    }
+    uint active = (numVerts > 0);
+
+#ifdef MC_SUBGROUPS
+    uint count = sub_group_reduce_add(active);
+    uint slot = sub_group_scan_exclusive_add(active);
+    uint base = 0;
+    if (get_sub_group_local_id() == 0 && count > 0) {
+        base = atomic_add(appendCount, count);
+    }
+    base = sub_group_broadcast(base, 0);
+#else
+    __local uint groupCount;
+    __local uint groupBase;
+
+    uint lid = get_local_id(0);
+    if (lid == 0) {
+        groupCount = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    uint slot = 0;
+    if (active) {
+        slot = atomic_inc(&groupCount);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (lid == 0) {
+        groupBase = (groupCount > 0) ? atomic_add(appendCount, groupCount) : 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    uint base = groupBase;
+#endif
+
+    if (active) {
+        compactedVoxelArray[base + slot] = i;
+        compactedVerts[base + slot] = numVerts;
+    }
+}
+
+// one compare-exchange step of a bitonic sort of n (voxel, count) pairs by voxel id,
+// every block is sorted ascending so pairs past n act as +inf and never move
+// the first step of a stage pairs i with its mirror (mask = k-1), the others with i^j
+__kernel
+void
+sortCompactedVoxels(__global uint *keys, __global uint *values, uint n, uint mask)
+{
+    uint i = get_global_id(0);
+    uint p = i ^ mask;
+    if (i >= n || p <= i || p >= n) {
+        return;
+    }
+
+    uint ki = keys[i];
+    uint kp = keys[p];
+    if (ki > kp) {
+        keys[i] = kp;
+        keys[p] = ki;
+        uint v = values[i];
+        values[i] = values[p];
+        values[p] = v;
+    }
+}
+
+// spread the scan of the compacted vertex counts back to numVertsScanned[voxel],
+// which is where the generate kernels look up the first vertex of a voxel
+__kernel
+void
+scatterCompactedScan(__global uint *numVertsScanned, __global const uint *compactedVoxelArray,
+                     __global const uint *compactedScan, uint activeVoxels)
+{
+    uint i = get_global_id(0);
+    if (i < activeVoxels) {
+        numVertsScanned[compactedVoxelArray[i]] = compactedScan[i];
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Narrow classify
+// uchar vertex counts (at most 15) and one occupancy bit per voxel, 32 voxels
+// per word, instead of a uint of each. The occupancy scan runs over per-word
+// bit counts and compaction ranks a voxel within its word with popcount.
+////////////////////////////////////////////////////////////////////////////////
+
+// largest classify work-group, the host only uses multiples of 32
+#define MAX_CLASSIFY_WORDS (1024 / 32)
+
+__kernel
+void
+classifyVoxelNarrow(__global uchar *voxelVerts, __global uint *occupancyBits, __global uint *occupancyCount,
+                    VOLUME_ARG volume,
+                    uint4 gridSize, uint4 gridSizeShift, uint numVoxels,
+                    float isoValue, TABLE_ARG numVertsTex)
+{
+    __local uint groupBits[MAX_CLASSIFY_WORDS];
+
+    uint i = get_global_id(0);
+    uint lid = get_local_id(0);
+    uint groupWords = get_local_size(0) / 32;
+
+    if (lid < groupWords) {
+        groupBits[lid] = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (i < numVoxels) {
+        uint numVerts = 0;
+        int4 gridPos = calcGridPos(i, gridSizeShift, gridSize);
+        if (gridPos.x+1 < gridSize.x && gridPos.y+1 < gridSize.y && gridPos.z+1 < gridSize.z) {
+            float field[8];
+            sampleCorners(volume, gridPos, field);
+            int cubeindex = cubeIndexOf(field, isoValue);
+            numVerts = NUM_VERTS(numVertsTex, cubeindex);
+        }
+        voxelVerts[i] = (uchar)numVerts;
+        if (numVerts > 0) {
+            atomic_or(&groupBits[lid >> 5], 1u << (lid & 31));
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    uint word = get_group_id(0) * groupWords + lid;
+    if (lid < groupWords && word < (numVoxels + 31) / 32) {
+        occupancyBits[word] = groupBits[lid];
+        occupancyCount[word] = popcount(groupBits[lid]);
+    }
+}
+
+// compact voxel array from the occupancy bits, occupancyScan is the exclusive
+// scan of the per-word counts
+__kernel
+void
+compactVoxelsBits(__global uint *compactedVoxelArray, __global const uint *occupancyBits,
+                  __global const uint *occupancyScan, uint numVoxels)
+{
+    uint i = get_global_id(0);
+    if (i >= numVoxels) {
+        return;
+    }
+
+    uint bits = occupancyBits[i >> 5];
+    uint bit = i & 31;
+    if ((bits >> bit) & 1) {
+        compactedVoxelArray[ occupancyScan[i >> 5] + popcount(bits & ((1u << bit) - 1)) ] = i;
+    }
+}
+
+// procedural volumes, same fields and shape order as MC_SYNTH (mc_synth.h), quantized
+// like the UNORM_INT8 image
+uint synthHash(uint x, uint y, uint z, uint seed)
+{
+    uint h = seed ^ (x * 0x8da6b343u) ^ (y * 0xd8163841u) ^ (z * 0xcb1ab31fu);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+float synthLattice(int x, int y, int z, uint seed)
+{
+    return synthHash((uint)x, (uint)y, (uint)z, seed) * (2.0f / 4294967295.0f) - 1.0f;
+}
+
+float synthValueNoise(float3 p, uint seed)
+{
+    float3 f = floor(p);
+    int3 c = convert_int3(f);
+    float3 t = p - f;
+    t = t * t * (3.0f - 2.0f * t);
+
+    float c00 = mix(synthLattice(c.x, c.y,     c.z,     seed), synthLattice(c.x + 1, c.y,     c.z,     seed), t.x);
+    float c01 = mix(synthLattice(c.x, c.y + 1, c.z,     seed), synthLattice(c.x + 1, c.y + 1, c.z,     seed), t.x);
+    float c10 = mix(synthLattice(c.x, c.y,     c.z + 1, seed), synthLattice(c.x + 1, c.y,     c.z + 1, seed), t.x);
+    float c11 = mix(synthLattice(c.x, c.y + 1, c.z + 1, seed), synthLattice(c.x + 1, c.y + 1, c.z + 1, seed), t.x);
+    return mix(mix(c00, c01, t.y), mix(c10, c11, t.y), t.z);
+}
+
+float synthField(float3 p, int shape, float frequency, uint seed)
+{
+    if (shape == 0) {           // sphere
+        return 0.7f - length(p);
+    } else if (shape == 1) {    // torus
+        float q = length(p.xy) - 0.6f;
+        return 0.25f - sqrt(q * q + p.z * p.z);
+    } else if (shape == 2) {    // gyroid
+        float3 s = p * (3.14159265f * frequency);
+        return (sin(s.x) * cos(s.y) + sin(s.y) * cos(s.z) + sin(s.z) * cos(s.x)) * (1.0f / 1.5f);
+    } else if (shape == 3) {    // metaballs
+        int numBalls = (int)clamp(frequency * frequency * frequency, 1.0f, 4096.0f);
+        float r = 0.7f / max(frequency, 1.0f);
+        float sum = 0.0f;
+        for (int b = 0; b < numBalls; b++) {
+            float3 c = (float3)((float)synthHash(b, 0, 0, seed), (float)synthHash(b, 1, 0, seed),
+                                (float)synthHash(b, 2, 0, seed)) * (1.6f / 4294967295.0f) - 0.8f;
+            float3 d = p - c;
+            sum += r * r / (dot(d, d) + 1.0e-6f);
+        }
+        return min(sum, 2.0f) - 1.0f;
+    } else if (shape == 4) {    // noise
+        float sum = 0.0f, amplitude = 1.0f, f = frequency * 0.5f;
+        for (int octave = 0; octave < 4; octave++) {
+            sum += amplitude * synthValueNoise(p * f, seed + octave);
+            amplitude *= 0.5f;
+            f *= 2.0f;
+        }
+        return sum * (1.0f / 1.875f);
+    }
+    return 0.0f;
+}
+
+// one work-item per sample of a linear uchar volume
+__kernel
+void
+synthesizeVolume(__global uchar *volume, uint4 gridSize, int shape, float frequency, uint seed)
+{
+    uint i = get_global_id(0);
+    uint j = get_global_id(1);
+    uint k = get_global_id(2);
+    if (i >= gridSize.x || j >= gridSize.y || k >= gridSize.z) {
+        return;
+    }
+
+    // the longest axis spans [-1, 1]
+    float maxDim = (float)max(max(gridSize.x, gridSize.y), max(gridSize.z, 2u));
+    float scale = 2.0f / (maxDim - 1.0f);
+    float3 p = ((float3)(2.0f * i, 2.0f * j, 2.0f * k) -
+                (convert_float3(gridSize.xyz) - 1.0f)) * 0.5f * scale;
+
+    float v = clamp(0.5f + synthField(p, shape, frequency, seed), 0.0f, 1.0f);
+    volume[((size_t)k * gridSize.y + j) * gridSize.x + i] = (uchar)clamp((int)round(v * 255.0f), 0, 255);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Volume pyramid (see mc_lod.h)
+////////////////////////////////////////////////////////////////////////////////
+
+// one work-item per sample of the coarser level, the mean of its 2 x 2 x 2 samples,
+// the last sample of an odd axis is repeated
+__kernel
+void
+downsampleVolume(__global const uchar *src, __global uchar *dst, uint4 srcSize, uint4 dstSize)
+{
+    uint i = get_global_id(0);
+    uint j = get_global_id(1);
+    uint k = get_global_id(2);
+    if (i >= dstSize.x || j >= dstSize.y || k >= dstSize.z) {
+        return;
+    }
+
+    uint sum = 0;
+    for (uint dz = 0; dz < 2; dz++) {
+        uint z = min(2 * k + dz, srcSize.z - 1);
+        for (uint dy = 0; dy < 2; dy++) {
+            uint y = min(2 * j + dy, srcSize.y - 1);
+            __global const uchar *row = src + ((size_t)z * srcSize.y + y) * srcSize.x;
+            sum += row[min(2 * i, srcSize.x - 1)] + row[min(2 * i + 1, srcSize.x - 1)];
+        }
+    }
+    dst[((size_t)k * dstSize.y + j) * dstSize.x + i] = (uchar)((sum + 4) / 8);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Seeded extraction (-seed)
+// Breadth first search over the active cells from the cell of a seed point. Two
+// cells are connected when the corners of their shared face are on both sides of
+// the isovalue, then the surface crosses an edge of that face. The visited cells
+// are appended with their vertex counts like classifyVoxelAppend does, so the
+// rest of the pass is the append path. The frontier bounds live on the device,
+// so the host enqueues several levels before it reads them back.
+////////////////////////////////////////////////////////////////////////////////
+
+// corners of the faces -x, +x, -y, +y, -z, +z as cube index bits, and the neighbour across each
+__constant uchar faceCornerMask[6] = {0x99, 0x66, 0x33, 0xcc, 0x0f, 0xf0};
+__constant int4 faceNeighbour[6] = {
+    (int4)(-1, 0, 0, 0), (int4)(1, 0, 0, 0), (int4)(0, -1, 0, 0),
+    (int4)(0, 1, 0, 0), (int4)(0, 0, -1, 0), (int4)(0, 0, 1, 0)
+};
+
+// the first crossed cell of the row from the seed towards +x, one work-item per cell
+__kernel
+void
+findSeedCell(volatile __global uint *seedCell, VOLUME_ARG volume, int4 seed, uint4 gridSize, float isoValue)
+{
+    int4 gridPos = seed;
+    gridPos.x += get_global_id(0);
+    if (gridPos.x + 1 >= gridSize.x) {
+        return;
+    }
+
+    float field[8];
+    sampleCorners(volume, gridPos, field);
+    int cubeindex = cubeIndexOf(field, isoValue);
+    if (cubeindex != 0 && cubeindex != 255) {
+        atomic_min(seedCell, (uint)gridPos.x);
+    }
+}
+
+// the vertices and the unvisited connected neighbours of the cell queue[i]
+void floodCell(__global uint *queue, __global uint *queueVerts, volatile __global uint *queueCount,
+               volatile __global uint *visited, uint i, VOLUME_ARG volume,
+               uint4 gridSize, uint4 gridSizeShift, uint4 gridSizeMask, float isoValue, TABLE_ARG numVertsTex)
+{
+    uint voxel = queue[i];
+    int4 gridPos = calcGridPos(voxel, gridSizeShift, gridSizeMask);
+    float field[8];
+    sampleCorners(volume, gridPos, field);
+    int cubeindex = cubeIndexOf(field, isoValue);
+    queueVerts[i] = NUM_VERTS(numVertsTex, cubeindex);
+
+    for (int f = 0; f < 6; f++) {
+        uint corners = cubeindex & faceCornerMask[f];
+        if (corners == 0 || corners == faceCornerMask[f]) {
+            continue;
+        }
+        int4 n = gridPos + faceNeighbour[f];
+        if (n.x < 0 || n.y < 0 || n.z < 0 ||
+            n.x + 1 >= gridSize.x || n.y + 1 >= gridSize.y || n.z + 1 >= gridSize.z) {
+            continue;
+        }
+        uint neighbour = n.x * gridSizeShift.x + n.y * gridSizeShift.y + n.z * gridSizeShift.z;
+        uint bit = 1u << (neighbour & 31);
+        if (atomic_or(&visited[neighbour >> 5], bit) & bit) {
+            continue;
+        }
+        queue[atomic_inc(queueCount)] = neighbour;
+    }
+}
+
+// expand the frontier queue[frontier[0], frontier[1]): count the vertices of each cell
+// and append the connected neighbours that aren't marked in the visited bits yet. The
+// launch has a fixed size and strides over the frontier, an empty one returns at once.
+__kernel
+void
+floodActiveCells(__global uint *queue, __global uint *queueVerts, volatile __global uint *queueCount,
+                 volatile __global uint *visited, __global const uint *frontier, VOLUME_ARG volume,
+                 uint4 gridSize, uint4 gridSizeShift, uint4 gridSizeMask, float isoValue, TABLE_ARG numVertsTex)
+{
+    uint end = frontier[1];
+    for (uint i = frontier[0] + get_global_id(0); i < end; i += get_global_size(0)) {
+        floodCell(queue, queueVerts, queueCount, visited, i, volume, gridSize, gridSizeShift, gridSizeMask,
+                  isoValue, numVertsTex);
+    }
+}
+
+// the next frontier is what the last level appended, one work-item
+__kernel
+void
+advanceFrontier(__global uint *frontier, __global const uint *queueCount)
+{
+    frontier[0] = frontier[1];
+    frontier[1] = *queueCount;
+}
+
+// clear the words of the visited cells, so the bits are zero for the next search
+// without touching the whole grid
+__kernel
+void
+clearVisitedCells(__global const uint *queue, uint count, __global uint *visited)
+{
+    uint i = get_global_id(0);
+    if (i < count) {
+        visited[queue[i] >> 5] = 0;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Label maps (-labels)
+// The samples are integer labels (the host uploads them as label / 255). A cell
+// whose corners don't all have the same label is read once by classifyLabels,
+// which appends it with its 8 labels. scatterLabelPairs then writes one
+// (cell, label) pair for every nonzero label of the cell, in per-label segments
+// sized from the label histogram, so one scan over the pairs gives every label
+// its own contiguous run of vertices. The surface of label L is the isosurface
+// at 0.5 of the indicator (label == L), its vertices are the edge midpoints.
+////////////////////////////////////////////////////////////////////////////////
+
+#define MAX_LABELS 256
+
+uint labelOf(float sample)
+{
+    return convert_uint_sat_rte(sample * 255.0f);
+}
+
+uint cornerLabel(uint2 labels, int c)
+{
+    return (((c < 4) ? labels.x : labels.y) >> ((c & 3) * 8)) & 0xff;
+}
+
+// corner bits that don't have label l, the cube index of the indicator of l
+int labelCubeIndex(uint2 labels, uint l)
+{
+    int cubeindex = 0;
+    for (int c = 0; c < 8; c++) {
+        cubeindex |= (cornerLabel(labels, c) != l) << c;
+    }
+    return cubeindex;
+}
+
+// the first corner with label l, so a label of a cell is handled once
+bool firstCornerOf(uint2 labels, int c)
+{
+    uint l = cornerLabel(labels, c);
+    for (int p = 0; p < c; p++) {
+        if (cornerLabel(labels, p) == l) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// append the cells with more than one label and count the cells of every label,
+// the histogram is gathered in local memory, one global atomic per label and work-group
+__kernel
+void
+classifyLabels(__global uint *compactedVoxelArray, __global uint2 *compactedLabels, volatile __global uint *appendCount,
+               volatile __global uint *labelCells, VOLUME_ARG volume, uint4 gridSize, uint4 gridSizeShift, uint numVoxels)
+{
+    __local uint groupLabelCells[MAX_LABELS];
+    __local uint groupCount;
+    __local uint groupBase;
+
+    uint i = get_global_id(0);
+    uint lid = get_local_id(0);
+    for (uint l = lid; l < MAX_LABELS; l += get_local_size(0)) {
+        groupLabelCells[l] = 0;
+    }
+    if (lid == 0) {
+        groupCount = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // no early return, every work-item has to reach the barriers
+    uint2 labels = (uint2)(0, 0);
+    uint active = 0;
+    if (i < numVoxels) {
+        int4 gridPos = calcGridPos(i, gridSizeShift, gridSize);
+        if (gridPos.x+1 < gridSize.x && gridPos.y+1 < gridSize.y && gridPos.z+1 < gridSize.z) {
+            float field[8];
+            sampleCorners(volume, gridPos, field);
+            for (int c = 0; c < 8; c++) {
+                uint l = labelOf(field[c]);
+                if (c < 4) labels.x |= l << (c * 8);
+                else labels.y |= l << ((c - 4) * 8);
+            }
+            active = (labels.x != labels.y || labels.x != (labels.x & 0xff) * 0x01010101u);
+        }
+    }
+
+    uint slot = 0;
+    if (active) {
+        slot = atomic_inc(&groupCount);
+        for (int c = 0; c < 8; c++) {
+            uint l = cornerLabel(labels, c);
+            if (l != 0 && firstCornerOf(labels, c)) {
+                atomic_inc(&groupLabelCells[l]);
+            }
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (lid == 0) {
+        groupBase = (groupCount > 0) ? atomic_add(appendCount, groupCount) : 0;
+    }
+    for (uint l = lid; l < MAX_LABELS; l += get_local_size(0)) {
+        if (groupLabelCells[l] > 0) {
+            atomic_add(&labelCells[l], groupLabelCells[l]);
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (active) {
+        compactedVoxelArray[groupBase + slot] = i;
+        compactedLabels[groupBase + slot] = labels;
+    }
+}
+
+// one work-item per appended cell, labelCursor starts at the first pair of each label
+__kernel
+void
+scatterLabelPairs(__global const uint *compactedVoxelArray, __global const uint2 *compactedLabels, uint activeCells,
+                  volatile __global uint *labelCursor, volatile __global uint *labelVerts,
+                  __global uint *pairVoxel, __global uint *pairCode, __global uint *pairVerts,
+                  TABLE_ARG numVertsTex)
+{
+    uint i = get_global_id(0);
+    if (i >= activeCells) {
+        return;
+    }
+
+    uint voxel = compactedVoxelArray[i];
+    uint2 labels = compactedLabels[i];
+    for (int c = 0; c < 8; c++) {
+        uint l = cornerLabel(labels, c);
+        if (l == 0 || !firstCornerOf(labels, c)) {
+            continue;
+        }
+        int cubeindex = labelCubeIndex(labels, l);
+        uint numVerts = NUM_VERTS(numVertsTex, cubeindex);
+        uint slot = atomic_inc(&labelCursor[l]);
+        pairVoxel[slot] = voxel;
+        pairCode[slot] = (l << 8) | cubeindex;
+        pairVerts[slot] = numVerts;
+        atomic_add(&labelVerts[l], numVerts);
+    }
+}
+
+// the triangles of one (cell, label) pair starting at pairVertsScanned[i], through
+// emitTriangle on the 0 / 1 field of the label's cube index
+__kernel
+void
+generateLabelTriangles(__global float4 *pos, __global float4 *norm, __global const uint *pairVoxel,
+                       __global const uint *pairCode, __global const uint *pairVertsScanned, uint numPairs,
+                       uint4 gridSize, uint4 gridSizeShift, uint4 gridSizeMask,
+                       float4 voxelSize, float4 upperLeftPos, uint maxVerts,
+                       TABLE_ARG numVertsTex, TABLE_ARG triTex, __global uint *vertexHash)
+{
+    uint i = get_global_id(0);
+    if (i >= numPairs) {
+        return;
+    }
+
+    uint voxel = pairVoxel[i];
+    int cubeindex = pairCode[i] & 0xff;
+    int4 gridPos = calcGridPos(voxel, gridSizeShift, gridSizeMask);
+
+    float field[8];
+    for (int c = 0; c < 8; c++) {
+        field[c] = (cubeindex & (1 << c)) ? 0.0f : 1.0f;
+    }
+
+    uint first = pairVertsScanned[i];
+    uint numTris = NUM_VERTS(numVertsTex, cubeindex) / 3;
+    for (uint t = 0; t < numTris; t++) {
+        uint index = first + t * 3;
+        if (index + 3 <= maxVerts) {
+            emitTriangle(pos, norm, vertexHash, index, gridPos, voxel, cubeindex, t, field,
+                         gridSize, gridSizeShift, voxelSize, upperLeftPos, 0.5f, triTex);
+        }
+    }
+}
@@ -0,0 +1,362 @@
+#include "mc_batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <oclUtils.h>
+
+#include "mc_helper.h"
+
+namespace MC_BATCH {
+
+	const char *formatNames[NUM_FORMATS] = { "obj", "ply", "raw" };
+
+	struct VolumeLoad {
+		bool done;
+		bool ok;
+		std::vector<float> samples;
+	};
+
+	static std::vector<std::thread> workers;
+	static std::deque<std::function<void()> > tasks;
+	static std::map<std::string, std::shared_ptr<VolumeLoad> > volumes;
+	static std::mutex lock;
+	static std::condition_variable taskReady;
+	static std::condition_variable taskDone;
+	static int pending = 0;
+	static bool stopping = false;
+	static std::atomic<int> failures(0);
+
+	Job::Job() : hasROI(false), format(FORMAT_OBJ)
+	{
+		memset(roi, 0, sizeof(roi));
+	}
+
+	static bool parseList(const char *list, std::vector<float> &values)
+	{
+		values.clear();
+		const char *c = list;
+		while (*c) {
+			char *end;
+			float v = (float)strtod(c, &end);
+			if (end == c) return false;
+			values.push_back(v);
+			c = end;
+			if (*c == ',') c++;
+		}
+		return !values.empty();
+	}
+
+	bool loadManifest(const char *path, std::vector<Job> &jobs)
+	{
+		FILE *f = fopen(path, "r");
+		if (!f) {
+			shrLog("batch: can't open manifest '%s'\n", path);
+			return false;
+		}
+
+		char line[4096];
+		int lineNumber = 0;
+		bool ok = true;
+		while (fgets(line, sizeof(line), f)) {
+			lineNumber++;
+			char *comment = strchr(line, '#');
+			if (comment) *comment = 0;
+
+			Job job;
+			char *token = strtok(line, " \t\r\n");
+			if (!token) continue;
+			job.volume = token;
+			while ((token = strtok(NULL, " \t\r\n")) != NULL) {
+				std::vector<float> values;
+				if (strncmp(token, "iso=", 4) == 0 && parseList(token + 4, values)) {
+					job.isoValues = values;
+				} else if (strncmp(token, "roi=", 4) == 0 && parseList(token + 4, values) && values.size() == 6) {
+					job.hasROI = true;
+					for (int i = 0; i < 6; i++) job.roi[i] = (cl_uint)MAX(values[i], 0.0f);
+				} else if (strncmp(token, "format=", 7) == 0) {
+					int format = 0;
+					while (format < NUM_FORMATS && strcmp(token + 7, formatNames[format]) != 0) format++;
+					if (format == NUM_FORMATS) {
+						shrLog("batch: %s:%d unknown format '%s'\n", path, lineNumber, token + 7);
+						ok = false;
+					}
+					if (format < NUM_FORMATS) job.format = (Format)format;
+				} else if (strncmp(token, "out=", 4) == 0) {
+					job.output = token + 4;
+				} else {
+					shrLog("batch: %s:%d can't parse '%s'\n", path, lineNumber, token);
+					ok = false;
+				}
+			}
+			if (job.isoValues.empty()) {
+				shrLog("batch: %s:%d has no iso=\n", path, lineNumber);
+				ok = false;
+				continue;
+			}
+			if (job.output.empty()) {
+				job.output = job.volume;
+			}
+			jobs.push_back(job);
+		}
+		fclose(f);
+		return ok;
+	}
+
+	static void workerLoop(void)
+	{
+		for (;;) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				taskReady.wait(guard, [] { return stopping || !tasks.empty(); });
+				if (tasks.empty()) return;
+				task = tasks.front();
+				tasks.pop_front();
+			}
+			task();
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				pending--;
+			}
+			taskDone.notify_all();
+		}
+	}
+
+	static void submit(const std::function<void()> &task)
+	{
+		if (workers.empty()) {
+			task();
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			tasks.push_back(task);
+			pending++;
+		}
+		taskReady.notify_one();
+	}
+
+	void start(int numWorkers)
+	{
+		stop();
+		stopping = false;
+		failures = 0;
+		for (int w = 0; w < numWorkers; w++) {
+			workers.push_back(std::thread(workerLoop));
+		}
+	}
+
+	void stop(void)
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		taskReady.notify_all();
+		for (size_t w = 0; w < workers.size(); w++) {
+			workers[w].join();
+		}
+		workers.clear();
+		volumes.clear();
+	}
+
+	void prefetch(const std::string &path, size_t numSamples)
+	{
+		std::shared_ptr<VolumeLoad> load;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (volumes.count(path)) return;
+			load = std::make_shared<VolumeLoad>();
+			load->done = load->ok = false;
+			volumes[path] = load;
+		}
+		submit([=]() {
+			std::vector<float> samples(numSamples);
+			FILE *f = fopen(path.c_str(), "rb");
+			size_t read = f ? fread(samples.data(), sizeof(float), numSamples, f) : 0;
+			if (f) fclose(f);
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				load->samples.swap(samples);
+				load->ok = (read == numSamples);
+				load->done = true;
+			}
+			taskDone.notify_all();
+		});
+	}
+
+	bool takeVolume(const std::string &path, size_t numSamples, std::vector<float> &samples)
+	{
+		prefetch(path, numSamples);
+		std::unique_lock<std::mutex> guard(lock);
+		std::shared_ptr<VolumeLoad> load = volumes[path];
+		taskDone.wait(guard, [&] { return load->done; });
+		volumes.erase(path);
+		samples.swap(load->samples);
+		return load->ok;
+	}
+
+	static bool writePLY(const std::string &path, const std::vector<float> &pos, const std::vector<uint> &vertexHash)
+	{
+		// weld by hash like MC_HELPER::getCompactMeshEigen
+		std::unordered_map<uint, int> index;
+		std::vector<uint> first;
+		std::vector<int> faces(vertexHash.size());
+		for (size_t i = 0; i < vertexHash.size(); i++) {
+			std::unordered_map<uint, int>::iterator it = index.find(vertexHash[i]);
+			if (it == index.end()) {
+				it = index.insert(std::make_pair(vertexHash[i], (int)first.size())).first;
+				first.push_back((uint)i);
+			}
+			faces[i] = it->second;
+		}
+
+		FILE *f = fopen(path.c_str(), "wb");
+		if (!f) return false;
+		fprintf(f, "ply\nformat binary_little_endian 1.0\nelement vertex %u\nproperty float x\nproperty float y\nproperty float z\n"
+				"element face %u\nproperty list uchar int vertex_indices\nend_header\n",
+				(uint)first.size(), (uint)(vertexHash.size() / 3));
+		for (size_t v = 0; v < first.size(); v++) {
+			fwrite(&pos[4 * first[v]], sizeof(float), 3, f);
+		}
+		const uchar three = 3;
+		for (size_t t = 0; t < faces.size() / 3; t++) {
+			fwrite(&three, 1, 1, f);
+			fwrite(&faces[3 * t], sizeof(int), 3, f);
+		}
+		bool ok = (ferror(f) == 0);
+		fclose(f);
+		return ok;
+	}
+
+	static bool writeRaw(const std::string &path, const std::vector<float> &pos)
+	{
+		FILE *f = fopen(path.c_str(), "wb");
+		if (!f) return false;
+		for (size_t v = 0; v < pos.size() / 4; v++) {
+			fwrite(&pos[4 * v], sizeof(float), 3, f);
+		}
+		bool ok = (ferror(f) == 0);
+		fclose(f);
+		return ok;
+	}
+
+	void writeMesh(const Job &job, float isoValue, std::vector<float> &pos, std::vector<float> &normal,
+				   std::vector<uint> &vertexHash)
+	{
+		// the isovalue is printed like the names of -save, which -regress parses
+		std::string path = job.output + "_" + std::to_string(isoValue) + "." + formatNames[job.format];
+
+		std::shared_ptr<std::vector<float> > meshPos = std::make_shared<std::vector<float> >();
+		std::shared_ptr<std::vector<float> > meshNormal = std::make_shared<std::vector<float> >();
+		std::shared_ptr<std::vector<uint> > meshHash = std::make_shared<std::vector<uint> >();
+		meshPos->swap(pos);
+		meshNormal->swap(normal);
+		meshHash->swap(vertexHash);
+
+		submit([=]() {
+			bool ok;
+			if (job.format == FORMAT_OBJ) {
+				ok = MC_HELPER::saveMesh(path, *meshPos, *meshNormal, *meshHash);
+			} else if (job.format == FORMAT_PLY) {
+				ok = writePLY(path, *meshPos, *meshHash);
+			} else {
+				ok = writeRaw(path, *meshPos);
+			}
+			if (!ok) {
+				shrLog("batch: writing '%s' failed\n", path.c_str());
+				failures++;
+			}
+		});
+	}
+
+	int flush(void)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		taskDone.wait(guard, [] { return pending == 0; });
+		return failures;
+	}
+
+	void run(const char *manifest, int numWorkers, size_t numSamples, bool roiSupported,
+			 UploadFn upload, ExtractFn extract)
+	{
+		std::vector<Job> jobs;
+		if (!loadManifest(manifest, jobs)) {
+			shrLog("batch: skipping the lines of '%s' that can't be parsed\n", manifest);
+		}
+		start(numWorkers);
+		if (!jobs.empty()) {
+			prefetch(jobs[0].volume, numSamples);
+		}
+
+		int failedJobs = 0;
+		uint batchVerts = 0;
+		double batchTime = 0.0;
+		std::vector<float> samples, pos, normal;
+		std::vector<uint> vertexHash;
+		for (size_t j = 0; j < jobs.size(); j++) {
+			const Job &job = jobs[j];
+			shrDeltaT(1);
+			bool loaded = takeVolume(job.volume, numSamples, samples);
+			if (j + 1 < jobs.size()) {
+				prefetch(jobs[j + 1].volume, numSamples);
+			}
+			double dLoad = shrDeltaT(1);
+			if (!loaded) {
+				shrLog("batch: job %u, '%s' is missing or smaller than the %u voxel grid\n", (uint)j, job.volume.c_str(), (uint)numSamples);
+				failedJobs++;
+				continue;
+			}
+			if (job.hasROI && !roiSupported) {
+				shrLog("batch: job %u, roi= needs the classic engine on one linear volume without -labels\n", (uint)j);
+				failedJobs++;
+				continue;
+			}
+
+			upload(samples.data());
+			double dUpload = shrDeltaT(1);
+			batchTime += dLoad + dUpload;
+
+			bool failed = false;
+			for (size_t i = 0; i < job.isoValues.size(); i++) {
+				float isoValue = job.isoValues[i];
+				bool ok = extract(job, isoValue, pos, normal, vertexHash);
+				double dExtract = shrDeltaT(1);
+				batchTime += dExtract;
+				if (!ok) {
+					failed = true;
+					continue;
+				}
+
+				uint verts = (uint)vertexHash.size();
+				batchVerts += verts;
+				writeMesh(job, isoValue, pos, normal, vertexHash);
+				shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes-batch, Job = %u, Volume = %s, Iso = %g, Verts = %u, Load = %.5f s, Upload = %.5f s, Extract = %.5f s\n",
+						 (uint)j, job.volume.c_str(), isoValue, verts, dLoad, dUpload, dExtract);
+				dLoad = dUpload = 0.0;
+			}
+			if (failed) {
+				failedJobs++;
+			}
+		}
+
+		shrDeltaT(1);
+		int failedWrites = flush();
+		double dWrite = shrDeltaT(1);
+		stop();
+		shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes-batch, Jobs = %u, Failed = %d, Failed Writes = %d, Verts = %u, Time = %.5f s, Write Tail = %.5f s\n",
+				 (uint)jobs.size(), failedJobs, failedWrites, batchVerts, batchTime, dWrite);
+	}
+};
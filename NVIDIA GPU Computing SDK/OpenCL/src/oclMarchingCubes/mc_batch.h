@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_BATCH {
+	// Manifest driven batch extraction (-batch=<manifest>). One job per line:
+	//   <volume file> iso=<v>[,<v>...] [roi=x0,y0,z0,x1,y1,z1] [format=obj|ply|raw] [out=<prefix>]
+	// '#' starts a comment. The ROI is in grid points, only the box is extracted (see extractROI)
+	// and -roi is the box of the jobs without one. The meshes are written to <prefix>_<iso>.<format>
+	// with the isovalue printed like -save does (prefix defaults to the volume file).
+	// The volumes have to match the grid given on the command line.
+	// A host worker pool loads the next job's volume and writes the meshes while the
+	// device extracts, the device side keeps its program and buffers for the whole batch.
+
+	enum Format {
+		FORMAT_OBJ,		// welded by vertex hash, through MC_HELPER::saveMesh
+		FORMAT_PLY,		// welded binary little endian
+		FORMAT_RAW,		// flat float x/y/z triangle soup
+		NUM_FORMATS
+	};
+
+	extern const char *formatNames[NUM_FORMATS];
+
+	struct Job {
+		std::string volume;
+		std::vector<float> isoValues;
+		bool hasROI;
+		cl_uint roi[6];
+		Format format;
+		std::string output;
+
+		Job();
+	};
+
+	bool loadManifest(const char *path, std::vector<Job> &jobs);
+
+	// the pool that loads volumes and writes meshes
+	void start(int numWorkers);
+	void stop(void);
+
+	// load numSamples floats of path on a worker, takeVolume waits for it (false if the
+	// file is missing or short)
+	void prefetch(const std::string &path, size_t numSamples);
+	bool takeVolume(const std::string &path, size_t numSamples, std::vector<float> &samples);
+
+	// write on a worker, the mesh is moved into the queue
+	void writeMesh(const Job &job, float isoValue, std::vector<float> &pos, std::vector<float> &normal,
+				   std::vector<uint> &vertexHash);
+	// wait for the queued writes, returns the number of files that failed
+	int flush(void);
+
+	// upload replaces the samples of the volume, extract computes one isovalue of a job
+	// (its roi= box, if any) and moves the mesh into pos/normal/vertexHash, false if it failed
+	typedef void (*UploadFn)(const float *samples);
+	typedef bool (*ExtractFn)(const Job &job, float isoValue, std::vector<float> &pos, std::vector<float> &normal,
+							  std::vector<uint> &vertexHash);
+
+	// run the jobs of the manifest on a pool of numWorkers, each volume holds numSamples
+	// samples. Without roiSupported the jobs with roi= fail.
+	void run(const char *manifest, int numWorkers, size_t numSamples, bool roiSupported,
+			 UploadFn upload, ExtractFn extract);
+};
@@ -0,0 +1,175 @@
+#include "mc_bufferPlan.h"
+
+#include <algorithm>
+
+#include <oclUtils.h>
+
+namespace MC_BUFFERPLAN {
+
+	struct PlannedBuffer {
+		std::string name;
+		size_t bytes;
+		cl_mem *target;
+		int firstStage;
+		int lastStage;
+		size_t offset;		// in the backing buffer
+	};
+
+	static std::vector<PlannedBuffer> buffers;
+	static cl_mem d_backing = 0;
+	static bool allocated = false;
+
+	void reset(void)
+	{
+		release();
+		buffers.clear();
+	}
+
+	int addBuffer(const char *name, size_t bytes, cl_mem *target)
+	{
+		PlannedBuffer buffer;
+		buffer.name = name;
+		buffer.bytes = bytes;
+		buffer.target = target;
+		buffer.firstStage = -1;
+		buffer.lastStage = -1;
+		buffer.offset = 0;
+		buffers.push_back(buffer);
+		return (int)buffers.size() - 1;
+	}
+
+	void use(int stage, int id)
+	{
+		PlannedBuffer &buffer = buffers[id];
+		if (buffer.firstStage < 0 || stage < buffer.firstStage) buffer.firstStage = stage;
+		if (stage > buffer.lastStage) buffer.lastStage = stage;
+	}
+
+	void use(int stage, std::initializer_list<int> ids)
+	{
+		for (int id : ids) {
+			use(stage, id);
+		}
+	}
+
+	static bool liveTogether(const PlannedBuffer &a, const PlannedBuffer &b)
+	{
+		// a buffer without any declared use is kept live for the whole pass
+		if (a.firstStage < 0 || b.firstStage < 0) return true;
+		return a.firstStage <= b.lastStage && b.firstStage <= a.lastStage;
+	}
+
+	static bool largerFirst(const PlannedBuffer *a, const PlannedBuffer *b)
+	{
+		return a->bytes > b->bytes;
+	}
+
+	static size_t alignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// greedy first fit, largest buffers first: each buffer goes to the lowest aligned
+	// offset that doesn't intersect a placed buffer it is live together with
+	static size_t pack(size_t alignment)
+	{
+		std::vector<PlannedBuffer*> order;
+		for (size_t i = 0; i < buffers.size(); i++) {
+			order.push_back(&buffers[i]);
+		}
+		std::stable_sort(order.begin(), order.end(), largerFirst);
+
+		size_t total = 0;
+		for (size_t i = 0; i < order.size(); i++) {
+			PlannedBuffer *buffer = order[i];
+
+			// candidate offsets: 0 and the end of every conflicting buffer
+			std::vector<size_t> candidates(1, 0);
+			for (size_t j = 0; j < i; j++) {
+				if (liveTogether(*buffer, *order[j])) {
+					candidates.push_back(alignUp(order[j]->offset + order[j]->bytes, alignment));
+				}
+			}
+			std::sort(candidates.begin(), candidates.end());
+
+			for (size_t c = 0; c < candidates.size(); c++) {
+				size_t begin = candidates[c];
+				size_t end = begin + buffer->bytes;
+				bool fits = true;
+				for (size_t j = 0; j < i && fits; j++) {
+					const PlannedBuffer *other = order[j];
+					fits = !liveTogether(*buffer, *other) ||
+						   end <= other->offset || other->offset + other->bytes <= begin;
+				}
+				if (fits) {
+					buffer->offset = begin;
+					break;
+				}
+			}
+			total = MAX(total, buffer->offset + buffer->bytes);
+		}
+		return total;
+	}
+
+	cl_int allocate(cl_context context, cl_device_id device, bool alias)
+	{
+		release();
+
+		size_t separate = 0;
+		for (size_t i = 0; i < buffers.size(); i++) {
+			separate += buffers[i].bytes;
+		}
+
+		// sub-buffer origins have to be aligned to the device base address alignment (in bits)
+		cl_uint alignBits = 0;
+		cl_ulong maxAlloc = 0;
+		clGetDeviceInfo(device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &alignBits, NULL);
+		clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAlloc, NULL);
+		size_t alignment = MAX((size_t)alignBits / 8, (size_t)1);
+		size_t packed = pack(alignment);
+
+		shrLog("Buffer plan: %u buffers, %.1f MB separate, %.1f MB aliased\n", (uint)buffers.size(),
+			   separate / (1024.0 * 1024.0), packed / (1024.0 * 1024.0));
+		for (size_t i = 0; i < buffers.size(); i++) {
+			shrLog("  %-20s stages %d-%d  offset %10u  %10u bytes\n", buffers[i].name.c_str(),
+				   buffers[i].firstStage, buffers[i].lastStage, (uint)buffers[i].offset, (uint)buffers[i].bytes);
+		}
+
+		if (alias && packed > maxAlloc) {
+			shrLog("Buffer plan: %.1f MB exceeds the largest allocation of the device, not aliasing\n",
+				   packed / (1024.0 * 1024.0));
+			alias = false;
+		}
+
+		cl_int err = CL_SUCCESS;
+		allocated = true;
+		if (!alias) {
+			for (size_t i = 0; i < buffers.size(); i++) {
+				*buffers[i].target = clCreateBuffer(context, CL_MEM_READ_WRITE, buffers[i].bytes, 0, &err);
+				if (err != CL_SUCCESS) return err;
+			}
+			return CL_SUCCESS;
+		}
+
+		d_backing = clCreateBuffer(context, CL_MEM_READ_WRITE, packed, 0, &err);
+		if (err != CL_SUCCESS) return err;
+		for (size_t i = 0; i < buffers.size(); i++) {
+			cl_buffer_region region = { buffers[i].offset, buffers[i].bytes };
+			*buffers[i].target = clCreateSubBuffer(d_backing, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+			if (err != CL_SUCCESS) return err;
+		}
+		return CL_SUCCESS;
+	}
+
+	void release(void)
+	{
+		if (!allocated) return;
+		for (size_t i = 0; i < buffers.size(); i++) {
+			if (*buffers[i].target) clReleaseMemObject(*buffers[i].target);
+			*buffers[i].target = 0;
+		}
+		if (d_backing) clReleaseMemObject(d_backing);
+		d_backing = 0;
+		allocated = false;
+	}
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_BUFFERPLAN {
+	// Lifetime based aliasing of the per-pass device buffers. Each buffer is declared
+	// with the pipeline stages that use it, it is live from its first to its last stage.
+	// Buffers whose lifetimes don't overlap get overlapping ranges of one backing
+	// buffer, handed out as sub-buffers.
+
+	// start a new plan, buffers of a previous plan have to be released first
+	void reset(void);
+
+	// declare a buffer, *target receives the cl_mem on allocate; returns its id for use()
+	int addBuffer(const char *name, size_t bytes, cl_mem *target);
+
+	// buffer id is read or written in stage (stages are ordered indices of one pass)
+	void use(int stage, int id);
+	void use(int stage, std::initializer_list<int> ids);
+
+	// create the buffers, aliased into one backing buffer if alias is set and the packed
+	// size fits in one allocation, separately otherwise. The footprint of the separate
+	// and the packed layout is logged either way.
+	cl_int allocate(cl_context context, cl_device_id device, bool alias);
+
+	// release all buffers of the plan and clear their targets
+	void release(void);
+};
@@ -0,0 +1,569 @@
+#include "mc_flyingEdges.h"
+
+#include <thread>
+
+#include <oclUtils.h>
+
+#include "ScanApple.h"
+
+// defined in tables.h, which is included by oclMarchingCubes.cpp
+extern uchar triTable[256][16];
+extern uchar numVertsTable[256];
+
+namespace MC_FLYINGEDGES {
+
+	// one work-item per row
+	static const size_t ROW_GROUP_SIZE = 64;
+
+	static cl_kernel xEdgesKernel = 0;
+	static cl_kernel yzEdgesKernel = 0;
+	static cl_kernel generateKernel = 0;
+	static cl_kernel expandKernel = 0;
+
+	static cl_context cxContext = 0;
+	static uint numRows = 0;
+
+	// per-row data
+	static cl_mem d_edgeCases = 0;		// (nx - 1) x-edge cases per row
+	static cl_mem d_rowTrim = 0;		// uint2 x-edge trim
+	static cl_mem d_cellTrim = 0;		// uint2 cell trim
+	static cl_mem d_rowEdges = 0;		// uint4 x/y/z intersections and triangles
+	static cl_mem d_rowVerts = 0;
+	static cl_mem d_rowTris = 0;
+	static cl_mem d_vertBase = 0;
+	static cl_mem d_triBase = 0;
+
+	// indexed output, grown on demand
+	static cl_mem d_points = 0;
+	static cl_mem d_pointHash = 0;
+	static cl_mem d_triIndices = 0;
+	static size_t pointCapacity = 0;
+	static size_t triCapacity = 0;
+
+	static void releaseMem(cl_mem &buffer)
+	{
+		if (buffer) clReleaseMemObject(buffer);
+		buffer = 0;
+	}
+
+	cl_int createKernels(cl_program program)
+	{
+		releaseKernels();
+
+		cl_int err = CL_SUCCESS;
+		xEdgesKernel = clCreateKernel(program, "feXEdges", &err);
+		if (err != CL_SUCCESS) return err;
+		yzEdgesKernel = clCreateKernel(program, "feYZEdges", &err);
+		if (err != CL_SUCCESS) return err;
+		generateKernel = clCreateKernel(program, "feGenerate", &err);
+		if (err != CL_SUCCESS) return err;
+		expandKernel = clCreateKernel(program, "feExpandTriangles", &err);
+		return err;
+	}
+
+	void releaseKernels(void)
+	{
+		if (xEdgesKernel) clReleaseKernel(xEdgesKernel);
+		if (yzEdgesKernel) clReleaseKernel(yzEdgesKernel);
+		if (generateKernel) clReleaseKernel(generateKernel);
+		if (expandKernel) clReleaseKernel(expandKernel);
+		xEdgesKernel = yzEdgesKernel = generateKernel = expandKernel = 0;
+	}
+
+	cl_int init(cl_context context, const cl_uint gridSize[4])
+	{
+		close();
+		cxContext = context;
+		numRows = gridSize[1] * gridSize[2];
+
+		cl_int err = CL_SUCCESS;
+		d_edgeCases = clCreateBuffer(context, CL_MEM_READ_WRITE, (gridSize[0] - 1) * numRows * sizeof(cl_uchar), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		d_rowTrim = clCreateBuffer(context, CL_MEM_READ_WRITE, numRows * 2 * sizeof(cl_uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		d_cellTrim = clCreateBuffer(context, CL_MEM_READ_WRITE, numRows * 2 * sizeof(cl_uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		d_rowEdges = clCreateBuffer(context, CL_MEM_READ_WRITE, numRows * 4 * sizeof(cl_uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		d_rowVerts = clCreateBuffer(context, CL_MEM_READ_WRITE, numRows * sizeof(cl_uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		d_rowTris = clCreateBuffer(context, CL_MEM_READ_WRITE, numRows * sizeof(cl_uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		d_vertBase = clCreateBuffer(context, CL_MEM_READ_WRITE, numRows * sizeof(cl_uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		d_triBase = clCreateBuffer(context, CL_MEM_READ_WRITE, numRows * sizeof(cl_uint), 0, &err);
+		return err;
+	}
+
+	void close(void)
+	{
+		releaseMem(d_edgeCases);
+		releaseMem(d_rowTrim);
+		releaseMem(d_cellTrim);
+		releaseMem(d_rowEdges);
+		releaseMem(d_rowVerts);
+		releaseMem(d_rowTris);
+		releaseMem(d_vertBase);
+		releaseMem(d_triBase);
+		releaseMem(d_points);
+		releaseMem(d_pointHash);
+		releaseMem(d_triIndices);
+		pointCapacity = triCapacity = 0;
+	}
+
+	// total of an exclusive scan: last input + last scanned value
+	static uint scanTotal(cl_command_queue queue, cl_mem input, cl_mem scanned, uint count, cl_int &err)
+	{
+		uint lastElement = 0, lastScanElement = 0;
+		err = clEnqueueReadBuffer(queue, input, CL_TRUE, (count - 1) * sizeof(uint), sizeof(uint), &lastElement, 0, 0, 0);
+		if (err != CL_SUCCESS) return 0;
+		err = clEnqueueReadBuffer(queue, scanned, CL_TRUE, (count - 1) * sizeof(uint), sizeof(uint), &lastScanElement, 0, 0, 0);
+		if (err != CL_SUCCESS) return 0;
+		return lastElement + lastScanElement;
+	}
+
+	static cl_int reserve(size_t points, size_t tris)
+	{
+		cl_int err = CL_SUCCESS;
+		if (points > pointCapacity) {
+			releaseMem(d_points);
+			releaseMem(d_pointHash);
+			// leave some room so a slowly moving isovalue doesn't reallocate every frame
+			pointCapacity = points + points / 4;
+			d_points = clCreateBuffer(cxContext, CL_MEM_READ_WRITE, pointCapacity * 4 * sizeof(cl_float), 0, &err);
+			if (err != CL_SUCCESS) return err;
+			d_pointHash = clCreateBuffer(cxContext, CL_MEM_READ_WRITE, pointCapacity * sizeof(cl_uint), 0, &err);
+			if (err != CL_SUCCESS) return err;
+		}
+		if (tris > triCapacity) {
+			releaseMem(d_triIndices);
+			triCapacity = tris + tris / 4;
+			d_triIndices = clCreateBuffer(cxContext, CL_MEM_READ_WRITE, triCapacity * 3 * sizeof(cl_uint), 0, &err);
+		}
+		return err;
+	}
+
+	cl_int extract(cl_command_queue queue, cl_mem volume, cl_mem numVertsTex, cl_mem triTex,
+				   const cl_uint gridSize[4], const cl_float voxelSize[4], const cl_float upperLeft[4], float isoValue,
+				   cl_mem pos, cl_mem norm, cl_mem vertexHash, uint maxVerts, uint &totalVerts)
+	{
+		cl_int err = CL_SUCCESS;
+		size_t threads = ROW_GROUP_SIZE;
+		size_t grid = (numRows + ROW_GROUP_SIZE - 1) / ROW_GROUP_SIZE * ROW_GROUP_SIZE;
+		totalVerts = 0;
+
+		// pass 1: x-edges
+		err = clSetKernelArg(xEdgesKernel, 0, sizeof(cl_mem), &d_edgeCases);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(xEdgesKernel, 1, sizeof(cl_mem), &d_rowTrim);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(xEdgesKernel, 2, sizeof(cl_mem), &d_rowEdges);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(xEdgesKernel, 3, sizeof(cl_mem), &volume);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(xEdgesKernel, 4, 4 * sizeof(cl_uint), gridSize);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(xEdgesKernel, 5, sizeof(float), &isoValue);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueNDRangeKernel(queue, xEdgesKernel, 1, NULL, &grid, &threads, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+
+		// pass 2: y/z-edges, trims and triangle counts
+		err = clSetKernelArg(yzEdgesKernel, 0, sizeof(cl_mem), &d_edgeCases);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(yzEdgesKernel, 1, sizeof(cl_mem), &d_rowTrim);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(yzEdgesKernel, 2, sizeof(cl_mem), &d_rowEdges);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(yzEdgesKernel, 3, sizeof(cl_mem), &d_cellTrim);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(yzEdgesKernel, 4, sizeof(cl_mem), &d_rowVerts);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(yzEdgesKernel, 5, sizeof(cl_mem), &d_rowTris);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(yzEdgesKernel, 6, 4 * sizeof(cl_uint), gridSize);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(yzEdgesKernel, 7, sizeof(cl_mem), &numVertsTex);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueNDRangeKernel(queue, yzEdgesKernel, 1, NULL, &grid, &threads, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+
+		// pass 3: row offsets
+		MeshProc::scanApple::ScanAPPLEProcess(d_vertBase, d_rowVerts, numRows);
+		MeshProc::scanApple::ScanAPPLEProcess(d_triBase, d_rowTris, numRows);
+		uint numPoints = scanTotal(queue, d_rowVerts, d_vertBase, numRows, err);
+		if (err != CL_SUCCESS) return err;
+		uint numTris = scanTotal(queue, d_rowTris, d_triBase, numRows, err);
+		if (err != CL_SUCCESS || numTris == 0) return err;
+
+		err = reserve(numPoints, numTris);
+		if (err != CL_SUCCESS) return err;
+
+		// pass 4: intersections and triangle indices
+		int k = 0;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &d_points);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &d_pointHash);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &d_triIndices);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &d_edgeCases);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &d_rowTrim);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &d_cellTrim);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &d_rowEdges);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &d_vertBase);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &d_triBase);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &volume);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, 4 * sizeof(cl_uint), gridSize);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, 4 * sizeof(cl_float), voxelSize);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, 4 * sizeof(cl_float), upperLeft);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(float), &isoValue);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &numVertsTex);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateKernel, k++, sizeof(cl_mem), &triTex);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueNDRangeKernel(queue, generateKernel, 1, NULL, &grid, &threads, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+
+		// expand to the vertex buffers used for rendering
+		size_t triGrid = (numTris + ROW_GROUP_SIZE - 1) / ROW_GROUP_SIZE * ROW_GROUP_SIZE;
+		err = clSetKernelArg(expandKernel, 0, sizeof(cl_mem), &pos);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(expandKernel, 1, sizeof(cl_mem), &norm);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(expandKernel, 2, sizeof(cl_mem), &vertexHash);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(expandKernel, 3, sizeof(cl_mem), &d_points);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(expandKernel, 4, sizeof(cl_mem), &d_pointHash);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(expandKernel, 5, sizeof(cl_mem), &d_triIndices);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(expandKernel, 6, sizeof(cl_uint), &numTris);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(expandKernel, 7, sizeof(cl_uint), &maxVerts);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueNDRangeKernel(queue, expandKernel, 1, NULL, &triGrid, &threads, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+
+		totalVerts = MIN(numTris * 3, maxVerts / 3 * 3);
+		return CL_SUCCESS;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// CPU engine, the same passes as the fe* kernels with a thread per z slab
+	////////////////////////////////////////////////////////////////////////////////
+
+	static inline bool isCut(uchar ec)
+	{
+		return ec == 1 || ec == 2;
+	}
+
+	struct CPURows {
+		uint nx, ny, nz;
+		const uchar *volume;
+		float isoValue;
+		std::vector<uchar> edgeCases;
+		std::vector<uint> trim;			// x-edge trim, 2 per row
+		std::vector<uint> cellTrim;		// 2 per row
+		std::vector<uint> edges;		// x/y/z intersections and triangles, 4 per row
+		std::vector<uint> vertBase;
+		std::vector<uint> triBase;
+
+		const uchar *rowCases(uint r) const { return &edgeCases[r * (nx - 1)]; }
+		float sample(uint x, uint y, uint z) const { return volume[(z * ny + y) * nx + x] / 255.0f; }
+		uint inside(uint r, uint i) const { return (i < nx - 1) ? (rowCases(r)[i] & 1) : (rowCases(r)[nx - 2] >> 1); }
+
+		// see feTrim in marchingCubes_kernel.cl
+		void trimOf(const uint *rows, int n, uint &xl, uint &xr) const
+		{
+			const uchar *ec0 = rowCases(rows[0]);
+			xl = trim[2 * rows[0]];
+			xr = trim[2 * rows[0] + 1];
+			bool left = false, right = false;
+			for (int m = 1; m < n; m++) {
+				const uchar *ec = rowCases(rows[m]);
+				xl = MIN(xl, trim[2 * rows[m]]);
+				xr = MAX(xr, trim[2 * rows[m] + 1]);
+				left |= ((ec[0] ^ ec0[0]) & 1) != 0;
+				right |= ((ec[nx - 2] ^ ec0[nx - 2]) & 2) != 0;
+			}
+			if (left) xl = 0;
+			if (right) xr = nx - 1;
+		}
+	};
+
+	static inline int cubeIndexFromRows(uint r00, uint r10, uint r01, uint r11)
+	{
+		return r00 | ((r10 & 1) << 3) | ((r10 & 2) << 1) | (r01 << 4) | ((r11 & 1) << 7) | ((r11 & 2) << 5);
+	}
+
+	static inline void interp(float isoValue, const float p0[4], const float p1[4], float f0, float f1, float *out)
+	{
+		float t = (isoValue - f0) / (f1 - f0);
+		for (int c = 0; c < 4; c++) {
+			out[c] = p0[c] + t * (p1[c] - p0[c]);
+		}
+	}
+
+	// run fn(begin, end) over contiguous ranges of [0, n), rows are ordered by z so each range is a slab
+	template <class Fn>
+	static void parallelFor(int numThreads, uint n, Fn fn, ThreadInit threadInit, const void *threadInitArg)
+	{
+		if (numThreads <= 1 || n < 2) {
+			fn(0u, n);
+			return;
+		}
+		std::vector<std::thread> workers;
+		uint chunk = (n + numThreads - 1) / numThreads;
+		for (uint begin = 0; begin < n; begin += chunk) {
+			uint end = MIN(begin + chunk, n);
+			workers.push_back(std::thread([=]() {
+				if (threadInit) threadInit(threadInitArg);
+				fn(begin, end);
+			}));
+		}
+		for (size_t i = 0; i < workers.size(); ++i) {
+			workers[i].join();
+		}
+	}
+
+	static void xEdgesCPU(CPURows &rows, uint r)
+	{
+		uint nx = rows.nx;
+		uint y = r % rows.ny;
+		uint z = r / rows.ny;
+		uchar *ec = &rows.edgeCases[r * (nx - 1)];
+
+		uint inside0 = (rows.sample(0, y, z) < rows.isoValue);
+		uint xl = nx - 1, xr = 0, numX = 0;
+		for (uint i = 0; i < nx - 1; i++) {
+			uint inside1 = (rows.sample(i + 1, y, z) < rows.isoValue);
+			uchar c = (uchar)(inside0 | (inside1 << 1));
+			ec[i] = c;
+			if (isCut(c)) {
+				numX++;
+				xl = MIN(xl, i);
+				xr = i + 1;
+			}
+			inside0 = inside1;
+		}
+		rows.trim[2 * r] = xl;
+		rows.trim[2 * r + 1] = xr;
+		rows.edges[4 * r] = numX;
+	}
+
+	static void yzEdgesCPU(CPURows &rows, uint r)
+	{
+		uint ny = rows.ny, nz = rows.nz;
+		uint y = r % ny;
+		uint z = r / ny;
+		uint *counts = &rows.edges[4 * r];
+		counts[1] = counts[2] = counts[3] = 0;
+
+		uint ids[4];
+		uint xl, xr;
+		ids[0] = r;
+		if (y + 1 < ny) {
+			ids[1] = r + 1;
+			rows.trimOf(ids, 2, xl, xr);
+			for (uint i = xl; i <= xr; i++) counts[1] += (rows.inside(r, i) != rows.inside(ids[1], i));
+		}
+		if (z + 1 < nz) {
+			ids[1] = r + ny;
+			rows.trimOf(ids, 2, xl, xr);
+			for (uint i = xl; i <= xr; i++) counts[2] += (rows.inside(r, i) != rows.inside(ids[1], i));
+		}
+
+		xl = xr = 0;
+		if (y + 1 < ny && z + 1 < nz) {
+			ids[1] = r + 1;
+			ids[2] = r + ny;
+			ids[3] = r + ny + 1;
+			rows.trimOf(ids, 4, xl, xr);
+			const uchar *ec0 = rows.rowCases(r), *ec10 = rows.rowCases(ids[1]);
+			const uchar *ec01 = rows.rowCases(ids[2]), *ec11 = rows.rowCases(ids[3]);
+			for (uint i = xl; i < xr; i++) {
+				counts[3] += numVertsTable[cubeIndexFromRows(ec0[i], ec10[i], ec01[i], ec11[i])] / 3;
+			}
+		}
+		rows.cellTrim[2 * r] = xl;
+		rows.cellTrim[2 * r + 1] = xr;
+	}
+
+	static void generateCPU(const CPURows &rows, uint r, const float voxelSize[4], const float upperLeft[4],
+							float *points, uint *pointHash, uint *triIndices)
+	{
+		uint nx = rows.nx, ny = rows.ny, nz = rows.nz;
+		uint y = r % ny;
+		uint z = r / ny;
+		const uint *counts = &rows.edges[4 * r];
+		if (counts[0] + counts[1] + counts[2] + counts[3] == 0) return;
+
+		uint numPoints = nx * ny * nz;
+		uint rowPoint = r * nx;
+		float isoValue = rows.isoValue;
+		const uchar *ec0 = rows.rowCases(r);
+
+		float p0[4], p1[4];
+		p0[1] = upperLeft[1] + y * voxelSize[1];
+		p0[2] = upperLeft[2] + z * voxelSize[2];
+		p0[3] = 1.0f;
+
+		// intersections owned by the row: x, then y, then z
+		uint id = rows.vertBase[r];
+		for (uint i = rows.trim[2 * r]; i < rows.trim[2 * r + 1]; i++) {
+			if (!isCut(ec0[i])) continue;
+			p0[0] = upperLeft[0] + i * voxelSize[0];
+			p1[0] = p0[0] + voxelSize[0]; p1[1] = p0[1]; p1[2] = p0[2]; p1[3] = 1.0f;
+			interp(isoValue, p0, p1, rows.sample(i, y, z), rows.sample(i + 1, y, z), &points[4 * id]);
+			pointHash[id++] = rowPoint + i;
+		}
+
+		uint ids[4];
+		uint xl, xr;
+		ids[0] = r;
+		for (int axis = 1; axis <= 2; axis++) {
+			if (axis == 1 ? (y + 1 >= ny) : (z + 1 >= nz)) continue;
+			ids[1] = (axis == 1) ? r + 1 : r + ny;
+			rows.trimOf(ids, 2, xl, xr);
+			for (uint i = xl; i <= xr; i++) {
+				if (rows.inside(r, i) == rows.inside(ids[1], i)) continue;
+				p0[0] = upperLeft[0] + i * voxelSize[0];
+				p1[0] = p0[0]; p1[1] = p0[1]; p1[2] = p0[2]; p1[3] = 1.0f;
+				p1[axis] += voxelSize[axis];
+				float f1 = (axis == 1) ? rows.sample(i, y + 1, z) : rows.sample(i, y, z + 1);
+				interp(isoValue, p0, p1, rows.sample(i, y, z), f1, &points[4 * id]);
+				pointHash[id++] = rowPoint + i + axis * numPoints;
+			}
+		}
+
+		if (counts[3] == 0) return;
+
+		// triangles, one running counter per edge list of the four rows (see feGenerate)
+		uint r10 = r + 1, r01 = r + ny, r11 = r + ny + 1;
+		const uchar *ec10 = rows.rowCases(r10), *ec01 = rows.rowCases(r01), *ec11 = rows.rowCases(r11);
+		uint x00 = rows.vertBase[r], x10 = rows.vertBase[r10], x01 = rows.vertBase[r01], x11 = rows.vertBase[r11];
+		uint y00 = x00 + counts[0];
+		uint y01 = x01 + rows.edges[4 * r01];
+		uint z00 = y00 + counts[1];
+		uint z10 = x10 + rows.edges[4 * r10] + rows.edges[4 * r10 + 1];
+
+		uint tri = rows.triBase[r];
+		for (uint i = rows.cellTrim[2 * r]; i < rows.cellTrim[2 * r + 1]; i++) {
+			uint c00 = ec0[i], c10 = ec10[i], c01 = ec01[i], c11 = ec11[i];
+			uint yAt00 = (c00 ^ c10) & 1, yAt01 = (c01 ^ c11) & 1;
+			uint zAt00 = (c00 ^ c01) & 1, zAt10 = (c10 ^ c11) & 1;
+
+			int cubeindex = cubeIndexFromRows(c00, c10, c01, c11);
+			uint numVerts = numVertsTable[cubeindex];
+			if (numVerts > 0) {
+				uint edgeId[12] = { x00, y00 + yAt00, x10, y00, x01, y01 + yAt01, x11, y01,
+									z00, z00 + zAt00, z10 + zAt10, z10 };
+				for (uint v = 0; v < numVerts; v++) {
+					triIndices[tri * 3 + v] = edgeId[triTable[cubeindex][v]];
+				}
+				tri += numVerts / 3;
+			}
+
+			x00 += isCut((uchar)c00);
+			x10 += isCut((uchar)c10);
+			x01 += isCut((uchar)c01);
+			x11 += isCut((uchar)c11);
+			y00 += yAt00;
+			y01 += yAt01;
+			z00 += zAt00;
+			z10 += zAt10;
+		}
+	}
+
+	void extractCPU(const uchar *volume, const cl_uint gridSize[4], const cl_float voxelSize[4], const cl_float upperLeft[4],
+					float isoValue, int numThreads,
+					std::vector<float> &pos, std::vector<float> &normal, std::vector<uint> &vertexHash,
+					ThreadInit threadInit, const void *threadInitArg)
+	{
+		if (numThreads <= 0) {
+			numThreads = MAX((int)std::thread::hardware_concurrency(), 1);
+		}
+
+		CPURows rows;
+		rows.nx = gridSize[0];
+		rows.ny = gridSize[1];
+		rows.nz = gridSize[2];
+		rows.volume = volume;
+		rows.isoValue = isoValue;
+		uint numRows = rows.ny * rows.nz;
+		rows.edgeCases.resize((rows.nx - 1) * numRows);
+		rows.trim.resize(2 * numRows);
+		rows.cellTrim.resize(2 * numRows);
+		rows.edges.resize(4 * numRows);
+		rows.vertBase.resize(numRows);
+		rows.triBase.resize(numRows);
+
+		// passes 1 and 2
+		parallelFor(numThreads, numRows, [&rows](uint begin, uint end) {
+			for (uint r = begin; r < end; r++) xEdgesCPU(rows, r);
+		}, threadInit, threadInitArg);
+		parallelFor(numThreads, numRows, [&rows](uint begin, uint end) {
+			for (uint r = begin; r < end; r++) yzEdgesCPU(rows, r);
+		}, threadInit, threadInitArg);
+
+		// pass 3: row offsets
+		uint numPoints = 0, numTris = 0;
+		for (uint r = 0; r < numRows; r++) {
+			rows.vertBase[r] = numPoints;
+			rows.triBase[r] = numTris;
+			numPoints += rows.edges[4 * r] + rows.edges[4 * r + 1] + rows.edges[4 * r + 2];
+			numTris += rows.edges[4 * r + 3];
+		}
+
+		// pass 4
+		std::vector<float> points(4 * (size_t)numPoints);
+		std::vector<uint> pointHash(numPoints);
+		std::vector<uint> triIndices(3 * (size_t)numTris);
+		parallelFor(numThreads, numRows, [&](uint begin, uint end) {
+			for (uint r = begin; r < end; r++) {
+				generateCPU(rows, r, voxelSize, upperLeft, points.data(), pointHash.data(), triIndices.data());
+			}
+		}, threadInit, threadInitArg);
+
+		// expand to the flat shaded soup
+		pos.resize(12 * (size_t)numTris);
+		normal.resize(12 * (size_t)numTris);
+		vertexHash.resize(3 * (size_t)numTris);
+		parallelFor(numThreads, numTris, [&](uint begin, uint end) {
+			for (uint t = begin; t < end; t++) {
+				const float *v[3];
+				for (int m = 0; m < 3; m++) {
+					uint index = triIndices[3 * t + m];
+					v[m] = &points[4 * index];
+					for (int c = 0; c < 4; c++) pos[12 * t + 4 * m + c] = v[m][c];
+					vertexHash[3 * t + m] = pointHash[index];
+				}
+				float e0[3], e1[3], n[4];
+				for (int c = 0; c < 3; c++) {
+					e0[c] = v[1][c] - v[0][c];
+					e1[c] = v[2][c] - v[0][c];
+				}
+				n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+				n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+				n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+				n[3] = 0.0f;
+				for (int m = 0; m < 3; m++) {
+					for (int c = 0; c < 4; c++) normal[12 * t + 4 * m + c] = n[c];
+				}
+			}
+		}, threadInit, threadInitArg);
+	}
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_FLYINGEDGES {
+	// Flying Edges (Schroeder, Maynard, Geveci 2015), see the fe* kernels in marchingCubes_kernel.cl.
+	// Both engines write the same flat shaded triangle soup and edge hashes as generateTriangles2.
+
+	// kernels come from the marching cubes program, recreate them whenever it is rebuilt
+	cl_int createKernels(cl_program program);
+	void releaseKernels(void);
+
+	// per-row buffers for a grid of gridSize points, the point/triangle buffers grow on demand
+	cl_int init(cl_context context, const cl_uint gridSize[4]);
+	void close(void);
+
+	// OpenCL engine: x-edge pass, y/z-edge + trim pass, row scans, output pass and the
+	// expansion to pos/norm/vertexHash (3 vertices per triangle, at most maxVerts)
+	cl_int extract(cl_command_queue queue, cl_mem volume, cl_mem numVertsTex, cl_mem triTex,
+				   const cl_uint gridSize[4], const cl_float voxelSize[4], const cl_float upperLeft[4], float isoValue,
+				   cl_mem pos, cl_mem norm, cl_mem vertexHash, uint maxVerts, uint &totalVerts);
+
+	// called first on every worker thread of extractCPU, the NUMA path pins them with it
+	typedef void (*ThreadInit)(const void *arg);
+
+	// CPU engine on the normalized 8 bit volume, rows are split into contiguous z slabs,
+	// one per thread (numThreads <= 0 uses all hardware threads). The row arrays are
+	// allocated by the calling thread.
+	void extractCPU(const uchar *volume, const cl_uint gridSize[4], const cl_float voxelSize[4], const cl_float upperLeft[4],
+					float isoValue, int numThreads,
+					std::vector<float> &pos, std::vector<float> &normal, std::vector<uint> &vertexHash,
+					ThreadInit threadInit = NULL, const void *threadInitArg = NULL);
+};
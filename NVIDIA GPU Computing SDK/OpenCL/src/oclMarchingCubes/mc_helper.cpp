@@ -3,7 +3,7 @@
 #include <igl/writeOBJ.h>
 
 namespace MC_HELPER {
-	void saveMesh(std::string filename, std::vector<float> &verts, std::vector<float> &fNormals, std::vector<uint> &vHashes) {
+	bool saveMesh(std::string filename, std::vector<float> &verts, std::vector<float> &fNormals, std::vector<uint> &vHashes) {
 
 
 		//void getCompactMesh(std::vector<float> &verts,std::vector<float> &fNormals,std::vector<uint> &vHashes,
@@ -20,6 +20,7 @@ namespace MC_HELPER {
 		else {
 			printf("save %s failed!\n", filename.c_str());
 		}
+		return flag;
 	}
 
 	void getCompactMeshEigen(std::vector<float> &verts, std::vector<uint> &vHashes, std::vector<float> &fNormals, 
@@ -8,7 +8,8 @@ typedef unsigned int uint;
 
 
 namespace MC_HELPER {
-	void saveMesh(std::string filename, std::vector<float> &verts, std::vector<float> &fNormals, std::vector<uint> &vHashes);
+	// returns false when the file can't be written
+	bool saveMesh(std::string filename, std::vector<float> &verts, std::vector<float> &fNormals, std::vector<uint> &vHashes);
 
 	void getCompactMeshEigen(std::vector<float> &verts, std::vector<uint> &vHashes, std::vector<float> &fNormals,
 							Eigen::MatrixXf &V, Eigen::MatrixXi &F, Eigen::MatrixXf &vN, Eigen::MatrixXi &FN);
@@ -0,0 +1,134 @@
+#include "mc_histoPyramid.h"
+
+#include <oclUtils.h>
+
+namespace MC_HISTOPYRAMID {
+
+	static const size_t REDUCE_GROUP_SIZE = 128;
+
+	static cl_kernel reduceKernel = 0;
+	static cl_kernel traverseKernel = 0;
+
+	// level l: x, y, z = size in cells, w = offset into d_pyramid (unused for the base level)
+	static std::vector<cl_uint> levels;
+	static cl_uint numLevels = 0;
+	static cl_mem d_pyramid = 0;
+	static cl_mem d_levels = 0;
+
+	cl_int createKernels(cl_program program)
+	{
+		releaseKernels();
+
+		cl_int err = CL_SUCCESS;
+		reduceKernel = clCreateKernel(program, "hpReduce", &err);
+		if (err != CL_SUCCESS) return err;
+		traverseKernel = clCreateKernel(program, "hpGenerateTriangles", &err);
+		return err;
+	}
+
+	void releaseKernels(void)
+	{
+		if (reduceKernel) clReleaseKernel(reduceKernel);
+		if (traverseKernel) clReleaseKernel(traverseKernel);
+		reduceKernel = traverseKernel = 0;
+	}
+
+	cl_int init(cl_context context, const cl_uint gridSize[4])
+	{
+		close();
+
+		// halve every axis (rounding up) until a single cell is left
+		cl_uint dims[3] = { gridSize[0], gridSize[1], gridSize[2] };
+		cl_uint offset = 0;
+		levels.clear();
+		for (;;) {
+			levels.push_back(dims[0]);
+			levels.push_back(dims[1]);
+			levels.push_back(dims[2]);
+			levels.push_back(offset);
+			if (levels.size() > 4) {
+				offset += dims[0] * dims[1] * dims[2];
+			}
+			if (dims[0] == 1 && dims[1] == 1 && dims[2] == 1) break;
+			for (int a = 0; a < 3; a++) {
+				dims[a] = (dims[a] + 1) / 2;
+			}
+		}
+		numLevels = (cl_uint)(levels.size() / 4);
+
+		cl_int err = CL_SUCCESS;
+		d_pyramid = clCreateBuffer(context, CL_MEM_READ_WRITE, MAX(offset, 1u) * sizeof(cl_uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		d_levels = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, levels.size() * sizeof(cl_uint), &levels[0], &err);
+		return err;
+	}
+
+	void close(void)
+	{
+		if (d_pyramid) clReleaseMemObject(d_pyramid);
+		if (d_levels) clReleaseMemObject(d_levels);
+		d_pyramid = d_levels = 0;
+		numLevels = 0;
+	}
+
+	cl_int extract(cl_command_queue queue, cl_mem voxelVerts, cl_mem volume, cl_mem triTex,
+				   const cl_uint gridSize[4], const cl_uint gridSizeShift[4], const cl_float voxelSize[4],
+				   const cl_float upperLeft[4], float isoValue,
+				   cl_mem pos, cl_mem norm, cl_mem vertexHash, uint maxVerts, uint &totalVerts)
+	{
+		cl_int err = CL_SUCCESS;
+		size_t threads = REDUCE_GROUP_SIZE;
+		totalVerts = 0;
+
+		// bottom-up reduction, level 1 reads the classify output
+		for (cl_uint l = 1; l < numLevels; l++) {
+			const cl_uint *src = &levels[4 * (l - 1)];
+			const cl_uint *dst = &levels[4 * l];
+			cl_mem srcBuffer = (l == 1) ? voxelVerts : d_pyramid;
+			cl_uint srcOffset = (l == 1) ? 0 : src[3];
+			cl_uint numCells = dst[0] * dst[1] * dst[2];
+			size_t grid = (numCells + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE * REDUCE_GROUP_SIZE;
+
+			err |= clSetKernelArg(reduceKernel, 0, sizeof(cl_mem), &d_pyramid);
+			err |= clSetKernelArg(reduceKernel, 1, sizeof(cl_uint), &dst[3]);
+			err |= clSetKernelArg(reduceKernel, 2, sizeof(cl_mem), &srcBuffer);
+			err |= clSetKernelArg(reduceKernel, 3, sizeof(cl_uint), &srcOffset);
+			err |= clSetKernelArg(reduceKernel, 4, 4 * sizeof(cl_uint), dst);
+			err |= clSetKernelArg(reduceKernel, 5, 4 * sizeof(cl_uint), src);
+			err |= clEnqueueNDRangeKernel(queue, reduceKernel, 1, NULL, &grid, &threads, 0, 0, 0);
+			if (err != CL_SUCCESS) return err;
+		}
+
+		// the top cell holds the total
+		cl_mem topBuffer = (numLevels == 1) ? voxelVerts : d_pyramid;
+		cl_uint topOffset = (numLevels == 1) ? 0 : levels[4 * (numLevels - 1) + 3];
+		err = clEnqueueReadBuffer(queue, topBuffer, CL_TRUE, topOffset * sizeof(cl_uint), sizeof(cl_uint), &totalVerts, 0, 0, 0);
+		if (err != CL_SUCCESS || totalVerts == 0) return err;
+
+		// top-down traversal, one work-item per triangle
+		cl_uint numTris = totalVerts / 3;
+		size_t emitThreads = EMIT_THREADS;
+		size_t grid = (numTris + EMIT_THREADS - 1) / EMIT_THREADS * EMIT_THREADS;
+		int k = 0;
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(cl_mem), &pos);
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(cl_mem), &norm);
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(cl_mem), &vertexHash);
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(cl_mem), &voxelVerts);
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(cl_mem), &d_pyramid);
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(cl_mem), &d_levels);
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(cl_uint), &numLevels);
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(cl_mem), &volume);
+		err |= clSetKernelArg(traverseKernel, k++, 4 * sizeof(cl_uint), gridSize);
+		err |= clSetKernelArg(traverseKernel, k++, 4 * sizeof(cl_uint), gridSizeShift);
+		err |= clSetKernelArg(traverseKernel, k++, 4 * sizeof(cl_float), voxelSize);
+		err |= clSetKernelArg(traverseKernel, k++, 4 * sizeof(cl_float), upperLeft);
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(float), &isoValue);
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(cl_uint), &maxVerts);
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(cl_mem), &triTex);
+		err |= clSetKernelArg(traverseKernel, k++, sizeof(cl_uint), &numTris);
+		err |= clEnqueueNDRangeKernel(queue, traverseKernel, 1, NULL, &grid, &emitThreads, 0, 0, 0);
+
+		totalVerts = MIN(numTris * 3, maxVerts / 3 * 3);
+		return err;
+	}
+};
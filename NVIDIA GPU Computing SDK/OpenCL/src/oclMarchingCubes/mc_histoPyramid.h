@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_HISTOPYRAMID {
+	// HistoPyramid (Dyken, Ziegler, Theobalt, Seidel 2008), see the hp* kernels in marchingCubes_kernel.cl.
+	// The base level is the per-voxel vertex count written by classify, every level above
+	// sums 2x2x2 cells of the one below up to a single cell holding the total vertex count.
+	// Each output triangle then finds its voxel by a top-down traversal, so no scan or
+	// compaction over all voxels is needed.
+
+	// kernels come from the marching cubes program, recreate them whenever it is rebuilt
+	cl_int createKernels(cl_program program);
+	void releaseKernels(void);
+
+	// level layout for a grid of gridSize voxels, levels 1..top share one buffer
+	cl_int init(cl_context context, const cl_uint gridSize[4]);
+	void close(void);
+
+	// reduce voxelVerts into the pyramid, then emit one triangle per work-item into
+	// pos/norm/vertexHash (same layout as generateTriangles2, at most maxVerts)
+	cl_int extract(cl_command_queue queue, cl_mem voxelVerts, cl_mem volume, cl_mem triTex,
+				   const cl_uint gridSize[4], const cl_uint gridSizeShift[4], const cl_float voxelSize[4],
+				   const cl_float upperLeft[4], float isoValue,
+				   cl_mem pos, cl_mem norm, cl_mem vertexHash, uint maxVerts, uint &totalVerts);
+};
@@ -0,0 +1,273 @@
+#include "mc_labels.h"
+
+#include <algorithm>
+
+#include <oclUtils.h>
+
+#include "ScanApple.h"
+#include "mc_profile.h"
+
+namespace MC_LABELS {
+
+	static cl_kernel classifyLabelsKernel = 0;
+	static cl_kernel scatterLabelPairsKernel = 0;
+	static cl_kernel generateLabelTrianglesKernel = 0;
+
+	static cl_context cxContext = 0;
+	static cl_mem d_labelCells = 0;		// cells of each label
+	static cl_mem d_labelCursor = 0;	// next pair of each label
+	static cl_mem d_labelVerts = 0;		// vertices of each label
+	static cl_mem d_pairVoxel = 0;		// (cell, label) pairs in label order
+	static cl_mem d_pairCode = 0;		// label << 8 | cube index
+	static cl_mem d_pairVerts = 0;
+	static cl_mem d_pairVertsScan = 0;
+	static uint pairCapacity = 0;
+	static std::vector<uint> labelVertStart(MAX_LABELS + 1, 0);
+
+	static void releaseMem(cl_mem &buffer)
+	{
+		if (buffer) clReleaseMemObject(buffer);
+		buffer = 0;
+	}
+
+	cl_int createKernels(cl_program program)
+	{
+		releaseKernels();
+
+		cl_int err = CL_SUCCESS;
+		classifyLabelsKernel = clCreateKernel(program, "classifyLabels", &err);
+		if (err != CL_SUCCESS) return err;
+		scatterLabelPairsKernel = clCreateKernel(program, "scatterLabelPairs", &err);
+		if (err != CL_SUCCESS) return err;
+		generateLabelTrianglesKernel = clCreateKernel(program, "generateLabelTriangles", &err);
+		return err;
+	}
+
+	void releaseKernels(void)
+	{
+		if (classifyLabelsKernel) clReleaseKernel(classifyLabelsKernel);
+		if (scatterLabelPairsKernel) clReleaseKernel(scatterLabelPairsKernel);
+		if (generateLabelTrianglesKernel) clReleaseKernel(generateLabelTrianglesKernel);
+		classifyLabelsKernel = scatterLabelPairsKernel = generateLabelTrianglesKernel = 0;
+	}
+
+	cl_int init(cl_context context)
+	{
+		close();
+		cxContext = context;
+
+		cl_int err = CL_SUCCESS;
+		d_labelCells = clCreateBuffer(context, CL_MEM_READ_WRITE, MAX_LABELS * sizeof(uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		d_labelCursor = clCreateBuffer(context, CL_MEM_READ_WRITE, MAX_LABELS * sizeof(uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		d_labelVerts = clCreateBuffer(context, CL_MEM_READ_WRITE, MAX_LABELS * sizeof(uint), 0, &err);
+		return err;
+	}
+
+	void close(void)
+	{
+		releaseMem(d_labelCells);
+		releaseMem(d_labelCursor);
+		releaseMem(d_labelVerts);
+		releaseMem(d_pairVoxel);
+		releaseMem(d_pairCode);
+		releaseMem(d_pairVerts);
+		releaseMem(d_pairVertsScan);
+		pairCapacity = 0;
+		std::fill(labelVertStart.begin(), labelVertStart.end(), 0);
+	}
+
+	// grow the pair buffers to hold numPairs pairs
+	static cl_int reserve(uint numPairs)
+	{
+		if (numPairs <= pairCapacity) {
+			return CL_SUCCESS;
+		}
+		cl_mem *buffers[] = { &d_pairVoxel, &d_pairCode, &d_pairVerts, &d_pairVertsScan };
+		pairCapacity = 0;
+		uint capacity = MAX(numPairs + numPairs / 2, 1024u);
+		cl_int err = CL_SUCCESS;
+		for (int b = 0; b < 4; b++) {
+			releaseMem(*buffers[b]);
+			*buffers[b] = clCreateBuffer(cxContext, CL_MEM_READ_WRITE, capacity * sizeof(uint), 0, &err);
+			if (err != CL_SUCCESS) return err;
+		}
+		pairCapacity = capacity;
+		return err;
+	}
+
+	static cl_int classifyLabels(cl_command_queue queue, cl_mem volume, const cl_uint gridSize[4], const cl_uint gridSizeShift[4],
+								 uint numVoxels, cl_mem compVoxelArray, cl_mem compLabels, cl_mem appendCount, uint threads)
+	{
+		int k = 0;
+		cl_int err = clSetKernelArg(classifyLabelsKernel, k++, sizeof(cl_mem), &compVoxelArray);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(classifyLabelsKernel, k++, sizeof(cl_mem), &compLabels);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(classifyLabelsKernel, k++, sizeof(cl_mem), &appendCount);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(classifyLabelsKernel, k++, sizeof(cl_mem), &d_labelCells);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(classifyLabelsKernel, k++, sizeof(cl_mem), &volume);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(classifyLabelsKernel, k++, 4 * sizeof(cl_uint), gridSize);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(classifyLabelsKernel, k++, 4 * sizeof(cl_uint), gridSizeShift);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(classifyLabelsKernel, k++, sizeof(uint), &numVoxels);
+		if (err != CL_SUCCESS) return err;
+
+		size_t localSize = threads;
+		size_t globalSize = (numVoxels + threads - 1) / threads * threads;
+		return clEnqueueNDRangeKernel(queue, classifyLabelsKernel, 1, NULL, &globalSize, &localSize, 0, 0,
+									  MC_PROFILE::event("classifyLabels", (double)numVoxels * sizeof(uchar)));
+	}
+
+	static cl_int scatterLabelPairs(cl_command_queue queue, cl_mem numVertsTable, cl_mem compVoxelArray, cl_mem compLabels,
+									uint activeCells, uint numPairs, uint threads)
+	{
+		int k = 0;
+		cl_int err = clSetKernelArg(scatterLabelPairsKernel, k++, sizeof(cl_mem), &compVoxelArray);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(scatterLabelPairsKernel, k++, sizeof(cl_mem), &compLabels);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(scatterLabelPairsKernel, k++, sizeof(uint), &activeCells);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(scatterLabelPairsKernel, k++, sizeof(cl_mem), &d_labelCursor);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(scatterLabelPairsKernel, k++, sizeof(cl_mem), &d_labelVerts);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(scatterLabelPairsKernel, k++, sizeof(cl_mem), &d_pairVoxel);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(scatterLabelPairsKernel, k++, sizeof(cl_mem), &d_pairCode);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(scatterLabelPairsKernel, k++, sizeof(cl_mem), &d_pairVerts);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(scatterLabelPairsKernel, k++, sizeof(cl_mem), &numVertsTable);
+		if (err != CL_SUCCESS) return err;
+
+		size_t localSize = threads;
+		size_t globalSize = (activeCells + threads - 1) / threads * threads;
+		return clEnqueueNDRangeKernel(queue, scatterLabelPairsKernel, 1, NULL, &globalSize, &localSize, 0, 0,
+									  MC_PROFILE::event("scatterLabelPairs", (double)activeCells * 3 * sizeof(uint) + (double)numPairs * 3 * sizeof(uint)));
+	}
+
+	cl_int compact(cl_command_queue queue, cl_mem volume, cl_mem numVertsTable,
+				   const cl_uint gridSize[4], const cl_uint gridSizeShift[4], uint numVoxels,
+				   cl_mem compVoxelArray, cl_mem compLabels, cl_mem appendCount,
+				   uint classifyThreads, uint compactThreads, uint maxVerts, uint &numPairs, uint &totalVerts)
+	{
+		static const uint zeros[MAX_LABELS] = { 0 };
+		std::fill(labelVertStart.begin(), labelVertStart.end(), 0);
+		numPairs = 0;
+		totalVerts = 0;
+
+		cl_int err = clEnqueueWriteBuffer(queue, appendCount, CL_FALSE, 0, sizeof(uint), zeros, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueWriteBuffer(queue, d_labelCells, CL_FALSE, 0, sizeof(zeros), zeros, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+		err = classifyLabels(queue, volume, gridSize, gridSizeShift, numVoxels, compVoxelArray, compLabels, appendCount, classifyThreads);
+		if (err != CL_SUCCESS) return err;
+
+		uint activeCells = 0;
+		uint labelPairStart[MAX_LABELS];
+		err = clEnqueueReadBuffer(queue, appendCount, CL_FALSE, 0, sizeof(uint), &activeCells, 0, 0,
+								  MC_PROFILE::event("readback activeVoxels", sizeof(uint)));
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueReadBuffer(queue, d_labelCells, CL_TRUE, 0, sizeof(labelPairStart), labelPairStart, 0, 0,
+								  MC_PROFILE::event("readback labelCells", sizeof(labelPairStart)));
+		if (err != CL_SUCCESS) return err;
+
+		// the histogram is tiny, its exclusive scan is done here
+		uint pairs = 0;
+		for (int l = 0; l < MAX_LABELS; l++) {
+			uint cells = labelPairStart[l];
+			labelPairStart[l] = pairs;
+			pairs += cells;
+		}
+		if (pairs == 0) {
+			return CL_SUCCESS;
+		}
+		err = reserve(pairs);
+		if (err != CL_SUCCESS) return err;
+
+		uint labelVerts[MAX_LABELS];
+		err = clEnqueueWriteBuffer(queue, d_labelCursor, CL_FALSE, 0, sizeof(labelPairStart), labelPairStart, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueWriteBuffer(queue, d_labelVerts, CL_FALSE, 0, sizeof(zeros), zeros, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+		err = scatterLabelPairs(queue, numVertsTable, compVoxelArray, compLabels, activeCells, pairs, compactThreads);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueReadBuffer(queue, d_labelVerts, CL_TRUE, 0, sizeof(labelVerts), labelVerts, 0, 0,
+								  MC_PROFILE::event("readback labelVerts", sizeof(labelVerts)));
+		if (err != CL_SUCCESS) return err;
+
+		MC_PROFILE::setScope("scan verts");
+		MeshProc::scanApple::ScanAPPLEProcess(d_pairVertsScan, d_pairVerts, pairs);
+
+		for (int l = 0; l < MAX_LABELS; l++) {
+			labelVertStart[l + 1] = labelVertStart[l] + labelVerts[l];
+		}
+		numPairs = pairs;
+		totalVerts = labelVertStart[MAX_LABELS];
+
+		// the vertex buffers hold maxVerts vertices, generate drops the triangles past them
+		if (totalVerts > maxVerts) {
+			shrLog("-labels: %u vertices don't fit the %u of the vertex buffers, keeping the first\n", totalVerts, maxVerts);
+			totalVerts = maxVerts - maxVerts % 3;
+			for (int l = 0; l <= MAX_LABELS; l++) {
+				labelVertStart[l] = MIN(labelVertStart[l], totalVerts);
+			}
+		}
+		return CL_SUCCESS;
+	}
+
+	cl_int generate(cl_command_queue queue, cl_mem numVertsTable, cl_mem triTex, uint numPairs,
+					const cl_uint gridSize[4], const cl_uint gridSizeShift[4], const cl_uint gridSizeMask[4],
+					const cl_float voxelSize[4], const cl_float upperLeft[4],
+					cl_mem pos, cl_mem norm, cl_mem vertexHash, uint maxVerts, uint threads)
+	{
+		int k = 0;
+		cl_int err = clSetKernelArg(generateLabelTrianglesKernel, k++, sizeof(cl_mem), &pos);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, sizeof(cl_mem), &norm);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, sizeof(cl_mem), &d_pairVoxel);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, sizeof(cl_mem), &d_pairCode);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, sizeof(cl_mem), &d_pairVertsScan);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, sizeof(uint), &numPairs);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, 4 * sizeof(cl_uint), gridSize);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, 4 * sizeof(cl_uint), gridSizeShift);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, 4 * sizeof(cl_uint), gridSizeMask);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, 4 * sizeof(float), voxelSize);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, 4 * sizeof(float), upperLeft);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, sizeof(uint), &maxVerts);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, sizeof(cl_mem), &numVertsTable);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, sizeof(cl_mem), &triTex);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(generateLabelTrianglesKernel, k++, sizeof(cl_mem), &vertexHash);
+		if (err != CL_SUCCESS) return err;
+
+		size_t localSize = threads;
+		size_t globalSize = (numPairs + threads - 1) / threads * threads;
+		return clEnqueueNDRangeKernel(queue, generateLabelTrianglesKernel, 1, NULL, &globalSize, &localSize, 0, 0,
+									  MC_PROFILE::event("generateLabelTriangles", (double)numPairs * 3 * sizeof(uint) + (double)labelVertStart[MAX_LABELS] * 9 * sizeof(float)));
+	}
+
+	const std::vector<uint> &vertStart(void)
+	{
+		return labelVertStart;
+	}
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_LABELS {
+	// Label maps (-labels), see classifyLabels, scatterLabelPairs and generateLabelTriangles in
+	// marchingCubes_kernel.cl. The volume holds integer labels 0..255, 0 is the background, and
+	// one pass extracts the boundary of every other label l into its own run of the vertex
+	// buffers, vertStart()[l] <= vertex < vertStart()[l + 1].
+	// The label map is classified once into the cells with more than one label and a label
+	// histogram, then a (cell, label) pair is written for every nonzero label of those cells,
+	// grouped by label. The scan over the pairs is a scan of each label's segment plus the
+	// vertices of the labels before it.
+
+	static const int MAX_LABELS = 256;
+
+	// kernels come from the marching cubes program, recreate them whenever it is rebuilt
+	cl_int createKernels(cl_program program);
+	void releaseKernels(void);
+
+	// per-label counters, the pair buffers grow with the pairs of each pass
+	cl_int init(cl_context context);
+	void close(void);
+
+	// classify, scatter and scan the pairs. compVoxelArray and compLabels hold one entry per
+	// voxel, numPairs is the number of pairs and totalVerts their vertices, clamped to
+	// the whole triangles of maxVerts.
+	cl_int compact(cl_command_queue queue, cl_mem volume, cl_mem numVertsTable,
+				   const cl_uint gridSize[4], const cl_uint gridSizeShift[4], uint numVoxels,
+				   cl_mem compVoxelArray, cl_mem compLabels, cl_mem appendCount,
+				   uint classifyThreads, uint compactThreads, uint maxVerts, uint &numPairs, uint &totalVerts);
+
+	// emit the triangles of the pairs of the last compact into pos/norm/vertexHash (same
+	// layout as generateTriangles2, at most maxVerts)
+	cl_int generate(cl_command_queue queue, cl_mem numVertsTable, cl_mem triTex, uint numPairs,
+					const cl_uint gridSize[4], const cl_uint gridSizeShift[4], const cl_uint gridSizeMask[4],
+					const cl_float voxelSize[4], const cl_float upperLeft[4],
+					cl_mem pos, cl_mem norm, cl_mem vertexHash, uint maxVerts, uint threads);
+
+	// MAX_LABELS + 1 vertex offsets of the last compact
+	const std::vector<uint> &vertStart(void);
+};
@@ -0,0 +1,129 @@
+#include "mc_lod.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include <oclUtils.h>
+
+namespace MC_LOD {
+
+	static std::vector<Level> levels;
+
+	int numLevels(const cl_uint gridSize[4], int maxLevels)
+	{
+		cl_uint dims[3] = { gridSize[0], gridSize[1], gridSize[2] };
+		int n = 1;
+		while (n < maxLevels) {
+			for (int a = 0; a < 3; a++) {
+				dims[a] = (dims[a] + 1) / 2;
+			}
+			if (dims[0] < 2 || dims[1] < 2 || dims[2] < 2) break;
+			n++;
+		}
+		return n;
+	}
+
+	cl_int build(cl_context context, cl_command_queue queue, cl_program program,
+				 const uchar *samples, cl_mem volume, const cl_uint gridSize[4], int numLevels, bool images)
+	{
+		release();
+		Level base;
+		base.volume = volume;
+		memcpy(base.gridSize, gridSize, sizeof(base.gridSize));
+		base.voxelScale = 1.0f;
+		base.originShift = 0.0f;
+		levels.push_back(base);
+
+		cl_int err;
+		size_t size = (size_t)gridSize[0] * gridSize[1] * gridSize[2];
+		cl_mem src = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, size, (void *)samples, &err);
+		if (err != CL_SUCCESS) return err;
+		cl_kernel kernel = clCreateKernel(program, "downsampleVolume", &err);
+		if (err != CL_SUCCESS) {
+			clReleaseMemObject(src);
+			return err;
+		}
+
+		// the linear levels are the sources of the next ones, image levels get a copy
+		bool srcOwned = true;
+		for (int l = 1; l < numLevels && err == CL_SUCCESS; l++) {
+			const Level &prev = levels.back();
+			Level level;
+			for (int a = 0; a < 3; a++) {
+				level.gridSize[a] = (prev.gridSize[a] + 1) / 2;
+			}
+			level.gridSize[3] = 0;
+			level.voxelScale = prev.voxelScale * 2.0f;
+			level.originShift = (level.voxelScale - 1.0f) * 0.5f;
+
+			size_t n = (size_t)level.gridSize[0] * level.gridSize[1] * level.gridSize[2];
+			cl_mem dst = clCreateBuffer(context, CL_MEM_READ_WRITE, n, 0, &err);
+			if (err != CL_SUCCESS) break;
+
+			int k = 0;
+			err = clSetKernelArg(kernel, k++, sizeof(cl_mem), &src);
+			err |= clSetKernelArg(kernel, k++, sizeof(cl_mem), &dst);
+			err |= clSetKernelArg(kernel, k++, 4 * sizeof(cl_uint), prev.gridSize);
+			err |= clSetKernelArg(kernel, k++, 4 * sizeof(cl_uint), level.gridSize);
+			size_t global[3] = { level.gridSize[0], level.gridSize[1], level.gridSize[2] };
+			if (err == CL_SUCCESS) {
+				err = clEnqueueNDRangeKernel(queue, kernel, 3, NULL, global, NULL, 0, 0, 0);
+			}
+
+			if (images) {
+				cl_image_format format;
+				format.image_channel_order = CL_R;
+				format.image_channel_data_type = CL_UNORM_INT8;
+				cl_int imageErr;
+				level.volume = clCreateImage3D(context, CL_MEM_READ_ONLY, &format, level.gridSize[0], level.gridSize[1],
+											   level.gridSize[2], 0, 0, 0, &imageErr);
+				err |= imageErr;
+				if (err == CL_SUCCESS) {
+					size_t origin[3] = { 0, 0, 0 };
+					err = clEnqueueCopyBufferToImage(queue, dst, level.volume, 0, origin, global, 0, 0, 0);
+				}
+			} else {
+				level.volume = dst;
+			}
+			if (level.volume) {
+				levels.push_back(level);
+			}
+
+			if (srcOwned) {
+				err |= clFinish(queue);
+				clReleaseMemObject(src);
+			}
+			src = dst;
+			srcOwned = images;
+		}
+		if (srcOwned) {
+			err |= clFinish(queue);
+			clReleaseMemObject(src);
+		}
+		clReleaseKernel(kernel);
+
+		if (err != CL_SUCCESS) {
+			release();
+		}
+		return err;
+	}
+
+	int count()
+	{
+		return (int)levels.size();
+	}
+
+	const Level &level(int l)
+	{
+		return levels[CLAMP(l, 0, (int)levels.size() - 1)];
+	}
+
+	void release()
+	{
+		for (size_t l = 1; l < levels.size(); l++) {
+			clReleaseMemObject(levels[l].volume);
+		}
+		levels.clear();
+	}
+};
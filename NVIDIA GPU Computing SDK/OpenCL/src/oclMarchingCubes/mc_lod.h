@@ -0,0 +1,31 @@
+#pragma once
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_LOD {
+	// Mip pyramid of the volume for coarse extraction (-lod, -progressive). Level l + 1 holds the
+	// mean of 2 x 2 x 2 samples of level l, so its grid point i sits at the center of the level 0
+	// points [i 2^l, (i + 1) 2^l - 1]: the voxels are 2^l times larger and the origin moves by
+	// (2^l - 1) / 2 level 0 voxels. Each level has about 1/8 of the voxels of the one below.
+	struct Level {
+		cl_mem volume;			// UNORM_INT8 image or linear uchar buffer, level 0 is the caller's
+		cl_uint gridSize[4];
+		float voxelScale;		// 2^l
+		float originShift;		// (2^l - 1) / 2
+	};
+
+	// number of levels up to maxLevels that keep at least 2 points on every axis
+	int numLevels(const cl_uint gridSize[4], int maxLevels);
+
+	// level 0 is "volume" with the linear uchar "samples" of gridSize, the others are built from
+	// them with downsampleVolume of program, as images if "images" is set
+	cl_int build(cl_context context, cl_command_queue queue, cl_program program,
+				 const uchar *samples, cl_mem volume, const cl_uint gridSize[4], int numLevels, bool images);
+
+	int count();
+	const Level &level(int l);
+
+	// releases the levels above 0
+	void release();
+};
@@ -0,0 +1,359 @@
+#include "mc_numa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#elif defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+#include <oclUtils.h>
+
+#include "mc_flyingEdges.h"
+
+namespace MC_NUMA {
+
+	// bytes of the bandwidth buffer of every node
+	static const size_t BANDWIDTH_BYTES = 256 << 20;
+
+	struct Slab {
+		Node node;
+		int threads;
+		cl_uint z0, z1;				// cells [z0, z1), points [z0, z1]
+		std::vector<uchar> volume;
+		std::vector<float> pos;
+		std::vector<float> normal;
+		std::vector<uint> vertexHash;
+		double time;
+	};
+
+	static std::vector<Slab> slabs;
+	static cl_uint grid[4];
+
+	Config::Config() : maxNodes(0), threadsPerNode(0), pin(true) {}
+
+	// "0-7,16-23"
+	static bool parseCPUList(const char *list, std::vector<int> &cpus)
+	{
+		cpus.clear();
+		const char *c = list;
+		while (*c && *c != '\n') {
+			char *end;
+			long first = strtol(c, &end, 10);
+			if (end == c || first < 0) return false;
+			long last = first;
+			c = end;
+			if (*c == '-') {
+				last = strtol(c + 1, &end, 10);
+				if (end == c + 1 || last < first) return false;
+				c = end;
+			}
+			for (long cpu = first; cpu <= last; cpu++) {
+				cpus.push_back((int)cpu);
+			}
+			if (*c == ',') c++;
+		}
+		return !cpus.empty();
+	}
+
+	static std::vector<Node> systemTopology(void)
+	{
+		std::vector<Node> nodes;
+#if defined(_WIN32)
+		ULONG highest = 0;
+		if (GetNumaHighestNodeNumber(&highest)) {
+			for (ULONG n = 0; n <= highest; n++) {
+				ULONGLONG mask = 0;
+				if (!GetNumaNodeProcessorMask((UCHAR)n, &mask) || mask == 0) continue;
+				Node node;
+				node.id = (int)n;
+				for (int cpu = 0; cpu < 64; cpu++) {
+					if (mask & (1ull << cpu)) node.cpus.push_back(cpu);
+				}
+				nodes.push_back(node);
+			}
+		}
+#elif defined(__linux__)
+		std::vector<int> ids;
+		char line[4096];
+		FILE *f = fopen("/sys/devices/system/node/online", "r");
+		if (f) {
+			if (fgets(line, sizeof(line), f)) parseCPUList(line, ids);
+			fclose(f);
+		}
+		for (size_t i = 0; i < ids.size(); i++) {
+			char path[128];
+			sprintf(path, "/sys/devices/system/node/node%d/cpulist", ids[i]);
+			f = fopen(path, "r");
+			if (!f) continue;
+			Node node;
+			node.id = ids[i];
+			if (fgets(line, sizeof(line), f) && parseCPUList(line, node.cpus)) {
+				nodes.push_back(node);
+			}
+			fclose(f);
+		}
+#endif
+		if (nodes.empty()) {
+			Node node;
+			node.id = 0;
+			int numCPUs = MAX((int)std::thread::hardware_concurrency(), 1);
+			for (int cpu = 0; cpu < numCPUs; cpu++) {
+				node.cpus.push_back(cpu);
+			}
+			nodes.push_back(node);
+		}
+		return nodes;
+	}
+
+	std::vector<Node> topology(const Config &config)
+	{
+		std::vector<Node> nodes;
+		if (!config.topology.empty()) {
+			std::string list = config.topology;
+			size_t begin = 0;
+			while (begin <= list.size()) {
+				size_t end = list.find(':', begin);
+				if (end == std::string::npos) end = list.size();
+				Node node;
+				node.id = (int)nodes.size();
+				if (parseCPUList(list.substr(begin, end - begin).c_str(), node.cpus)) {
+					nodes.push_back(node);
+				} else {
+					shrLog("numa: ignoring node '%s' of -numatopology\n", list.substr(begin, end - begin).c_str());
+				}
+				begin = end + 1;
+			}
+		}
+		if (nodes.empty()) {
+			nodes = systemTopology();
+		}
+		if (config.maxNodes > 0 && nodes.size() > (size_t)config.maxNodes) {
+			nodes.resize(config.maxNodes);
+		}
+		return nodes;
+	}
+
+	void logTopology(const std::vector<Node> &nodes)
+	{
+		for (size_t n = 0; n < nodes.size(); n++) {
+			std::string list;
+			char cpu[16];
+			for (size_t c = 0; c < nodes[n].cpus.size(); c++) {
+				sprintf(cpu, c ? ",%d" : "%d", nodes[n].cpus[c]);
+				list += cpu;
+			}
+			shrLog("numa: node %d, %u CPUs (%s)\n", nodes[n].id, (uint)nodes[n].cpus.size(), list.c_str());
+		}
+	}
+
+	bool pinThread(const std::vector<int> &cpus)
+	{
+#if defined(_WIN32)
+		DWORD_PTR mask = 0;
+		for (size_t c = 0; c < cpus.size(); c++) {
+			if (cpus[c] < (int)(8 * sizeof(DWORD_PTR))) mask |= (DWORD_PTR)1 << cpus[c];
+		}
+		return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (size_t c = 0; c < cpus.size(); c++) {
+			if (cpus[c] < CPU_SETSIZE) CPU_SET(cpus[c], &set);
+		}
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+		return false;
+#endif
+	}
+
+	static void pinWorker(const void *arg)
+	{
+		pinThread(*(const std::vector<int> *)arg);
+	}
+
+	static int threadsOf(const Node &node, const Config &config)
+	{
+		int threads = (config.threadsPerNode > 0) ? config.threadsPerNode : (int)node.cpus.size();
+		return MAX(threads, 1);
+	}
+
+	// one thread per slab, pinned to its node when asked
+	template <class Fn>
+	static void forEachSlab(bool pin, Fn fn)
+	{
+		std::vector<std::thread> threads;
+		for (size_t s = 0; s < slabs.size(); s++) {
+			threads.push_back(std::thread([&, s]() {
+				if (pin) pinThread(slabs[s].node.cpus);
+				fn(slabs[s]);
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++) {
+			threads[t].join();
+		}
+	}
+
+	static bool pinSlabs = true;
+
+	void init(const std::vector<Node> &nodes, const Config &config, const uchar *volume, const cl_uint gridSize[4])
+	{
+		close();
+		if (nodes.empty() || !volume || gridSize[2] < 2) return;
+		memcpy(grid, gridSize, sizeof(grid));
+		pinSlabs = config.pin;
+
+		// cells in proportion to the threads of the node
+		uint totalThreads = 0;
+		for (size_t n = 0; n < nodes.size(); n++) {
+			totalThreads += threadsOf(nodes[n], config);
+		}
+		cl_uint numCells = gridSize[2] - 1;
+		uint threads = 0;
+		cl_uint z0 = 0;
+		for (size_t n = 0; n < nodes.size(); n++) {
+			threads += threadsOf(nodes[n], config);
+			cl_uint z1 = (cl_uint)((unsigned long long)numCells * threads / totalThreads);
+			if (z1 <= z0) continue;
+			Slab slab;
+			slab.node = nodes[n];
+			slab.threads = threadsOf(nodes[n], config);
+			slab.z0 = z0;
+			slab.z1 = z1;
+			slab.time = 0.0;
+			slabs.push_back(slab);
+			z0 = z1;
+		}
+
+		// first touch on the owning node
+		size_t plane = (size_t)gridSize[0] * gridSize[1];
+		forEachSlab(pinSlabs, [&](Slab &slab) {
+			slab.volume.assign(volume + slab.z0 * plane, volume + (slab.z1 + 1) * plane);
+		});
+		for (size_t s = 0; s < slabs.size(); s++) {
+			shrLog("numa: node %d extracts z %u..%u with %d threads\n", slabs[s].node.id, slabs[s].z0, slabs[s].z1, slabs[s].threads);
+		}
+	}
+
+	void close(void)
+	{
+		slabs.clear();
+	}
+
+	bool ready(void)
+	{
+		return !slabs.empty();
+	}
+
+	void extract(const cl_float voxelSize[4], const cl_float upperLeft[4], float isoValue,
+				 std::vector<float> &pos, std::vector<float> &normal, std::vector<uint> &vertexHash)
+	{
+		pos.clear();
+		normal.clear();
+		vertexHash.clear();
+
+		uint gridPoints = grid[0] * grid[1] * grid[2];
+		forEachSlab(pinSlabs, [&](Slab &slab) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			cl_uint slabGrid[4] = { grid[0], grid[1], slab.z1 - slab.z0 + 1, 0 };
+			cl_float slabUpperLeft[4] = { upperLeft[0], upperLeft[1], upperLeft[2] + slab.z0 * voxelSize[2], upperLeft[3] };
+			MC_FLYINGEDGES::extractCPU(slab.volume.data(), slabGrid, voxelSize, slabUpperLeft, isoValue, slab.threads,
+									   slab.pos, slab.normal, slab.vertexHash,
+									   pinSlabs ? pinWorker : NULL, &slab.node.cpus);
+
+			// point + axis * numPoints of the slab grid -> the full grid
+			uint slabPoints = slabGrid[0] * slabGrid[1] * slabGrid[2];
+			uint pointOffset = slab.z0 * grid[0] * grid[1];
+			for (size_t v = 0; v < slab.vertexHash.size(); v++) {
+				uint h = slab.vertexHash[v];
+				slab.vertexHash[v] = (h / slabPoints) * gridPoints + (h % slabPoints) + pointOffset;
+			}
+			slab.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		});
+
+		for (size_t s = 0; s < slabs.size(); s++) {
+			pos.insert(pos.end(), slabs[s].pos.begin(), slabs[s].pos.end());
+			normal.insert(normal.end(), slabs[s].normal.begin(), slabs[s].normal.end());
+			vertexHash.insert(vertexHash.end(), slabs[s].vertexHash.begin(), slabs[s].vertexHash.end());
+		}
+	}
+
+	// every worker reads its own node local share, all of them start together
+	static double bandwidth(const std::vector<Node> &nodes, size_t numNodes, const Config &config)
+	{
+		const int nIter = 10;
+		std::atomic<int> ready(0);
+		std::atomic<unsigned long long> checksum(0);
+		int numWorkers = 0;
+		for (size_t n = 0; n < numNodes; n++) {
+			numWorkers += threadsOf(nodes[n], config);
+		}
+
+		std::chrono::steady_clock::time_point start;
+		std::vector<std::thread> workers;
+		for (size_t n = 0; n < numNodes; n++) {
+			int threads = threadsOf(nodes[n], config);
+			size_t count = BANDWIDTH_BYTES / threads / sizeof(unsigned long long);
+			for (int t = 0; t < threads; t++) {
+				workers.push_back(std::thread([&, n, count]() {
+					if (config.pin) pinThread(nodes[n].cpus);
+					std::vector<unsigned long long> data(count, 1);
+					if (++ready == numWorkers) {
+						start = std::chrono::steady_clock::now();
+						++ready;
+					}
+					while (ready.load() <= numWorkers) {
+						std::this_thread::yield();
+					}
+					unsigned long long sum = 0;
+					for (int i = 0; i < nIter; i++) {
+						for (size_t e = 0; e < count; e++) sum += data[e];
+					}
+					checksum += sum;
+				}));
+			}
+		}
+		for (size_t t = 0; t < workers.size(); t++) {
+			workers[t].join();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return (double)BANDWIDTH_BYTES * numNodes * nIter / seconds;
+	}
+
+	void benchmark(const std::vector<Node> &nodes, const Config &config, const uchar *volume, const cl_uint gridSize[4],
+				   const cl_float voxelSize[4], const cl_float upperLeft[4], float isoValue)
+	{
+		const int nIter = 10;
+		std::vector<float> pos, normal;
+		std::vector<uint> vertexHash;
+		double numVoxels = (double)gridSize[0] * gridSize[1] * gridSize[2];
+
+		for (size_t numNodes = 1; numNodes <= nodes.size(); numNodes++) {
+			std::vector<Node> used(nodes.begin(), nodes.begin() + numNodes);
+			double bytesPerSecond = bandwidth(nodes, numNodes, config);
+
+			init(used, config, volume, gridSize);
+			extract(voxelSize, upperLeft, isoValue, pos, normal, vertexHash);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int i = 0; i < nIter; i++) {
+				extract(voxelSize, upperLeft, isoValue, pos, normal, vertexHash);
+			}
+			double dAvgTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / nIter;
+
+			shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes-numa, Nodes = %u, Bandwidth = %.2f GB/s, Per Node = %.2f GB/s, Throughput = %.4f MVoxels/s, Time = %.5f s, Verts = %u\n",
+					 (uint)numNodes, 1.0e-9 * bytesPerSecond, 1.0e-9 * bytesPerSecond / numNodes,
+					 (1.0e-6 * numVoxels) / dAvgTime, dAvgTime, (uint)vertexHash.size());
+			for (size_t s = 0; s < slabs.size(); s++) {
+				shrLog("numa:   node %d, %.5f s\n", slabs[s].node.id, slabs[s].time);
+			}
+		}
+	}
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_NUMA {
+	// NUMA placement of the CPU engine. The grid is split into one z slab per node; each node
+	// copies its planes of the volume with a thread pinned to its CPUs, so the pages land
+	// on that node (first touch), and runs MC_FLYINGEDGES::extractCPU on them with its
+	// own pinned workers, whose row arrays are first touched there as well.
+	// The slab outputs are merged in z order with the edge hashes mapped back to the full
+	// grid, the mesh is the same as the one of a single extractCPU over the whole volume.
+
+	struct Node {
+		int id;
+		std::vector<int> cpus;
+	};
+
+	struct Config {
+		std::string topology;	// -numatopology=0-7,16-23:8-15,24-31 (CPU lists, nodes split by ':'), empty = from the OS
+		int maxNodes;			// -numanodes=<n>, 0 = all nodes
+		int threadsPerNode;		// -numathreads=<n>, 0 = one per CPU of the node
+		bool pin;				// -nopin clears it
+
+		Config();
+	};
+
+	// nodes of the configured or detected topology, a single node of all hardware threads
+	// when the OS doesn't tell
+	std::vector<Node> topology(const Config &config);
+	void logTopology(const std::vector<Node> &nodes);
+
+	// restrict the calling thread to cpus, false if the OS doesn't support it
+	bool pinThread(const std::vector<int> &cpus);
+
+	// split the volume over the nodes and place every slab on its node, call again when the volume changes
+	void init(const std::vector<Node> &nodes, const Config &config, const uchar *volume, const cl_uint gridSize[4]);
+	void close(void);
+	bool ready(void);
+
+	// same output as MC_FLYINGEDGES::extractCPU
+	void extract(const cl_float voxelSize[4], const cl_float upperLeft[4], float isoValue,
+				 std::vector<float> &pos, std::vector<float> &normal, std::vector<uint> &vertexHash);
+
+	// streaming read bandwidth of node local memory and extraction throughput on the first
+	// 1..N nodes, one oclMarchingCubes-numa line per node count. Leaves the placement on all nodes.
+	void benchmark(const std::vector<Node> &nodes, const Config &config, const uchar *volume, const cl_uint gridSize[4],
+				   const cl_float voxelSize[4], const cl_float upperLeft[4], float isoValue);
+};
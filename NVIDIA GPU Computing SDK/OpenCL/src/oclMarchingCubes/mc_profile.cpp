@@ -0,0 +1,184 @@
+#include "mc_profile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+
+#include <oclUtils.h>
+
+namespace MC_PROFILE {
+
+	struct Pending {
+		std::string stage;
+		double bytes;
+		cl_event event;
+	};
+
+	struct Stage {
+		std::vector<double> ms;		// one sample per iteration
+		double bytes;				// per iteration
+	};
+
+	struct Case {
+		cl_uint gridSize[3];
+		float isoValue;
+		std::vector<std::string> order;	// stages in first enqueue order
+		std::map<std::string, Stage> stages;
+	};
+
+	static std::vector<Case> cases;
+	static std::deque<Pending> pending;	// deque keeps the events in place while more are added
+	static bool active = false;
+	static std::string currentScope;
+
+	void setCase(const cl_uint gridSize[3], float isoValue)
+	{
+		Case c;
+		memcpy(c.gridSize, gridSize, sizeof(c.gridSize));
+		c.isoValue = isoValue;
+		cases.push_back(c);
+	}
+
+	void begin(void)
+	{
+		if (cases.empty()) {
+			cl_uint none[3] = { 0, 0, 0 };
+			setCase(none, 0.0f);
+		}
+		active = true;
+	}
+
+	cl_event *event(const std::string &stage, double bytes)
+	{
+		if (!active) return NULL;
+		Pending p;
+		p.stage = stage;
+		p.bytes = bytes;
+		p.event = 0;
+		pending.push_back(p);
+		return &pending.back().event;
+	}
+
+	bool recording(void)
+	{
+		return active;
+	}
+
+	cl_int end(void)
+	{
+		active = false;
+		Case &c = cases.back();
+		std::map<std::string, std::pair<double, double> > iteration;	// ms, bytes
+
+		cl_int err = CL_SUCCESS;
+		for (size_t i = 0; i < pending.size(); i++) {
+			Pending &p = pending[i];
+			if (!p.event) continue;
+			cl_ulong start = 0, end = 0;
+			err |= clWaitForEvents(1, &p.event);
+			err |= clGetEventProfilingInfo(p.event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+			err |= clGetEventProfilingInfo(p.event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+			clReleaseEvent(p.event);
+
+			if (!iteration.count(p.stage) && !c.stages.count(p.stage)) {
+				c.order.push_back(p.stage);
+			}
+			iteration[p.stage].first += (end - start) * 1.0e-6;
+			iteration[p.stage].second += p.bytes;
+		}
+		pending.clear();
+
+		for (std::map<std::string, std::pair<double, double> >::iterator it = iteration.begin(); it != iteration.end(); ++it) {
+			Stage &s = c.stages[it->first];
+			s.ms.push_back(it->second.first);
+			s.bytes = it->second.second;
+		}
+		return err;
+	}
+
+	void setScope(const char *scope)
+	{
+		currentScope = scope;
+	}
+
+	const std::string &scope(void)
+	{
+		return currentScope;
+	}
+
+	// nearest rank on the sorted samples
+	static double percentile(const std::vector<double> &sorted, double p)
+	{
+		if (sorted.empty()) return 0.0;
+		size_t rank = (size_t)(p * (sorted.size() - 1) + 0.5);
+		return sorted[MIN(rank, sorted.size() - 1)];
+	}
+
+	bool report(const char *path, const char *deviceName)
+	{
+		bool json = path && strstr(path, ".json") != NULL;
+		FILE *f = path ? fopen(path, "w") : NULL;
+		if (path && !f) {
+			shrLog("profile: can't write '%s'\n", path);
+		}
+
+		if (f && json) {
+			fprintf(f, "{\n  \"device\": \"%s\",\n  \"cases\": [", deviceName);
+		} else if (f) {
+			fprintf(f, "device,grid_x,grid_y,grid_z,iso,stage,count,median_ms,p95_ms,p99_ms,bytes,gbps\n");
+		}
+
+		for (size_t ci = 0; ci < cases.size(); ci++) {
+			const Case &c = cases[ci];
+			shrLog("profile: grid %u x %u x %u, iso %g\n", c.gridSize[0], c.gridSize[1], c.gridSize[2], c.isoValue);
+			if (f && json) {
+				fprintf(f, "%s\n    {\"grid\": [%u, %u, %u], \"iso\": %g, \"stages\": [", ci ? "," : "",
+						c.gridSize[0], c.gridSize[1], c.gridSize[2], c.isoValue);
+			}
+			for (size_t si = 0; si < c.order.size(); si++) {
+				const std::string &name = c.order[si];
+				const Stage &s = c.stages.find(name)->second;
+				std::vector<double> sorted = s.ms;
+				std::sort(sorted.begin(), sorted.end());
+				double median = percentile(sorted, 0.5), p95 = percentile(sorted, 0.95), p99 = percentile(sorted, 0.99);
+				double gbps = (median > 0.0) ? s.bytes / (median * 1.0e-3) * 1.0e-9 : 0.0;
+
+				shrLog("profile:   %-40s median %9.4f ms  p95 %9.4f ms  p99 %9.4f ms  %8.2f GB/s\n",
+					   name.c_str(), median, p95, p99, gbps);
+				if (f && json) {
+					fprintf(f, "%s\n      {\"stage\": \"%s\", \"count\": %u, \"median_ms\": %.6f, \"p95_ms\": %.6f, \"p99_ms\": %.6f, \"bytes\": %.0f, \"gbps\": %.3f}",
+							si ? "," : "", name.c_str(), (uint)s.ms.size(), median, p95, p99, s.bytes, gbps);
+				} else if (f) {
+					fprintf(f, "\"%s\",%u,%u,%u,%g,\"%s\",%u,%.6f,%.6f,%.6f,%.0f,%.3f\n", deviceName,
+							c.gridSize[0], c.gridSize[1], c.gridSize[2], c.isoValue, name.c_str(),
+							(uint)s.ms.size(), median, p95, p99, s.bytes, gbps);
+				}
+			}
+			if (f && json) {
+				fprintf(f, "\n    ]}");
+			}
+		}
+
+		if (f && json) {
+			fprintf(f, "\n  ]\n}\n");
+		}
+		if (f) {
+			fclose(f);
+			shrLog("profile: written to '%s'\n", path);
+		}
+		return !path || f != NULL;
+	}
+
+	void reset(void)
+	{
+		for (size_t i = 0; i < pending.size(); i++) {
+			if (pending[i].event) clReleaseEvent(pending[i].event);
+		}
+		pending.clear();
+		cases.clear();
+		active = false;
+	}
+};
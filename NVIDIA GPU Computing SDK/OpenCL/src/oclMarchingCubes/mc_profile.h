@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_PROFILE {
+	// Per-stage timing from OpenCL event timestamps (the queue needs CL_QUEUE_PROFILING_ENABLE).
+	// Between begin() and end() every enqueue that passes event(stage, bytes) as its event
+	// records one sample; the samples of a stage within one begin/end pair are added up,
+	// so every pair is one iteration. bytes is the minimum traffic of the command, used
+	// for the achieved GB/s.
+
+	// case the following iterations belong to, e.g. one grid size and isovalue of a sweep
+	void setCase(const cl_uint gridSize[3], float isoValue);
+
+	void begin(void);
+	// NULL while no iteration is recorded, so it can always be passed to clEnqueue*
+	cl_event *event(const std::string &stage, double bytes);
+	bool recording(void);
+	cl_int end(void);
+
+	// prefix of the stage names of shared code (the scan), e.g. "scan occupied"
+	void setScope(const char *scope);
+	const std::string &scope(void);
+
+	// median / p95 / p99 per case and stage to the log, and as JSON or CSV (by the extension of path)
+	bool report(const char *path, const char *deviceName);
+	void reset(void);
+};
@@ -0,0 +1,111 @@
+#include "mc_programCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <oclUtils.h>
+
+#include "mc_tuner.h"
+
+namespace MC_PROGRAMCACHE {
+
+	static std::string cacheDirectory = ".";
+	static bool cacheEnabled = true;
+
+	void setDirectory(const std::string &directory)
+	{
+		cacheDirectory = directory.empty() ? std::string(".") : directory;
+	}
+
+	void setEnabled(bool enabled)
+	{
+		cacheEnabled = enabled;
+	}
+
+	// 64 bit FNV-1a
+	static unsigned long long hashBytes(unsigned long long hash, const char *data, size_t length)
+	{
+		for (size_t i = 0; i < length; i++) {
+			hash ^= (unsigned char)data[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	static std::string cacheFile(cl_device_id device, const char *name, const char *source, size_t length, const char *options)
+	{
+		std::string deviceKey = MC_TUNER::deviceKey(device);
+		unsigned long long hash = 14695981039346656037ULL;
+		hash = hashBytes(hash, deviceKey.c_str(), deviceKey.size() + 1);
+		hash = hashBytes(hash, options ? options : "", options ? strlen(options) + 1 : 1);
+		hash = hashBytes(hash, source, length);
+
+		char key[17];
+		sprintf(key, "%016llx", hash);
+		return cacheDirectory + "/" + name + "_" + key + ".bin";
+	}
+
+	static bool readBinary(const std::string &file, std::vector<unsigned char> &binary)
+	{
+		std::ifstream in(file.c_str(), std::ios::in | std::ios::binary);
+		if (!in.is_open()) return false;
+		std::ostringstream oss;
+		oss << in.rdbuf();
+		std::string data = oss.str();
+		binary.assign(data.begin(), data.end());
+		return !binary.empty();
+	}
+
+	static void writeBinary(const std::string &file, cl_program program, cl_device_id device)
+	{
+		char *binary = NULL;
+		size_t length = 0;
+		oclGetProgBinary(program, device, &binary, &length);
+		if (!binary) return;
+
+		std::ofstream out(file.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (out.is_open()) {
+			out.write(binary, length);
+		}
+		free(binary);
+	}
+
+	cl_program build(cl_context context, cl_device_id device, const char *name,
+					 const char *source, size_t length, const char *options, cl_int *err)
+	{
+		std::string file;
+		if (cacheEnabled) {
+			file = cacheFile(device, name, source, length, options);
+
+			std::vector<unsigned char> binary;
+			if (readBinary(file, binary)) {
+				const unsigned char *data = &binary[0];
+				size_t size = binary.size();
+				cl_int status = CL_SUCCESS;
+				cl_program program = clCreateProgramWithBinary(context, 1, &device, &size, &data, &status, err);
+				if (*err == CL_SUCCESS && status == CL_SUCCESS) {
+					*err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+					if (*err == CL_SUCCESS) {
+						shrLog("Loaded %s from '%s'\n", name, file.c_str());
+						return program;
+					}
+				}
+				if (program) clReleaseProgram(program);
+				shrLog("Cached binary '%s' is stale, rebuilding %s\n", file.c_str(), name);
+			}
+		}
+
+		cl_program program = clCreateProgramWithSource(context, 1, &source, &length, err);
+		if (*err != CL_SUCCESS) return program;
+		*err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+		if (*err == CL_SUCCESS && cacheEnabled) {
+			writeBinary(file, program, device);
+		}
+		return program;
+	}
+};
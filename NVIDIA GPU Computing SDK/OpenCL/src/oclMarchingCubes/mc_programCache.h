@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+
+#include <CL/opencl.h>
+
+namespace MC_PROGRAMCACHE {
+	// On-disk cache of program binaries. The key hashes the device name, driver version,
+	// build options and program source, so any change to one of them is a miss.
+	// Files are "<directory>/<name>_<key>.bin".
+
+	void setDirectory(const std::string &directory);
+	void setEnabled(bool enabled);
+
+	// create and build a program for one device, from the cached binary when there is one.
+	// A cached binary that fails to load or build is discarded and the source is built
+	// instead, a successful source build is written to the cache. On a build error the
+	// program is still returned (with *err set) so the caller can log the build info.
+	cl_program build(cl_context context, cl_device_id device, const char *name,
+					 const char *source, size_t length, const char *options, cl_int *err);
+};
@@ -0,0 +1,274 @@
+#include "mc_regress.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+#include <oclUtils.h>
+
+namespace MC_REGRESS {
+
+	bool loadOBJ(const char *path, Mesh &mesh)
+	{
+		FILE *f = fopen(path, "r");
+		if (!f) {
+			shrLog("regress: can't open '%s'\n", path);
+			return false;
+		}
+
+		mesh.verts.clear();
+		mesh.faces.clear();
+		char line[1024];
+		bool ok = true;
+		while (fgets(line, sizeof(line), f)) {
+			if (line[0] == 'v' && line[1] == ' ') {
+				float x, y, z;
+				if (sscanf(line + 2, "%f %f %f", &x, &y, &z) != 3) ok = false;
+				mesh.verts.push_back(x);
+				mesh.verts.push_back(y);
+				mesh.verts.push_back(z);
+			} else if (line[0] == 'f' && line[1] == ' ') {
+				// "f a b c" or "f a/t/n ...", polygons are fanned
+				std::vector<int> polygon;
+				char *c = line + 2;
+				for (;;) {
+					char *end;
+					long index = strtol(c, &end, 10);
+					if (end == c) break;
+					polygon.push_back((index < 0) ? (int)(mesh.verts.size() / 3 + index) : (int)index - 1);
+					c = end;
+					while (*c && *c != ' ' && *c != '\t') c++;
+				}
+				for (size_t i = 2; i < polygon.size(); i++) {
+					mesh.faces.push_back(polygon[0]);
+					mesh.faces.push_back(polygon[i - 1]);
+					mesh.faces.push_back(polygon[i]);
+				}
+			}
+		}
+		fclose(f);
+
+		int numVerts = (int)(mesh.verts.size() / 3);
+		for (size_t i = 0; i < mesh.faces.size(); i++) {
+			if (mesh.faces[i] < 0 || mesh.faces[i] >= numVerts) ok = false;
+		}
+		if (!ok) {
+			shrLog("regress: '%s' is not a valid triangle mesh\n", path);
+		}
+		return ok;
+	}
+
+	void weld(const std::vector<float> &pos, const std::vector<uint> &vertexHash, Mesh &mesh)
+	{
+		// first appearance order, like MC_HELPER::getCompactMeshEigen
+		std::unordered_map<uint, int> index;
+		mesh.verts.clear();
+		mesh.faces.resize(vertexHash.size() / 3 * 3);
+		for (size_t i = 0; i < mesh.faces.size(); i++) {
+			std::unordered_map<uint, int>::iterator it = index.find(vertexHash[i]);
+			if (it == index.end()) {
+				it = index.insert(std::make_pair(vertexHash[i], (int)(mesh.verts.size() / 3))).first;
+				mesh.verts.insert(mesh.verts.end(), &pos[4 * i], &pos[4 * i] + 3);
+			}
+			mesh.faces[i] = it->second;
+		}
+	}
+
+	static int findRoot(std::vector<int> &parent, int v)
+	{
+		while (parent[v] != v) {
+			parent[v] = parent[parent[v]];
+			v = parent[v];
+		}
+		return v;
+	}
+
+	static void hashValue(cl_ulong &hash, cl_ulong value)
+	{
+		// FNV-1a over the bytes of value
+		for (int b = 0; b < 8; b++) {
+			hash ^= (value >> (8 * b)) & 0xff;
+			hash *= 0x100000001b3ull;
+		}
+	}
+
+	Topology topology(const Mesh &mesh)
+	{
+		Topology t;
+		memset(&t, 0, sizeof(t));
+		size_t numVerts = mesh.verts.size() / 3;
+		t.faces = (uint)(mesh.faces.size() / 3);
+
+		std::unordered_map<unsigned long long, uint> edgeFaces;
+		std::vector<int> parent(numVerts);
+		std::vector<bool> used(numVerts, false);
+		for (size_t v = 0; v < numVerts; v++) {
+			parent[v] = (int)v;
+		}
+		for (size_t f = 0; f < t.faces; f++) {
+			for (int e = 0; e < 3; e++) {
+				int a = mesh.faces[3 * f + e], b = mesh.faces[3 * f + (e + 1) % 3];
+				used[a] = true;
+				unsigned long long key = ((unsigned long long)MIN(a, b) << 32) | (unsigned long long)MAX(a, b);
+				edgeFaces[key]++;
+				int ra = findRoot(parent, a), rb = findRoot(parent, b);
+				if (ra != rb) parent[ra] = rb;
+			}
+		}
+
+		for (size_t v = 0; v < numVerts; v++) {
+			if (!used[v]) continue;
+			t.vertices++;
+			if (findRoot(parent, (int)v) == (int)v) t.components++;
+		}
+		t.edges = (uint)edgeFaces.size();
+		for (std::unordered_map<unsigned long long, uint>::iterator it = edgeFaces.begin(); it != edgeFaces.end(); ++it) {
+			if (it->second == 1) t.boundaryEdges++;
+			if (it->second > 2) t.nonManifoldEdges++;
+		}
+		t.euler = (int)t.vertices - (int)t.edges + (int)t.faces;
+
+		t.hash = 0xcbf29ce484222325ull;
+		hashValue(t.hash, t.components);
+		hashValue(t.hash, t.boundaryEdges);
+		hashValue(t.hash, t.nonManifoldEdges);
+		hashValue(t.hash, (cl_ulong)(cl_long)t.euler);
+		return t;
+	}
+
+	// nearest vertex queries on a uniform grid of about one point per cell
+	class PointGrid {
+	public:
+		PointGrid(const std::vector<float> &points) : points(points)
+		{
+			size_t n = points.size() / 3;
+			for (int a = 0; a < 3; a++) {
+				lo[a] = FLT_MAX;
+				hi[a] = -FLT_MAX;
+			}
+			for (size_t i = 0; i < n; i++) {
+				for (int a = 0; a < 3; a++) {
+					lo[a] = MIN(lo[a], points[3 * i + a]);
+					hi[a] = MAX(hi[a], points[3 * i + a]);
+				}
+			}
+			float extent = MAX(MAX(hi[0] - lo[0], hi[1] - lo[1]), MAX(hi[2] - lo[2], 1.0e-6f));
+			cellSize = extent / MAX(cbrtf((float)n), 1.0f);
+			for (int a = 0; a < 3; a++) {
+				dims[a] = MAX((int)((hi[a] - lo[a]) / cellSize) + 1, 1);
+			}
+			start.assign((size_t)dims[0] * dims[1] * dims[2] + 1, 0);
+			for (size_t i = 0; i < n; i++) start[cellOf(&points[3 * i]) + 1]++;
+			for (size_t c = 1; c < start.size(); c++) start[c] += start[c - 1];
+			order.resize(n);
+			std::vector<uint> fill(start.begin(), start.end() - 1);
+			for (size_t i = 0; i < n; i++) order[fill[cellOf(&points[3 * i])]++] = (uint)i;
+		}
+
+		double nearest(const float *q) const
+		{
+			int c[3];
+			for (int a = 0; a < 3; a++) {
+				c[a] = CLAMP((int)((q[a] - lo[a]) / cellSize), 0, dims[a] - 1);
+			}
+			double best = DBL_MAX;
+			int maxRing = MAX(MAX(dims[0], dims[1]), dims[2]);
+			for (int r = 0; r <= maxRing; r++) {
+				// every point outside ring r is at least r cells from q's cell
+				if (best < DBL_MAX && sqrt(best) <= (r - 1) * (double)cellSize) break;
+				for (int z = c[2] - r; z <= c[2] + r; z++) {
+					for (int y = c[1] - r; y <= c[1] + r; y++) {
+						for (int x = c[0] - r; x <= c[0] + r; x++) {
+							if (MAX(MAX(abs(x - c[0]), abs(y - c[1])), abs(z - c[2])) != r) continue;
+							if (x < 0 || y < 0 || z < 0 || x >= dims[0] || y >= dims[1] || z >= dims[2]) continue;
+							size_t cell = ((size_t)z * dims[1] + y) * dims[0] + x;
+							for (uint i = start[cell]; i < start[cell + 1]; i++) {
+								const float *p = &points[3 * order[i]];
+								double dx = p[0] - q[0], dy = p[1] - q[1], dz = p[2] - q[2];
+								best = MIN(best, dx * dx + dy * dy + dz * dz);
+							}
+						}
+					}
+				}
+			}
+			return sqrt(best);
+		}
+
+	private:
+		size_t cellOf(const float *p) const
+		{
+			int c[3];
+			for (int a = 0; a < 3; a++) {
+				c[a] = CLAMP((int)((p[a] - lo[a]) / cellSize), 0, dims[a] - 1);
+			}
+			return ((size_t)c[2] * dims[1] + c[1]) * dims[0] + c[0];
+		}
+
+		const std::vector<float> &points;
+		float lo[3], hi[3];
+		float cellSize;
+		int dims[3];
+		std::vector<uint> start;
+		std::vector<uint> order;
+	};
+
+	static double directedHausdorff(const Mesh &from, const PointGrid &to)
+	{
+		double d = 0.0;
+		for (size_t i = 0; i < from.verts.size() / 3; i++) {
+			d = MAX(d, to.nearest(&from.verts[3 * i]));
+		}
+		return d;
+	}
+
+	double hausdorff(const Mesh &a, const Mesh &b)
+	{
+		if (a.verts.empty() || b.verts.empty()) {
+			return (a.verts.empty() && b.verts.empty()) ? 0.0 : DBL_MAX;
+		}
+		PointGrid gridA(a.verts), gridB(b.verts);
+		return MAX(directedHausdorff(a, gridB), directedHausdorff(b, gridA));
+	}
+
+	bool isoFromName(const std::string &path, float &isoValue)
+	{
+		size_t underscore = path.rfind('_');
+		if (underscore == std::string::npos) return false;
+		const char *c = path.c_str() + underscore + 1;
+		char *end;
+		double v = strtod(c, &end);
+		if (end == c) return false;
+		isoValue = (float)v;
+		return true;
+	}
+
+	bool loadBaseline(const char *path, std::map<std::string, double> &baseline)
+	{
+		FILE *f = fopen(path, "r");
+		if (!f) return false;
+		char key[1024];
+		double value;
+		while (fscanf(f, "%1023s %lf", key, &value) == 2) {
+			baseline[key] = value;
+		}
+		fclose(f);
+		return true;
+	}
+
+	bool saveBaseline(const char *path, const std::map<std::string, double> &baseline)
+	{
+		FILE *f = fopen(path, "w");
+		if (!f) return false;
+		for (std::map<std::string, double>::const_iterator it = baseline.begin(); it != baseline.end(); ++it) {
+			fprintf(f, "%s %.4f\n", it->first.c_str(), it->second);
+		}
+		bool ok = (ferror(f) == 0);
+		fclose(f);
+		return ok;
+	}
+};
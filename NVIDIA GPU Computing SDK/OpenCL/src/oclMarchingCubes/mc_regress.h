@@ -0,0 +1,48 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_REGRESS {
+	// Comparison of an extracted mesh with a reference OBJ (-regress), e.g. the organ
+	// meshes in data/ written by -save. The gates are
+	//   counts:     vertices and faces within a relative tolerance
+	//   topology:   components, boundary and non-manifold edges and the Euler characteristic,
+	//               which don't depend on vertex or face order, hashed into one value
+	//   geometry:   symmetric Hausdorff distance between the vertex sets
+	//   throughput: not below (1 - slowdown) x a recorded baseline
+
+	struct Mesh {
+		std::vector<float> verts;	// x, y, z
+		std::vector<int> faces;		// 3 per triangle, 0 based
+	};
+
+	struct Topology {
+		uint vertices;				// referenced by a face
+		uint edges;
+		uint faces;
+		uint boundaryEdges;			// used by one face
+		uint nonManifoldEdges;		// used by more than two faces
+		uint components;
+		int euler;					// V - E + F
+		cl_ulong hash;
+	};
+
+	bool loadOBJ(const char *path, Mesh &mesh);
+	// weld the triangle soup of the extraction (4 floats per vertex) by vertex hash
+	void weld(const std::vector<float> &pos, const std::vector<uint> &vertexHash, Mesh &mesh);
+
+	Topology topology(const Mesh &mesh);
+	double hausdorff(const Mesh &a, const Mesh &b);
+
+	// the isovalue from a "<volume>_<iso>.obj" name as written by -save
+	bool isoFromName(const std::string &path, float &isoValue);
+
+	// throughput baselines, one "<key> <MVoxels/s>" per line
+	bool loadBaseline(const char *path, std::map<std::string, double> &baseline);
+	bool saveBaseline(const char *path, const std::map<std::string, double> &baseline);
+};
@@ -0,0 +1,85 @@
+#include "mc_roi.h"
+
+#include <string.h>
+
+#include <oclUtils.h>
+
+namespace MC_ROI {
+
+	static cl_mem d_boxVolume = 0;		// samples of copiedBox
+	static VoxelBox copiedBox;
+
+	void clamp(VoxelBox &box, const cl_uint gridSize[3])
+	{
+		for (int a = 0; a < 3; a++) {
+			box.hi[a] = CLAMP(box.hi[a], 1u, MAX(gridSize[a], 2u) - 1);
+			box.lo[a] = MIN(box.lo[a], box.hi[a] - 1);
+		}
+	}
+
+	cl_int copyVolume(cl_context context, cl_command_queue queue, cl_mem volume, const cl_uint gridSize[3],
+					  const MC_VOLUME::Layout *layout, const VoxelBox &box, cl_mem &boxVolume)
+	{
+		if (d_boxVolume && memcmp(&box, &copiedBox, sizeof(box)) == 0) {
+			boxVolume = d_boxVolume;
+			return CL_SUCCESS;
+		}
+		close();
+
+		size_t origin[3], region[3], zero[3] = { 0, 0, 0 };
+		for (int a = 0; a < 3; a++) {
+			origin[a] = box.lo[a];
+			region[a] = box.hi[a] - box.lo[a] + 1;
+		}
+
+		cl_int err = CL_SUCCESS;
+		if (layout) {
+			// bytes along x
+			size_t element = MC_VOLUME::numBytes(*layout) / MC_VOLUME::numElements(*layout);
+			size_t rowPitch = gridSize[0] * element, slicePitch = rowPitch * gridSize[1];
+			d_boxVolume = clCreateBuffer(context, CL_MEM_READ_ONLY, region[0] * region[1] * region[2] * element, 0, &err);
+			if (err != CL_SUCCESS) return err;
+			origin[0] *= element;
+			region[0] *= element;
+			err = clEnqueueCopyBufferRect(queue, volume, d_boxVolume, origin, zero, region,
+										  rowPitch, slicePitch, region[0], region[0] * region[1], 0, 0, 0);
+		} else {
+			cl_image_format volumeFormat;
+			volumeFormat.image_channel_order = CL_R;
+			volumeFormat.image_channel_data_type = CL_UNORM_INT8;
+			d_boxVolume = clCreateImage3D(context, CL_MEM_READ_ONLY, &volumeFormat, region[0], region[1], region[2], 0, 0, 0, &err);
+			if (err != CL_SUCCESS) return err;
+			err = clEnqueueCopyImage(queue, volume, d_boxVolume, origin, zero, region, 0, 0, 0);
+		}
+		if (err != CL_SUCCESS) {
+			close();
+			return err;
+		}
+		copiedBox = box;
+		boxVolume = d_boxVolume;
+		return CL_SUCCESS;
+	}
+
+	void close(void)
+	{
+		if (d_boxVolume) clReleaseMemObject(d_boxVolume);
+		d_boxVolume = 0;
+	}
+
+	void remapHashes(std::vector<uint> &vertexHash, const VoxelBox &box, const cl_uint fullGrid[3])
+	{
+		cl_uint dims[3];
+		for (int a = 0; a < 3; a++) {
+			dims[a] = box.hi[a] - box.lo[a] + 1;
+		}
+		cl_uint boxPoints = dims[0] * dims[1] * dims[2];
+		cl_uint gridPoints = fullGrid[0] * fullGrid[1] * fullGrid[2];
+		for (size_t v = 0; v < vertexHash.size(); v++) {
+			uint axis = vertexHash[v] / boxPoints, point = vertexHash[v] % boxPoints;
+			uint x = point % dims[0] + box.lo[0];
+			uint y = point / dims[0] % dims[1] + box.lo[1];
+			uint z = point / (dims[0] * dims[1]) + box.lo[2];
+			vertexHash[v] = axis * gridPoints + (z * fullGrid[1] + y) * fullGrid[0] + x;
+		}
+	}
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+#include "mc_volume.h"
+
+namespace MC_ROI {
+	// Region of interest (-roi=x0,y0,z0,x1,y1,z1 and the roi= of -batch jobs). The samples of
+	// the box are copied out of the volume so the classic kernels run on the box as a grid of
+	// its own, the edge hashes of the box are then moved to those of the whole grid, so they
+	// match an extraction of the whole grid and those of neighbouring boxes.
+
+	// the voxels lo <= v < hi, their points lo..hi
+	struct VoxelBox {
+		cl_uint lo[3];
+		cl_uint hi[3];
+	};
+
+	// keep at least one voxel per axis of the box inside the grid
+	void clamp(VoxelBox &box, const cl_uint gridSize[3]);
+
+	// the samples of box out of volume (gridSize points), an image or, with layout, a linear
+	// buffer of the box. The copy is kept and only redone when the box changes.
+	cl_int copyVolume(cl_context context, cl_command_queue queue, cl_mem volume, const cl_uint gridSize[3],
+					  const MC_VOLUME::Layout *layout, const VoxelBox &box, cl_mem &boxVolume);
+	void close(void);
+
+	// point + axis * points of the box, to the same in the grid of fullGrid points
+	void remapHashes(std::vector<uint> &vertexHash, const VoxelBox &box, const cl_uint fullGrid[3]);
+};
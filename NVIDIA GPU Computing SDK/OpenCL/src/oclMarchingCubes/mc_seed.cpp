@@ -0,0 +1,204 @@
+#include "mc_seed.h"
+
+#include <vector>
+
+#include <oclUtils.h>
+
+#include "mc_profile.h"
+
+namespace MC_SEED {
+
+	static const uint NO_CELL = 0xffffffff;
+
+	static cl_kernel findSeedCellKernel = 0;
+	static cl_kernel floodActiveCellsKernel = 0;
+	static cl_kernel advanceFrontierKernel = 0;
+	static cl_kernel clearVisitedCellsKernel = 0;
+
+	static cl_mem d_visitedBits = 0;	// one bit per voxel reached by the search
+	static cl_mem d_seedCell = 0;		// x of the first crossed cell from the seed
+	static cl_mem d_frontier = 0;		// [begin, end) of the frontier in the queue
+	static uint numGroups = 0;			// groups of a flood launch, they stride over the frontier
+
+	cl_int createKernels(cl_program program)
+	{
+		releaseKernels();
+
+		cl_int err = CL_SUCCESS;
+		findSeedCellKernel = clCreateKernel(program, "findSeedCell", &err);
+		if (err != CL_SUCCESS) return err;
+		floodActiveCellsKernel = clCreateKernel(program, "floodActiveCells", &err);
+		if (err != CL_SUCCESS) return err;
+		advanceFrontierKernel = clCreateKernel(program, "advanceFrontier", &err);
+		if (err != CL_SUCCESS) return err;
+		clearVisitedCellsKernel = clCreateKernel(program, "clearVisitedCells", &err);
+		return err;
+	}
+
+	void releaseKernels(void)
+	{
+		if (findSeedCellKernel) clReleaseKernel(findSeedCellKernel);
+		if (floodActiveCellsKernel) clReleaseKernel(floodActiveCellsKernel);
+		if (advanceFrontierKernel) clReleaseKernel(advanceFrontierKernel);
+		if (clearVisitedCellsKernel) clReleaseKernel(clearVisitedCellsKernel);
+		findSeedCellKernel = floodActiveCellsKernel = advanceFrontierKernel = clearVisitedCellsKernel = 0;
+	}
+
+	cl_int init(cl_context context, cl_device_id device, uint numVoxels)
+	{
+		close();
+
+		// enough groups to fill the device
+		cl_uint computeUnits = 1;
+		clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, NULL);
+		numGroups = MAX(computeUnits, 1u) * 8;
+
+		// zero once, every search clears the words it marked
+		cl_int err = CL_SUCCESS;
+		std::vector<uint> zeros((numVoxels + 31) / 32, 0);
+		d_visitedBits = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, zeros.size() * sizeof(uint), zeros.data(), &err);
+		if (err != CL_SUCCESS) return err;
+		d_seedCell = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		d_frontier = clCreateBuffer(context, CL_MEM_READ_WRITE, 2 * sizeof(uint), 0, &err);
+		return err;
+	}
+
+	void close(void)
+	{
+		if (d_visitedBits) clReleaseMemObject(d_visitedBits);
+		if (d_seedCell) clReleaseMemObject(d_seedCell);
+		if (d_frontier) clReleaseMemObject(d_frontier);
+		d_visitedBits = d_seedCell = d_frontier = 0;
+	}
+
+	static cl_int findSeedCell(cl_command_queue queue, const cl_int seed[4], cl_mem volume, const cl_uint gridSize[4],
+							   float isoValue, uint threads)
+	{
+		int k = 0;
+		cl_int err = clSetKernelArg(findSeedCellKernel, k++, sizeof(cl_mem), &d_seedCell);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(findSeedCellKernel, k++, sizeof(cl_mem), &volume);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(findSeedCellKernel, k++, 4 * sizeof(cl_int), seed);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(findSeedCellKernel, k++, 4 * sizeof(cl_uint), gridSize);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(findSeedCellKernel, k++, sizeof(float), &isoValue);
+		if (err != CL_SUCCESS) return err;
+
+		uint cells = gridSize[0] - 1 - seed[0];
+		size_t localSize = threads;
+		size_t globalSize = (cells + threads - 1) / threads * threads;
+		return clEnqueueNDRangeKernel(queue, findSeedCellKernel, 1, NULL, &globalSize, &localSize, 0, 0,
+									  MC_PROFILE::event("findSeedCell", (double)cells * 4));
+	}
+
+	// one level of the search over the frontier in d_frontier, then the next frontier
+	static cl_int floodActiveCells(cl_command_queue queue, cl_mem volume, cl_mem numVertsTable,
+								   const cl_uint gridSize[4], const cl_uint gridSizeShift[4], const cl_uint gridSizeMask[4], float isoValue,
+								   cl_mem compVoxelArray, cl_mem voxelOccupied, cl_mem appendCount, uint threads)
+	{
+		int k = 0;
+		cl_int err = clSetKernelArg(floodActiveCellsKernel, k++, sizeof(cl_mem), &compVoxelArray);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(floodActiveCellsKernel, k++, sizeof(cl_mem), &voxelOccupied);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(floodActiveCellsKernel, k++, sizeof(cl_mem), &appendCount);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(floodActiveCellsKernel, k++, sizeof(cl_mem), &d_visitedBits);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(floodActiveCellsKernel, k++, sizeof(cl_mem), &d_frontier);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(floodActiveCellsKernel, k++, sizeof(cl_mem), &volume);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(floodActiveCellsKernel, k++, 4 * sizeof(cl_uint), gridSize);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(floodActiveCellsKernel, k++, 4 * sizeof(cl_uint), gridSizeShift);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(floodActiveCellsKernel, k++, 4 * sizeof(cl_uint), gridSizeMask);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(floodActiveCellsKernel, k++, sizeof(float), &isoValue);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(floodActiveCellsKernel, k++, sizeof(cl_mem), &numVertsTable);
+		if (err != CL_SUCCESS) return err;
+
+		size_t localSize = threads;
+		size_t globalSize = (size_t)numGroups * threads;
+		// the frontier size is only known on the device, no traffic is recorded
+		err = clEnqueueNDRangeKernel(queue, floodActiveCellsKernel, 1, NULL, &globalSize, &localSize, 0, 0,
+									 MC_PROFILE::event("floodActiveCells", 0.0));
+		if (err != CL_SUCCESS) return err;
+
+		err = clSetKernelArg(advanceFrontierKernel, 0, sizeof(cl_mem), &d_frontier);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(advanceFrontierKernel, 1, sizeof(cl_mem), &appendCount);
+		if (err != CL_SUCCESS) return err;
+		return clEnqueueTask(queue, advanceFrontierKernel, 0, 0, MC_PROFILE::event("advanceFrontier", 4 * sizeof(uint)));
+	}
+
+	static cl_int clearVisitedCells(cl_command_queue queue, cl_mem compVoxelArray, uint count, uint threads)
+	{
+		cl_int err = clSetKernelArg(clearVisitedCellsKernel, 0, sizeof(cl_mem), &compVoxelArray);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(clearVisitedCellsKernel, 1, sizeof(uint), &count);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(clearVisitedCellsKernel, 2, sizeof(cl_mem), &d_visitedBits);
+		if (err != CL_SUCCESS) return err;
+
+		size_t localSize = threads;
+		size_t globalSize = (count + threads - 1) / threads * threads;
+		return clEnqueueNDRangeKernel(queue, clearVisitedCellsKernel, 1, NULL, &globalSize, &localSize, 0, 0,
+									  MC_PROFILE::event("clearVisitedCells", (double)count * 2 * sizeof(uint)));
+	}
+
+	cl_int search(cl_command_queue queue, const cl_int seed[4], cl_mem volume, cl_mem numVertsTable,
+				  const cl_uint gridSize[4], const cl_uint gridSizeShift[4], const cl_uint gridSizeMask[4], float isoValue,
+				  cl_mem compVoxelArray, cl_mem voxelOccupied, cl_mem appendCount, uint threads, uint &activeVoxels)
+	{
+		activeVoxels = 0;
+		for (int a = 0; a < 3; a++) {
+			if (seed[a] < 0 || seed[a] + 1 >= (cl_int)gridSize[a]) {
+				return CL_SUCCESS;
+			}
+		}
+
+		uint seedX = NO_CELL;
+		cl_int err = clEnqueueWriteBuffer(queue, d_seedCell, CL_FALSE, 0, sizeof(uint), &NO_CELL, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+		err = findSeedCell(queue, seed, volume, gridSize, isoValue, threads);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueReadBuffer(queue, d_seedCell, CL_TRUE, 0, sizeof(uint), &seedX, 0, 0,
+								  MC_PROFILE::event("readback seedCell", sizeof(uint)));
+		if (err != CL_SUCCESS) return err;
+		if (seedX == NO_CELL) {
+			return CL_SUCCESS;
+		}
+
+		// queue and mark the starting cell, its word is zero
+		uint seedVoxel = seedX + seed[1] * gridSizeShift[1] + seed[2] * gridSizeShift[2];
+		uint seedBit = 1u << (seedVoxel & 31);
+		uint frontier[2] = { 0, 1 };
+		err = clEnqueueWriteBuffer(queue, compVoxelArray, CL_FALSE, 0, sizeof(uint), &seedVoxel, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueWriteBuffer(queue, d_visitedBits, CL_FALSE, (seedVoxel >> 5) * sizeof(uint), sizeof(uint), &seedBit, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueWriteBuffer(queue, appendCount, CL_FALSE, 0, sizeof(uint), &frontier[1], 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueWriteBuffer(queue, d_frontier, CL_FALSE, 0, sizeof(frontier), frontier, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+
+		while (frontier[0] < frontier[1]) {
+			for (int level = 0; level < LEVELS_PER_READBACK; level++) {
+				err = floodActiveCells(queue, volume, numVertsTable, gridSize, gridSizeShift, gridSizeMask, isoValue,
+									   compVoxelArray, voxelOccupied, appendCount, threads);
+				if (err != CL_SUCCESS) return err;
+			}
+			err = clEnqueueReadBuffer(queue, d_frontier, CL_TRUE, 0, sizeof(frontier), frontier, 0, 0,
+									  MC_PROFILE::event("readback frontier", sizeof(frontier)));
+			if (err != CL_SUCCESS) return err;
+		}
+		activeVoxels = frontier[1];
+		return clearVisitedCells(queue, compVoxelArray, activeVoxels, threads);
+	}
+};
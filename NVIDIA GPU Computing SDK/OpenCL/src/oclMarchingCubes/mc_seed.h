@@ -0,0 +1,30 @@
+#pragma once
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_SEED {
+	// Seeded extraction (-seed=x,y,z), see findSeedCell and floodActiveCells in marchingCubes_kernel.cl.
+	// Instead of classifying the grid, the cells connected to the first crossed cell along +x
+	// from the seed are appended one frontier per launch until no new cells are reached, so
+	// the work is proportional to the cells of the connected surface plus one row of the grid.
+	// The frontier bounds stay on the device and are read back every LEVELS_PER_READBACK
+	// levels, the levels past the end of the search return at once.
+
+	static const int LEVELS_PER_READBACK = 8;
+
+	// kernels come from the marching cubes program, recreate them whenever it is rebuilt
+	cl_int createKernels(cl_program program);
+	void releaseKernels(void);
+
+	// visited bits for numVoxels cells, the launches fill the compute units of device
+	cl_int init(cl_context context, cl_device_id device, uint numVoxels);
+	void close(void);
+
+	// append the cells reached from seed (a point of the grid) to compVoxelArray with their
+	// vertex counts in voxelOccupied, like compactVoxelsAppend. activeVoxels is 0 when the
+	// seed is outside the grid or no cell of its row is crossed.
+	cl_int search(cl_command_queue queue, const cl_int seed[4], cl_mem volume, cl_mem numVertsTable,
+				  const cl_uint gridSize[4], const cl_uint gridSizeShift[4], const cl_uint gridSizeMask[4], float isoValue,
+				  cl_mem compVoxelArray, cl_mem voxelOccupied, cl_mem appendCount, uint threads, uint &activeVoxels);
+};
@@ -0,0 +1,507 @@
+#include "mc_slabs.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <oclUtils.h>
+
+#include "mc_programCache.h"
+#include "mc_volume.h"
+
+// cl_ext_device_fission, not in the OpenCL 1.1 headers of the SDK
+#ifndef CL_DEVICE_PARTITION_EQUALLY_EXT
+typedef cl_ulong cl_device_partition_property_ext;
+#define CL_DEVICE_PARTITION_EQUALLY_EXT 0x4050
+#define CL_PROPERTIES_LIST_END_EXT ((cl_device_partition_property_ext)0)
+#endif
+#ifndef CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN_EXT
+#define CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN_EXT 0x4053
+#define CL_AFFINITY_DOMAIN_NUMA_EXT 0x10
+#endif
+typedef cl_int (CL_API_CALL *CreateSubDevicesFn)(cl_device_id, const cl_device_partition_property_ext *,
+												 cl_uint, cl_device_id *, cl_uint *);
+typedef cl_int (CL_API_CALL *ReleaseDeviceFn)(cl_device_id);
+
+namespace MC_SLABS {
+
+	static const size_t CLASSIFY_GROUP_SIZE = 64;
+	static const size_t GENERATE_GROUP_SIZE = 32;
+
+	struct Worker {
+		cl_device_id device;
+		cl_context context;
+		cl_command_queue queue;
+		cl_program program;
+		cl_kernel classifyKernel;
+		cl_kernel generateKernel;
+		bool volumeBuffer;
+
+		cl_mem volume;
+		cl_mem voxelVerts;
+		cl_mem voxelOccupied;
+		cl_mem compactedVoxels;
+		cl_mem vertsScan;
+		cl_mem numVertsTable;	// unused by the __constant tables, passed for the signature
+		cl_mem triTable;
+		cl_mem pos;
+		cl_mem norm;
+		cl_mem vertexHash;
+		uint vertexCapacity;
+
+		std::deque<uint> slabs;		// own run of slabs, guarded by queueLock
+		double throughput;			// voxels per second, 0 until measured
+		double busyTime;
+		uint slabsDone;
+		uint slabsStolen;
+		std::string name;
+	};
+
+	struct SlabResult {
+		std::vector<float> pos;
+		std::vector<float> normal;
+		std::vector<uint> vertexHash;
+	};
+
+	static std::vector<Worker> workers;
+	static std::vector<cl_device_id> subDevices;
+	static ReleaseDeviceFn releaseDevice = NULL;
+	static std::mutex queueLock;
+
+	static cl_uint grid[4];
+	static cl_uint depth = 0;
+	static cl_uint numSlabs = 0;
+	static cl_uint slabVoxelsMax = 0;
+
+	std::vector<cl_device_id> partitionDevices(const std::vector<cl_device_id> &devices, cl_uint subDevicesPerCPU)
+	{
+		std::vector<cl_device_id> result;
+		CreateSubDevicesFn createSubDevices = (CreateSubDevicesFn)clGetExtensionFunctionAddress("clCreateSubDevicesEXT");
+		releaseDevice = (ReleaseDeviceFn)clGetExtensionFunctionAddress("clReleaseDeviceEXT");
+
+		for (size_t d = 0; d < devices.size(); d++) {
+			cl_device_type type = 0;
+			cl_uint computeUnits = 0;
+			char extensions[4096] = "";
+			clGetDeviceInfo(devices[d], CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+			clGetDeviceInfo(devices[d], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, NULL);
+			clGetDeviceInfo(devices[d], CL_DEVICE_EXTENSIONS, sizeof(extensions), extensions, NULL);
+
+			bool fission = createSubDevices && (type & CL_DEVICE_TYPE_CPU) && strstr(extensions, "cl_ext_device_fission");
+			bool byNuma = (subDevicesPerCPU == PARTITION_NUMA);
+			if (!fission || subDevicesPerCPU < 2 || (!byNuma && computeUnits < subDevicesPerCPU)) {
+				result.push_back(devices[d]);
+				continue;
+			}
+
+			cl_device_partition_property_ext props[] = {
+				CL_DEVICE_PARTITION_EQUALLY_EXT, byNuma ? 1 : computeUnits / subDevicesPerCPU, CL_PROPERTIES_LIST_END_EXT
+			};
+			if (byNuma) {
+				props[0] = CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN_EXT;
+				props[1] = CL_AFFINITY_DOMAIN_NUMA_EXT;
+			}
+			cl_uint count = 0;
+			if (createSubDevices(devices[d], props, 0, NULL, &count) != CL_SUCCESS || count == 0) {
+				result.push_back(devices[d]);
+				continue;
+			}
+			std::vector<cl_device_id> parts(count);
+			if (createSubDevices(devices[d], props, count, &parts[0], NULL) != CL_SUCCESS) {
+				result.push_back(devices[d]);
+				continue;
+			}
+			result.insert(result.end(), parts.begin(), parts.end());
+			subDevices.insert(subDevices.end(), parts.begin(), parts.end());
+		}
+		return result;
+	}
+
+	static cl_int initWorker(Worker &w, cl_device_id device, const char *source)
+	{
+		w.device = device;
+		w.context = 0;
+		w.queue = 0;
+		w.program = 0;
+		w.classifyKernel = w.generateKernel = 0;
+		w.volume = w.voxelVerts = w.voxelOccupied = w.compactedVoxels = w.vertsScan = 0;
+		w.numVertsTable = w.triTable = w.pos = w.norm = w.vertexHash = 0;
+		w.vertexCapacity = 0;
+		w.throughput = 0.0;
+		w.busyTime = 0.0;
+		w.slabsDone = w.slabsStolen = 0;
+
+		char name[256] = "";
+		clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+		w.name = name;
+
+		cl_int err = CL_SUCCESS;
+		w.context = clCreateContext(0, 1, &device, NULL, NULL, &err);
+		if (err != CL_SUCCESS) return err;
+		w.queue = clCreateCommandQueue(w.context, device, 0, &err);
+		if (err != CL_SUCCESS) return err;
+
+		// one slab plus the plane it shares with the next one
+		cl_uint slabGrid[4] = { grid[0], grid[1], depth + 1, 0 };
+		w.volumeBuffer = MC_VOLUME::preferBuffer(device);
+		char options[512];
+		sprintf(options, "-cl-mad-enable -D NTHREADS=%u -D MC_TABLES_CONSTANT", (uint)GENERATE_GROUP_SIZE);
+		std::string buildOptions(options);
+		if (w.volumeBuffer) {
+			buildOptions += " " + MC_VOLUME::buildOptions(MC_VOLUME::layout(slabGrid, MC_VOLUME::FORMAT_UCHAR, false));
+		}
+		w.program = MC_PROGRAMCACHE::build(w.context, device, "oclMarchingCubes_slab", source, strlen(source),
+										   buildOptions.c_str(), &err);
+		if (err != CL_SUCCESS) {
+			if (w.program) oclLogBuildInfo(w.program, device);
+			return err;
+		}
+		w.classifyKernel = clCreateKernel(w.program, "classifyVoxel", &err);
+		if (err != CL_SUCCESS) return err;
+		w.generateKernel = clCreateKernel(w.program, "generateTriangles2", &err);
+		if (err != CL_SUCCESS) return err;
+
+		if (w.volumeBuffer) {
+			w.volume = clCreateBuffer(w.context, CL_MEM_READ_ONLY, slabVoxelsMax * sizeof(cl_uchar), 0, &err);
+		} else {
+			cl_image_format format;
+			format.image_channel_order = CL_R;
+			format.image_channel_data_type = CL_UNORM_INT8;
+			w.volume = clCreateImage3D(w.context, CL_MEM_READ_ONLY, &format, grid[0], grid[1], depth + 1, 0, 0, 0, &err);
+		}
+		if (err != CL_SUCCESS) return err;
+
+		size_t memSize = slabVoxelsMax * sizeof(cl_uint);
+		w.voxelVerts = clCreateBuffer(w.context, CL_MEM_READ_WRITE, memSize, 0, &err);
+		if (err != CL_SUCCESS) return err;
+		w.voxelOccupied = clCreateBuffer(w.context, CL_MEM_READ_WRITE, memSize, 0, &err);
+		if (err != CL_SUCCESS) return err;
+		w.compactedVoxels = clCreateBuffer(w.context, CL_MEM_READ_ONLY, memSize, 0, &err);
+		if (err != CL_SUCCESS) return err;
+		w.vertsScan = clCreateBuffer(w.context, CL_MEM_READ_ONLY, memSize, 0, &err);
+		if (err != CL_SUCCESS) return err;
+		w.numVertsTable = clCreateBuffer(w.context, CL_MEM_READ_ONLY, sizeof(cl_uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		w.triTable = clCreateBuffer(w.context, CL_MEM_READ_ONLY, sizeof(cl_uint), 0, &err);
+		return err;
+	}
+
+	static void releaseWorker(Worker &w)
+	{
+		cl_mem buffers[] = { w.volume, w.voxelVerts, w.voxelOccupied, w.compactedVoxels, w.vertsScan,
+							 w.numVertsTable, w.triTable, w.pos, w.norm, w.vertexHash };
+		for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++) {
+			if (buffers[i]) clReleaseMemObject(buffers[i]);
+		}
+		if (w.classifyKernel) clReleaseKernel(w.classifyKernel);
+		if (w.generateKernel) clReleaseKernel(w.generateKernel);
+		if (w.program) clReleaseProgram(w.program);
+		if (w.queue) clReleaseCommandQueue(w.queue);
+		if (w.context) clReleaseContext(w.context);
+	}
+
+	cl_int init(const std::vector<cl_device_id> &devices, const char *source,
+				const cl_uint gridSize[4], cl_uint slabDepth)
+	{
+		close();
+		if (devices.empty() || gridSize[2] < 2) return CL_INVALID_VALUE;
+
+		memcpy(grid, gridSize, sizeof(grid));
+		depth = MAX(MIN(slabDepth, gridSize[2] - 1), 1u);
+		numSlabs = (gridSize[2] - 1 + depth - 1) / depth;
+		slabVoxelsMax = gridSize[0] * gridSize[1] * (depth + 1);
+
+		workers.resize(devices.size());
+		for (size_t d = 0; d < devices.size(); d++) {
+			cl_int err = initWorker(workers[d], devices[d], source);
+			if (err != CL_SUCCESS) {
+				shrLog("slabs: device %u (%s) failed to initialize (%d)\n", (uint)d, workers[d].name.c_str(), err);
+				workers.resize(d + 1);
+				close();
+				return err;
+			}
+			shrLog("slabs: device %u: %s, %s volume\n", (uint)d, workers[d].name.c_str(),
+				   workers[d].volumeBuffer ? "buffer" : "image");
+		}
+		shrLog("slabs: %u slabs of %u voxel layers on %u devices\n", numSlabs, depth, (uint)workers.size());
+		return CL_SUCCESS;
+	}
+
+	void close(void)
+	{
+		for (size_t w = 0; w < workers.size(); w++) {
+			releaseWorker(workers[w]);
+		}
+		workers.clear();
+		if (releaseDevice) {
+			for (size_t d = 0; d < subDevices.size(); d++) {
+				releaseDevice(subDevices[d]);
+			}
+		}
+		subDevices.clear();
+	}
+
+	static cl_int ensureCapacity(Worker &w, uint numVerts)
+	{
+		if (numVerts <= w.vertexCapacity) return CL_SUCCESS;
+		uint capacity = MAX(numVerts, w.vertexCapacity * 2);
+		if (w.pos) clReleaseMemObject(w.pos);
+		if (w.norm) clReleaseMemObject(w.norm);
+		if (w.vertexHash) clReleaseMemObject(w.vertexHash);
+		w.pos = w.norm = w.vertexHash = 0;
+		w.vertexCapacity = 0;
+
+		cl_int err = CL_SUCCESS;
+		w.pos = clCreateBuffer(w.context, CL_MEM_WRITE_ONLY, capacity * 4 * sizeof(float), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		w.norm = clCreateBuffer(w.context, CL_MEM_WRITE_ONLY, capacity * 4 * sizeof(float), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		w.vertexHash = clCreateBuffer(w.context, CL_MEM_WRITE_ONLY, capacity * sizeof(uint), 0, &err);
+		if (err != CL_SUCCESS) return err;
+		w.vertexCapacity = capacity;
+		return CL_SUCCESS;
+	}
+
+	static cl_int extractSlab(Worker &w, cl_uint slab, const uchar *volume, const cl_float voxelSize[4],
+							  const cl_float upperLeft[4], float isoValue, SlabResult &result)
+	{
+		cl_uint z0 = slab * depth;
+		cl_uint planes = MIN(depth, grid[2] - 1 - z0) + 1;
+		cl_uint slabGrid[4] = { grid[0], grid[1], planes, 0 };
+		cl_uint slabShift[4] = { 1, grid[0], grid[0] * grid[1], 0 };
+		cl_uint numVoxels = grid[0] * grid[1] * planes;
+		cl_float slabUpperLeft[4] = { upperLeft[0], upperLeft[1], upperLeft[2] + z0 * voxelSize[2], upperLeft[3] };
+		const uchar *src = volume + (size_t)z0 * grid[0] * grid[1];
+
+		cl_int err = CL_SUCCESS;
+		if (w.volumeBuffer) {
+			err = clEnqueueWriteBuffer(w.queue, w.volume, CL_FALSE, 0, numVoxels, src, 0, 0, 0);
+		} else {
+			size_t origin[3] = { 0, 0, 0 };
+			size_t region[3] = { grid[0], grid[1], planes };
+			err = clEnqueueWriteImage(w.queue, w.volume, CL_FALSE, origin, region, grid[0], grid[0] * grid[1], src, 0, 0, 0);
+		}
+		if (err != CL_SUCCESS) return err;
+
+		size_t threads = CLASSIFY_GROUP_SIZE;
+		size_t global = (numVoxels + threads - 1) / threads * threads;
+		int k = 0;
+		err = clSetKernelArg(w.classifyKernel, k++, sizeof(cl_mem), &w.voxelVerts);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.classifyKernel, k++, sizeof(cl_mem), &w.voxelOccupied);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.classifyKernel, k++, sizeof(cl_mem), &w.volume);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.classifyKernel, k++, 4 * sizeof(cl_uint), slabGrid);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.classifyKernel, k++, 4 * sizeof(cl_uint), slabShift);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.classifyKernel, k++, 4 * sizeof(cl_uint), slabGrid);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.classifyKernel, k++, sizeof(cl_uint), &numVoxels);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.classifyKernel, k++, 4 * sizeof(cl_float), voxelSize);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.classifyKernel, k++, sizeof(float), &isoValue);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.classifyKernel, k++, sizeof(cl_mem), &w.numVertsTable);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueNDRangeKernel(w.queue, w.classifyKernel, 1, NULL, &global, &threads, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+
+		// the slabs are small enough to scan and compact on the host
+		std::vector<uint> verts(numVoxels);
+		err = clEnqueueReadBuffer(w.queue, w.voxelVerts, CL_TRUE, 0, numVoxels * sizeof(uint), &verts[0], 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+
+		std::vector<uint> compacted;
+		uint totalVerts = 0;
+		for (cl_uint i = 0; i < numVoxels; i++) {
+			uint n = verts[i];
+			verts[i] = totalVerts;
+			if (n > 0) {
+				compacted.push_back(i);
+				totalVerts += n;
+			}
+		}
+		if (totalVerts == 0) return CL_SUCCESS;
+
+		// generateTriangles2 only writes below maxVerts - 3
+		uint maxVerts = totalVerts + 3;
+		uint activeVoxels = (uint)compacted.size();
+		err = ensureCapacity(w, maxVerts);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueWriteBuffer(w.queue, w.compactedVoxels, CL_FALSE, 0, activeVoxels * sizeof(uint), &compacted[0], 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueWriteBuffer(w.queue, w.vertsScan, CL_FALSE, 0, numVoxels * sizeof(uint), &verts[0], 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+
+		threads = GENERATE_GROUP_SIZE;
+		global = (activeVoxels + threads - 1) / threads * threads;
+		k = 0;
+		err = clSetKernelArg(w.generateKernel, k++, sizeof(cl_mem), &w.pos);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, sizeof(cl_mem), &w.norm);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, sizeof(cl_mem), &w.compactedVoxels);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, sizeof(cl_mem), &w.vertsScan);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, sizeof(cl_mem), &w.volume);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, 4 * sizeof(cl_uint), slabGrid);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, 4 * sizeof(cl_uint), slabShift);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, 4 * sizeof(cl_uint), slabGrid);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, 4 * sizeof(cl_float), voxelSize);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, 4 * sizeof(cl_float), slabUpperLeft);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, sizeof(float), &isoValue);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, sizeof(cl_uint), &activeVoxels);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, sizeof(cl_uint), &maxVerts);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, sizeof(cl_mem), &w.numVertsTable);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, sizeof(cl_mem), &w.triTable);
+		if (err != CL_SUCCESS) return err;
+		err = clSetKernelArg(w.generateKernel, k++, sizeof(cl_mem), &w.vertexHash);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueNDRangeKernel(w.queue, w.generateKernel, 1, NULL, &global, &threads, 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+
+		result.pos.resize(totalVerts * 4);
+		result.normal.resize(totalVerts * 4);
+		result.vertexHash.resize(totalVerts);
+		err = clEnqueueReadBuffer(w.queue, w.pos, CL_FALSE, 0, totalVerts * 4 * sizeof(float), &result.pos[0], 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueReadBuffer(w.queue, w.norm, CL_FALSE, 0, totalVerts * 4 * sizeof(float), &result.normal[0], 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueReadBuffer(w.queue, w.vertexHash, CL_TRUE, 0, totalVerts * sizeof(uint), &result.vertexHash[0], 0, 0, 0);
+		if (err != CL_SUCCESS) return err;
+
+		// edge hashes are point + axis * numPoints of the slab grid, move them to the full grid
+		uint slabPoints = numVoxels;
+		uint gridPoints = grid[0] * grid[1] * grid[2];
+		uint pointOffset = z0 * grid[0] * grid[1];
+		for (uint v = 0; v < totalVerts; v++) {
+			uint h = result.vertexHash[v];
+			result.vertexHash[v] = (h / slabPoints) * gridPoints + (h % slabPoints) + pointOffset;
+		}
+		return CL_SUCCESS;
+	}
+
+	// own run first, then the end of the longest other run
+	static bool nextSlab(size_t self, cl_uint &slab)
+	{
+		std::lock_guard<std::mutex> lock(queueLock);
+		Worker &w = workers[self];
+		if (!w.slabs.empty()) {
+			slab = w.slabs.front();
+			w.slabs.pop_front();
+			return true;
+		}
+
+		size_t victim = self;
+		size_t longest = 0;
+		for (size_t v = 0; v < workers.size(); v++) {
+			if (workers[v].slabs.size() > longest) {
+				longest = workers[v].slabs.size();
+				victim = v;
+			}
+		}
+		if (longest == 0) return false;
+		slab = workers[victim].slabs.back();
+		workers[victim].slabs.pop_back();
+		w.slabsStolen++;
+		return true;
+	}
+
+	// contiguous runs in proportion to the measured throughput, equal runs until measured
+	static void dealSlabs(void)
+	{
+		double total = 0.0;
+		for (size_t w = 0; w < workers.size(); w++) {
+			total += (workers[w].throughput > 0.0) ? workers[w].throughput : 1.0;
+		}
+
+		double share = 0.0;
+		cl_uint begin = 0;
+		for (size_t w = 0; w < workers.size(); w++) {
+			share += ((workers[w].throughput > 0.0) ? workers[w].throughput : 1.0) / total;
+			cl_uint end = (w + 1 == workers.size()) ? numSlabs : MIN((cl_uint)(share * numSlabs + 0.5), numSlabs);
+			workers[w].slabs.clear();
+			for (cl_uint s = begin; s < end; s++) {
+				workers[w].slabs.push_back(s);
+			}
+			begin = MAX(begin, end);
+		}
+	}
+
+	cl_int extract(const uchar *volume, const cl_float voxelSize[4], const cl_float upperLeft[4], float isoValue,
+				   std::vector<float> &pos, std::vector<float> &normal, std::vector<uint> &vertexHash)
+	{
+		pos.clear();
+		normal.clear();
+		vertexHash.clear();
+		if (workers.empty()) return CL_INVALID_VALUE;
+
+		dealSlabs();
+		std::vector<SlabResult> results(numSlabs);
+		std::vector<int> errors(workers.size(), CL_SUCCESS);
+
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < workers.size(); t++) {
+			threads.push_back(std::thread([&, t]() {
+				Worker &w = workers[t];
+				w.busyTime = 0.0;
+				w.slabsDone = w.slabsStolen = 0;
+				double voxels = 0.0;
+				cl_uint slab;
+				while (errors[t] == CL_SUCCESS && nextSlab(t, slab)) {
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					errors[t] = extractSlab(w, slab, volume, voxelSize, upperLeft, isoValue, results[slab]);
+					w.busyTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+					voxels += (double)grid[0] * grid[1] * MIN(depth, grid[2] - 1 - slab * depth);
+					w.slabsDone++;
+				}
+				// smooth over extractions, a single slow frame shouldn't starve a device
+				if (w.busyTime > 0.0) {
+					double measured = voxels / w.busyTime;
+					w.throughput = (w.throughput > 0.0) ? 0.5 * (w.throughput + measured) : measured;
+				}
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++) {
+			threads[t].join();
+		}
+		for (size_t t = 0; t < errors.size(); t++) {
+			if (errors[t] != CL_SUCCESS) return errors[t];
+		}
+
+		// merge in z order
+		for (cl_uint s = 0; s < numSlabs; s++) {
+			pos.insert(pos.end(), results[s].pos.begin(), results[s].pos.end());
+			normal.insert(normal.end(), results[s].normal.begin(), results[s].normal.end());
+			vertexHash.insert(vertexHash.end(), results[s].vertexHash.begin(), results[s].vertexHash.end());
+		}
+		return CL_SUCCESS;
+	}
+
+	void logStats(void)
+	{
+		for (size_t w = 0; w < workers.size(); w++) {
+			shrLog("slabs: device %u %-32s %3u slabs (%u stolen), %.1f MVoxels/s\n", (uint)w, workers[w].name.c_str(),
+				   workers[w].slabsDone, workers[w].slabsStolen, workers[w].throughput * 1.0e-6);
+		}
+	}
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_SLABS {
+	// Heterogeneous extraction over several devices. The grid is cut into z slabs of slabDepth
+	// voxel layers; every slab is extracted on its own (classifyVoxel, host scan,
+	// generateTriangles2) and the slabs are merged in z order with the edge hashes mapped back
+	// to the full grid, so the mesh doesn't depend on which device ran which slab.
+	// Every device has its own context, queue and program. The slabs are dealt out in
+	// contiguous runs sized by the throughput each device reached on the previous extraction,
+	// a device whose run is done steals from the end of the longest remaining one.
+
+	// split the CPU devices that support cl_ext_device_fission into subDevicesPerCPU equal
+	// sub-devices, or one sub-device per NUMA node for PARTITION_NUMA, so every slab's
+	// buffers are touched by the cores of one node. The other devices are passed through
+	// (0 or 1 keeps them whole).
+	const cl_uint PARTITION_NUMA = ~0u;
+	std::vector<cl_device_id> partitionDevices(const std::vector<cl_device_id> &devices, cl_uint subDevicesPerCPU);
+
+	// source is the marching cubes program source including the table preamble
+	cl_int init(const std::vector<cl_device_id> &devices, const char *source,
+				const cl_uint gridSize[4], cl_uint slabDepth);
+	void close(void);
+
+	// same output as MC_FLYINGEDGES::extractCPU, volume is the normalized 8 bit volume
+	cl_int extract(const uchar *volume, const cl_float voxelSize[4], const cl_float upperLeft[4], float isoValue,
+				   std::vector<float> &pos, std::vector<float> &normal, std::vector<uint> &vertexHash);
+
+	// slabs, steals and throughput of every device on the last extraction
+	void logStats(void);
+};
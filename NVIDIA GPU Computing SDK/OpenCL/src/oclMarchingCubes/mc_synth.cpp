@@ -0,0 +1,182 @@
+#include "mc_synth.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include <oclUtils.h>
+
+namespace MC_SYNTH {
+
+	const char *shapeNames[NUM_SHAPES] = { "sphere", "torus", "gyroid", "metaballs", "noise" };
+
+	bool parseShape(const char *name, Shape &shape)
+	{
+		for (int s = 0; s < NUM_SHAPES; s++) {
+			if (strcmp(name, shapeNames[s]) == 0) {
+				shape = (Shape)s;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	Params::Params()
+		: shape(SHAPE_SPHERE), frequency(4.0f), seed(1)
+	{
+	}
+
+	// keep in sync with synthHash / synthField in marchingCubes_kernel.cl
+	static cl_uint hash(cl_uint x, cl_uint y, cl_uint z, cl_uint seed)
+	{
+		cl_uint h = seed ^ (x * 0x8da6b343u) ^ (y * 0xd8163841u) ^ (z * 0xcb1ab31fu);
+		h ^= h >> 16;
+		h *= 0x7feb352du;
+		h ^= h >> 15;
+		h *= 0x846ca68bu;
+		h ^= h >> 16;
+		return h;
+	}
+
+	// [-1, 1]
+	static float lattice(int x, int y, int z, cl_uint seed)
+	{
+		return hash((cl_uint)x, (cl_uint)y, (cl_uint)z, seed) * (2.0f / 4294967295.0f) - 1.0f;
+	}
+
+	static float fade(float t)
+	{
+		return t * t * (3.0f - 2.0f * t);
+	}
+
+	static float lerp(float a, float b, float t)
+	{
+		return a + (b - a) * t;
+	}
+
+	static float valueNoise(float x, float y, float z, cl_uint seed)
+	{
+		float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+		int ix = (int)fx, iy = (int)fy, iz = (int)fz;
+		float tx = fade(x - fx), ty = fade(y - fy), tz = fade(z - fz);
+
+		float c[2][2];
+		for (int dz = 0; dz < 2; dz++) {
+			for (int dy = 0; dy < 2; dy++) {
+				c[dz][dy] = lerp(lattice(ix, iy + dy, iz + dz, seed), lattice(ix + 1, iy + dy, iz + dz, seed), tx);
+			}
+		}
+		return lerp(lerp(c[0][0], c[0][1], ty), lerp(c[1][0], c[1][1], ty), tz);
+	}
+
+	static float field(const Params &params, float x, float y, float z)
+	{
+		switch (params.shape) {
+		case SHAPE_SPHERE:
+			return 0.7f - sqrtf(x * x + y * y + z * z);
+		case SHAPE_TORUS: {
+			float q = sqrtf(x * x + y * y) - 0.6f;
+			return 0.25f - sqrtf(q * q + z * z);
+		}
+		case SHAPE_GYROID: {
+			float s = 3.14159265f * params.frequency;
+			float sx = s * x, sy = s * y, sz = s * z;
+			return (sinf(sx) * cosf(sy) + sinf(sy) * cosf(sz) + sinf(sz) * cosf(sx)) * (1.0f / 1.5f);
+		}
+		case SHAPE_METABALLS: {
+			int numBalls = (int)CLAMP(params.frequency * params.frequency * params.frequency, 1.0f, 4096.0f);
+			float r = 0.7f / MAX(params.frequency, 1.0f);
+			float sum = 0.0f;
+			for (int b = 0; b < numBalls; b++) {
+				float cx = hash(b, 0, 0, params.seed) * (1.6f / 4294967295.0f) - 0.8f;
+				float cy = hash(b, 1, 0, params.seed) * (1.6f / 4294967295.0f) - 0.8f;
+				float cz = hash(b, 2, 0, params.seed) * (1.6f / 4294967295.0f) - 0.8f;
+				float d2 = (x - cx) * (x - cx) + (y - cy) * (y - cy) + (z - cz) * (z - cz);
+				sum += r * r / (d2 + 1.0e-6f);
+			}
+			return MIN(sum, 2.0f) - 1.0f;
+		}
+		case SHAPE_NOISE: {
+			float sum = 0.0f, amplitude = 1.0f, f = params.frequency * 0.5f;
+			for (int octave = 0; octave < 4; octave++) {
+				sum += amplitude * valueNoise(x * f, y * f, z * f, params.seed + octave);
+				amplitude *= 0.5f;
+				f *= 2.0f;
+			}
+			return sum * (1.0f / 1.875f);
+		}
+		default:
+			return 0.0f;
+		}
+	}
+
+	void fill(const Params &params, const cl_uint gridSize[4], float *volume, int numThreads)
+	{
+		if (numThreads <= 0) {
+			numThreads = MAX((int)std::thread::hardware_concurrency(), 1);
+		}
+		cl_uint maxDim = MAX(MAX(gridSize[0], gridSize[1]), MAX(gridSize[2], 2u));
+		float scale = 2.0f / (maxDim - 1);
+
+		// z slices round robin
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; t++) {
+			threads.push_back(std::thread([=]() {
+				for (cl_uint k = t; k < gridSize[2]; k += numThreads) {
+					float z = (2.0f * k - (gridSize[2] - 1.0f)) * 0.5f * scale;
+					float *slice = volume + (size_t)k * gridSize[0] * gridSize[1];
+					for (cl_uint j = 0; j < gridSize[1]; j++) {
+						float y = (2.0f * j - (gridSize[1] - 1.0f)) * 0.5f * scale;
+						for (cl_uint i = 0; i < gridSize[0]; i++) {
+							float x = (2.0f * i - (gridSize[0] - 1.0f)) * 0.5f * scale;
+							float v = 0.5f + field(params, x, y, z);
+							slice[(size_t)j * gridSize[0] + i] = CLAMP(v, 0.0f, 1.0f);
+						}
+					}
+				}
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++) {
+			threads[t].join();
+		}
+	}
+
+	cl_mem fillDevice(cl_context context, cl_command_queue queue, cl_program program,
+					  const Params &params, const cl_uint gridSize[4], cl_int *err)
+	{
+		size_t numSamples = (size_t)gridSize[0] * gridSize[1] * gridSize[2];
+		cl_mem volume = clCreateBuffer(context, CL_MEM_READ_WRITE, numSamples, 0, err);
+		if (*err != CL_SUCCESS) return 0;
+
+		cl_kernel kernel = clCreateKernel(program, "synthesizeVolume", err);
+		if (*err != CL_SUCCESS) {
+			clReleaseMemObject(volume);
+			return 0;
+		}
+
+		cl_uint grid[4] = { gridSize[0], gridSize[1], gridSize[2], 0 };
+		cl_int shape = params.shape;
+		int k = 0;
+		*err = clSetKernelArg(kernel, k++, sizeof(cl_mem), &volume);
+		*err |= clSetKernelArg(kernel, k++, 4 * sizeof(cl_uint), grid);
+		*err |= clSetKernelArg(kernel, k++, sizeof(cl_int), &shape);
+		*err |= clSetKernelArg(kernel, k++, sizeof(float), &params.frequency);
+		*err |= clSetKernelArg(kernel, k++, sizeof(cl_uint), &params.seed);
+
+		size_t global[3] = { gridSize[0], gridSize[1], gridSize[2] };
+		if (*err == CL_SUCCESS) {
+			*err = clEnqueueNDRangeKernel(queue, kernel, 3, NULL, global, NULL, 0, 0, 0);
+		}
+		if (*err == CL_SUCCESS) {
+			*err = clFinish(queue);
+		}
+		clReleaseKernel(kernel);
+		if (*err != CL_SUCCESS) {
+			clReleaseMemObject(volume);
+			return 0;
+		}
+		return volume;
+	}
+};
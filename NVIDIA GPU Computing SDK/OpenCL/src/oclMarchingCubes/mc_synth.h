@@ -0,0 +1,40 @@
+#pragma once
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_SYNTH {
+	// Procedural volumes (-synth=<shape>) for benchmarks that don't depend on a data file.
+	// Every shape is a field f with the surface at f = 0 (positive inside), stored as
+	// clamp(0.5 + f, 0, 1), so the surface is at isovalue 0.5 and the samples need no range
+	// search. The grid is mapped to [-1, 1] along its longest axis, unit voxels.
+	// synthesizeVolume in marchingCubes_kernel.cl evaluates the same fields on the device.
+	enum Shape {
+		SHAPE_SPHERE,		// one sphere, radius 0.7
+		SHAPE_TORUS,		// one torus around z
+		SHAPE_GYROID,		// frequency periods across the grid
+		SHAPE_METABALLS,	// frequency^3 balls of radius 0.7 / frequency
+		SHAPE_NOISE,		// 4 octaves of value noise, base frequency lattice cells across the grid
+		NUM_SHAPES
+	};
+
+	extern const char *shapeNames[NUM_SHAPES];
+	bool parseShape(const char *name, Shape &shape);
+
+	struct Params {
+		Shape shape;
+		float frequency;	// surface density of gyroid, metaballs and noise
+		cl_uint seed;		// metaball centers and noise lattice
+
+		Params();
+	};
+
+	// fill volume with gridSize[0] x gridSize[1] x gridSize[2] samples in [0, 1] on numThreads
+	// host threads (0 = all hardware threads)
+	void fill(const Params &params, const cl_uint gridSize[4], float *volume, int numThreads);
+
+	// the same volume quantized like the UNORM_INT8 image into a new linear uchar buffer,
+	// program has to be built from marchingCubes_kernel.cl
+	cl_mem fillDevice(cl_context context, cl_command_queue queue, cl_program program,
+					  const Params &params, const cl_uint gridSize[4], cl_int *err);
+};
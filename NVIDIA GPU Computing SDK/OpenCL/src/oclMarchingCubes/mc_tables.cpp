@@ -0,0 +1,76 @@
+#include "mc_tables.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace MC_TABLES {
+
+	const char *storageNames[NUM_STORAGES] = { "image", "constant", "packed" };
+
+	bool parseStorage(const char *name, Storage &storage)
+	{
+		for (int s = 0; s < NUM_STORAGES; s++) {
+			if (strcmp(name, storageNames[s]) == 0) {
+				storage = (Storage)s;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const char *buildOption(Storage storage)
+	{
+		switch (storage) {
+		case STORAGE_CONSTANT: return "-D MC_TABLES_CONSTANT";
+		case STORAGE_PACKED:   return "-D MC_TABLES_PACKED";
+		default:               return "";
+		}
+	}
+
+	static void appendf(std::string &s, const char *format, unsigned long long value)
+	{
+		char buffer[32];
+		sprintf(buffer, format, value);
+		s += buffer;
+	}
+
+	std::string programSource(const uchar triTable[256][16], const uchar numVertsTable[256])
+	{
+		std::string s;
+		s += "#if defined(MC_TABLES_CONSTANT)\n";
+		s += "__constant uchar mcNumVertsTable[256] = {";
+		for (int c = 0; c < 256; c++) {
+			appendf(s, (c % 16 == 0) ? "\n%llu," : " %llu,", numVertsTable[c]);
+		}
+		s += "\n};\n__constant uchar mcTriTable[256 * 16] = {";
+		for (int c = 0; c < 256; c++) {
+			s += "\n";
+			for (int e = 0; e < 16; e++) {
+				appendf(s, "%llu,", triTable[c][e]);
+			}
+		}
+		s += "\n};\n";
+
+		// unused entries (0xff) become 0xf, they are never read
+		s += "#elif defined(MC_TABLES_PACKED)\n";
+		s += "__constant uint mcNumVertsPacked[32] = {";
+		for (int w = 0; w < 32; w++) {
+			unsigned long long word = 0;
+			for (int n = 0; n < 8; n++) {
+				word |= (unsigned long long)(numVertsTable[w * 8 + n] & 0xf) << (n * 4);
+			}
+			appendf(s, (w % 8 == 0) ? "\n0x%08llxu," : " 0x%08llxu,", word);
+		}
+		s += "\n};\n__constant ulong mcTriPacked[256] = {";
+		for (int c = 0; c < 256; c++) {
+			unsigned long long word = 0;
+			for (int e = 0; e < 16; e++) {
+				word |= (unsigned long long)(triTable[c][e] & 0xf) << (e * 4);
+			}
+			appendf(s, (c % 4 == 0) ? "\n0x%016llxul," : " 0x%016llxul,", word);
+		}
+		s += "\n};\n";
+		s += "#endif\n\n";
+		return s;
+	}
+};
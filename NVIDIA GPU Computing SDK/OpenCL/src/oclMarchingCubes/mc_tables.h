@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+
+#include "defines.h"
+
+namespace MC_TABLES {
+	// Storage of the marching cubes lookup tables in the kernels, selected with a build
+	// option, see NUM_VERTS / TRI_EDGE in marchingCubes_kernel.cl.
+	enum Storage {
+		STORAGE_IMAGE,		// uchar image2d, read through the table sampler
+		STORAGE_CONSTANT,	// uchar __constant arrays
+		STORAGE_PACKED,		// 4 bit entries in __constant uint / ulong arrays
+		NUM_STORAGES
+	};
+
+	extern const char *storageNames[NUM_STORAGES];
+
+	// name to storage, returns false for an unknown name
+	bool parseStorage(const char *name, Storage &storage);
+
+	// option selecting the storage in the program build ("" for images)
+	const char *buildOption(Storage storage);
+
+	// __constant definitions of both the plain and the packed tables, each guarded by
+	// its build option, to be prepended to the program source
+	std::string programSource(const uchar triTable[256][16], const uchar numVertsTable[256]);
+};
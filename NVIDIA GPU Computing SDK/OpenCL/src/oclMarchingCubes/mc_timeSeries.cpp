@@ -0,0 +1,324 @@
+#include "mc_timeSeries.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <oclUtils.h>
+
+#include "mc_helper.h"
+
+namespace MC_TIMESERIES {
+
+	struct Slot {
+		cl_mem volume;
+		cl_mem staging;			// CL_MEM_ALLOC_HOST_PTR, mapped for the lifetime of the slot
+		uchar *stagingPtr;
+		cl_event uploaded;
+		cl_event consumed;		// marker after the kernels of the last frame that read the volume
+		int frame;
+	};
+
+	struct Output {
+		cl_mem pos;
+		cl_mem normal;
+		cl_mem vertexHash;
+		cl_event readDone;
+		std::vector<float> h_pos;
+		std::vector<float> h_normal;
+		std::vector<uint> h_vertexHash;
+	};
+
+	static cl_command_queue computeQueue = 0;
+	static cl_command_queue transferQueue = 0;
+	static std::vector<Slot> slots;
+	static std::vector<Output> outputs;
+	static cl_uint grid[4];
+	static size_t numPoints = 0;
+	static bool uploadBuffer = false;
+	static std::vector<float> fileData;
+
+	static void releaseEvent(cl_event &event)
+	{
+		if (event) clReleaseEvent(event);
+		event = 0;
+	}
+
+	bool frameName(const char *pattern, int frame, std::string &name)
+	{
+		char buffer[1024];
+		int length = snprintf(buffer, sizeof(buffer), pattern, frame);
+		if (length < 0 || length >= (int)sizeof(buffer)) {
+			shrLog("-series=%s: the name of frame %d doesn't fit %u characters\n", pattern, frame, (uint)sizeof(buffer) - 1);
+			return false;
+		}
+		name = buffer;
+		return true;
+	}
+
+	cl_int init(cl_context context, cl_device_id device, cl_command_queue queue,
+				const cl_uint gridSize[4], int numSlots, bool volumeBuffer, uint maxVerts)
+	{
+		close();
+		computeQueue = queue;
+		uploadBuffer = volumeBuffer;
+		memcpy(grid, gridSize, sizeof(grid));
+		numPoints = (size_t)gridSize[0] * gridSize[1] * gridSize[2];
+
+		cl_int err = CL_SUCCESS;
+		transferQueue = clCreateCommandQueue(context, device, 0, &err);
+		if (err != CL_SUCCESS) return err;
+
+		cl_image_format format;
+		format.image_channel_order = CL_R;
+		format.image_channel_data_type = CL_UNORM_INT8;
+		slots.resize(MAX(numSlots, 1));
+		for (size_t s = 0; s < slots.size(); s++) {
+			Slot &slot = slots[s];
+			slot.volume = slot.staging = 0;
+			slot.stagingPtr = NULL;
+			slot.uploaded = slot.consumed = 0;
+			slot.frame = -1;
+
+			if (volumeBuffer) {
+				slot.volume = clCreateBuffer(context, CL_MEM_READ_ONLY, numPoints, 0, &err);
+			} else {
+				slot.volume = clCreateImage3D(context, CL_MEM_READ_ONLY, &format, gridSize[0], gridSize[1], gridSize[2], 0, 0, 0, &err);
+			}
+			if (err != CL_SUCCESS) return err;
+			slot.staging = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, numPoints, 0, &err);
+			if (err != CL_SUCCESS) return err;
+			slot.stagingPtr = (uchar *)clEnqueueMapBuffer(transferQueue, slot.staging, CL_TRUE, CL_MAP_WRITE, 0, numPoints, 0, 0, 0, &err);
+			if (err != CL_SUCCESS) return err;
+		}
+
+		outputs.resize((slots.size() > 1) ? 2 : 1);
+		for (size_t o = 0; o < outputs.size(); o++) {
+			Output &out = outputs[o];
+			out.pos = out.normal = out.vertexHash = 0;
+			out.readDone = 0;
+			out.pos = clCreateBuffer(context, CL_MEM_READ_WRITE, maxVerts * 4 * sizeof(float), 0, &err);
+			if (err != CL_SUCCESS) return err;
+			out.normal = clCreateBuffer(context, CL_MEM_READ_WRITE, maxVerts * 4 * sizeof(float), 0, &err);
+			if (err != CL_SUCCESS) return err;
+			out.vertexHash = clCreateBuffer(context, CL_MEM_READ_WRITE, maxVerts * sizeof(uint), 0, &err);
+			if (err != CL_SUCCESS) return err;
+		}
+		return CL_SUCCESS;
+	}
+
+	void close(void)
+	{
+		if (transferQueue) clFinish(transferQueue);
+		if (computeQueue) clFinish(computeQueue);
+
+		for (size_t s = 0; s < slots.size(); s++) {
+			Slot &slot = slots[s];
+			if (slot.stagingPtr) clEnqueueUnmapMemObject(transferQueue, slot.staging, slot.stagingPtr, 0, 0, 0);
+			releaseEvent(slot.uploaded);
+			releaseEvent(slot.consumed);
+			if (slot.volume) clReleaseMemObject(slot.volume);
+			if (slot.staging) clReleaseMemObject(slot.staging);
+		}
+		if (transferQueue) clFinish(transferQueue);
+		slots.clear();
+
+		for (size_t o = 0; o < outputs.size(); o++) {
+			Output &out = outputs[o];
+			releaseEvent(out.readDone);
+			if (out.pos) clReleaseMemObject(out.pos);
+			if (out.normal) clReleaseMemObject(out.normal);
+			if (out.vertexHash) clReleaseMemObject(out.vertexHash);
+		}
+		outputs.clear();
+
+		if (transferQueue) clReleaseCommandQueue(transferQueue);
+		transferQueue = 0;
+		computeQueue = 0;
+	}
+
+	cl_int stage(int frame, const char *path, float &fmin, float &fmax)
+	{
+		Slot &slot = slots[frame % slots.size()];
+
+		FILE *f = fopen(path, "rb");
+		if (!f) {
+			shrLog("series: can't open '%s'\n", path);
+			return CL_INVALID_VALUE;
+		}
+		fileData.resize(numPoints);
+		size_t read = fread(fileData.data(), sizeof(float), numPoints, f);
+		fclose(f);
+		if (read != numPoints) {
+			shrLog("series: '%s' has %u of %u samples\n", path, (uint)read, (uint)numPoints);
+			return CL_INVALID_VALUE;
+		}
+
+		if (fmin >= fmax) {
+			fmin = fmax = fileData[0];
+			for (size_t i = 1; i < numPoints; i++) {
+				fmin = MIN(fmin, fileData[i]);
+				fmax = MAX(fmax, fileData[i]);
+			}
+		}
+
+		// the previous upload from this staging memory has to be done before it is overwritten
+		if (slot.uploaded) {
+			cl_int err = clWaitForEvents(1, &slot.uploaded);
+			if (err != CL_SUCCESS) return err;
+			releaseEvent(slot.uploaded);
+		}
+		// same quantization as initMC
+		for (size_t i = 0; i < numPoints; i++) {
+			float val = roundf((fileData[i] - fmin) / (fmax - fmin) * 255.0f);
+			slot.stagingPtr[i] = (uchar)MIN(MAX((int)val, 0), 255);
+		}
+
+		// the volume is free once the kernels of the slot's last frame are done
+		cl_uint numWait = slot.consumed ? 1 : 0;
+		cl_int err;
+		if (uploadBuffer) {
+			err = clEnqueueWriteBuffer(transferQueue, slot.volume, CL_FALSE, 0, numPoints, slot.stagingPtr,
+									   numWait, numWait ? &slot.consumed : NULL, &slot.uploaded);
+		} else {
+			size_t origin[3] = { 0, 0, 0 };
+			size_t region[3] = { grid[0], grid[1], grid[2] };
+			err = clEnqueueWriteImage(transferQueue, slot.volume, CL_FALSE, origin, region, 0, 0, slot.stagingPtr,
+									  numWait, numWait ? &slot.consumed : NULL, &slot.uploaded);
+		}
+		clFlush(transferQueue);
+		slot.frame = frame;
+		return err;
+	}
+
+	cl_int acquire(int frame, cl_mem &volume, cl_mem &pos, cl_mem &normal, cl_mem &vertexHash)
+	{
+		Slot &slot = slots[frame % slots.size()];
+		Output &out = outputs[frame % outputs.size()];
+		if (slot.frame != frame || !slot.uploaded) return CL_INVALID_VALUE;
+
+		volume = slot.volume;
+		pos = out.pos;
+		normal = out.normal;
+		vertexHash = out.vertexHash;
+
+		// and for the readback of the frame that used these outputs before
+		cl_event events[2] = { slot.uploaded, out.readDone };
+		return clEnqueueWaitForEvents(computeQueue, out.readDone ? 2 : 1, events);
+	}
+
+	cl_int release(int frame, uint numVerts)
+	{
+		Slot &slot = slots[frame % slots.size()];
+		Output &out = outputs[frame % outputs.size()];
+		releaseEvent(slot.consumed);
+		cl_int err = clEnqueueMarker(computeQueue, &slot.consumed);
+		if (err != CL_SUCCESS) return err;
+		clFlush(computeQueue);
+
+		releaseEvent(out.readDone);
+		out.h_pos.resize(numVerts * 4);
+		out.h_normal.resize(numVerts * 4);
+		out.h_vertexHash.resize(numVerts);
+		if (numVerts == 0) {
+			return clEnqueueMarker(transferQueue, &out.readDone);
+		}
+		err = clEnqueueReadBuffer(transferQueue, out.pos, CL_FALSE, 0, numVerts * 4 * sizeof(float), out.h_pos.data(),
+								  1, &slot.consumed, NULL);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueReadBuffer(transferQueue, out.normal, CL_FALSE, 0, numVerts * 4 * sizeof(float), out.h_normal.data(),
+								  1, &slot.consumed, NULL);
+		if (err != CL_SUCCESS) return err;
+		err = clEnqueueReadBuffer(transferQueue, out.vertexHash, CL_FALSE, 0, numVerts * sizeof(uint), out.h_vertexHash.data(),
+								  1, &slot.consumed, &out.readDone);
+		if (err != CL_SUCCESS) return err;
+		clFlush(transferQueue);
+		return CL_SUCCESS;
+	}
+
+	cl_int finish(int frame, std::vector<float> &pos, std::vector<float> &normal, std::vector<uint> &vertexHash)
+	{
+		Output &out = outputs[frame % outputs.size()];
+		if (!out.readDone) return CL_INVALID_VALUE;
+		cl_int err = clWaitForEvents(1, &out.readDone);
+		pos.swap(out.h_pos);
+		normal.swap(out.h_normal);
+		vertexHash.swap(out.h_vertexHash);
+		return err;
+	}
+
+	cl_int run(const char *pattern, int firstFrame, int numFrames, int numSlots, const char *executablePath,
+			   cl_context context, cl_device_id device, cl_command_queue computeQueue,
+			   const cl_uint gridSize[4], bool volumeBuffer, uint maxVerts, float fmin, float fmax,
+			   bool save, float isoValue, ExtractFn extract)
+	{
+		std::vector<std::string> paths(numFrames);
+		for (int t = 0; t < numFrames; t++) {
+			std::string name;
+			if (!frameName(pattern, firstFrame + t, name)) {
+				return CL_SUCCESS;
+			}
+			char *path = shrFindFilePath(name.c_str(), executablePath);
+			paths[t] = path ? path : name;
+		}
+
+		cl_int err = init(context, device, computeQueue, gridSize, numSlots, volumeBuffer, maxVerts);
+		if (err != CL_SUCCESS) return err;
+
+		uint seriesVerts = 0;
+		std::vector<float> pos, normal;
+		std::vector<uint> vertexHash;
+		auto finishFrame = [&](int t) {
+			cl_int err = finish(t, pos, normal, vertexHash);
+			if (err != CL_SUCCESS) return err;
+			seriesVerts += (uint)vertexHash.size();
+			if (save) {
+				MC_HELPER::saveMesh(paths[t] + "_" + std::to_string(isoValue) + ".obj", pos, normal, vertexHash);
+			}
+			return CL_SUCCESS;
+		};
+
+		shrDeltaT(1);
+		for (int t = 0; t < MIN(numSlots - 1, numFrames); t++) {
+			err = stage(t, paths[t].c_str(), fmin, fmax);
+			if (err != CL_SUCCESS) return err;
+		}
+		for (int t = 0; t < numFrames; t++) {
+			// load the frame furthest ahead while the device works on the previous ones
+			int ahead = t + numSlots - 1;
+			if (ahead < numFrames) {
+				err = stage(ahead, paths[ahead].c_str(), fmin, fmax);
+				if (err != CL_SUCCESS) return err;
+			}
+
+			cl_mem volume, framePos, frameNormal, frameHash;
+			err = acquire(t, volume, framePos, frameNormal, frameHash);
+			if (err != CL_SUCCESS) return err;
+			uint numVerts = 0;
+			err = extract(volume, framePos, frameNormal, frameHash, numVerts);
+			if (err != CL_SUCCESS) return err;
+			err = release(t, numVerts);
+			if (err != CL_SUCCESS) return err;
+
+			// with a single slot nothing overlaps, otherwise frame t-1 was read back while frame t ran
+			if (numSlots == 1) {
+				err = finishFrame(t);
+			} else if (t > 0) {
+				err = finishFrame(t - 1);
+			}
+			if (err != CL_SUCCESS) return err;
+		}
+		if (numSlots > 1) {
+			err = finishFrame(numFrames - 1);
+			if (err != CL_SUCCESS) return err;
+		}
+		double dTime = shrDeltaT(1);
+
+		double numVoxels = (double)gridSize[0] * gridSize[1] * gridSize[2];
+		shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes-series, Frames = %d, Buffers = %d, Throughput = %.2f frames/s, %.4f MVoxels/s, Time = %.5f s, Verts = %u\n",
+				 numFrames, numSlots, numFrames / dTime, (1.0e-6 * numVoxels * numFrames) / dTime, dTime, seriesVerts);
+
+		close();
+		return CL_SUCCESS;
+	}
+};
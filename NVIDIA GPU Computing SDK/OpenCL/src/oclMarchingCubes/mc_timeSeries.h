@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_TIMESERIES {
+	// Pipelined extraction of a sequence of volumes of the same grid. Every frame goes
+	// through a ring of slots (volume image, pinned staging memory, events):
+	//   stage    host loads and normalizes the frame into the slot's pinned staging memory,
+	//            the transfer queue uploads it once the compute that last read the slot is done
+	//   acquire  the compute queue waits for the upload
+	//   release  marks the end of the frame's kernels and enqueues the readback of its
+	//            vertices on the transfer queue
+	//   finish   waits for the readback
+	// With 2 or 3 slots the upload of frame t+1 and the readback of frame t-1 overlap the
+	// kernels of frame t, 1 slot serializes everything (the reference timing).
+	// The vertex outputs are double buffered as long as there is more than one slot.
+
+	// "cardiac_%03d.raw" -> "cardiac_007.raw", false (logged) if the name is too long
+	bool frameName(const char *pattern, int frame, std::string &name);
+
+	// volumeBuffer uploads into a linear uchar buffer instead of a UNORM_INT8 image
+	cl_int init(cl_context context, cl_device_id device, cl_command_queue computeQueue,
+				const cl_uint gridSize[4], int numSlots, bool volumeBuffer, uint maxVerts);
+	void close(void);
+
+	// fmin >= fmax takes the range of this frame and returns it, so the whole sequence
+	// is normalized like its first frame
+	cl_int stage(int frame, const char *path, float &fmin, float &fmax);
+
+	// the compute queue waits for the upload of frame, returns its volume and output buffers
+	cl_int acquire(int frame, cl_mem &volume, cl_mem &pos, cl_mem &normal, cl_mem &vertexHash);
+	cl_int release(int frame, uint numVerts);
+	cl_int finish(int frame, std::vector<float> &pos, std::vector<float> &normal, std::vector<uint> &vertexHash);
+
+	// extract one frame from volume into pos/normal/vertexHash, numVerts of them are read back
+	typedef cl_int (*ExtractFn)(cl_mem volume, cl_mem pos, cl_mem normal, cl_mem vertexHash, uint &numVerts);
+
+	// stage, extract and read back numFrames frames of pattern from firstFrame on through
+	// numSlots slots and log the throughput. The frame files are looked up next to
+	// executablePath, save writes <frame file>_<isoValue>.obj of each frame. fmin < fmax
+	// is the range of every frame, otherwise the first frame's range is used.
+	cl_int run(const char *pattern, int firstFrame, int numFrames, int numSlots, const char *executablePath,
+			   cl_context context, cl_device_id device, cl_command_queue computeQueue,
+			   const cl_uint gridSize[4], bool volumeBuffer, uint maxVerts, float fmin, float fmax,
+			   bool save, float isoValue, ExtractFn extract);
+};
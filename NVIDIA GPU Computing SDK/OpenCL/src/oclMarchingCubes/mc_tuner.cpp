@@ -0,0 +1,223 @@
+#include "mc_tuner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <fstream>
+#include <sstream>
+
+#include <oclUtils.h>
+
+#include "mc_tables.h"
+
+namespace MC_TUNER {
+
+	enum {
+		CLASSIFY = 0,
+		COMPACT = 1,
+		GENERATE = 2,
+		SCAN = 3,
+		TABLES = 4,
+		NUM_KERNELS = 5
+	};
+
+	static const char* KernelNames[NUM_KERNELS] = { "classifyVoxel", "compactVoxels", "generateTriangles2", "scan", "tables" };
+
+	// local memory per generateTriangles2 work-item: vertlist (12 float4) + edgeHash (12 uint)
+	static const cl_ulong GENERATE_LOCAL_BYTES = 12 * (4 * sizeof(float) + sizeof(uint));
+
+	LaunchConfig::LaunchConfig()
+		: classifyThreads(CLASSIFY_THREADS), compactThreads(COMPACT_THREADS),
+		  generateThreads(NTHREADS), scanGroupSize(SCAN_GROUP_SIZE), tableStorage(MC_TABLES::STORAGE_IMAGE)
+	{
+	}
+
+	bool LaunchConfig::operator==(const LaunchConfig &rhs) const
+	{
+		return classifyThreads == rhs.classifyThreads && compactThreads == rhs.compactThreads &&
+			   generateThreads == rhs.generateThreads && scanGroupSize == rhs.scanGroupSize &&
+			   tableStorage == rhs.tableStorage;
+	}
+
+	static uint& field(LaunchConfig &config, int kernel)
+	{
+		switch (kernel) {
+		case CLASSIFY: return config.classifyThreads;
+		case COMPACT:  return config.compactThreads;
+		case GENERATE: return config.generateThreads;
+		case TABLES:   return config.tableStorage;
+		default:       return config.scanGroupSize;
+		}
+	}
+
+	static std::string deviceString(cl_device_id device, cl_device_info param)
+	{
+		char buffer[1024];
+		if (clGetDeviceInfo(device, param, sizeof(buffer), buffer, NULL) != CL_SUCCESS) {
+			return std::string("unknown");
+		}
+		return std::string(buffer);
+	}
+
+	std::string deviceKey(cl_device_id device)
+	{
+		return deviceString(device, CL_DEVICE_NAME) + "|" + deviceString(device, CL_DRIVER_VERSION);
+	}
+
+	DeviceLimits deviceLimits(cl_device_id device, uint numVoxels)
+	{
+		DeviceLimits limits;
+		limits.maxWorkGroupSize = 256;
+		limits.localMemSize = 16 * 1024;
+		limits.numVoxels = numVoxels;
+		cl_bool images = CL_FALSE;
+		clGetDeviceInfo(device, CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &images, NULL);
+		limits.imageSupport = (images == CL_TRUE);
+		clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &limits.maxWorkGroupSize, NULL);
+		clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &limits.localMemSize, NULL);
+		return limits;
+	}
+
+	static bool parseLine(const std::string &line, std::string &key, uint grid[3], LaunchConfig &config)
+	{
+		// <device key> \t <gx> <gy> <gz> \t <classify> <compact> <generate> <scan> [<tables>]
+		size_t tab0 = line.find('\t');
+		size_t tab1 = (tab0 == std::string::npos) ? tab0 : line.find('\t', tab0 + 1);
+		if (tab1 == std::string::npos) return false;
+
+		key = line.substr(0, tab0);
+		std::istringstream gridStream(line.substr(tab0 + 1, tab1 - tab0 - 1));
+		std::istringstream configStream(line.substr(tab1 + 1));
+		gridStream >> grid[0] >> grid[1] >> grid[2];
+		configStream >> config.classifyThreads >> config.compactThreads >> config.generateThreads >> config.scanGroupSize;
+		if (gridStream.fail() || configStream.fail()) return false;
+
+		// entries written before the table storage was tuned use images
+		if (!(configStream >> config.tableStorage) || config.tableStorage >= MC_TABLES::NUM_STORAGES) {
+			config.tableStorage = MC_TABLES::STORAGE_IMAGE;
+		}
+		return true;
+	}
+
+	static std::string formatLine(const std::string &key, const uint grid[3], const LaunchConfig &config)
+	{
+		std::ostringstream oss;
+		oss << key << '\t' << grid[0] << ' ' << grid[1] << ' ' << grid[2] << '\t'
+			<< config.classifyThreads << ' ' << config.compactThreads << ' '
+			<< config.generateThreads << ' ' << config.scanGroupSize << ' ' << config.tableStorage;
+		return oss.str();
+	}
+
+	bool loadConfig(const std::string &cacheFile, const std::string &key, const uint gridSize[3], LaunchConfig &config)
+	{
+		std::ifstream in(cacheFile.c_str());
+		if (!in.is_open()) return false;
+
+		double numVoxels = (double)gridSize[0] * gridSize[1] * gridSize[2];
+		double bestDist = -1.0;
+		std::string line;
+		while (std::getline(in, line)) {
+			std::string lineKey;
+			uint grid[3];
+			LaunchConfig entry;
+			if (!parseLine(line, lineKey, grid, entry) || lineKey != key) continue;
+
+			double dist = fabs((double)grid[0] * grid[1] * grid[2] - numVoxels);
+			if (bestDist < 0.0 || dist < bestDist) {
+				bestDist = dist;
+				config = entry;
+			}
+			if (dist == 0.0) break;
+		}
+		return bestDist >= 0.0;
+	}
+
+	bool saveConfig(const std::string &cacheFile, const std::string &key, const uint gridSize[3], const LaunchConfig &config)
+	{
+		// keep the entries of other devices and grids, replace ours
+		std::vector<std::string> lines;
+		{
+			std::ifstream in(cacheFile.c_str());
+			std::string line;
+			while (std::getline(in, line)) {
+				std::string lineKey;
+				uint grid[3];
+				LaunchConfig entry;
+				if (!parseLine(line, lineKey, grid, entry)) continue;
+				if (lineKey == key && grid[0] == gridSize[0] && grid[1] == gridSize[1] && grid[2] == gridSize[2]) continue;
+				lines.push_back(line);
+			}
+		}
+		lines.push_back(formatLine(key, gridSize, config));
+
+		std::ofstream out(cacheFile.c_str(), std::ios::out | std::ios::trunc);
+		if (!out.is_open()) {
+			shrLog("Error writing tuning cache '%s'\n", cacheFile.c_str());
+			return false;
+		}
+		for (size_t i = 0; i < lines.size(); ++i) {
+			out << lines[i] << '\n';
+		}
+		return true;
+	}
+
+	static std::vector<uint> candidates(const DeviceLimits &limits, int kernel)
+	{
+		std::vector<uint> sizes;
+		if (kernel == TABLES) {
+			for (uint storage = 0; storage < MC_TABLES::NUM_STORAGES; storage++) {
+				if (storage == MC_TABLES::STORAGE_IMAGE && !limits.imageSupport) continue;
+				sizes.push_back(storage);
+			}
+			return sizes;
+		}
+		uint maxSize = (uint)MIN(limits.maxWorkGroupSize, (size_t)1024);
+		for (uint size = 32; size <= maxSize; size <<= 1) {
+			switch (kernel) {
+			case GENERATE:
+				if (GENERATE_LOCAL_BYTES * size + 2 * sizeof(uint) > limits.localMemSize) continue;
+				break;
+			default:
+				break;
+			}
+			sizes.push_back(size);
+		}
+		return sizes;
+	}
+
+	LaunchConfig tune(const DeviceLimits &limits, const LaunchConfig &start, TimeLaunchFn timeLaunch)
+	{
+		LaunchConfig best = start;
+		double bestTime = timeLaunch(best);
+		shrLog("tune: start %u/%u/%u/%u %s  %.3f ms\n", best.classifyThreads, best.compactThreads,
+			   best.generateThreads, best.scanGroupSize, MC_TABLES::storageNames[best.tableStorage], bestTime * 1000.0);
+
+		// the kernels are nearly independent, two rounds of coordinate descent are enough
+		for (int round = 0; round < 2; ++round) {
+			bool improved = false;
+			for (int kernel = 0; kernel < NUM_KERNELS; ++kernel) {
+				std::vector<uint> sizes = candidates(limits, kernel);
+				for (size_t i = 0; i < sizes.size(); ++i) {
+					if (sizes[i] == field(best, kernel)) continue;
+
+					LaunchConfig trial = best;
+					field(trial, kernel) = sizes[i];
+					double t = timeLaunch(trial);
+					shrLog("tune: %-18s %4u  %.3f ms\n", KernelNames[kernel], sizes[i], t * 1000.0);
+					if (t < bestTime) {
+						bestTime = t;
+						best = trial;
+						improved = true;
+					}
+				}
+			}
+			if (!improved) break;
+		}
+
+		shrLog("tune: best  %u/%u/%u/%u %s  %.3f ms\n", best.classifyThreads, best.compactThreads,
+			   best.generateThreads, best.scanGroupSize, MC_TABLES::storageNames[best.tableStorage], bestTime * 1000.0);
+		return best;
+	}
+};
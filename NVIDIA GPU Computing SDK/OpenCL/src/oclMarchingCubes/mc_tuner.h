@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_TUNER {
+	// work-group sizes used by one pass of the marching cubes pipeline
+	struct LaunchConfig {
+		uint classifyThreads;	// classifyVoxel
+		uint compactThreads;	// compactVoxels
+		uint generateThreads;	// generateTriangles2, compiled into the program as NTHREADS
+		uint scanGroupSize;		// ScanApple prescan kernels
+		uint tableStorage;		// MC_TABLES::Storage of the lookup tables, a build option too
+
+		LaunchConfig();
+		bool operator==(const LaunchConfig &rhs) const;
+		bool operator!=(const LaunchConfig &rhs) const { return !(*this == rhs); }
+	};
+
+	// limits of the current device, used to prune the candidate list
+	struct DeviceLimits {
+		size_t maxWorkGroupSize;
+		cl_ulong localMemSize;
+		uint numVoxels;
+		bool imageSupport;		// image tables are only a candidate with image support
+	};
+
+	// returns the average time (s) of one pipeline pass with the given configuration
+	typedef double (*TimeLaunchFn)(const LaunchConfig &config);
+
+	// cache key: "<device name>|<driver version>"
+	std::string deviceKey(cl_device_id device);
+	DeviceLimits deviceLimits(cl_device_id device, uint numVoxels);
+
+	// the cache is a text file with one line per (device, grid) pair; on a miss for
+	// the exact grid the entry of the same device with the closest voxel count is used
+	bool loadConfig(const std::string &cacheFile, const std::string &key, const uint gridSize[3], LaunchConfig &config);
+	bool saveConfig(const std::string &cacheFile, const std::string &key, const uint gridSize[3], const LaunchConfig &config);
+
+	// coordinate descent over the work-group size of each kernel and the table storage,
+	// starting at "start"
+	LaunchConfig tune(const DeviceLimits &limits, const LaunchConfig &start, TimeLaunchFn timeLaunch);
+};
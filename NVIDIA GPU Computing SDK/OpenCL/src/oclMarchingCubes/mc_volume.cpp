@@ -0,0 +1,141 @@
+#include "mc_volume.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include <oclUtils.h>
+
+namespace MC_VOLUME {
+
+	const char *formatNames[NUM_FORMATS] = { "uchar", "ushort", "float" };
+
+	bool parseFormat(const char *name, Format &format)
+	{
+		for (int f = 0; f < NUM_FORMATS; f++) {
+			if (strcmp(name, formatNames[f]) == 0) {
+				format = (Format)f;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	Layout::Layout()
+		: morton(false), format(FORMAT_UCHAR)
+	{
+		dims[0] = dims[1] = dims[2] = 0;
+		mortonBits[0] = mortonBits[1] = mortonBits[2] = 0;
+	}
+
+	bool imageSupport(cl_device_id device)
+	{
+		cl_bool images = CL_FALSE;
+		clGetDeviceInfo(device, CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &images, NULL);
+		return images == CL_TRUE;
+	}
+
+	bool preferBuffer(cl_device_id device)
+	{
+		cl_device_type type = 0;
+		clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(cl_device_type), &type, NULL);
+		return !imageSupport(device) || (type & CL_DEVICE_TYPE_CPU) != 0;
+	}
+
+	static cl_uint ceilLog2(cl_uint n)
+	{
+		cl_uint bits = 0;
+		while ((1u << bits) < n) bits++;
+		return bits;
+	}
+
+	Layout layout(const cl_uint gridSize[4], Format format, bool morton)
+	{
+		Layout l;
+		l.format = format;
+		l.morton = morton;
+		for (int a = 0; a < 3; a++) {
+			l.dims[a] = gridSize[a];
+			l.mortonBits[a] = morton ? ceilLog2(gridSize[a]) : 0;
+		}
+		return l;
+	}
+
+	size_t numElements(const Layout &layout)
+	{
+		// the Morton order covers the grid padded to powers of two
+		if (layout.morton) {
+			return (size_t)1 << (layout.mortonBits[0] + layout.mortonBits[1] + layout.mortonBits[2]);
+		}
+		return (size_t)layout.dims[0] * layout.dims[1] * layout.dims[2];
+	}
+
+	size_t numBytes(const Layout &layout)
+	{
+		static const size_t elementSize[NUM_FORMATS] = { sizeof(cl_uchar), sizeof(cl_ushort), sizeof(cl_float) };
+		return numElements(layout) * elementSize[layout.format];
+	}
+
+	size_t mortonIndex(const Layout &layout, cl_uint x, cl_uint y, cl_uint z)
+	{
+		size_t index = 0;
+		cl_uint shift = 0;
+		cl_uint bits = MAX(layout.mortonBits[0], MAX(layout.mortonBits[1], layout.mortonBits[2]));
+		for (cl_uint b = 0; b < bits; b++) {
+			if (b < layout.mortonBits[0]) index |= (size_t)((x >> b) & 1) << shift++;
+			if (b < layout.mortonBits[1]) index |= (size_t)((y >> b) & 1) << shift++;
+			if (b < layout.mortonBits[2]) index |= (size_t)((z >> b) & 1) << shift++;
+		}
+		return index;
+	}
+
+	std::string buildOptions(const Layout &layout)
+	{
+		static const char *formatDefines[NUM_FORMATS] = { "MC_VOLUME_UCHAR", "MC_VOLUME_USHORT", "MC_VOLUME_FLOAT" };
+
+		char options[256];
+		sprintf(options, "-D MC_VOLUME_BUFFER -D %s -D MC_VOLUME_X=%u -D MC_VOLUME_Y=%u -D MC_VOLUME_Z=%u",
+				formatDefines[layout.format], layout.dims[0], layout.dims[1], layout.dims[2]);
+		std::string s(options);
+		if (layout.morton) {
+			sprintf(options, " -D MC_VOLUME_MORTON -D MC_MORTON_BITS=%u -D MC_MORTON_BITS_X=%u -D MC_MORTON_BITS_Y=%u -D MC_MORTON_BITS_Z=%u",
+					MAX(layout.mortonBits[0], MAX(layout.mortonBits[1], layout.mortonBits[2])),
+					layout.mortonBits[0], layout.mortonBits[1], layout.mortonBits[2]);
+			s += options;
+		}
+		return s;
+	}
+
+	template <class T>
+	static cl_mem upload(cl_context context, const Layout &layout, const float *samples,
+						 float fmin, float fmax, float range, bool round, cl_int *err)
+	{
+		// same arithmetic as the 8 bit normalization in initMC, so uchar matches the image
+		std::vector<T> data(numElements(layout), (T)0);
+		size_t i = 0;
+		for (cl_uint z = 0; z < layout.dims[2]; z++) {
+			for (cl_uint y = 0; y < layout.dims[1]; y++) {
+				for (cl_uint x = 0; x < layout.dims[0]; x++, i++) {
+					float val = (fmax > fmin) ? (float)((samples[i] - fmin) / (fmax - fmin) * (double)range) : 0.0f;
+					if (round) val = roundf(val);
+					val = MIN(MAX(val, 0.0f), range);
+					size_t dst = layout.morton ? mortonIndex(layout, x, y, z) : i;
+					data[dst] = (T)val;
+				}
+			}
+		}
+		return clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, data.size() * sizeof(T), &data[0], err);
+	}
+
+	cl_mem createBuffer(cl_context context, const Layout &layout, const float *samples,
+						float fmin, float fmax, cl_int *err)
+	{
+		switch (layout.format) {
+		case FORMAT_USHORT: return upload<cl_ushort>(context, layout, samples, fmin, fmax, 65535.0f, true, err);
+		case FORMAT_FLOAT:  return upload<cl_float>(context, layout, samples, fmin, fmax, 1.0f, false, err);
+		default:            return upload<cl_uchar>(context, layout, samples, fmin, fmax, 255.0f, true, err);
+		}
+	}
+};
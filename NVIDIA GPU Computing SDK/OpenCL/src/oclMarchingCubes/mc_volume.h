@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+
+#include <CL/opencl.h>
+
+#include "defines.h"
+
+namespace MC_VOLUME {
+	// Buffer storage of the volume for devices without (fast) images, see VOLUME_ARG / SAMPLE
+	// in marchingCubes_kernel.cl. The kernels index the buffer with the grid compiled in,
+	// so its build options have to be part of the program build.
+	enum Format {
+		FORMAT_UCHAR,		// same quantization as the UNORM_INT8 image
+		FORMAT_USHORT,
+		FORMAT_FLOAT,
+		NUM_FORMATS
+	};
+
+	extern const char *formatNames[NUM_FORMATS];
+	bool parseFormat(const char *name, Format &format);
+
+	struct Layout {
+		cl_uint dims[3];
+		cl_uint mortonBits[3];	// bits per axis of the Morton index, 0 for the linear layout
+		bool morton;
+		Format format;
+
+		Layout();
+	};
+
+	// buffers on CPU devices and on devices without image support, images otherwise
+	bool imageSupport(cl_device_id device);
+	bool preferBuffer(cl_device_id device);
+
+	Layout layout(const cl_uint gridSize[4], Format format, bool morton);
+	size_t numElements(const Layout &layout);
+	size_t numBytes(const Layout &layout);
+	size_t mortonIndex(const Layout &layout, cl_uint x, cl_uint y, cl_uint z);
+
+	// "-D MC_VOLUME_BUFFER ..." for the program build
+	std::string buildOptions(const Layout &layout);
+
+	// normalize the raw samples to [fmin, fmax] -> [0, 1], convert them to the layout's format
+	// and order and upload them
+	cl_mem createBuffer(cl_context context, const Layout &layout, const float *samples,
+						float fmin, float fmax, cl_int *err);
+};
@@ -81,16 +81,36 @@
 #include <string.h>
 #include <math.h>
 
+#include <chrono>
 #include <memory>
 #include <iostream>
 #include <cassert>
 
 #include <vector>
 #include <string>
+#include <map>
 
 #include "defines.h"
 #include "tables.h"
 #include "mc_helper.h"
+#include "mc_tuner.h"
+#include "mc_batch.h"
+#include "mc_bufferPlan.h"
+#include "mc_flyingEdges.h"
+#include "mc_histoPyramid.h"
+#include "mc_labels.h"
+#include "mc_lod.h"
+#include "mc_numa.h"
+#include "mc_profile.h"
+#include "mc_programCache.h"
+#include "mc_regress.h"
+#include "mc_roi.h"
+#include "mc_seed.h"
+#include "mc_slabs.h"
+#include "mc_synth.h"
+#include "mc_tables.h"
+#include "mc_timeSeries.h"
+#include "mc_volume.h"
 #include "ScanApple.h"
 
 // standard utility and system includes
@@ -127,6 +147,7 @@
 cl_platform_id cpPlatform;
 cl_uint uiNumDevices;
 cl_device_id* cdDevices;
+cl_platform_id* cdPlatforms;
 cl_uint uiDeviceUsed;
 cl_uint uiDevCount;
 cl_context cxGPUContext;
@@ -134,8 +155,19 @@ cl_device_id device;
 cl_command_queue cqCommandQueue;
 cl_program cpProgram;
 cl_kernel classifyVoxelKernel;
+cl_kernel classifyVoxelTiledKernel;
 cl_kernel compactVoxelsKernel;
 cl_kernel generateTriangles2Kernel;
+cl_kernel computeCornerSignsKernel;
+cl_kernel classifyVoxelSignsKernel;
+cl_kernel compactVoxelsCubeIndexKernel;
+cl_kernel generateTrianglesCubeIndexKernel;
+cl_kernel generateTrianglesPerTriKernel;
+cl_kernel classifyVoxelAppendKernel;
+cl_kernel sortCompactedVoxelsKernel;
+cl_kernel scatterCompactedScanKernel;
+cl_kernel classifyVoxelNarrowKernel;
+cl_kernel compactVoxelsBitsKernel;
 cl_int ciErrNum;
 char* cPathAndName = NULL;          // var for full paths to data, src, etc.
 char* cSourceCL;                    // Buffer to hold source for compilation 
@@ -205,11 +237,20 @@ cl_mem d_voxelVertsScan = 0;
 cl_mem d_voxelOccupied = 0;
 cl_mem d_voxelOccupiedScan = 0;
 cl_mem d_compVoxelArray;
+cl_mem d_cornerSigns = 0;			// one inside bit per grid point, rows padded to whole words
+cl_mem d_voxelCubeIndex = 0;		// uchar cube index per voxel
+cl_mem d_compCubeIndex = 0;			// cube index of each compacted voxel
+cl_mem d_appendCount = 0;			// number of voxels appended by classifyVoxelAppend
+cl_mem d_voxelVertsNarrow = 0;		// uchar vertex count per voxel
+cl_mem d_occupancyBits = 0;			// one occupied bit per voxel, 32 voxels per word
+cl_mem d_occupancyCount = 0;		// occupied voxels of each word
+cl_mem d_occupancyScan = 0;			// exclusive scan of d_occupancyCount
 
 cl_mem d_VertsHash = 0;
 
 //host data
 std::vector<uint> h_VertsHash;
+std::vector<uchar> h_volume;		// normalized volume, kept for the CPU engine
 std::vector<float> h_pos;
 std::vector<float> h_normal;
 
@@ -226,6 +267,168 @@ cl_float mc_translate[4] = {0.0, 0.0, 0.0, 0.0};
 
 bool saveMeshFlag = 0;
 
+// launch configuration, loaded from the tuning cache at startup
+MC_TUNER::LaunchConfig g_launch;
+std::string tuneCacheFile = "oclMarchingCubes_tuning.txt";
+bool bTune = false;
+bool bLaunchConfigCached = false;
+
+// lookup table storage forced with -tables=image|constant|packed, otherwise the
+// fastest one is picked on the first run on a device and kept in the tuning cache
+int forcedTableStorage = -1;
+
+// use the 3D tiled classify kernel (-classify=tiled)
+bool g_classifyTiled = false;
+
+// classify from a corner sign bitfield and pass the cube index on to generate (-signbits)
+bool g_signBits = false;
+uint cornerSignWordsPerRow = 0;
+uint cornerSignWords = 0;
+
+// compact by appending active voxels in classify, then scan only those (-compact=append)
+// -deterministic sorts the appended voxels back into grid order
+bool g_compactAppend = false;
+bool g_deterministic = false;
+
+// only the surface connected to the cell of a seed point (-seed=x,y,z, a grid point in the
+// volume): the first crossed cell from it towards +x starts a search over the active cells
+bool g_seeded = false;
+cl_int seedPoint[4] = { 0, 0, 0, 0 };
+
+// classify into uchar vertex counts and an occupancy bitmask (-narrow)
+bool g_narrow = false;
+uint occupancyWords = 0;
+
+// stages of one classic pass in order, the buffer plan derives lifetimes from them
+enum MCStage {
+    STAGE_CLASSIFY,
+    STAGE_SCAN_OCCUPIED,
+    STAGE_COMPACT,
+    STAGE_SCAN_VERTS,
+    STAGE_GENERATE,
+    STAGE_READBACK
+};
+bool g_aliasBuffers = false;	// -aliasbuffers, share storage between buffers with disjoint lifetimes
+
+// extraction engine (-engine=classic|hp|fe|fecpu|slabs)
+enum MCEngine {
+    ENGINE_CLASSIC,				// classify / scan / compact / generateTriangles2
+    ENGINE_HISTOPYRAMID,		// classify / HistoPyramid reduction and traversal, see mc_histoPyramid.h
+    ENGINE_FLYING_EDGES,		// Flying Edges on the device, see mc_flyingEdges.h
+    ENGINE_FLYING_EDGES_CPU,	// Flying Edges on the host threads, uploaded for rendering
+    ENGINE_SLABS,				// z slabs scheduled over all devices, see mc_slabs.h
+    NUM_ENGINES
+};
+const char *engineNames[NUM_ENGINES] = { "classic", "hp", "fe", "fecpu", "slabs" };
+MCEngine g_engine = ENGINE_CLASSIC;
+bool engineReady[NUM_ENGINES] = { true, false, false, false, false };
+bool bBenchEngines = false;		// -benchengines, time every engine after TestNoGL
+int feCPUThreads = 0;			// -fethreads=<n>, 0 = all hardware threads
+int slabDepth = 32;				// -slabdepth=<n>, voxel layers per slab of the slabs engine
+int subDevicesPerCPU = 0;		// -subdevices=<n>|numa, split CPU devices with device fission
+
+// NUMA placement of the CPU engine (-numa), see mc_numa.h for the -numa* options
+bool g_numa = false;
+bool bBenchNuma = false;		// -benchnuma, bandwidth and throughput per node count after TestNoGL
+MC_NUMA::Config numaConfig;
+std::vector<MC_NUMA::Node> numaNodes;
+
+// time series (-series=<printf pattern of the frame files> -frames=<n>), extracted with
+// -seriesbuffers volume slots (1 = no overlap) instead of TestNoGL, -seriessave writes every frame
+const char *seriesPattern = NULL;
+int seriesFrames = 0;
+int seriesFirstFrame = 0;		// -firstframe=<n>
+int seriesBuffers = 3;
+bool bSeriesSave = false;
+
+// batch jobs (-batch=<manifest>, see mc_batch.h) instead of TestNoGL, with
+// -batchworkers host threads loading volumes and writing meshes
+const char *batchManifest = NULL;
+int batchWorkers = 2;
+
+// per-stage event timing (-profile[=<file.json|file.csv>], see mc_profile.h) after TestNoGL,
+// swept over -profilegrids=<n>[,<n>...] (cubes cut from the loaded volume, default the whole
+// grid) and -profileiso=<v>[,<v>...] with -profileiters samples per case
+// reference mesh regression (-regress=<ref.obj>[,<ref.obj>...]) instead of TestNoGL with the
+// current volume and engine, the isovalue comes from the "<volume>_<iso>.obj" name of each
+// reference, see mc_regress.h for the gates
+const char *regressReferences = NULL;
+const char *regressBaseline = NULL;		// -regressbaseline=<file> of throughputs per engine and reference
+bool bRegressUpdate = false;			// -regressupdate, record the measured throughputs in it
+float regressSlowdown = 0.1f;			// -regressslowdown=<f>, fail below (1 - f) x baseline
+float regressCountTolerance = 0.0f;		// -regresscounttol=<f>, relative vertex / face count difference
+float regressDistance = 0.01f;			// -regressdistance=<f>, Hausdorff limit in smallest voxel sides
+
+bool bProfile = false;
+const char *profileOutput = NULL;
+const char *profileGrids = NULL;
+const char *profileIsoValues = NULL;
+int profileIterations = 20;
+
+// bake the grid and launch sizes into the program as build constants (-specialize),
+// every build is kept by its options so switching back and forth doesn't recompile
+bool g_specialize = false;
+bool bBenchSpecialize = false;	// -benchspecialize, compare generic and specialized kernels after TestNoGL
+std::map<std::string, cl_program> programVariants;
+
+// volume storage (-volume=image|buffer, default picked from the device), the buffer
+// element type (-volumetype=uchar|ushort|float) and Morton order (-morton)
+int volumeStorageMode = -1;		// -1 auto, 0 image, 1 buffer
+bool g_volumeBuffer = false;
+bool g_imageSupport = true;
+MC_VOLUME::Format volumeBufferFormat = MC_VOLUME::FORMAT_UCHAR;
+bool g_volumeMorton = false;
+MC_VOLUME::Layout volumeLayout;
+std::string programVolumeOptions;	// MC_VOLUME::buildOptions of the layout cpProgram was built for
+
+// procedural volume instead of the file (-synth=sphere|torus|gyroid|metaballs|noise, see
+// mc_synth.h) tuned with -synthfreq=<f> and -synthseed=<n>, -synthdevice fills it with a kernel
+bool g_synth = false;
+bool g_synthDevice = false;
+MC_SYNTH::Params synthParams;
+
+// implicit surface instead of a volume (-implicit=<file.cl>): classify and generate evaluate the
+// "float mcField(float3 p)" of the file at the world position of each grid point, with the
+// longest axis of the -grid* size spanning [-1, 1]. The grid is extracted in z slabs of
+// -implicitslab=<n> voxel layers (default about 16M voxels), only the slab buffers and the mesh
+// are stored. -implicitopts=<options> are added to the build, e.g. -cl-std=CLC++
+bool g_implicit = false;
+std::string implicitSource;
+const char *implicitOptions = "";
+int implicitSlabDepth = 0;
+cl_uint implicitGrid[3];
+cl_float implicitUpperLeftZ;
+
+// volume pyramid of -lodlevels=<n> levels (default 4, see mc_lod.h) for the classic engine,
+// -lod=<l> extracts at level l, -progressive extracts at the coarsest level while the isovalue
+// changes and at level 0 once it has been still for -progressivedelay=<s> seconds
+int lodLevels = 1;
+int lodLevel = 0;
+bool g_progressive = false;
+float progressiveDelay = 0.25f;
+std::chrono::steady_clock::time_point lastIsoChange;
+cl_float lodVoxelSize[4];			// level 0 voxel size, origin and buffer layout
+cl_float lodUpperLeft[4];
+MC_VOLUME::Layout lodLayout;
+
+// region of interest (-roi=x0,y0,z0,x1,y1,z1, the voxels x0 <= x < x1 ...): classify, the scans,
+// compaction and generate only cover the box and the pass and vertex buffers are sized for it
+// (for the whole grid with -batch, whose jobs have their own boxes), the vertices and their hashes are those of the whole grid, see extractROI()
+bool g_roi = false;
+bool roiActive = false;				// the active grid is roiActiveBox, see extractROI
+MC_ROI::VoxelBox roiBox;
+MC_ROI::VoxelBox roiActiveBox;
+uint roiCapacity = 0;				// voxels of the buffers
+
+// label maps (-labels): every nonzero label is extracted into its own run of the vertex
+// buffers, see MC_LABELS
+bool g_labels = false;
+cl_mem d_compLabels = 0;			// 8 corner labels of each appended cell
+
+// emit one triangle per work-item instead of one voxel per work-item (-emit=tri)
+bool g_emitPerTriangle = false;
+bool bBenchEmit = false;		// -benchemit, compare both emission kernels after TestNoGL
+
 // toggles
 bool wireframe = false;
 bool animate = true;
@@ -251,7 +454,23 @@ const char* cpExecutableName;
 // forward declarations
 void runTest(int argc, char** argv);
 void initMC(int argc, char** argv);
+void loadVolume(char** argv);
 void computeIsosurface();
+void computeIsosurfaceEngine();
+void computeIsosurfaceImplicit();
+void enqueueClassify();
+void compactVoxelsScan();
+void compactVoxelsAppend();
+void compactVoxelsSeeded();
+void compactLabelPairs();
+void scanAppendedVoxels();
+void compactActiveVoxels();
+void compactVoxelsNarrow();
+void planPassBuffers();
+void initEngine(MCEngine engine);
+void benchmarkEngines();
+void readbackMesh();
+void saveRequestedMesh();
 
 bool initGL(int argc, char **argv);
 void createVBO(GLuint* vbo, unsigned int size, cl_mem &vbo_cl);
@@ -266,15 +485,43 @@ void timerEvent(int value);
 void idle();
 void reshape(int w, int h);
 void TestNoGL();
+void benchmarkEmission();
+void benchmarkSpecialization();
+void benchmarkNuma();
+void benchmarkProfile();
+void runTimeSeries();
+void runBatch();
+bool runRegression();
+static void setActiveGrid(const cl_uint dims[3]);
+void selectLevel(int level);
+bool extractROI(float iso, const MC_ROI::VoxelBox &box);
+void refineLevel();
+void quantizeVolume(const float *h_volumeF, size_t size, uchar *h_volumeU, float &fmin, float &fmax);
+void enqueueGenerateTriangles(bool perTriangle);
+void buildMCProgram(const MC_TUNER::LaunchConfig &config);
+void ensureProgramLayout();
+void applyLaunchConfig(const MC_TUNER::LaunchConfig &config);
+bool narrowClassifyFits(uint threads);
+void tuneLaunchConfig();
+void selectTableStorage();
 
 template <class T>
-void dumpBuffer(cl_mem d_buffer, T *h_buffer, int nelements);
+void dumpBuffer(cl_mem d_buffer, T *h_buffer, int nelements, const char *stage = "readback");
 
 
 void mainMenu(int i);
 
 void allocateTextures(	cl_mem *d_triTable, cl_mem* d_numVertsTable )
 {
+    // without images the kernels read the __constant tables, the arguments are plain buffers
+    if (!g_imageSupport) {
+        *d_triTable = clCreateBuffer(cxGPUContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(triTable), (void*) triTable, &ciErrNum);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        *d_numVertsTable = clCreateBuffer(cxGPUContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(numVertsTable), (void*) numVertsTable, &ciErrNum);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        return;
+    }
+
     cl_image_format imageFormat;
     imageFormat.image_channel_order = CL_R;
     imageFormat.image_channel_data_type = CL_UNSIGNED_INT8;
@@ -305,34 +552,75 @@ void allocateTextures(	cl_mem *d_triTable, cl_mem* d_numVertsTable )
 //    
 //}
 
+// round a / b up
+uint iDivUp(uint a, uint b)
+{
+    return (a % b != 0) ? (a / b + 1) : (a / b);
+}
+
+// classifyVoxel and classifyVoxelTiled share their arguments
 void
-launch_classifyVoxel( dim3 grid, dim3 threads, cl_mem voxelVerts, cl_mem voxelOccupied, cl_mem volume,
+setClassifyVoxelArgs( cl_kernel kernel, cl_mem voxelVerts, cl_mem voxelOccupied, cl_mem volume,
 					  cl_uint gridSize[4], cl_uint gridSizeShift[4], cl_uint gridSizeMask[4], uint numVoxels,
 					  cl_float voxelSize[4], float isoValue)
 {
-    ciErrNum = clSetKernelArg(classifyVoxelKernel, 0, sizeof(cl_mem), &voxelVerts);
+    ciErrNum = clSetKernelArg(kernel, 0, sizeof(cl_mem), &voxelVerts);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(classifyVoxelKernel, 1, sizeof(cl_mem), &voxelOccupied);
+    ciErrNum = clSetKernelArg(kernel, 1, sizeof(cl_mem), &voxelOccupied);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(classifyVoxelKernel, 2, sizeof(cl_mem), &volume);
+    ciErrNum = clSetKernelArg(kernel, 2, sizeof(cl_mem), &volume);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(classifyVoxelKernel, 3, 4 * sizeof(cl_uint), gridSize);
+    ciErrNum = clSetKernelArg(kernel, 3, 4 * sizeof(cl_uint), gridSize);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(classifyVoxelKernel, 4, 4 * sizeof(cl_uint), gridSizeShift);
+    ciErrNum = clSetKernelArg(kernel, 4, 4 * sizeof(cl_uint), gridSizeShift);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(classifyVoxelKernel, 5, 4 * sizeof(cl_uint), gridSizeMask);
+    ciErrNum = clSetKernelArg(kernel, 5, 4 * sizeof(cl_uint), gridSizeMask);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(classifyVoxelKernel, 6, sizeof(uint), &numVoxels);
+    ciErrNum = clSetKernelArg(kernel, 6, sizeof(uint), &numVoxels);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(classifyVoxelKernel, 7, 4 * sizeof(cl_float), voxelSize);
+    ciErrNum = clSetKernelArg(kernel, 7, 4 * sizeof(cl_float), voxelSize);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(classifyVoxelKernel, 8, sizeof(float), &isoValue);
+    ciErrNum = clSetKernelArg(kernel, 8, sizeof(float), &isoValue);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(classifyVoxelKernel, 9, sizeof(cl_mem), &d_numVertsTable);
+    ciErrNum = clSetKernelArg(kernel, 9, sizeof(cl_mem), &d_numVertsTable);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
+
+// minimum traffic of the triangle generation, for the profiler's GB/s: compacted id, scan
+// and eight corner samples per active voxel, position, normal and hash per vertex
+static double generateTrafficBytes(uint activeVoxels)
+{
+    return (double)activeVoxels * (2 * sizeof(uint) + 8 * sizeof(uchar)) +
+           (double)totalVerts * (8 * sizeof(float) + sizeof(uint));
+}
+
+void
+launch_classifyVoxel( dim3 grid, dim3 threads, cl_mem voxelVerts, cl_mem voxelOccupied, cl_mem volume,
+					  cl_uint gridSize[4], cl_uint gridSizeShift[4], cl_uint gridSizeMask[4], uint numVoxels,
+					  cl_float voxelSize[4], float isoValue)
+{
+    setClassifyVoxelArgs(classifyVoxelKernel, voxelVerts, voxelOccupied, volume,
+                         gridSize, gridSizeShift, gridSizeMask, numVoxels, voxelSize, isoValue);
 
     grid.x *= threads.x;
-    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, classifyVoxelKernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, 0);
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, classifyVoxelKernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, MC_PROFILE::event("classifyVoxel", (double)numVoxels * (sizeof(uchar) + 2 * sizeof(uint))));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
+
+// 3D launch, one work-item per cell, rounded up to whole tiles
+void
+launch_classifyVoxelTiled( cl_mem voxelVerts, cl_mem voxelOccupied, cl_mem volume,
+						   cl_uint gridSize[4], cl_uint gridSizeShift[4], cl_uint gridSizeMask[4], uint numVoxels,
+						   cl_float voxelSize[4], float isoValue)
+{
+    setClassifyVoxelArgs(classifyVoxelTiledKernel, voxelVerts, voxelOccupied, volume,
+                         gridSize, gridSizeShift, gridSizeMask, numVoxels, voxelSize, isoValue);
+
+    dim3 threads(CLASSIFY_TILE_X, CLASSIFY_TILE_Y, CLASSIFY_TILE_Z);
+    dim3 grid(iDivUp(gridSize[0], CLASSIFY_TILE_X) * CLASSIFY_TILE_X,
+              iDivUp(gridSize[1], CLASSIFY_TILE_Y) * CLASSIFY_TILE_Y,
+              iDivUp(gridSize[2], CLASSIFY_TILE_Z) * CLASSIFY_TILE_Z);
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, classifyVoxelTiledKernel, 3, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, MC_PROFILE::event("classifyVoxelTiled", (double)numVoxels * (sizeof(uchar) + 2 * sizeof(uint))));
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
 }
 
@@ -349,8 +637,119 @@ launch_compactVoxels(dim3 grid, dim3 threads, cl_mem compVoxelArray, cl_mem voxe
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
     
     grid.x *= threads.x;
-    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, compactVoxelsKernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, 0);
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, compactVoxelsKernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, MC_PROFILE::event("compactVoxels", (double)numVoxels * 2 * sizeof(uint) + (double)activeVoxels * sizeof(uint)));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
+
+// sign bitfield pass, one work-item per bit
+void
+launch_computeCornerSigns(cl_mem cornerSigns, cl_mem volume, cl_uint gridSize[4], float isoValue)
+{
+    ciErrNum = clSetKernelArg(computeCornerSignsKernel, 0, sizeof(cl_mem), &cornerSigns);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(computeCornerSignsKernel, 1, sizeof(cl_mem), &volume);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(computeCornerSignsKernel, 2, 4 * sizeof(cl_uint), gridSize);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(computeCornerSignsKernel, 3, sizeof(cl_uint), &cornerSignWordsPerRow);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(computeCornerSignsKernel, 4, sizeof(cl_uint), &cornerSignWords);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(computeCornerSignsKernel, 5, sizeof(float), &isoValue);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    size_t threads = CORNER_SIGN_THREADS;
+    size_t grid = iDivUp(cornerSignWords * 32, CORNER_SIGN_THREADS) * CORNER_SIGN_THREADS;
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, computeCornerSignsKernel, 1, NULL, &grid, &threads, 0, 0, MC_PROFILE::event("computeCornerSigns", (double)numVoxels * sizeof(uchar) + (double)cornerSignWords * sizeof(uint)));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
+
+void
+launch_classifyVoxelSigns(dim3 grid, dim3 threads, cl_mem voxelVerts, cl_mem voxelOccupied, cl_mem voxelCubeIndex,
+                          cl_mem cornerSigns, cl_uint gridSize[4], cl_uint gridSizeShift[4], uint numVoxels)
+{
+    int k = 0;
+    ciErrNum = clSetKernelArg(classifyVoxelSignsKernel, k++, sizeof(cl_mem), &voxelVerts);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelSignsKernel, k++, sizeof(cl_mem), &voxelOccupied);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelSignsKernel, k++, sizeof(cl_mem), &voxelCubeIndex);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelSignsKernel, k++, sizeof(cl_mem), &cornerSigns);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelSignsKernel, k++, 4 * sizeof(cl_uint), gridSize);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelSignsKernel, k++, 4 * sizeof(cl_uint), gridSizeShift);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelSignsKernel, k++, sizeof(cl_uint), &numVoxels);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelSignsKernel, k++, sizeof(cl_uint), &cornerSignWordsPerRow);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelSignsKernel, k++, sizeof(cl_mem), &d_numVertsTable);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    grid.x *= threads.x;
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, classifyVoxelSignsKernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, MC_PROFILE::event("classifyVoxelSigns", (double)cornerSignWords * sizeof(uint) + (double)numVoxels * (2 * sizeof(uint) + sizeof(uchar))));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
+
+void
+launch_compactVoxelsCubeIndex(dim3 grid, dim3 threads, cl_mem compVoxelArray, cl_mem compCubeIndex,
+                              cl_mem voxelOccupied, cl_mem voxelOccupiedScan, cl_mem voxelCubeIndex, uint numVoxels)
+{
+    ciErrNum = clSetKernelArg(compactVoxelsCubeIndexKernel, 0, sizeof(cl_mem), &compVoxelArray);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(compactVoxelsCubeIndexKernel, 1, sizeof(cl_mem), &compCubeIndex);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(compactVoxelsCubeIndexKernel, 2, sizeof(cl_mem), &voxelOccupied);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(compactVoxelsCubeIndexKernel, 3, sizeof(cl_mem), &voxelOccupiedScan);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(compactVoxelsCubeIndexKernel, 4, sizeof(cl_mem), &voxelCubeIndex);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(compactVoxelsCubeIndexKernel, 5, sizeof(cl_uint), &numVoxels);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    grid.x *= threads.x;
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, compactVoxelsCubeIndexKernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, MC_PROFILE::event("compactVoxelsCubeIndex", (double)numVoxels * (2 * sizeof(uint) + sizeof(uchar)) + (double)activeVoxels * (sizeof(uint) + sizeof(uchar))));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
+
+// arguments from numVertsScanned on are the same for generateTriangles2 and generateTrianglesCubeIndex,
+// returns the index after them for the arguments of generateTrianglesPerTri
+int
+setGenerateTrianglesArgs(cl_kernel kernel, int k, cl_mem numVertsScanned, cl_mem volume,
+                         cl_uint gridSize[4], cl_uint gridSizeShift[4], cl_uint gridSizeMask[4],
+                         cl_float voxelSize[4], cl_float UpperLeft[4], float isoValue, uint activeVoxels, uint maxVerts)
+{
+    ciErrNum = clSetKernelArg(kernel, k++, sizeof(cl_mem), &numVertsScanned);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(kernel, k++, sizeof(cl_mem), &volume);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS,  pCleanup); 
+    ciErrNum = clSetKernelArg(kernel, k++, 4 * sizeof(cl_uint), gridSize);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(kernel, k++, 4 * sizeof(cl_uint), gridSizeShift);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(kernel, k++, 4 * sizeof(cl_uint), gridSizeMask);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(kernel, k++, 4 * sizeof(cl_float), voxelSize);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+	ciErrNum = clSetKernelArg(kernel, k++, 4 * sizeof(cl_float), UpperLeft);
+	oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(kernel, k++, sizeof(float), &isoValue);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(kernel, k++, sizeof(uint), &activeVoxels);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(kernel, k++, sizeof(uint), &maxVerts);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    ciErrNum = clSetKernelArg(kernel, k++, sizeof(cl_mem), &d_numVertsTable);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(kernel, k++, sizeof(cl_mem), &d_triTable);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+	ciErrNum = clSetKernelArg(kernel, k++, sizeof(cl_mem), &d_VertsHash);
+	oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    return k;
 }
 
 void
@@ -366,38 +765,177 @@ launch_generateTriangles2(dim3 grid, dim3 threads,
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
     ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, sizeof(cl_mem), &compactedVoxelArray);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, sizeof(cl_mem), &numVertsScanned);
+    setGenerateTrianglesArgs(generateTriangles2Kernel, k, numVertsScanned, volume, gridSize, gridSizeShift, gridSizeMask,
+                             voxelSize, UpperLeft, isoValue, activeVoxels, maxVerts);
+
+    grid.x *= threads.x;
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, generateTriangles2Kernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, MC_PROFILE::event("generateTriangles2", generateTrafficBytes(activeVoxels)));
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, sizeof(cl_mem), &volume);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS,  pCleanup); 
-    ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, 4 * sizeof(cl_uint), gridSize);
+
+}
+
+void
+launch_generateTrianglesCubeIndex(dim3 grid, dim3 threads,
+                                  cl_mem pos, cl_mem norm, cl_mem compactedVoxelArray, cl_mem compactedCubeIndex,
+                                  cl_mem numVertsScanned, cl_mem volume,
+                                  cl_uint gridSize[4], cl_uint gridSizeShift[4], cl_uint gridSizeMask[4],
+                                  cl_float voxelSize[4], cl_float UpperLeft[4], float isoValue, uint activeVoxels, uint maxVerts)
+{
+	int k = 0;
+    ciErrNum = clSetKernelArg(generateTrianglesCubeIndexKernel, k++, sizeof(cl_mem), &pos);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, 4 * sizeof(cl_uint), gridSizeShift);
+    ciErrNum = clSetKernelArg(generateTrianglesCubeIndexKernel, k++, sizeof(cl_mem), &norm);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, 4 * sizeof(cl_uint), gridSizeMask);
+    ciErrNum = clSetKernelArg(generateTrianglesCubeIndexKernel, k++, sizeof(cl_mem), &compactedVoxelArray);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, 4 * sizeof(cl_float), voxelSize);
+    ciErrNum = clSetKernelArg(generateTrianglesCubeIndexKernel, k++, sizeof(cl_mem), &compactedCubeIndex);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-	ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, 4 * sizeof(cl_float), UpperLeft);
-	oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, sizeof(float), &isoValue);
+    setGenerateTrianglesArgs(generateTrianglesCubeIndexKernel, k, numVertsScanned, volume, gridSize, gridSizeShift, gridSizeMask,
+                             voxelSize, UpperLeft, isoValue, activeVoxels, maxVerts);
+
+    grid.x *= threads.x;
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, generateTrianglesCubeIndexKernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, MC_PROFILE::event("generateTrianglesCubeIndex", generateTrafficBytes(activeVoxels) + activeVoxels * sizeof(uchar)));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
+
+// one work-item per triangle, rounded up to whole work-groups
+void
+launch_generateTrianglesPerTri(dim3 grid, dim3 threads,
+                               cl_mem pos, cl_mem norm, cl_mem compactedVoxelArray, cl_mem numVertsScanned, cl_mem volume,
+                               cl_uint gridSize[4], cl_uint gridSizeShift[4], cl_uint gridSizeMask[4],
+                               cl_float voxelSize[4], cl_float UpperLeft[4], float isoValue, uint activeVoxels, uint maxVerts,
+                               uint numTris)
+{
+	int k = 0;
+    ciErrNum = clSetKernelArg(generateTrianglesPerTriKernel, k++, sizeof(cl_mem), &pos);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, sizeof(uint), &activeVoxels);
+    ciErrNum = clSetKernelArg(generateTrianglesPerTriKernel, k++, sizeof(cl_mem), &norm);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, sizeof(uint), &maxVerts);
+    ciErrNum = clSetKernelArg(generateTrianglesPerTriKernel, k++, sizeof(cl_mem), &compactedVoxelArray);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    k = setGenerateTrianglesArgs(generateTrianglesPerTriKernel, k, numVertsScanned, volume, gridSize, gridSizeShift, gridSizeMask,
+                                 voxelSize, UpperLeft, isoValue, activeVoxels, maxVerts);
+    ciErrNum = clSetKernelArg(generateTrianglesPerTriKernel, k++, sizeof(uint), &numTris);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    grid.x *= threads.x;
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, generateTrianglesPerTriKernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, MC_PROFILE::event("generateTrianglesPerTri", generateTrafficBytes(activeVoxels)));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
 
-    ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, sizeof(cl_mem), &d_numVertsTable);
+void
+launch_classifyVoxelAppend(dim3 grid, dim3 threads, cl_mem compVoxelArray, cl_mem compVerts, cl_mem appendCount, cl_mem volume,
+                           cl_uint gridSize[4], cl_uint gridSizeShift[4], uint numVoxels, float isoValue)
+{
+    int k = 0;
+    ciErrNum = clSetKernelArg(classifyVoxelAppendKernel, k++, sizeof(cl_mem), &compVoxelArray);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, sizeof(cl_mem), &d_triTable);
+    ciErrNum = clSetKernelArg(classifyVoxelAppendKernel, k++, sizeof(cl_mem), &compVerts);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelAppendKernel, k++, sizeof(cl_mem), &appendCount);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelAppendKernel, k++, sizeof(cl_mem), &volume);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelAppendKernel, k++, 4 * sizeof(cl_uint), gridSize);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelAppendKernel, k++, 4 * sizeof(cl_uint), gridSizeShift);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelAppendKernel, k++, sizeof(uint), &numVoxels);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelAppendKernel, k++, sizeof(float), &isoValue);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelAppendKernel, k++, sizeof(cl_mem), &d_numVertsTable);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    grid.x *= threads.x;
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, classifyVoxelAppendKernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, MC_PROFILE::event("classifyVoxelAppend", (double)numVoxels * sizeof(uchar) + (double)activeVoxels * 2 * sizeof(uint)));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
+
+void
+launch_classifyVoxelNarrow(dim3 grid, dim3 threads, cl_mem voxelVerts, cl_mem occupancyBits, cl_mem occupancyCount, cl_mem volume,
+                           cl_uint gridSize[4], cl_uint gridSizeShift[4], uint numVoxels, float isoValue)
+{
+    int k = 0;
+    ciErrNum = clSetKernelArg(classifyVoxelNarrowKernel, k++, sizeof(cl_mem), &voxelVerts);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelNarrowKernel, k++, sizeof(cl_mem), &occupancyBits);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelNarrowKernel, k++, sizeof(cl_mem), &occupancyCount);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelNarrowKernel, k++, sizeof(cl_mem), &volume);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelNarrowKernel, k++, 4 * sizeof(cl_uint), gridSize);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelNarrowKernel, k++, 4 * sizeof(cl_uint), gridSizeShift);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelNarrowKernel, k++, sizeof(uint), &numVoxels);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelNarrowKernel, k++, sizeof(float), &isoValue);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(classifyVoxelNarrowKernel, k++, sizeof(cl_mem), &d_numVertsTable);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    grid.x *= threads.x;
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, classifyVoxelNarrowKernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, MC_PROFILE::event("classifyVoxelNarrow", (double)numVoxels * (2 * sizeof(uchar)) + (double)occupancyWords * 2 * sizeof(uint)));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
+
+void
+launch_compactVoxelsBits(dim3 grid, dim3 threads, cl_mem compVoxelArray, cl_mem occupancyBits, cl_mem occupancyScan, uint numVoxels)
+{
+    ciErrNum = clSetKernelArg(compactVoxelsBitsKernel, 0, sizeof(cl_mem), &compVoxelArray);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(compactVoxelsBitsKernel, 1, sizeof(cl_mem), &occupancyBits);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(compactVoxelsBitsKernel, 2, sizeof(cl_mem), &occupancyScan);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(compactVoxelsBitsKernel, 3, sizeof(cl_uint), &numVoxels);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-	ciErrNum = clSetKernelArg(generateTriangles2Kernel, k++, sizeof(cl_mem), &d_VertsHash);
-	oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
 
     grid.x *= threads.x;
-    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, generateTriangles2Kernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, 0);
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, compactVoxelsBitsKernel, 1, NULL, (size_t*) &grid, (size_t*) &threads, 0, 0, MC_PROFILE::event("compactVoxelsBits", (double)occupancyWords * 2 * sizeof(uint) + (double)activeVoxels * sizeof(uint)));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
+
+// bitonic sort of n (voxel, count) pairs by voxel id, one launch per compare-exchange step
+void
+launch_sortCompactedVoxels(cl_mem keys, cl_mem values, uint n, uint threads)
+{
+    ciErrNum = clSetKernelArg(sortCompactedVoxelsKernel, 0, sizeof(cl_mem), &keys);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(sortCompactedVoxelsKernel, 1, sizeof(cl_mem), &values);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(sortCompactedVoxelsKernel, 2, sizeof(uint), &n);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    size_t localSize = threads;
+    size_t globalSize = iDivUp(n, threads) * threads;
+    for (uint k = 2; k < 2 * n; k <<= 1) {
+        for (uint mask = k - 1; mask > 0; mask = (mask == k - 1) ? (k >> 2) : (mask >> 1)) {
+            ciErrNum = clSetKernelArg(sortCompactedVoxelsKernel, 3, sizeof(uint), &mask);
+            ciErrNum |= clEnqueueNDRangeKernel(cqCommandQueue, sortCompactedVoxelsKernel, 1, NULL, &globalSize, &localSize, 0, 0, MC_PROFILE::event("sortCompactedVoxels", (double)n * 4 * sizeof(uint)));
+            oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        }
+    }
+}
+
+void
+launch_scatterCompactedScan(cl_mem numVertsScanned, cl_mem compVoxelArray, cl_mem compScan, uint activeVoxels, uint threads)
+{
+    ciErrNum = clSetKernelArg(scatterCompactedScanKernel, 0, sizeof(cl_mem), &numVertsScanned);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(scatterCompactedScanKernel, 1, sizeof(cl_mem), &compVoxelArray);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(scatterCompactedScanKernel, 2, sizeof(cl_mem), &compScan);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    ciErrNum = clSetKernelArg(scatterCompactedScanKernel, 3, sizeof(uint), &activeVoxels);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
 
+    size_t localSize = threads;
+    size_t globalSize = iDivUp(activeVoxels, threads) * threads;
+    ciErrNum = clEnqueueNDRangeKernel(cqCommandQueue, scatterCompactedScanKernel, 1, NULL, &globalSize, &localSize, 0, 0, MC_PROFILE::event("scatterCompactedScan", (double)activeVoxels * 3 * sizeof(uint)));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
 }
 
 void animation()
@@ -478,18 +1016,60 @@ float* loadRawFilef(const char* filename, size_t size)
 }
 
 
-void initCL(int argc, char** argv) {
-    //Get the NVIDIA platform
-    ciErrNum = oclGetPlatformID(&cpPlatform);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-
-    // Get the number of GPU devices available to the platform
-    ciErrNum = clGetDeviceIDs(cpPlatform, CL_DEVICE_TYPE_GPU, 0, NULL, &uiDevCount);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+// Every device of every platform, GPUs first so -device=0 keeps picking the GPU when there is one.
+// cdPlatforms[i] is the platform of cdDevices[i].
+cl_int enumerateDevices(void)
+{
+    cl_uint numPlatforms = 0;
+    cl_int err = clGetPlatformIDs(0, NULL, &numPlatforms);
+    if (err != CL_SUCCESS) return err;
+    if (numPlatforms == 0) return CL_DEVICE_NOT_FOUND;
+    std::vector<cl_platform_id> platforms(numPlatforms);
+    err = clGetPlatformIDs(numPlatforms, &platforms[0], NULL);
+    if (err != CL_SUCCESS) return err;
+
+    std::vector<cl_device_id> gpus, others;
+    std::vector<cl_platform_id> gpuPlatforms, otherPlatforms;
+    for (cl_uint p = 0; p < numPlatforms; p++) {
+        cl_uint count = 0;
+        if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, 0, NULL, &count) != CL_SUCCESS || count == 0) continue;
+        std::vector<cl_device_id> devices(count);
+        err = clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, count, &devices[0], NULL);
+        if (err != CL_SUCCESS) return err;
+        for (cl_uint d = 0; d < count; d++) {
+            cl_device_type type = 0;
+            clGetDeviceInfo(devices[d], CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+            if (type & CL_DEVICE_TYPE_GPU) {
+                gpus.push_back(devices[d]);
+                gpuPlatforms.push_back(platforms[p]);
+            } else {
+                others.push_back(devices[d]);
+                otherPlatforms.push_back(platforms[p]);
+            }
+        }
+    }
+    gpus.insert(gpus.end(), others.begin(), others.end());
+    gpuPlatforms.insert(gpuPlatforms.end(), otherPlatforms.begin(), otherPlatforms.end());
+    if (gpus.empty()) return CL_DEVICE_NOT_FOUND;
 
-    // Create the device list
+    uiDevCount = (cl_uint)gpus.size();
     cdDevices = new cl_device_id [uiDevCount];
-    ciErrNum = clGetDeviceIDs(cpPlatform, CL_DEVICE_TYPE_GPU, uiDevCount, cdDevices, NULL);
+    cdPlatforms = new cl_platform_id [uiDevCount];
+    for (cl_uint i = 0; i < uiDevCount; i++) {
+        char name[256] = "";
+        cl_device_type type = 0;
+        cdDevices[i] = gpus[i];
+        cdPlatforms[i] = gpuPlatforms[i];
+        clGetDeviceInfo(cdDevices[i], CL_DEVICE_NAME, sizeof(name), name, NULL);
+        clGetDeviceInfo(cdDevices[i], CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+        shrLog("device %u: %s (%s)\n", i, name, (type & CL_DEVICE_TYPE_GPU) ? "GPU" : (type & CL_DEVICE_TYPE_CPU) ? "CPU" : "accelerator");
+    }
+    return CL_SUCCESS;
+}
+
+void initCL(int argc, char** argv) {
+    // Get the devices of all platforms
+    ciErrNum = enumerateDevices();
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
 
     // Get device requested on command line, if any
@@ -500,6 +1080,7 @@ void initCL(int argc, char** argv) {
       uiDeviceUsed = CLAMP(uiDeviceUsed, 0, uiEndDev);
       uiEndDev = uiDeviceUsed; 
     } 
+    cpPlatform = cdPlatforms[uiDeviceUsed];
 
 	// Check if the requested device (or any of the devices if none requested) supports context sharing with OpenGL
     if(g_glInterop)
@@ -541,6 +1122,7 @@ void initCL(int argc, char** argv) {
        
         shrLog("%s...\n\n", bSharingSupported ? "Using CL-GL Interop" : "No device found that supports CL/GL context sharing");  
         oclCheckErrorEX(bSharingSupported, true, pCleanup);
+        cpPlatform = cdPlatforms[uiDeviceUsed];
 
         // Define OS-specific context properties and create the OpenCL context
         #if defined (__APPLE__)
@@ -585,47 +1167,46 @@ void initCL(int argc, char** argv) {
 
     oclPrintDevInfo(LOGBOTH, cdDevices[uiDeviceUsed]);
 
-    // create a command-queue
-    cqCommandQueue = clCreateCommandQueue(cxGPUContext, cdDevices[uiDeviceUsed], 0, &ciErrNum);
+    // create a command-queue, with event timestamps only for -profile
+    cl_command_queue_properties queueProperties = bProfile ? CL_QUEUE_PROFILING_ENABLE : 0;
+    cqCommandQueue = clCreateCommandQueue(cxGPUContext, cdDevices[uiDeviceUsed], queueProperties, &ciErrNum);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
 
     // Program Setup
     size_t program_length;
     cPathAndName = shrFindFilePath("marchingCubes_kernel.cl", argv[0]);
     oclCheckErrorEX(cPathAndName != NULL, shrTRUE, pCleanup);
-    cSourceCL = oclLoadProgSource(cPathAndName, "", &program_length);
+    // the field function of -implicit goes in front of the kernels like the tables
+    std::string preamble = MC_TABLES::programSource(triTable, numVertsTable) + implicitSource;
+    cSourceCL = oclLoadProgSource(cPathAndName, preamble.c_str(), &program_length);
     oclCheckErrorEX(cSourceCL != NULL, shrTRUE, pCleanup);
 
-    // create the program
-    cpProgram = clCreateProgramWithSource(cxGPUContext, 1,
-					  (const char **)&cSourceCL, &program_length, &ciErrNum);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    
-    // build the program
-    std::string buildOpts = "-cl-mad-enable";
-    ciErrNum = clBuildProgram(cpProgram, 0, NULL, buildOpts.c_str(), NULL, NULL);
-    if (ciErrNum != CL_SUCCESS)
-    {
-        // write out standard error, Build Log and PTX, then cleanup and return error
-        shrLogEx(LOGBOTH | ERRORMSG, ciErrNum, STDERROR);
-        oclLogBuildInfo(cpProgram, oclGetFirstDev(cxGPUContext));
-        oclLogPtx(cpProgram, oclGetFirstDev(cxGPUContext), "oclMarchinCubes.ptx");
-        Cleanup(EXIT_FAILURE); 
-    }
-
-    // create the kernel
-    classifyVoxelKernel = clCreateKernel(cpProgram, "classifyVoxel", &ciErrNum);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+	device = cdDevices[uiDeviceUsed];
 
-    compactVoxelsKernel = clCreateKernel(cpProgram, "compactVoxels", &ciErrNum);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    // volume and table storage the device can read (fast)
+    g_imageSupport = MC_VOLUME::imageSupport(device);
+    if (volumeStorageMode < 0) {
+        g_volumeBuffer = MC_VOLUME::preferBuffer(device);
+    }
+    if (!g_imageSupport) {
+        g_volumeBuffer = true;
+        if (g_launch.tableStorage == MC_TABLES::STORAGE_IMAGE) {
+            g_launch.tableStorage = MC_TABLES::STORAGE_CONSTANT;
+        }
+    }
+    if (g_implicit) {
+        g_volumeBuffer = false;
+    }
+    shrLog("Volume storage: %s\n", g_implicit ? "implicit" : g_volumeBuffer ? "buffer" : "image");
 
-    generateTriangles2Kernel = clCreateKernel(cpProgram, "generateTriangles2", &ciErrNum);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    // create and build the program with the default launch configuration,
+    // the buffer volume kernels need the grid and are built in initMC
+    if (!g_volumeBuffer) {
+        buildMCProgram(g_launch);
+    }
 
     // Setup Scan
     //initScan(cxGPUContext, cqCommandQueue, (const char**)argv);
-	device = cdDevices[uiDeviceUsed];
 	std::string DIR_CL("./");
 	int scanflag = MeshProc::scanApple::initScanAPPLE(cxGPUContext, cqCommandQueue, device, DIR_CL);
 	if (scanflag < 0) {
@@ -634,61 +1215,756 @@ void initCL(int argc, char** argv) {
 
 }
 
-
 ////////////////////////////////////////////////////////////////////////////////
-// Program main
+// Check the space delimited extension string of a device
 ////////////////////////////////////////////////////////////////////////////////
-int
-main(int argc, char** argv)
+bool deviceHasExtension(cl_device_id dev, const char *name)
 {
-    pArgc = &argc;
-    pArgv = argv;
-
-    shrQAStart(argc, argv);
-
-    cpExecutableName = argv[0];
-    shrSetLogFileName ("oclMarchingCubes.txt");
-    shrLog("%s Starting...\n\n", argv[0]); 
-
-    if (shrCheckCmdLineFlag(argc, (const char **)argv, "noprompt") ) 
-    {
-        g_bNoprompt = true;
+    size_t extensionSize = 0;
+    if (clGetDeviceInfo(dev, CL_DEVICE_EXTENSIONS, 0, NULL, &extensionSize) != CL_SUCCESS || extensionSize == 0) {
+        return false;
     }
+    std::string extensions(extensionSize, '\0');
+    clGetDeviceInfo(dev, CL_DEVICE_EXTENSIONS, extensionSize, &extensions[0], NULL);
+    extensions = " " + std::string(extensions.c_str()) + " ";
+    return extensions.find(" " + std::string(name) + " ") != std::string::npos;
+}
 
-    if (shrCheckCmdLineFlag(argc, (const char **)argv, "qatest") ) {    
-        bQATest = true;
-		animate = false;
+////////////////////////////////////////////////////////////////////////////////
+// OpenCL C version of a device as major * 10 + minor, from "OpenCL C <major>.<minor> ..."
+////////////////////////////////////////////////////////////////////////////////
+int deviceOpenCLCVersion(cl_device_id dev)
+{
+    char version[256] = "";
+    int major = 1, minor = 0;
+    if (clGetDeviceInfo(dev, CL_DEVICE_OPENCL_C_VERSION, sizeof(version), version, NULL) != CL_SUCCESS ||
+        sscanf(version, "OpenCL C %d.%d", &major, &minor) != 2) {
+        return 10;
     }
+    return major * 10 + minor;
+}
 
-    runTest(argc, argv);
-
-    Cleanup(EXIT_SUCCESS);
+////////////////////////////////////////////////////////////////////////////////
+// Build the marching cubes program for a set of build options, or return the
+// variant built earlier with the same options
+////////////////////////////////////////////////////////////////////////////////
+cl_program buildProgramVariant(const char *options, cl_int *err)
+{
+    std::map<std::string, cl_program>::iterator it = programVariants.find(options);
+    if (it != programVariants.end()) {
+        *err = CL_SUCCESS;
+        return it->second;
+    }
+    cl_program program = MC_PROGRAMCACHE::build(cxGPUContext, device, "oclMarchingCubes", cSourceCL, strlen(cSourceCL), options, err);
+    if (program && *err == CL_SUCCESS) {
+        programVariants[options] = program;
+    }
+    return program;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// initialize marching cubes
+// Build the marching cubes program and create its kernels.
+// The generateTriangles2 work-group size sizes its local arrays and the table
+// storage picks the table reads, so both are build options and the program is
+// rebuilt whenever they change.
+// With -specialize the grid, voxel size and classify work-group size are build
+// options too, if that build fails the generic kernels are used.
 ////////////////////////////////////////////////////////////////////////////////
-void
-initMC(int argc, char** argv)
+void buildMCProgram(const MC_TUNER::LaunchConfig &config)
 {
-    // parse command line arguments
-    int n;
-    if (shrGetCmdLineArgumenti( argc, (const char**) argv, "grid", &n)) {
-        gridSizeLog2[0] = gridSizeLog2[1] = gridSizeLog2[2] = n;
+    if (classifyVoxelKernel) clReleaseKernel(classifyVoxelKernel);
+    if (classifyVoxelTiledKernel) clReleaseKernel(classifyVoxelTiledKernel);
+    if (compactVoxelsKernel) clReleaseKernel(compactVoxelsKernel);
+    if (generateTriangles2Kernel) clReleaseKernel(generateTriangles2Kernel);
+    if (computeCornerSignsKernel) clReleaseKernel(computeCornerSignsKernel);
+    if (classifyVoxelSignsKernel) clReleaseKernel(classifyVoxelSignsKernel);
+    if (compactVoxelsCubeIndexKernel) clReleaseKernel(compactVoxelsCubeIndexKernel);
+    if (generateTrianglesCubeIndexKernel) clReleaseKernel(generateTrianglesCubeIndexKernel);
+    if (generateTrianglesPerTriKernel) clReleaseKernel(generateTrianglesPerTriKernel);
+    if (classifyVoxelAppendKernel) clReleaseKernel(classifyVoxelAppendKernel);
+    if (sortCompactedVoxelsKernel) clReleaseKernel(sortCompactedVoxelsKernel);
+    if (scatterCompactedScanKernel) clReleaseKernel(scatterCompactedScanKernel);
+    if (classifyVoxelNarrowKernel) clReleaseKernel(classifyVoxelNarrowKernel);
+    if (compactVoxelsBitsKernel) clReleaseKernel(compactVoxelsBitsKernel);
+    MC_FLYINGEDGES::releaseKernels();
+    MC_HISTOPYRAMID::releaseKernels();
+    MC_SEED::releaseKernels();
+    MC_LABELS::releaseKernels();
+
+    // build the program, or load it from the binary cache
+    char buildOpts[1024];
+    sprintf(buildOpts, "-cl-mad-enable -D NTHREADS=%u -D CLASSIFY_TILE_X=%d -D CLASSIFY_TILE_Y=%d -D CLASSIFY_TILE_Z=%d -D CORNER_SIGN_THREADS=%d %s",
+            config.generateThreads, CLASSIFY_TILE_X, CLASSIFY_TILE_Y, CLASSIFY_TILE_Z, CORNER_SIGN_THREADS,
+            MC_TABLES::buildOption((MC_TABLES::Storage)config.tableStorage));
+    // only the append classify uses sub-group functions, which need OpenCL C 2.0; the other
+    // paths and devices without 2.0 keep the default language and the local atomics,
+    // unless the field function picks its own language version
+    if (g_compactAppend && deviceHasExtension(device, "cl_khr_subgroups") && deviceOpenCLCVersion(device) >= 20 &&
+        !strstr(implicitOptions, "-cl-std")) {
+        strcat(buildOpts, " -cl-std=CL2.0 -D MC_SUBGROUPS");
     }
-    if (shrGetCmdLineArgumenti( argc, (const char**) argv, "gridx", &n)) {
-        gridSizeLog2[0] = n;
+    if (g_implicit) {
+        strcat(buildOpts, " -D MC_VOLUME_IMPLICIT ");
+        strcat(buildOpts, implicitOptions);
     }
-    if (shrGetCmdLineArgumenti( argc, (const char**) argv, "gridy", &n)) {
-        gridSizeLog2[1] = n;
+    // the grid is only known once initMC has loaded the volume
+    bool specialize = g_specialize && numVoxels > 0;
+    programVolumeOptions.clear();
+    if (g_volumeBuffer && numVoxels > 0) {
+        programVolumeOptions = MC_VOLUME::buildOptions(volumeLayout);
+        strcat(buildOpts, " ");
+        strcat(buildOpts, programVolumeOptions.c_str());
     }
-    if (shrGetCmdLineArgumenti( argc, (const char**) argv, "gridz", &n)) {
-        gridSizeLog2[2] = n;
+    if (specialize) {
+        sprintf(buildOpts + strlen(buildOpts), " -D MC_SPECIALIZED -D MC_GRID_X=%uu -D MC_GRID_Y=%uu -D MC_GRID_Z=%uu"
+                " -D MC_VOXEL_X=%.9ef -D MC_VOXEL_Y=%.9ef -D MC_VOXEL_Z=%.9ef -D MC_CLASSIFY_THREADS=%u",
+                gridSize[0], gridSize[1], gridSize[2], voxelSize[0], voxelSize[1], voxelSize[2], config.classifyThreads);
     }
-
-    char *filename;
-    if (shrGetCmdLineArgumentstr( argc, (const char**) argv, "file", &filename)) {
-        volumeFilename = filename;
+    cpProgram = buildProgramVariant(buildOpts, &ciErrNum);
+    if (specialize && ciErrNum != CL_SUCCESS)
+    {
+        shrLog("Specialized build failed, using the generic kernels\n");
+        if (cpProgram) {
+            oclLogBuildInfo(cpProgram, device);
+            clReleaseProgram(cpProgram);
+        }
+        g_specialize = false;
+        buildMCProgram(config);
+        return;
+    }
+    oclCheckErrorEX(cpProgram != NULL, true, pCleanup);
+    if (ciErrNum != CL_SUCCESS)
+    {
+        // write out standard error, Build Log and PTX, then cleanup and return error
+        shrLogEx(LOGBOTH | ERRORMSG, ciErrNum, STDERROR);
+        oclLogBuildInfo(cpProgram, oclGetFirstDev(cxGPUContext));
+        oclLogPtx(cpProgram, oclGetFirstDev(cxGPUContext), "oclMarchinCubes.ptx");
+        clReleaseProgram(cpProgram);
+        cpProgram = 0;
+        Cleanup(EXIT_FAILURE); 
+    }
+
+    // create the kernel
+    classifyVoxelKernel = clCreateKernel(cpProgram, "classifyVoxel", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    classifyVoxelTiledKernel = clCreateKernel(cpProgram, "classifyVoxelTiled", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    // fall back to the 1D kernel if the device can't run a whole tile per work-group
+    if (g_classifyTiled) {
+        size_t wgSize = 0;
+        clGetKernelWorkGroupInfo(classifyVoxelTiledKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &wgSize, NULL);
+        if (wgSize < CLASSIFY_TILE_X * CLASSIFY_TILE_Y * CLASSIFY_TILE_Z) {
+            shrLog("classifyVoxelTiled needs %d work-items per group, device allows %u, using classifyVoxel\n",
+                   CLASSIFY_TILE_X * CLASSIFY_TILE_Y * CLASSIFY_TILE_Z, (uint)wgSize);
+            g_classifyTiled = false;
+        }
+    }
+
+    compactVoxelsKernel = clCreateKernel(cpProgram, "compactVoxels", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    generateTriangles2Kernel = clCreateKernel(cpProgram, "generateTriangles2", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    computeCornerSignsKernel = clCreateKernel(cpProgram, "computeCornerSigns", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    classifyVoxelSignsKernel = clCreateKernel(cpProgram, "classifyVoxelSigns", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    compactVoxelsCubeIndexKernel = clCreateKernel(cpProgram, "compactVoxelsCubeIndex", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    generateTrianglesCubeIndexKernel = clCreateKernel(cpProgram, "generateTrianglesCubeIndex", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    generateTrianglesPerTriKernel = clCreateKernel(cpProgram, "generateTrianglesPerTri", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    classifyVoxelAppendKernel = clCreateKernel(cpProgram, "classifyVoxelAppend", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    sortCompactedVoxelsKernel = clCreateKernel(cpProgram, "sortCompactedVoxels", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    scatterCompactedScanKernel = clCreateKernel(cpProgram, "scatterCompactedScan", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    classifyVoxelNarrowKernel = clCreateKernel(cpProgram, "classifyVoxelNarrow", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    compactVoxelsBitsKernel = clCreateKernel(cpProgram, "compactVoxelsBits", &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    ciErrNum = MC_FLYINGEDGES::createKernels(cpProgram);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    ciErrNum = MC_HISTOPYRAMID::createKernels(cpProgram);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    ciErrNum = MC_SEED::createKernels(cpProgram);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    ciErrNum = MC_LABELS::createKernels(cpProgram);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Switch to a launch configuration, rebuilding the program if needed
+////////////////////////////////////////////////////////////////////////////////
+void applyLaunchConfig(const MC_TUNER::LaunchConfig &config)
+{
+    if (!g_imageSupport && config.tableStorage == MC_TABLES::STORAGE_IMAGE) {
+        MC_TUNER::LaunchConfig constantTables = config;
+        constantTables.tableStorage = MC_TABLES::STORAGE_CONSTANT;
+        applyLaunchConfig(constantTables);
+        return;
+    }
+
+    // the narrow buffers are planned, a classify size the narrow kernel can't run keeps the current one
+    if (g_narrow && config.classifyThreads != g_launch.classifyThreads && !narrowClassifyFits(config.classifyThreads)) {
+        shrLog("-narrow can't classify with %u work-items per group, keeping %u\n", config.classifyThreads, g_launch.classifyThreads);
+        MC_TUNER::LaunchConfig narrowFit = config;
+        narrowFit.classifyThreads = g_launch.classifyThreads;
+        applyLaunchConfig(narrowFit);
+        return;
+    }
+
+    // a specialized build also requires the classify work-group size
+    if (config.generateThreads != g_launch.generateThreads || config.tableStorage != g_launch.tableStorage ||
+        (g_specialize && config.classifyThreads != g_launch.classifyThreads)) {
+        buildMCProgram(config);
+    }
+    g_launch = config;
+    g_launch.scanGroupSize = MeshProc::scanApple::SetScanGroupSize(config.scanGroupSize);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Rebuild the program if its buffer kernels were built for another volume
+// layout, extractROI leaves those of the last box behind
+////////////////////////////////////////////////////////////////////////////////
+void ensureProgramLayout()
+{
+    if (g_volumeBuffer && numVoxels > 0 && MC_VOLUME::buildOptions(volumeLayout) != programVolumeOptions) {
+        buildMCProgram(g_launch);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// classifyVoxelNarrow packs the occupancy words of a work-group in local
+// memory: whole 32 voxel words, at most MAX_CLASSIFY_WORDS (1024 voxels) of
+// them, and no more work-items than the kernel (or, before the build, the
+// device) allows
+////////////////////////////////////////////////////////////////////////////////
+bool narrowClassifyFits(uint threads)
+{
+    size_t maxSize = 0;
+    if (!classifyVoxelNarrowKernel ||
+        clGetKernelWorkGroupInfo(classifyVoxelNarrowKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxSize, NULL) != CL_SUCCESS) {
+        clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &maxSize, NULL);
+    }
+    return threads > 0 && threads % 32 == 0 && threads <= 1024 && threads <= maxSize;
+}
+
+double timeLaunchConfig(const MC_TUNER::LaunchConfig &config)
+{
+    applyLaunchConfig(config);
+
+    // warmup, then average a few passes
+    computeIsosurface();
+    clFinish(cqCommandQueue);
+
+    const int nIter = 10;
+    shrDeltaT(1);
+    for (int i = 0; i < nIter; i++) {
+        computeIsosurface();
+    }
+    clFinish(cqCommandQueue);
+    return shrDeltaT(1) / nIter;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sweep the work-group sizes on this device and volume, then persist the best
+////////////////////////////////////////////////////////////////////////////////
+void tuneLaunchConfig()
+{
+    shrLog("Tuning launch configuration...\n");
+    MC_TUNER::DeviceLimits limits = MC_TUNER::deviceLimits(device, numVoxels);
+    MC_TUNER::LaunchConfig best = MC_TUNER::tune(limits, g_launch, timeLaunchConfig);
+    applyLaunchConfig(best);
+
+    if (MC_TUNER::saveConfig(tuneCacheFile, MC_TUNER::deviceKey(device), gridSize, g_launch)) {
+        shrLog("Saved launch configuration to '%s'\n", tuneCacheFile.c_str());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Time every lookup table storage with the current work-group sizes, keep the
+// fastest and persist it
+////////////////////////////////////////////////////////////////////////////////
+void selectTableStorage()
+{
+    MC_TUNER::LaunchConfig config = g_launch;
+    MC_TUNER::LaunchConfig best = g_launch;
+    double bestTime = -1.0;
+    for (uint storage = 0; storage < MC_TABLES::NUM_STORAGES; storage++) {
+        if (storage == MC_TABLES::STORAGE_IMAGE && !g_imageSupport) continue;
+        config.tableStorage = storage;
+        double t = timeLaunchConfig(config);
+        shrLog("tables: %-8s %.3f ms\n", MC_TABLES::storageNames[storage], t * 1000.0);
+        if (bestTime < 0.0 || t < bestTime) {
+            bestTime = t;
+            best = config;
+        }
+    }
+    applyLaunchConfig(best);
+    shrLog("Using %s lookup tables\n", MC_TABLES::storageNames[best.tableStorage]);
+
+    if (MC_TUNER::saveConfig(tuneCacheFile, MC_TUNER::deviceKey(device), gridSize, g_launch)) {
+        shrLog("Saved launch configuration to '%s'\n", tuneCacheFile.c_str());
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Program main
+////////////////////////////////////////////////////////////////////////////////
+int
+main(int argc, char** argv)
+{
+    pArgc = &argc;
+    pArgv = argv;
+
+    shrQAStart(argc, argv);
+
+    cpExecutableName = argv[0];
+    shrSetLogFileName ("oclMarchingCubes.txt");
+    shrLog("%s Starting...\n\n", argv[0]); 
+
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "noprompt") ) 
+    {
+        g_bNoprompt = true;
+    }
+
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "qatest") ) {    
+        bQATest = true;
+		animate = false;
+    }
+
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "tune") ) {
+        bTune = true;
+    }
+
+    // program binaries are cached next to the tuning cache unless -noprogramcache
+    char *programCacheDir;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "programcache", &programCacheDir)) {
+        MC_PROGRAMCACHE::setDirectory(programCacheDir);
+    }
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "noprogramcache") ) {
+        MC_PROGRAMCACHE::setEnabled(false);
+    }
+
+    char *classifyMode;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "classify", &classifyMode)) {
+        g_classifyTiled = (strcmp(classifyMode, "tiled") == 0);
+    }
+
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "signbits") ) {
+        g_signBits = true;
+    }
+
+    char *compactMode;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "compact", &compactMode)) {
+        g_compactAppend = (strcmp(compactMode, "append") == 0);
+    }
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "deterministic") ) {
+        g_deterministic = true;
+    }
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "aliasbuffers") ) {
+        g_aliasBuffers = true;
+    }
+
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "narrow") ) {
+        g_narrow = true;
+    }
+    if (g_narrow && (g_compactAppend || g_signBits)) {
+        shrLog("-narrow has its own classify and compaction, ignoring it with -compact=append or -signbits\n");
+        g_narrow = false;
+    }
+    // the append classify doesn't produce cube indices for generateTrianglesCubeIndex
+    if (g_compactAppend && g_signBits) {
+        shrLog("-compact=append replaces the sign bitfield classify, ignoring -signbits\n");
+        g_signBits = false;
+    }
+
+    char *seed;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "seed", &seed)) {
+        g_seeded = (sscanf(seed, "%d,%d,%d", &seedPoint[0], &seedPoint[1], &seedPoint[2]) == 3);
+        if (!g_seeded) {
+            shrLog("-seed=%s isn't x,y,z\n", seed);
+        }
+    }
+    // the search appends the visited cells, the rest of the pass is the append path
+    if (g_seeded) {
+        if (g_narrow || g_signBits) {
+            shrLog("-seed replaces classify, ignoring -narrow and -signbits\n");
+        }
+        g_compactAppend = true;
+        g_narrow = false;
+        g_signBits = false;
+    }
+
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "labels") ) {
+        g_labels = true;
+    }
+    // the label classify appends the cells and the pairs are ordered by label, not by cell
+    if (g_labels) {
+        if (g_narrow || g_signBits || g_compactAppend || g_deterministic) {
+            shrLog("-labels has its own classify and compaction, ignoring -narrow, -signbits, -compact and -deterministic\n");
+        }
+        g_compactAppend = false;
+        g_narrow = false;
+        g_signBits = false;
+        g_deterministic = false;
+    }
+
+    char *engine;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "engine", &engine)) {
+        for (int e = 0; e < NUM_ENGINES; e++) {
+            if (strcmp(engine, engineNames[e]) == 0) {
+                g_engine = (MCEngine)e;
+            }
+        }
+    }
+
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "benchengines") ) {
+        bBenchEngines = true;
+    }
+    shrGetCmdLineArgumenti(argc, (const char **)argv, "fethreads", &feCPUThreads);
+    shrGetCmdLineArgumenti(argc, (const char **)argv, "slabdepth", &slabDepth);
+    slabDepth = MAX(slabDepth, 1);
+    char *subDevices;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "subdevices", &subDevices)) {
+        subDevicesPerCPU = (strcmp(subDevices, "numa") == 0) ? (int)MC_SLABS::PARTITION_NUMA : atoi(subDevices);
+    }
+
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "numa") ) {
+        g_numa = true;
+    }
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "benchnuma") ) {
+        bBenchNuma = true;
+    }
+    char *numaTopology;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "numatopology", &numaTopology)) {
+        numaConfig.topology = numaTopology;
+    }
+    shrGetCmdLineArgumenti(argc, (const char **)argv, "numanodes", &numaConfig.maxNodes);
+    shrGetCmdLineArgumenti(argc, (const char **)argv, "numathreads", &numaConfig.threadsPerNode);
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "nopin") ) {
+        numaConfig.pin = false;
+    }
+    // the node slabs replace the host volume of the CPU engine, the other engines don't read them
+    if (g_numa && g_engine != ENGINE_FLYING_EDGES_CPU) {
+        shrLog("-numa places the volume of -engine=%s, ignoring it with -engine=%s\n",
+               engineNames[ENGINE_FLYING_EDGES_CPU], engineNames[g_engine]);
+        g_numa = false;
+    }
+    if (g_numa || bBenchNuma) {
+        numaNodes = MC_NUMA::topology(numaConfig);
+        MC_NUMA::logTopology(numaNodes);
+    }
+
+    char *batch;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "batch", &batch)) {
+        batchManifest = batch;
+        shrGetCmdLineArgumenti(argc, (const char **)argv, "batchworkers", &batchWorkers);
+        batchWorkers = MAX(batchWorkers, 0);
+        bQATest = true;
+        animate = false;
+    }
+
+    char *regress;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "regress", &regress)) {
+        regressReferences = regress;
+        char *baseline;
+        if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "regressbaseline", &baseline)) {
+            regressBaseline = baseline;
+        }
+        if (shrCheckCmdLineFlag(argc, (const char **)argv, "regressupdate") ) {
+            bRegressUpdate = true;
+        }
+        shrGetCmdLineArgumentf(argc, (const char **)argv, "regressslowdown", &regressSlowdown);
+        shrGetCmdLineArgumentf(argc, (const char **)argv, "regresscounttol", &regressCountTolerance);
+        shrGetCmdLineArgumentf(argc, (const char **)argv, "regressdistance", &regressDistance);
+        bQATest = true;
+        animate = false;
+    }
+
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "profile") ) {
+        bProfile = true;
+        char *profile;
+        if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "profile", &profile)) {
+            profileOutput = profile;
+        }
+        char *list;
+        if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "profilegrids", &list)) {
+            profileGrids = list;
+        }
+        if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "profileiso", &list)) {
+            profileIsoValues = list;
+        }
+        shrGetCmdLineArgumenti(argc, (const char **)argv, "profileiters", &profileIterations);
+        profileIterations = MAX(profileIterations, 1);
+    }
+
+    char *series;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "series", &series)) {
+        seriesPattern = series;
+        shrGetCmdLineArgumenti(argc, (const char **)argv, "frames", &seriesFrames);
+        shrGetCmdLineArgumenti(argc, (const char **)argv, "firstframe", &seriesFirstFrame);
+        shrGetCmdLineArgumenti(argc, (const char **)argv, "seriesbuffers", &seriesBuffers);
+        seriesBuffers = CLAMP(seriesBuffers, 1, 3);
+        if (shrCheckCmdLineFlag(argc, (const char **)argv, "seriessave") ) {
+            bSeriesSave = true;
+        }
+        // the first frame sets up the grid unless -file names another volume
+        static std::string firstFrame;
+        if (MC_TIMESERIES::frameName(seriesPattern, seriesFirstFrame, firstFrame)) {
+            volumeFilename = firstFrame.c_str();
+            // the frames are extracted without GL
+            bQATest = true;
+            animate = false;
+        } else {
+            seriesPattern = NULL;
+        }
+    }
+
+    char *emitMode;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "emit", &emitMode)) {
+        g_emitPerTriangle = (strcmp(emitMode, "tri") == 0);
+    }
+
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "benchemit") ) {
+        bBenchEmit = true;
+    }
+
+    char *tablesMode;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "tables", &tablesMode)) {
+        MC_TABLES::Storage storage;
+        if (MC_TABLES::parseStorage(tablesMode, storage)) {
+            forcedTableStorage = storage;
+            g_launch.tableStorage = storage;
+        }
+    }
+
+    char *volumeMode;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "volume", &volumeMode)) {
+        if (strcmp(volumeMode, "image") == 0) volumeStorageMode = 0;
+        if (strcmp(volumeMode, "buffer") == 0) volumeStorageMode = 1;
+        g_volumeBuffer = (volumeStorageMode == 1);
+    }
+    char *volumeType;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "volumetype", &volumeType)) {
+        MC_VOLUME::parseFormat(volumeType, volumeBufferFormat);
+    }
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "morton") ) {
+        g_volumeMorton = true;
+    }
+
+    char *synth;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "synth", &synth)) {
+        g_synth = MC_SYNTH::parseShape(synth, synthParams.shape);
+        if (!g_synth) {
+            shrLog("Unknown -synth=%s\n", synth);
+        }
+        shrGetCmdLineArgumentf(argc, (const char **)argv, "synthfreq", &synthParams.frequency);
+        int seed;
+        if (shrGetCmdLineArgumenti(argc, (const char **)argv, "synthseed", &seed)) {
+            synthParams.seed = (cl_uint)seed;
+        }
+        if (shrCheckCmdLineFlag(argc, (const char **)argv, "synthdevice") ) {
+            g_synthDevice = true;
+        }
+        if (g_synth) {
+            // names the saved meshes, the surface of every shape is at 0.5
+            volumeFilename = MC_SYNTH::shapeNames[synthParams.shape];
+            isoValue = 0.5f;
+        }
+    }
+    shrGetCmdLineArgumentf(argc, (const char **)argv, "iso", &isoValue);
+
+    char *implicit;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "implicit", &implicit)) {
+        char *path = shrFindFilePath(implicit, argv[0]);
+        size_t length;
+        char *source = path ? oclLoadProgSource(path, "", &length) : NULL;
+        if (source == NULL) {
+            shrLog("Error loading the field function '%s'\n", implicit);
+            exit(EXIT_FAILURE);
+        }
+        implicitSource = std::string(source) + "\n";
+        free(source);
+        char *options;
+        if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "implicitopts", &options)) {
+            implicitOptions = options;
+        }
+        shrGetCmdLineArgumenti(argc, (const char **)argv, "implicitslab", &implicitSlabDepth);
+        g_implicit = true;
+        // names the saved meshes, the slabs are extracted without GL
+        volumeFilename = implicit;
+        bQATest = true;
+        animate = false;
+    }
+
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "specialize") ) {
+        g_specialize = true;
+    }
+    if (shrCheckCmdLineFlag(argc, (const char **)argv, "benchspecialize") ) {
+        bBenchSpecialize = true;
+    }
+    int lod = 0;
+    if (shrGetCmdLineArgumenti(argc, (const char **)argv, "lod", &lod) ||
+        shrCheckCmdLineFlag(argc, (const char **)argv, "progressive") ) {
+        lodLevel = MAX(lod, 0);
+        lodLevels = MAX(lodLevel + 1, 4);
+        shrGetCmdLineArgumenti(argc, (const char **)argv, "lodlevels", &lodLevels);
+        g_progressive = shrCheckCmdLineFlag(argc, (const char **)argv, "progressive") != 0;
+        shrGetCmdLineArgumentf(argc, (const char **)argv, "progressivedelay", &progressiveDelay);
+    }
+    char *roi;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "roi", &roi)) {
+        MC_ROI::VoxelBox &b = roiBox;
+        g_roi = (sscanf(roi, "%u,%u,%u,%u,%u,%u", &b.lo[0], &b.lo[1], &b.lo[2], &b.hi[0], &b.hi[1], &b.hi[2]) == 6);
+        if (!g_roi) {
+            shrLog("-roi=%s isn't x0,y0,z0,x1,y1,z1\n", roi);
+        }
+    }
+    // the box is copied out of the one volume with the grid of the classic kernels,
+    // with -batch it's the box of the jobs without roi=
+    if (g_roi && (g_engine != ENGINE_CLASSIC || g_specialize || g_volumeMorton || lodLevels > 1 ||
+                  regressReferences || seriesPattern || bProfile ||
+                  bBenchEmit || bBenchEngines || bBenchSpecialize || bBenchNuma)) {
+        shrLog("-roi needs the classic engine on one linear volume without -lod or benchmarks, ignoring it\n");
+        g_roi = false;
+    }
+
+    if (g_seeded && g_engine != ENGINE_CLASSIC) {
+        shrLog("-seed needs the classic engine, ignoring -engine=%s\n", engineNames[g_engine]);
+        g_engine = ENGINE_CLASSIC;
+        g_numa = false;
+    }
+
+    // the pyramid is built from the loaded volume for the classic kernels
+    if (lodLevels > 1 && (g_engine != ENGINE_CLASSIC || g_specialize || batchManifest || regressReferences || seriesPattern)) {
+        shrLog("-lod and -progressive need the classic engine and one volume, ignoring them\n");
+        lodLevels = 1;
+        lodLevel = 0;
+        g_progressive = false;
+    }
+
+    // the slab loop drives the classic kernels, the grid of a specialized build changes per slab
+    if (g_implicit && (g_engine != ENGINE_CLASSIC || g_specialize || g_numa || g_synth || g_seeded)) {
+        shrLog("-implicit extracts with the classic engine, ignoring -engine, -specialize, -numa, -synth and -seed\n");
+        g_engine = ENGINE_CLASSIC;
+        g_specialize = false;
+        g_numa = false;
+        g_synth = false;
+        g_seeded = false;
+        lodLevels = 1;
+        lodLevel = 0;
+        g_progressive = false;
+        g_roi = false;
+    }
+    // and replaces the volumes of the other runs
+    if (g_implicit && (batchManifest || regressReferences || seriesPattern || bProfile)) {
+        shrLog("-implicit runs TestNoGL, ignoring -batch, -regress, -series and -profile\n");
+        batchManifest = NULL;
+        regressReferences = NULL;
+        seriesPattern = NULL;
+        bProfile = false;
+    }
+    // a label map has no isovalue, its levels can't be averaged into a pyramid and a cell
+    // emits the pairs of several labels, which the per-triangle and region paths don't know
+    if (g_labels && (g_engine != ENGINE_CLASSIC || g_implicit || lodLevels > 1 || g_roi || g_seeded ||
+                     g_emitPerTriangle || bBenchEmit || bBenchEngines || regressReferences)) {
+        shrLog("-labels extracts with the classic engine, ignoring -engine, -lod, -roi, -seed, -emit, -benchemit, -benchengines and -regress\n");
+        g_labels = !g_implicit;
+        g_engine = ENGINE_CLASSIC;
+        g_numa = false;
+        lodLevels = 1;
+        lodLevel = 0;
+        g_progressive = false;
+        g_roi = false;
+        g_seeded = false;
+        g_emitPerTriangle = false;
+        bBenchEmit = false;
+        bBenchEngines = false;
+        regressReferences = NULL;
+    }
+    if (strlen(implicitOptions) > 256) {
+        shrLog("-implicitopts is too long, ignoring it\n");
+        implicitOptions = "";
+    }
+
+    char *cacheFile;
+    if (shrGetCmdLineArgumentstr(argc, (const char **)argv, "tunecache", &cacheFile)) {
+        tuneCacheFile = cacheFile;
+    }
+
+    runTest(argc, argv);
+
+    Cleanup(EXIT_SUCCESS);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Normalize the raw samples to their range and quantize them to 8 bits
+////////////////////////////////////////////////////////////////////////////////
+void
+quantizeVolume(const float *h_volumeF, size_t size, uchar *h_volumeU, float &fmin, float &fmax)
+{
+	// a range given by the caller (fmin < fmax) is kept
+	if (fmin >= fmax) {
+		fmin = h_volumeF[0], fmax = h_volumeF[0];
+		for (size_t i = 0; i < size; ++i) {
+			if (h_volumeF[i] > fmax) fmax = h_volumeF[i];
+			if (h_volumeF[i] < fmin) fmin = h_volumeF[i];
+		}
+	}
+	auto bound = [](int x, int l, int h) {if (x < l) return l; if (x > h) return h; return x; };
+	for (size_t i = 0; i < size; ++i) {
+		float val = h_volumeF[i];
+		val = (h_volumeF[i] - fmin) / (fmax - fmin) * 255.0;
+		val = roundf(val);
+		h_volumeU[i] = (uchar)bound((int)val, 0, 255);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// initialize marching cubes
+////////////////////////////////////////////////////////////////////////////////
+void
+initMC(int argc, char** argv)
+{
+    // parse command line arguments
+    int n;
+    if (shrGetCmdLineArgumenti( argc, (const char**) argv, "grid", &n)) {
+        gridSizeLog2[0] = gridSizeLog2[1] = gridSizeLog2[2] = n;
+    }
+    if (shrGetCmdLineArgumenti( argc, (const char**) argv, "gridx", &n)) {
+        gridSizeLog2[0] = n;
+    }
+    if (shrGetCmdLineArgumenti( argc, (const char**) argv, "gridy", &n)) {
+        gridSizeLog2[1] = n;
+    }
+    if (shrGetCmdLineArgumenti( argc, (const char**) argv, "gridz", &n)) {
+        gridSizeLog2[2] = n;
+    }
+
+    char *filename;
+    if (shrGetCmdLineArgumentstr( argc, (const char**) argv, "file", &filename)) {
+        volumeFilename = filename;
     }
 
     gridSize[0] = gridSizeLog2[0];
@@ -704,99 +1980,364 @@ initMC(int argc, char** argv)
     gridSizeShift[1] = gridSize[0];
     gridSizeShift[2] = gridSize[0]*gridSize[1];
 
-    numVoxels = gridSize[0]*gridSize[1]*gridSize[2];
+    // the point counts, maxVerts and the edge hashes (axis * points + point) are 32 bit,
+    // so 3 x grid points have to fit a uint, about 1130^3 points
+    unsigned long long gridPoints = (unsigned long long)gridSize[0] * gridSize[1] * gridSize[2];
+    if (gridPoints == 0 || 3 * gridPoints > 0xffffffffull) {
+        shrLog("grid: %u x %u x %u has %llu points, the 32 bit edge hashes hold at most %llu\n",
+               gridSize[0], gridSize[1], gridSize[2], gridPoints, 0xffffffffull / 3);
+        exit(EXIT_FAILURE);
+    }
+    numVoxels = gridSize[0]*gridSize[1]*gridSize[2];
+
+    if (g_implicit) {
+        // the buffers hold one slab of the virtual grid
+        memcpy(implicitGrid, gridSize, sizeof(implicitGrid));
+        cl_uint sliceVoxels = MAX(gridSize[0] * gridSize[1], 1u);
+        if (implicitSlabDepth <= 0) {
+            implicitSlabDepth = (int)MAX((1u << 24) / sliceVoxels, 1u);
+        }
+        implicitSlabDepth = (int)MIN((cl_uint)implicitSlabDepth, MAX(gridSize[2], 2u) - 1);
+        cl_uint slab[3] = { gridSize[0], gridSize[1], (cl_uint)implicitSlabDepth + 1 };
+        setActiveGrid(slab);
+        shrLog("Implicit surface: %u x %u x %u grid in slabs of %d voxel layers\n",
+               implicitGrid[0], implicitGrid[1], implicitGrid[2], implicitSlabDepth);
+    }
+
+	// compute translate and scale info for MC
+	// the organ data's spacing and origin, synthetic volumes have unit voxels around the origin
+	if (g_implicit) {
+		// the longest axis spans [-1, 1] at every resolution
+		cl_uint maxDim = MAX(MAX(implicitGrid[0], implicitGrid[1]), MAX(implicitGrid[2], 2u));
+		for (int i = 0; i < 3; ++i) {
+			voxelSize[i] = 2.0f / (maxDim - 1);
+			UpperLeft[i] = -0.5f * voxelSize[i] * (implicitGrid[i] - 1);
+		}
+		implicitUpperLeftZ = UpperLeft[2];
+	} else if (g_synth) {
+		for (int i = 0; i < 3; ++i) {
+			voxelSize[i] = 1.0f;
+			UpperLeft[i] = -0.5f * (gridSize[i] - 1);
+		}
+	} else {
+		voxelSize[0] = 0.779297;
+		voxelSize[1] = 0.779297;
+		voxelSize[2] = 4.94444466;
+		UpperLeft[0] = -169.574997;
+		UpperLeft[1] = -52.0999985;
+		UpperLeft[2] = 224.460007;
+	}
+	float sx = 2.0f / (gridSize[0] * voxelSize[0]);
+	float sy = 2.0f / (gridSize[1] * voxelSize[1]);
+	if (sx < sy) mc_scale = sx;
+	else mc_scale = sy;
+	for (int i = 0; i < 3; ++i) {
+		mc_centerOffset[i] = -UpperLeft[i] - voxelSize[i]*(float)(gridSize[i]-1)*0.5;
+	}
+	mc_halfBound[0] = mc_halfBound[1] = 1.0;
+	mc_halfBound[2] = voxelSize[2] * (float)(gridSize[2] - 1)*0.5 * mc_scale;
+
+	cameraDistance = 8.0 * mc_halfBound[2];
+
+    maxVerts = gridSize[0]*gridSize[1]*gridSize[2];
+    shrLog("grid: %d x %d x %d = %d voxels\n", gridSize[0], gridSize[1], gridSize[2], numVoxels);
+    shrLog("max verts = %d\n", maxVerts);
+
+    if (g_implicit) {
+        // world position of grid point 0 of the current slab and the voxel size
+        d_volume = clCreateBuffer(cxGPUContext, CL_MEM_READ_ONLY, 8 * sizeof(cl_float), 0, &ciErrNum);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    } else {
+        loadVolume(argv);
+    }
+
+    cl_uint fullGrid[3] = { gridSize[0], gridSize[1], gridSize[2] };
+    // the boxes of a batch change from job to job, the buffers of the whole grid hold any of them
+    if (batchManifest) {
+        roiCapacity = numVoxels;
+    }
+    if (g_roi) {
+        MC_ROI::clamp(roiBox, gridSize);
+        cl_uint dims[3];
+        for (int a = 0; a < 3; a++) {
+            dims[a] = roiBox.hi[a] - roiBox.lo[a] + 1;
+        }
+        if (!batchManifest) {
+            setActiveGrid(dims);
+            maxVerts = numVoxels;
+            roiCapacity = numVoxels;
+        }
+        shrLog("Region of interest: voxels %u..%u x %u..%u x %u..%u, %u of %u points\n",
+               roiBox.lo[0], roiBox.hi[0] - 1, roiBox.lo[1], roiBox.hi[1] - 1, roiBox.lo[2], roiBox.hi[2] - 1,
+               dims[0] * dims[1] * dims[2], fullGrid[0] * fullGrid[1] * fullGrid[2]);
+    }
+
+    // create VBOs, without GL the vertex buffers are part of the buffer plan
+    if( !bQATest) {
+        createVBO(&posVbo, maxVerts*sizeof(float)*4, d_pos);
+        createVBO(&normalVbo, maxVerts*sizeof(float)*4, d_normal);
+    }
+    
+    // allocate textures
+	allocateTextures(&d_triTable, &d_numVertsTable );
+
+    // allocate device memory
+    if (g_narrow && !narrowClassifyFits(g_launch.classifyThreads)) {
+        shrLog("-narrow packs whole 32 voxel words of at most 1024 voxels per work-group, %u doesn't fit, using the plain classify\n",
+               g_launch.classifyThreads);
+        g_narrow = false;
+    }
+    if (g_narrow) {
+        occupancyWords = iDivUp(numVoxels, 32);
+    }
+    if (g_signBits) {
+        cornerSignWordsPerRow = iDivUp(gridSize[0], 32);
+        cornerSignWords = cornerSignWordsPerRow * gridSize[1] * gridSize[2];
+    }
+    planPassBuffers();
+    d_appendCount = clCreateBuffer(cxGPUContext, CL_MEM_READ_WRITE, sizeof(uint), 0, &ciErrNum);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    if (g_seeded) {
+        ciErrNum = MC_SEED::init(cxGPUContext, device, numVoxels);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    }
+    if (g_labels) {
+        ciErrNum = MC_LABELS::init(cxGPUContext);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    }
+
+    // build for this grid now that it is known
+    if (g_specialize || g_volumeBuffer) {
+        buildMCProgram(g_launch);
+    }
 
-	// compute translate and scale info for MC
-	voxelSize[0] = 0.779297;
-	voxelSize[1] = 0.779297;
-	voxelSize[2] = 4.94444466;
-	float sx = 2.0f / (gridSize[0] * voxelSize[0]);
-	float sy = 2.0f / (gridSize[1] * voxelSize[1]);
-	if (sx < sy) mc_scale = sx;
-	else mc_scale = sy;
-	UpperLeft[0] = -169.574997;
-	UpperLeft[1] = -52.0999985;
-	UpperLeft[2] = 224.460007;
-	for (int i = 0; i < 3; ++i) {
-		mc_centerOffset[i] = -UpperLeft[i] - voxelSize[i]*(float)(gridSize[i]-1)*0.5;
-	}
-	mc_halfBound[0] = mc_halfBound[1] = 1.0;
-	mc_halfBound[2] = voxelSize[2] * (float)(gridSize[2] - 1)*0.5 * mc_scale;
+    initEngine(g_engine);
 
-	cameraDistance = 8.0 * mc_halfBound[2];
+    // use the tuned launch configuration for this device, if there is one
+    MC_TUNER::LaunchConfig config;
+    if (MC_TUNER::loadConfig(tuneCacheFile, MC_TUNER::deviceKey(device), gridSize, config)) {
+        shrLog("Loaded launch configuration %u/%u/%u/%u %s from '%s'\n", config.classifyThreads, config.compactThreads,
+               config.generateThreads, config.scanGroupSize, MC_TABLES::storageNames[config.tableStorage], tuneCacheFile.c_str());
+        if (forcedTableStorage >= 0) {
+            config.tableStorage = forcedTableStorage;
+        }
+        applyLaunchConfig(config);
+        bLaunchConfigCached = true;
+    }
 
-    maxVerts = gridSize[0]*gridSize[1]*gridSize[2];
-    shrLog("grid: %d x %d x %d = %d voxels\n", gridSize[0], gridSize[1], gridSize[2], numVoxels);
-    shrLog("max verts = %d\n", maxVerts);
+    if (lodLevel > 0) {
+        int level = lodLevel;
+        lodLevel = 0;
+        selectLevel(level);
+    }
+    // outside of extractROI the active grid is the whole one
+    if (g_roi) {
+        setActiveGrid(fullGrid);
+    }
+}
 
-    // load volume data
-    char* path = shrFindFilePath(volumeFilename, argv[0]);
-    if (path == 0) {
-        shrLog("Error finding file '%s'\n", volumeFilename);
-        exit(EXIT_FAILURE);
+////////////////////////////////////////////////////////////////////////////////
+//! Load or generate the volume of the current grid into d_volume, and into
+//! h_volume for the engines that read it on the host
+////////////////////////////////////////////////////////////////////////////////
+void
+loadVolume(char** argv)
+{
+    size_t size = (size_t)gridSize[0]*gridSize[1]*gridSize[2];
+	uchar* h_volumeU = (uchar*)malloc(size * sizeof(uchar));
+	float* h_volumeF = NULL;
+	float fmin = 0.0f, fmax = 0.0f;
+	cl_mem d_synthVolume = 0;
+	bool hostVolume = (g_engine == ENGINE_FLYING_EDGES_CPU || g_engine == ENGINE_SLABS || bBenchEngines || bBenchNuma || g_numa);
+
+    // the buffer kernels are built for the layout of the grid, the synthetic volume and
+    // the pyramid need the program before initMC builds it
+    if (g_volumeBuffer) {
+        volumeLayout = MC_VOLUME::layout(gridSize, volumeBufferFormat, g_volumeMorton);
+        if ((g_synth && g_synthDevice) || lodLevels > 1) {
+            buildMCProgram(g_launch);
+        }
     }
 
-    int size = gridSize[0]*gridSize[1]*gridSize[2];
-    //uchar *volume = loadRawFile(path, size);
-	float* h_volumeF = loadRawFilef(path, size * sizeof(float));
-	oclCheckErrorEX(h_volumeF != NULL, true, pCleanup);
-	shrLog(" Raw file data loaded...\n\n");
+    if (g_synth) {
+        // the kernel writes linear uchar samples, other buffer layouts are converted on the host
+        bool onDevice = g_synthDevice && (!g_volumeBuffer || (volumeBufferFormat == MC_VOLUME::FORMAT_UCHAR && !g_volumeMorton));
+        shrLog("Synthetic volume: %s, frequency %g, seed %u, on the %s\n", MC_SYNTH::shapeNames[synthParams.shape],
+               synthParams.frequency, synthParams.seed, onDevice ? "device" : "host");
+        shrDeltaT(1);
+        if (onDevice) {
+            d_synthVolume = MC_SYNTH::fillDevice(cxGPUContext, cqCommandQueue, cpProgram, synthParams, gridSize, &ciErrNum);
+            oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+            if (hostVolume || lodLevels > 1) {
+                ciErrNum = clEnqueueReadBuffer(cqCommandQueue, d_synthVolume, CL_TRUE, 0, size, h_volumeU, 0, 0, 0);
+                oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+            }
+        } else {
+            h_volumeF = (float*)malloc(size * sizeof(float));
+            oclCheckErrorEX(h_volumeF != NULL, true, pCleanup);
+            MC_SYNTH::fill(synthParams, gridSize, h_volumeF, feCPUThreads);
+            // the samples are in [0, 1] already
+            fmin = 0.0f;
+            fmax = 1.0f;
+            quantizeVolume(h_volumeF, size, h_volumeU, fmin, fmax);
+        }
+        shrLog(" Generated in %.3f s\n\n", shrDeltaT(1));
+    } else {
+        // load volume data
+        char* path = shrFindFilePath(volumeFilename, argv[0]);
+        if (path == 0) {
+            shrLog("Error finding file '%s'\n", volumeFilename);
+            exit(EXIT_FAILURE);
+        }
 
-	uchar* h_volumeU = (uchar*)malloc(size * sizeof(uchar));
-	float fmin = h_volumeF[0], fmax = h_volumeF[0];
-	for (size_t i = 0; i < size; ++i) {
-		if (h_volumeF[i] > fmax) fmax = h_volumeF[i];
-		if (h_volumeF[i] < fmin) fmin = h_volumeF[i];
-	}
-	printf("%f %f \n", fmin, fmax);
-	auto bound = [](int x, int l, int h) {if (x < l) return l; if (x > h) return h; return x; };
-	for (size_t i = 0; i < size; ++i) {
-		float val = h_volumeF[i];
-		val = (h_volumeF[i] - fmin) / (fmax - fmin) * 255.0;
-		val = roundf(val);
-		h_volumeU[i] = (uchar)bound((int)val, 0, 255);
-	}
+        //uchar *volume = loadRawFile(path, size);
+        h_volumeF = loadRawFilef(path, size * sizeof(float));
+        oclCheckErrorEX(h_volumeF != NULL, true, pCleanup);
+        shrLog(" Raw file data loaded...\n\n");
+
+        // labels are stored as label / 255 in every volume format, not stretched to their range
+        if (g_labels) {
+            fmin = 0.0f;
+            fmax = 255.0f;
+        }
+
+        quantizeVolume(h_volumeF, size, h_volumeU, fmin, fmax);
+        printf("%f %f \n", fmin, fmax);
+    }
 
 	// Init OpenCL
-    cl_image_format volumeFormat;
-    volumeFormat.image_channel_order = CL_R;
-    volumeFormat.image_channel_data_type = CL_UNORM_INT8;
-    d_volume = clCreateImage3D(cxGPUContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &volumeFormat, 
-                                    gridSize[0], gridSize[1], gridSize[2],
-                                    gridSize[0], gridSize[0] * gridSize[1],
-								h_volumeU, &ciErrNum);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    if (g_volumeBuffer) {
+        if (d_synthVolume) {
+            d_volume = d_synthVolume;
+        } else {
+            d_volume = MC_VOLUME::createBuffer(cxGPUContext, volumeLayout, h_volumeF, fmin, fmax, &ciErrNum);
+            oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        }
+        shrLog("Volume buffer: %s%s, %u bytes\n", MC_VOLUME::formatNames[volumeBufferFormat],
+               g_volumeMorton ? " morton" : "", (uint)MC_VOLUME::numBytes(volumeLayout));
+    } else if (d_synthVolume) {
+        cl_image_format volumeFormat;
+        volumeFormat.image_channel_order = CL_R;
+        volumeFormat.image_channel_data_type = CL_UNORM_INT8;
+        d_volume = clCreateImage3D(cxGPUContext, CL_MEM_READ_ONLY, &volumeFormat,
+                                   gridSize[0], gridSize[1], gridSize[2], 0, 0, 0, &ciErrNum);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        size_t origin[3] = { 0, 0, 0 };
+        size_t region[3] = { gridSize[0], gridSize[1], gridSize[2] };
+        ciErrNum = clEnqueueCopyBufferToImage(cqCommandQueue, d_synthVolume, d_volume, 0, origin, region, 0, 0, 0);
+        ciErrNum |= clFinish(cqCommandQueue);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        clReleaseMemObject(d_synthVolume);
+    } else {
+        cl_image_format volumeFormat;
+        volumeFormat.image_channel_order = CL_R;
+        volumeFormat.image_channel_data_type = CL_UNORM_INT8;
+        d_volume = clCreateImage3D(cxGPUContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &volumeFormat, 
+                                        gridSize[0], gridSize[1], gridSize[2],
+                                        gridSize[0], gridSize[0] * gridSize[1],
+                                    h_volumeU, &ciErrNum);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    }
 
+    if (lodLevels > 1) {
+        lodLevels = MC_LOD::numLevels(gridSize, lodLevels);
+        ciErrNum = MC_LOD::build(cxGPUContext, cqCommandQueue, cpProgram, h_volumeU, d_volume, gridSize, lodLevels, !g_volumeBuffer);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        for (int l = 1; l < lodLevels; l++) {
+            const MC_LOD::Level &level = MC_LOD::level(l);
+            shrLog("Volume pyramid level %d: %u x %u x %u\n", l, level.gridSize[0], level.gridSize[1], level.gridSize[2]);
+        }
+        memcpy(lodVoxelSize, voxelSize, sizeof(lodVoxelSize));
+        memcpy(lodUpperLeft, UpperLeft, sizeof(lodUpperLeft));
+        lodLayout = volumeLayout;
+    }
+    if (hostVolume) {
+        h_volume.assign(h_volumeU, h_volumeU + size);
+    }
+    if (g_numa) {
+        MC_NUMA::init(numaNodes, numaConfig, h_volume.data(), gridSize);
+    }
 	free(h_volumeU);
 	free(h_volumeF);
+}
 
-    // create VBOs
-    if( !bQATest) {
-        createVBO(&posVbo, maxVerts*sizeof(float)*4, d_pos);
-        createVBO(&normalVbo, maxVerts*sizeof(float)*4, d_normal);
+////////////////////////////////////////////////////////////////////////////////
+//! Declare the per-pass buffers with the stages that read or write them and
+//! allocate them, aliased if -aliasbuffers is set
+////////////////////////////////////////////////////////////////////////////////
+void
+planPassBuffers()
+{
+    using MC_BUFFERPLAN::addBuffer;
+    using MC_BUFFERPLAN::use;
+
+    size_t memSize = sizeof(uint) * numVoxels;
+    MC_BUFFERPLAN::reset();
+
+    int compVoxels = addBuffer("compVoxelArray", memSize, &d_compVoxelArray);
+    int vertsScan = addBuffer("voxelVertsScan", memSize, &d_voxelVertsScan);
+    int hash = addBuffer("vertsHash", sizeof(uint) * maxVerts, &d_VertsHash);
+    use(STAGE_GENERATE, {compVoxels, vertsScan, hash});
+    use(STAGE_READBACK, hash);
+    if (bQATest) {
+        int pos = addBuffer("pos", maxVerts * sizeof(float) * 4, &d_pos);
+        int normal = addBuffer("normal", maxVerts * sizeof(float) * 4, &d_normal);
+        use(STAGE_GENERATE, {pos, normal});
+        use(STAGE_READBACK, {pos, normal});
     }
-    
-    // allocate textures
-	allocateTextures(&d_triTable, &d_numVertsTable );
 
-    // allocate device memory
-    unsigned int memSize = sizeof(uint) * numVoxels;
-    d_voxelVerts = clCreateBuffer(cxGPUContext, CL_MEM_READ_WRITE, memSize, 0, &ciErrNum);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    d_voxelVertsScan = clCreateBuffer(cxGPUContext, CL_MEM_READ_WRITE, memSize, 0, &ciErrNum);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    d_voxelOccupied = clCreateBuffer(cxGPUContext, CL_MEM_READ_WRITE, memSize, 0, &ciErrNum);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    d_voxelOccupiedScan = clCreateBuffer(cxGPUContext, CL_MEM_READ_WRITE, memSize, 0, &ciErrNum);
-    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-    d_compVoxelArray = clCreateBuffer(cxGPUContext, CL_MEM_READ_WRITE, memSize, 0, &ciErrNum);
+    if (g_labels) {
+        // the pair buffers depend on the labels of each pass, see MC_LABELS::compact()
+        int compLabels = addBuffer("compLabels", sizeof(cl_uint2) * numVoxels, &d_compLabels);
+        use(STAGE_CLASSIFY, {compVoxels, compLabels});
+        use(STAGE_COMPACT, {compVoxels, compLabels});
+    } else if (g_narrow) {
+        int verts = addBuffer("voxelVertsNarrow", sizeof(cl_uchar) * numVoxels, &d_voxelVertsNarrow);
+        int bits = addBuffer("occupancyBits", sizeof(uint) * occupancyWords, &d_occupancyBits);
+        int count = addBuffer("occupancyCount", sizeof(uint) * occupancyWords, &d_occupancyCount);
+        int scan = addBuffer("occupancyScan", sizeof(uint) * occupancyWords, &d_occupancyScan);
+        use(STAGE_CLASSIFY, {verts, bits, count});
+        use(STAGE_SCAN_OCCUPIED, {count, scan});
+        use(STAGE_COMPACT, {bits, scan, compVoxels});
+        use(STAGE_SCAN_VERTS, {verts, vertsScan});
+    } else {
+        int verts = addBuffer("voxelVerts", memSize, &d_voxelVerts);
+        int occupied = addBuffer("voxelOccupied", memSize, &d_voxelOccupied);
+        int occupiedScan = addBuffer("voxelOccupiedScan", memSize, &d_voxelOccupiedScan);
+        use(STAGE_CLASSIFY, {verts, occupied});
+        if (g_compactAppend) {
+            // classify appends ids and counts, the sort runs as the compact stage,
+            // then the counts are scanned and scattered to voxelVertsScan
+            use(STAGE_CLASSIFY, compVoxels);
+            use(STAGE_COMPACT, {compVoxels, occupied});
+            use(STAGE_SCAN_VERTS, {compVoxels, occupied, occupiedScan, vertsScan});
+        } else {
+            use(STAGE_SCAN_OCCUPIED, {occupied, occupiedScan});
+            use(STAGE_COMPACT, {occupied, occupiedScan, compVoxels});
+            use(STAGE_SCAN_VERTS, {verts, vertsScan});
+        }
+        // the HistoPyramid traversal reads the counts while it writes the vertices
+        if (g_engine == ENGINE_HISTOPYRAMID || bBenchEngines) {
+            use(STAGE_GENERATE, verts);
+        }
+    }
+
+    if (g_signBits) {
+        int cornerSigns = addBuffer("cornerSigns", sizeof(uint) * cornerSignWords, &d_cornerSigns);
+        int cubeIndex = addBuffer("voxelCubeIndex", sizeof(cl_uchar) * numVoxels, &d_voxelCubeIndex);
+        int compCubeIndex = addBuffer("compCubeIndex", sizeof(cl_uchar) * numVoxels, &d_compCubeIndex);
+        use(STAGE_CLASSIFY, {cornerSigns, cubeIndex});
+        use(STAGE_COMPACT, {cubeIndex, compCubeIndex});
+        use(STAGE_GENERATE, compCubeIndex);
+    }
+
+    ciErrNum = MC_BUFFERPLAN::allocate(cxGPUContext, device, g_aliasBuffers);
     oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
-	d_VertsHash = clCreateBuffer(cxGPUContext, CL_MEM_READ_WRITE, sizeof(uint)*maxVerts, 0, &ciErrNum);
-	oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
 }
 
 void Cleanup(int iExitCode)
 {
+    MC_BUFFERPLAN::release();
     deleteVBO(&posVbo, d_pos);
     deleteVBO(&normalVbo, d_normal);
 
@@ -808,7 +2349,28 @@ void Cleanup(int iExitCode)
     if( d_voxelOccupied) clReleaseMemObject(d_voxelOccupied);
     if( d_voxelOccupiedScan) clReleaseMemObject(d_voxelOccupiedScan);
     if( d_compVoxelArray) clReleaseMemObject(d_compVoxelArray);
-
+    if( d_cornerSigns) clReleaseMemObject(d_cornerSigns);
+    if( d_voxelCubeIndex) clReleaseMemObject(d_voxelCubeIndex);
+    if( d_compCubeIndex) clReleaseMemObject(d_compCubeIndex);
+    if( d_appendCount) clReleaseMemObject(d_appendCount);
+    if( d_voxelVertsNarrow) clReleaseMemObject(d_voxelVertsNarrow);
+    if( d_occupancyBits) clReleaseMemObject(d_occupancyBits);
+    if( d_occupancyCount) clReleaseMemObject(d_occupancyCount);
+    if( d_occupancyScan) clReleaseMemObject(d_occupancyScan);
+    MC_FLYINGEDGES::close();
+    MC_HISTOPYRAMID::close();
+    MC_SEED::close();
+    MC_LABELS::close();
+    MC_ROI::close();
+    MC_SLABS::close();
+    MC_NUMA::close();
+    MC_TIMESERIES::close();
+    MC_BATCH::stop();
+
+    if (MC_LOD::count() > 0) {
+        d_volume = MC_LOD::level(0).volume;
+        MC_LOD::release();
+    }
     if( d_volume) clReleaseMemObject(d_volume);
 	if (d_VertsHash) clReleaseMemObject(d_VertsHash);
 
@@ -818,7 +2380,25 @@ void Cleanup(int iExitCode)
     if(compactVoxelsKernel)clReleaseKernel(compactVoxelsKernel);  
     if(compactVoxelsKernel)clReleaseKernel(generateTriangles2Kernel);  
     if(compactVoxelsKernel)clReleaseKernel(classifyVoxelKernel);  
-    if(cpProgram)clReleaseProgram(cpProgram);
+    if(classifyVoxelTiledKernel)clReleaseKernel(classifyVoxelTiledKernel);
+    if(computeCornerSignsKernel)clReleaseKernel(computeCornerSignsKernel);
+    if(classifyVoxelSignsKernel)clReleaseKernel(classifyVoxelSignsKernel);
+    if(compactVoxelsCubeIndexKernel)clReleaseKernel(compactVoxelsCubeIndexKernel);
+    if(generateTrianglesCubeIndexKernel)clReleaseKernel(generateTrianglesCubeIndexKernel);
+    if(generateTrianglesPerTriKernel)clReleaseKernel(generateTrianglesPerTriKernel);
+    if(classifyVoxelAppendKernel)clReleaseKernel(classifyVoxelAppendKernel);
+    if(sortCompactedVoxelsKernel)clReleaseKernel(sortCompactedVoxelsKernel);
+    if(scatterCompactedScanKernel)clReleaseKernel(scatterCompactedScanKernel);
+    if(classifyVoxelNarrowKernel)clReleaseKernel(classifyVoxelNarrowKernel);
+    if(compactVoxelsBitsKernel)clReleaseKernel(compactVoxelsBitsKernel);
+    MC_FLYINGEDGES::releaseKernels();
+    MC_HISTOPYRAMID::releaseKernels();
+    MC_SEED::releaseKernels();
+    MC_LABELS::releaseKernels();
+    for (std::map<std::string, cl_program>::iterator it = programVariants.begin(); it != programVariants.end(); ++it) {
+        clReleaseProgram(it->second);
+    }
+    programVariants.clear();
 
     if(cqCommandQueue)clReleaseCommandQueue(cqCommandQueue);
     if(cxGPUContext)clReleaseContext(cxGPUContext);
@@ -880,37 +2460,173 @@ runTest(int argc, char** argv)
     // Initialize OpenCL buffers for Marching Cubes 
     initMC(argc, argv);
 
+    if (bTune) {
+        tuneLaunchConfig();
+    } else if (!bLaunchConfigCached && forcedTableStorage < 0) {
+        selectTableStorage();
+    }
+
     // start rendering mainloop
     if( !bQATest ) {
         glutMainLoop();
+    } else if (batchManifest) {
+        runBatch();
+    } else if (regressReferences) {
+        if (!runRegression()) {
+            Cleanup(EXIT_FAILURE);
+        }
+    } else if (seriesPattern) {
+        runTimeSeries();
     } else {
         TestNoGL();
+        if (bBenchEmit) {
+            benchmarkEmission();
+        }
+        if (bBenchEngines) {
+            benchmarkEngines();
+        }
+        if (bBenchSpecialize) {
+            benchmarkSpecialization();
+        }
+        if (bBenchNuma) {
+            benchmarkNuma();
+        }
+        if (bProfile) {
+            benchmarkProfile();
+        }
     }
 }
 
 #define DEBUG_BUFFERS 0
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Run the OpenCL part of the computation
+//! Emit the triangles of the compacted voxels, either one voxel or one triangle
+//! per work-item
 ////////////////////////////////////////////////////////////////////////////////
 void
-computeIsosurface()
+enqueueGenerateTriangles(bool perTriangle)
+{
+    // activeVoxels counts the (cell, label) pairs
+    if (g_labels) {
+        ciErrNum = MC_LABELS::generate(cqCommandQueue, d_numVertsTable, d_triTable, activeVoxels,
+                                       gridSize, gridSizeShift, gridSizeMask, voxelSize, UpperLeft,
+                                       d_pos, d_normal, d_VertsHash, maxVerts, g_launch.generateThreads);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        return;
+    }
+    if (perTriangle) {
+        uint numTris = totalVerts / 3;
+        dim3 grid(iDivUp(numTris, EMIT_THREADS), 1, 1);
+        launch_generateTrianglesPerTri(grid, EMIT_THREADS, d_pos, d_normal,
+                                       d_compVoxelArray, d_voxelVertsScan, d_volume,
+                                       gridSize, gridSizeShift, gridSizeMask,
+                                       voxelSize, UpperLeft, isoValue, activeVoxels, maxVerts, numTris);
+        return;
+    }
+
+    dim3 grid2((int) ceil(activeVoxels / (float) g_launch.generateThreads), 1, 1);
+
+    //while(grid2.x > 65535) {
+    //    grid2.x/=2;
+    //    grid2.y*=2;
+    //}
+    if (g_signBits) {
+        launch_generateTrianglesCubeIndex(grid2, g_launch.generateThreads, d_pos, d_normal,
+                                          d_compVoxelArray, d_compCubeIndex,
+                                          d_voxelVertsScan, d_volume,
+                                          gridSize, gridSizeShift, gridSizeMask,
+                                          voxelSize, UpperLeft, isoValue, activeVoxels, maxVerts);
+    } else {
+        launch_generateTriangles2(grid2, g_launch.generateThreads, d_pos, d_normal, 
+                                  d_compVoxelArray, 
+                                  d_voxelVertsScan, d_volume, 
+                                  gridSize, gridSizeShift, gridSizeMask, 
+                                  voxelSize, UpperLeft, isoValue, activeVoxels,
+                                  maxVerts);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Copy the generated vertices back to the host, then save them if requested
+////////////////////////////////////////////////////////////////////////////////
+void
+readbackMesh()
+{
+	h_pos.resize(totalVerts * 4);
+	h_normal.resize(totalVerts * 4);
+	h_VertsHash.resize(totalVerts);
+	dumpBuffer(d_pos, h_pos.data(), totalVerts * 4, "readback pos");
+	dumpBuffer(d_normal, h_normal.data(), totalVerts * 4, "readback normal");
+	dumpBuffer(d_VertsHash, h_VertsHash.data(), totalVerts, "readback hash");
+	saveRequestedMesh();
+}
+
+void
+saveRequestedMesh()
 {
-    int threads = 128;
-    dim3 grid(numVoxels / threads, 1, 1);
+	std::string filename;
+	filename = std::string(volumeFilename) + "_" + std::to_string(isoValue) + ".obj";
+	if (saveMeshFlag && g_labels) {
+		// one mesh per label, the hashes of labels that share an edge are the same
+		const std::vector<uint> &labelVertStart = MC_LABELS::vertStart();
+		for (int l = 1; l < MC_LABELS::MAX_LABELS; l++) {
+			uint first = labelVertStart[l], count = labelVertStart[l + 1] - first;
+			if (count == 0) continue;
+			std::vector<float> pos(h_pos.begin() + first * 4, h_pos.begin() + (first + count) * 4);
+			std::vector<float> normal(h_normal.begin() + first * 4, h_normal.begin() + (first + count) * 4);
+			std::vector<uint> hash(h_VertsHash.begin() + first, h_VertsHash.begin() + first + count);
+			MC_HELPER::saveMesh(std::string(volumeFilename) + "_label" + std::to_string(l) + ".obj", pos, normal, hash);
+		}
+		saveMeshFlag = 0;
+	} else if (saveMeshFlag) {
+		MC_HELPER::saveMesh(filename, h_pos, h_normal, h_VertsHash);
+		saveMeshFlag = 0;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Classify every voxel into d_voxelVerts / d_voxelOccupied
+////////////////////////////////////////////////////////////////////////////////
+void
+enqueueClassify()
+{
+    int threads = g_launch.classifyThreads;
+    dim3 grid(iDivUp(numVoxels, threads), 1, 1);
     // get around maximum grid size of 65535 in each dimension
     //if (grid.x > 65535) {
     //    grid.y = grid.x / 32768;
     //    grid.x = 32768;
     //}
 
-    // calculate number of vertices need per voxel
-    launch_classifyVoxel(grid, threads, 
+    if (g_signBits) {
+        launch_computeCornerSigns(d_cornerSigns, d_volume, gridSize, isoValue);
+        launch_classifyVoxelSigns(grid, threads, d_voxelVerts, d_voxelOccupied, d_voxelCubeIndex,
+                                  d_cornerSigns, gridSize, gridSizeShift, numVoxels);
+    } else if (g_classifyTiled) {
+        launch_classifyVoxelTiled(d_voxelVerts, d_voxelOccupied, d_volume, 
+                                  gridSize, gridSizeShift, gridSizeMask, 
+                                  numVoxels, voxelSize, isoValue);
+    } else {
+        launch_classifyVoxel(grid, threads, 
 						d_voxelVerts, d_voxelOccupied, d_volume, 
 						gridSize, gridSizeShift, gridSizeMask, 
                          numVoxels, voxelSize, isoValue);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Classify, then compact with a scan over all voxels
+//! sets activeVoxels / totalVerts, d_compVoxelArray and d_voxelVertsScan
+////////////////////////////////////////////////////////////////////////////////
+void
+compactVoxelsScan()
+{
+    // calculate number of vertices need per voxel
+    enqueueClassify();
+
 
     // scan voxel occupied array
+	MC_PROFILE::setScope("scan occupied");
 	MeshProc::scanApple::ScanAPPLEProcess(d_voxelOccupiedScan, d_voxelOccupied, numVoxels); //openclScan(d_voxelOccupiedScan, d_voxelOccupied, numVoxels);
 
     // read back values to calculate total number of non-empty voxels
@@ -919,8 +2635,8 @@ computeIsosurface()
     {
         uint lastElement, lastScanElement;
 
-        clEnqueueReadBuffer(cqCommandQueue, d_voxelOccupied,CL_TRUE, (numVoxels-1) * sizeof(uint), sizeof(uint), &lastElement, 0, 0, 0);
-        clEnqueueReadBuffer(cqCommandQueue, d_voxelOccupiedScan,CL_TRUE, (numVoxels-1) * sizeof(uint), sizeof(uint), &lastScanElement, 0, 0, 0);
+        clEnqueueReadBuffer(cqCommandQueue, d_voxelOccupied,CL_TRUE, (numVoxels-1) * sizeof(uint), sizeof(uint), &lastElement, 0, 0, MC_PROFILE::event("readback activeVoxels", sizeof(uint)));
+        clEnqueueReadBuffer(cqCommandQueue, d_voxelOccupiedScan,CL_TRUE, (numVoxels-1) * sizeof(uint), sizeof(uint), &lastScanElement, 0, 0, MC_PROFILE::event("readback activeVoxels", sizeof(uint)));
 
         activeVoxels = lastElement + lastScanElement;
     }
@@ -934,22 +2650,236 @@ computeIsosurface()
     //printf("activeVoxels = %d\n", activeVoxels);
 
     // compact voxel index array
-    launch_compactVoxels(grid, threads, d_compVoxelArray, d_voxelOccupied, d_voxelOccupiedScan, numVoxels);
+    dim3 compactGrid(iDivUp(numVoxels, g_launch.compactThreads), 1, 1);
+    if (g_signBits) {
+        launch_compactVoxelsCubeIndex(compactGrid, g_launch.compactThreads, d_compVoxelArray, d_compCubeIndex,
+                                      d_voxelOccupied, d_voxelOccupiedScan, d_voxelCubeIndex, numVoxels);
+    } else {
+        launch_compactVoxels(compactGrid, g_launch.compactThreads, d_compVoxelArray, d_voxelOccupied, d_voxelOccupiedScan, numVoxels);
+    }
 
 
     // scan voxel vertex count array
+	MC_PROFILE::setScope("scan verts");
 	MeshProc::scanApple::ScanAPPLEProcess(d_voxelVertsScan, d_voxelVerts, numVoxels);//openclScan(d_voxelVertsScan, d_voxelVerts, numVoxels);
 
     // readback total number of vertices
     {
         uint lastElement, lastScanElement;
-        clEnqueueReadBuffer(cqCommandQueue, d_voxelVerts,CL_TRUE, (numVoxels-1) * sizeof(uint), sizeof(uint), &lastElement, 0, 0, 0);
-        clEnqueueReadBuffer(cqCommandQueue, d_voxelVertsScan,CL_TRUE, (numVoxels-1) * sizeof(uint), sizeof(uint), &lastScanElement, 0, 0, 0);
+        clEnqueueReadBuffer(cqCommandQueue, d_voxelVerts,CL_TRUE, (numVoxels-1) * sizeof(uint), sizeof(uint), &lastElement, 0, 0, MC_PROFILE::event("readback totalVerts", sizeof(uint)));
+        clEnqueueReadBuffer(cqCommandQueue, d_voxelVertsScan,CL_TRUE, (numVoxels-1) * sizeof(uint), sizeof(uint), &lastScanElement, 0, 0, MC_PROFILE::event("readback totalVerts", sizeof(uint)));
+
+        totalVerts = lastElement + lastScanElement;
+    }
+
+    //printf("totalVerts = %d\n", totalVerts);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Classify and append the active voxels, then scan only those
+//! same outputs as compactVoxelsScan, d_voxelOccupied / d_voxelOccupiedScan
+//! hold the compacted vertex counts and their scan
+////////////////////////////////////////////////////////////////////////////////
+void
+compactVoxelsAppend()
+{
+    static const uint zero = 0;
+    int threads = g_launch.classifyThreads;
+    dim3 grid(iDivUp(numVoxels, threads), 1, 1);
+
+    ciErrNum = clEnqueueWriteBuffer(cqCommandQueue, d_appendCount, CL_FALSE, 0, sizeof(uint), &zero, 0, 0, 0);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    launch_classifyVoxelAppend(grid, threads, d_compVoxelArray, d_voxelOccupied, d_appendCount, d_volume,
+                               gridSize, gridSizeShift, numVoxels, isoValue);
+
+    ciErrNum = clEnqueueReadBuffer(cqCommandQueue, d_appendCount, CL_TRUE, 0, sizeof(uint), &activeVoxels, 0, 0,
+                                   MC_PROFILE::event("readback activeVoxels", sizeof(uint)));
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    if (activeVoxels == 0) {
+        totalVerts = 0;
+        return;
+    }
+    scanAppendedVoxels();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Scan the vertex counts of the activeVoxels appended voxels and scatter the
+//! offsets to d_voxelVertsScan
+////////////////////////////////////////////////////////////////////////////////
+void
+scanAppendedVoxels()
+{
+    // append order depends on scheduling, sort for a repeatable vertex order
+    if (g_deterministic) {
+        launch_sortCompactedVoxels(d_compVoxelArray, d_voxelOccupied, activeVoxels, g_launch.compactThreads);
+    }
+
+    // scan the compacted vertex counts
+	MC_PROFILE::setScope("scan verts");
+	MeshProc::scanApple::ScanAPPLEProcess(d_voxelOccupiedScan, d_voxelOccupied, activeVoxels);
+    {
+        uint lastElement, lastScanElement;
+        clEnqueueReadBuffer(cqCommandQueue, d_voxelOccupied, CL_TRUE, (activeVoxels-1) * sizeof(uint), sizeof(uint), &lastElement, 0, 0, MC_PROFILE::event("readback totalVerts", sizeof(uint)));
+        clEnqueueReadBuffer(cqCommandQueue, d_voxelOccupiedScan, CL_TRUE, (activeVoxels-1) * sizeof(uint), sizeof(uint), &lastScanElement, 0, 0, MC_PROFILE::event("readback totalVerts", sizeof(uint)));
+
+        totalVerts = lastElement + lastScanElement;
+    }
+
+    launch_scatterCompactedScan(d_voxelVertsScan, d_compVoxelArray, d_voxelOccupiedScan, activeVoxels, g_launch.compactThreads);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Classify into uchar counts and occupancy bits, then compact
+//! same outputs as compactVoxelsScan, the occupancy scan is over words
+////////////////////////////////////////////////////////////////////////////////
+void
+compactVoxelsNarrow()
+{
+    // the occupancy words of a work-group are packed in local memory, see narrowClassifyFits
+    int threads = g_launch.classifyThreads;
+    dim3 grid(iDivUp(numVoxels, threads), 1, 1);
+    launch_classifyVoxelNarrow(grid, threads, d_voxelVertsNarrow, d_occupancyBits, d_occupancyCount, d_volume,
+                               gridSize, gridSizeShift, numVoxels, isoValue);
+
+    // scan the bit count of each occupancy word
+	MC_PROFILE::setScope("scan occupancy");
+	MeshProc::scanApple::ScanAPPLEProcess(d_occupancyScan, d_occupancyCount, occupancyWords);
+    {
+        uint lastElement, lastScanElement;
+        clEnqueueReadBuffer(cqCommandQueue, d_occupancyCount, CL_TRUE, (occupancyWords-1) * sizeof(uint), sizeof(uint), &lastElement, 0, 0, MC_PROFILE::event("readback activeVoxels", sizeof(uint)));
+        clEnqueueReadBuffer(cqCommandQueue, d_occupancyScan, CL_TRUE, (occupancyWords-1) * sizeof(uint), sizeof(uint), &lastScanElement, 0, 0, MC_PROFILE::event("readback activeVoxels", sizeof(uint)));
+
+        activeVoxels = lastElement + lastScanElement;
+    }
+
+    if (activeVoxels==0) {
+        totalVerts = 0;
+        return;
+    }
+
+    dim3 compactGrid(iDivUp(numVoxels, g_launch.compactThreads), 1, 1);
+    launch_compactVoxelsBits(compactGrid, g_launch.compactThreads, d_compVoxelArray, d_occupancyBits, d_occupancyScan, numVoxels);
+
+    // scan the uchar vertex counts into the uint offsets the generate kernels read
+	MC_PROFILE::setScope("scan verts");
+	MeshProc::scanApple::ScanAPPLEProcessU8(d_voxelVertsScan, d_voxelVertsNarrow, numVoxels);
+    {
+        uchar lastElement;
+        uint lastScanElement;
+        clEnqueueReadBuffer(cqCommandQueue, d_voxelVertsNarrow, CL_TRUE, (numVoxels-1) * sizeof(uchar), sizeof(uchar), &lastElement, 0, 0, MC_PROFILE::event("readback totalVerts", sizeof(uchar)));
+        clEnqueueReadBuffer(cqCommandQueue, d_voxelVertsScan, CL_TRUE, (numVoxels-1) * sizeof(uint), sizeof(uint), &lastScanElement, 0, 0, MC_PROFILE::event("readback totalVerts", sizeof(uint)));
 
         totalVerts = lastElement + lastScanElement;
     }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Allocate the buffers of an engine the first time it is used
+////////////////////////////////////////////////////////////////////////////////
+void
+initEngine(MCEngine engine)
+{
+    if (engineReady[engine]) return;
+
+    if (engine == ENGINE_HISTOPYRAMID) {
+        // the pyramid is built from the uint counts of enqueueClassify, which -narrow doesn't allocate
+        if (!d_voxelVerts) {
+            d_voxelVerts = clCreateBuffer(cxGPUContext, CL_MEM_READ_WRITE, sizeof(uint) * numVoxels, 0, &ciErrNum);
+            oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+            d_voxelOccupied = clCreateBuffer(cxGPUContext, CL_MEM_READ_WRITE, sizeof(uint) * numVoxels, 0, &ciErrNum);
+            oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        }
+        ciErrNum = MC_HISTOPYRAMID::init(cxGPUContext, gridSize);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    } else if (engine == ENGINE_FLYING_EDGES) {
+        ciErrNum = MC_FLYINGEDGES::init(cxGPUContext, gridSize);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    } else if (engine == ENGINE_SLABS) {
+        std::vector<cl_device_id> devices(cdDevices, cdDevices + uiDevCount);
+        devices = MC_SLABS::partitionDevices(devices, (cl_uint)subDevicesPerCPU);
+        ciErrNum = MC_SLABS::init(devices, cSourceCL, gridSize, (cl_uint)slabDepth);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    }
+    engineReady[engine] = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Alternative engines, they fill the same vertex buffers as the classic path
+////////////////////////////////////////////////////////////////////////////////
+void
+computeIsosurfaceEngine()
+{
+    cl_mem interopBuffers[] = {d_pos, d_normal};
+	if( g_glInterop ) {
+		glFlush();
+		ciErrNum = clEnqueueAcquireGLObjects(cqCommandQueue, 2, interopBuffers, 0, 0, 0);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    }
+
+    if (g_engine == ENGINE_HISTOPYRAMID) {
+        enqueueClassify();
+        ciErrNum = MC_HISTOPYRAMID::extract(cqCommandQueue, d_voxelVerts, d_volume, d_triTable,
+                                            gridSize, gridSizeShift, voxelSize, UpperLeft, isoValue,
+                                            d_pos, d_normal, d_VertsHash, maxVerts, totalVerts);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        readbackMesh();
+    } else if (g_engine == ENGINE_FLYING_EDGES) {
+        ciErrNum = MC_FLYINGEDGES::extract(cqCommandQueue, d_volume, d_numVertsTable, d_triTable,
+                                           gridSize, voxelSize, UpperLeft, isoValue,
+                                           d_pos, d_normal, d_VertsHash, maxVerts, totalVerts);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        readbackMesh();
+    } else {
+        if (g_engine == ENGINE_SLABS) {
+            ciErrNum = MC_SLABS::extract(h_volume.data(), voxelSize, UpperLeft, isoValue, h_pos, h_normal, h_VertsHash);
+            oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        } else if (g_numa) {
+            MC_NUMA::extract(voxelSize, UpperLeft, isoValue, h_pos, h_normal, h_VertsHash);
+        } else {
+            MC_FLYINGEDGES::extractCPU(h_volume.data(), gridSize, voxelSize, UpperLeft, isoValue, feCPUThreads,
+                                       h_pos, h_normal, h_VertsHash);
+        }
+        totalVerts = (uint)MIN(h_VertsHash.size(), (size_t)(maxVerts / 3 * 3));
+        if (totalVerts > 0) {
+            ciErrNum = clEnqueueWriteBuffer(cqCommandQueue, d_pos, CL_TRUE, 0, totalVerts * 4 * sizeof(float), h_pos.data(), 0, 0, 0);
+            oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+            ciErrNum = clEnqueueWriteBuffer(cqCommandQueue, d_normal, CL_TRUE, 0, totalVerts * 4 * sizeof(float), h_normal.data(), 0, 0, 0);
+            oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+        }
+        saveRequestedMesh();
+    }
+
+	if( g_glInterop ) {
+		ciErrNum = clEnqueueReleaseGLObjects(cqCommandQueue, 2, interopBuffers, 0, 0, 0);
+		oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+		clFinish( cqCommandQueue );
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Run the OpenCL part of the computation
+////////////////////////////////////////////////////////////////////////////////
+void
+computeIsosurface()
+{
+    if (g_implicit) {
+        computeIsosurfaceImplicit();
+        return;
+    }
+    if (g_engine != ENGINE_CLASSIC) {
+        computeIsosurfaceEngine();
+        return;
+    }
+    if (g_roi && !roiActive) {
+        extractROI(isoValue, roiBox);
+        return;
+    }
+    ensureProgramLayout();
 
-    //printf("totalVerts = %d\n", totalVerts);
+    compactActiveVoxels();
+    if (activeVoxels == 0) {
+        return;
+    }
 
 
     cl_mem interopBuffers[] = {d_pos, d_normal};
@@ -962,32 +2892,10 @@ computeIsosurface()
         oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
     }
     
-    dim3 grid2((int) ceil(activeVoxels / (float) NTHREADS), 1, 1);
+    enqueueGenerateTriangles(g_emitPerTriangle);
 
-    //while(grid2.x > 65535) {
-    //    grid2.x/=2;
-    //    grid2.y*=2;
-    //}
-    launch_generateTriangles2(grid2, NTHREADS, d_pos, d_normal, 
-                                            d_compVoxelArray, 
-                                            d_voxelVertsScan, d_volume, 
-                                            gridSize, gridSizeShift, gridSizeMask, 
-                                            voxelSize, UpperLeft, isoValue, activeVoxels,
-                              maxVerts);
 
-
-	h_pos.resize(totalVerts * 4);
-	h_normal.resize(totalVerts * 4);
-	h_VertsHash.resize(totalVerts);
-	dumpBuffer(d_pos, h_pos.data(), totalVerts * 4);
-	dumpBuffer(d_normal, h_normal.data(), totalVerts * 4);
-	dumpBuffer(d_VertsHash, h_VertsHash.data(), totalVerts);
-	std::string filename;
-	filename = std::string(volumeFilename) + "_" + std::to_string(isoValue) + ".obj";
-	if (saveMeshFlag) {
-		MC_HELPER::saveMesh(filename, h_pos, h_normal, h_VertsHash);
-		saveMeshFlag = 0;
-	}
+	readbackMesh();
 
 
 	if( g_glInterop ) {
@@ -1154,7 +3062,11 @@ display()
     shrDeltaT(0);
 
     // run CUDA kernel to generate geometry
-    if (compute) {
+    int level = lodLevel;
+    if (g_progressive) {
+        refineLevel();
+    }
+    if (compute || lodLevel != level) {
         computeIsosurface();
     }
 
@@ -1256,6 +3168,12 @@ keyboard(unsigned char key, int /*x*/, int /*y*/)
 		break;
     }
 
+    // scrub the isovalue on the coarsest level
+    if (g_progressive && key && strchr("=-+_", key)) {
+        lastIsoChange = std::chrono::steady_clock::now();
+        selectLevel(MC_LOD::count() - 1);
+    }
+
     printf("isoValue = %f\n", isoValue);
     printf("voxels = %d\n", activeVoxels);
     printf("verts = %d\n", totalVerts);
@@ -1362,21 +3280,26 @@ void mainMenu(int i)
 }
 
 template <class T>
-void dumpBuffer(cl_mem d_buffer, T *h_buffer, int nelements) {
-    clEnqueueReadBuffer(cqCommandQueue,d_buffer, CL_TRUE, 0,nelements * sizeof(T), h_buffer, 0, 0, 0);
+void dumpBuffer(cl_mem d_buffer, T *h_buffer, int nelements, const char *stage) {
+    clEnqueueReadBuffer(cqCommandQueue,d_buffer, CL_TRUE, 0,nelements * sizeof(T), h_buffer, 0, 0,
+                        MC_PROFILE::event(stage, (double)nelements * sizeof(T)));
 }
 
 // Run a test sequence without any GL 
 //*****************************************************************************
 void TestNoGL()
 {
-    d_normal = clCreateBuffer(cxGPUContext, CL_MEM_WRITE_ONLY,  maxVerts*sizeof(float)*4, NULL, &ciErrNum);
-    d_pos = clCreateBuffer(cxGPUContext, CL_MEM_WRITE_ONLY,  maxVerts*sizeof(float)*4, NULL, &ciErrNum);
-        
-    
     // Warmup
     computeIsosurface();
     clFinish(cqCommandQueue);
+    if (g_labels) {
+        const std::vector<uint> &labelVertStart = MC_LABELS::vertStart();
+        for (int l = 1; l < MC_LABELS::MAX_LABELS; l++) {
+            if (labelVertStart[l + 1] > labelVertStart[l]) {
+                shrLog("label %d: %u triangles\n", l, (labelVertStart[l + 1] - labelVertStart[l]) / 3);
+            }
+        }
+    }
     
     // Start timer 0 and process n loops on the GPU 
     shrDeltaT(0); 
@@ -1390,6 +3313,688 @@ void TestNoGL()
     
     // Get elapsed time and throughput, then log to sample and master logs
     double dAvgTime = shrDeltaT(0)/nIter;
-    shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes, Throughput = %.4f MVoxels/s, Time = %.5f s, Size = %u Voxels, NumDevsUsed = %u, Workgroup = %u\n", 
-           (1.0e-6 * numVoxels)/dAvgTime, dAvgTime, numVoxels, 1, NTHREADS); 
-}
\ No newline at end of file
+    double dVoxels = g_implicit ? (double)implicitGrid[0] * implicitGrid[1] * implicitGrid[2] : g_roi ? roiCapacity : numVoxels;
+    shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes, Throughput = %.4f MVoxels/s, Time = %.5f s, Size = %.0f Voxels, NumDevsUsed = %u, Workgroup = %u\n", 
+           (1.0e-6 * dVoxels)/dAvgTime, dAvgTime, dVoxels, 1, g_launch.generateThreads); 
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Time the per-voxel and the per-triangle emission kernels on the current
+//! volume and isovalue, e.g. the organ data:
+//! -qatest -benchemit -file=OrganImageData.dat -gridx=512 -gridy=512 -gridz=20
+////////////////////////////////////////////////////////////////////////////////
+void benchmarkEmission()
+{
+    if (g_engine != ENGINE_CLASSIC) {
+        shrLog("-benchemit needs the classic engine\n");
+        return;
+    }
+
+    // fill the compacted voxel array and vertex scan once
+    computeIsosurface();
+    clFinish(cqCommandQueue);
+    if (totalVerts == 0) {
+        shrLog("benchemit: no triangles at isovalue %f\n", isoValue);
+        return;
+    }
+
+    const int nIter = 100;
+    double dTime[2];
+    for (int mode = 0; mode < 2; mode++) {
+        enqueueGenerateTriangles(mode == 1);
+        clFinish(cqCommandQueue);
+
+        shrDeltaT(1);
+        for (int i = 0; i < nIter; i++) {
+            enqueueGenerateTriangles(mode == 1);
+        }
+        clFinish(cqCommandQueue);
+        dTime[mode] = shrDeltaT(1) / nIter;
+    }
+
+    shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes-emit, PerVoxel = %.5f s, PerTriangle = %.5f s, Speedup = %.2f, Voxels = %u, Triangles = %u\n",
+             dTime[0], dTime[1], dTime[0] / dTime[1], activeVoxels, totalVerts / 3);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Time a full extraction (including the vertex readback) with every engine
+//! on the current volume and isovalue
+////////////////////////////////////////////////////////////////////////////////
+void benchmarkEngines()
+{
+    MCEngine engine = g_engine;
+    const int nIter = 20;
+
+    for (int e = 0; e < NUM_ENGINES; e++) {
+        g_engine = (MCEngine)e;
+        initEngine(g_engine);
+
+        computeIsosurface();
+        clFinish(cqCommandQueue);
+
+        shrDeltaT(1);
+        for (int i = 0; i < nIter; i++) {
+            computeIsosurface();
+        }
+        clFinish(cqCommandQueue);
+        double dAvgTime = shrDeltaT(1) / nIter;
+
+        shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes-engine, Engine = %s, Throughput = %.4f MVoxels/s, Time = %.5f s, Verts = %u\n",
+                 engineNames[e], (1.0e-6 * numVoxels) / dAvgTime, dAvgTime, totalVerts);
+        if (g_engine == ENGINE_SLABS) {
+            MC_SLABS::logStats();
+        }
+    }
+    g_engine = engine;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Time classify and generate with the generic and the grid specialized
+//! program on the current volume and isovalue
+////////////////////////////////////////////////////////////////////////////////
+void benchmarkSpecialization()
+{
+    if (g_engine != ENGINE_CLASSIC || g_compactAppend || g_narrow) {
+        shrLog("-benchspecialize needs the classic engine with the default classify\n");
+        return;
+    }
+
+    bool specialize = g_specialize;
+    const int nIter = 100;
+    double dClassify[2], dGenerate[2];
+    uint verts[2];
+    for (int mode = 0; mode < 2; mode++) {
+        g_specialize = (mode == 1);
+        buildMCProgram(g_launch);
+        if (mode == 1 && !g_specialize) {
+            return;
+        }
+
+        // fill the compacted voxel array and vertex scan once
+        computeIsosurface();
+        clFinish(cqCommandQueue);
+        verts[mode] = totalVerts;
+
+        shrDeltaT(1);
+        for (int i = 0; i < nIter; i++) {
+            enqueueClassify();
+        }
+        clFinish(cqCommandQueue);
+        dClassify[mode] = shrDeltaT(1) / nIter;
+
+        // classify rewrote the same counts, the compacted voxels are still valid
+        shrDeltaT(1);
+        for (int i = 0; i < nIter; i++) {
+            enqueueGenerateTriangles(false);
+        }
+        clFinish(cqCommandQueue);
+        dGenerate[mode] = shrDeltaT(1) / nIter;
+    }
+
+    shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes-specialize, Classify = %.5f / %.5f s, Generate = %.5f / %.5f s, Speedup = %.2f / %.2f, Verts = %u / %u\n",
+             dClassify[0], dClassify[1], dGenerate[0], dGenerate[1],
+             dClassify[0] / dClassify[1], dGenerate[0] / dGenerate[1], verts[0], verts[1]);
+
+    g_specialize = specialize;
+    buildMCProgram(g_launch);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read bandwidth and CPU engine throughput on 1..N NUMA nodes
+////////////////////////////////////////////////////////////////////////////////
+void benchmarkNuma()
+{
+    MC_NUMA::benchmark(numaNodes, numaConfig, h_volume.data(), gridSize, voxelSize, UpperLeft, isoValue);
+
+    // the benchmark leaves the volume placed on all nodes, keep it only for -numa
+    if (!g_numa) {
+        MC_NUMA::close();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Extract one -series frame from the buffers of its MC_TIMESERIES slot
+////////////////////////////////////////////////////////////////////////////////
+static cl_int extractFrame(cl_mem volume, cl_mem pos, cl_mem normal, cl_mem vertexHash, uint &numVerts)
+{
+    d_volume = volume;
+    d_pos = pos;
+    d_normal = normal;
+    d_VertsHash = vertexHash;
+    compactActiveVoxels();
+    if (activeVoxels > 0) {
+        enqueueGenerateTriangles(g_emitPerTriangle);
+    }
+    // generate drops the triangles past maxVerts
+    numVerts = (activeVoxels > 0) ? MIN(totalVerts, maxVerts / 3 * 3) : 0;
+    return CL_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Extract every frame of the -series sequence with the classic engine. Frame
+//! t+1 is uploaded and frame t-1 read back on the transfer queue while the
+//! kernels of frame t run, the first frame's range normalizes all of them.
+////////////////////////////////////////////////////////////////////////////////
+void runTimeSeries()
+{
+    if (g_engine != ENGINE_CLASSIC) {
+        shrLog("-series needs the classic engine\n");
+        return;
+    }
+    if (g_volumeBuffer && (volumeBufferFormat != MC_VOLUME::FORMAT_UCHAR || g_volumeMorton)) {
+        shrLog("-series uploads linear uchar volumes, not -volumetype=%s%s\n",
+               MC_VOLUME::formatNames[volumeBufferFormat], g_volumeMorton ? " -morton" : "");
+        return;
+    }
+    if (seriesFrames <= 0) {
+        shrLog("-series needs -frames=<n>\n");
+        return;
+    }
+
+    cl_mem volume = d_volume, pos = d_pos, normal = d_normal, vertsHash = d_VertsHash;
+    // label ids keep their values, other frames take the range of the first one
+    float fmin = 0.0f, fmax = g_labels ? 255.0f : 0.0f;
+    ciErrNum = MC_TIMESERIES::run(seriesPattern, seriesFirstFrame, seriesFrames, seriesBuffers, cpExecutableName,
+                                  cxGPUContext, device, cqCommandQueue, gridSize, g_volumeBuffer, maxVerts, fmin, fmax,
+                                  bSeriesSave, isoValue, extractFrame);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    d_volume = volume;
+    d_pos = pos;
+    d_normal = normal;
+    d_VertsHash = vertsHash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Replace the contents of the volume with new samples of the same grid
+////////////////////////////////////////////////////////////////////////////////
+void uploadVolume(const float *h_volumeF)
+{
+    // each volume is normalized to its own range, label ids to the fixed one of loadVolume
+    float fmin = 0.0f, fmax = g_labels ? 255.0f : 0.0f;
+    std::vector<uchar> h_volumeU(numVoxels);
+    quantizeVolume(h_volumeF, numVoxels, h_volumeU.data(), fmin, fmax);
+
+    if (g_volumeBuffer) {
+        clReleaseMemObject(d_volume);
+        d_volume = MC_VOLUME::createBuffer(cxGPUContext, volumeLayout, h_volumeF, fmin, fmax, &ciErrNum);
+    } else {
+        size_t origin[3] = { 0, 0, 0 };
+        size_t region[3] = { gridSize[0], gridSize[1], gridSize[2] };
+        ciErrNum = clEnqueueWriteImage(cqCommandQueue, d_volume, CL_TRUE, origin, region, 0, 0, h_volumeU.data(), 0, 0, 0);
+    }
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    // the host engines read h_volume
+    if (!h_volume.empty()) {
+        h_volume.swap(h_volumeU);
+    }
+    if (g_numa) {
+        MC_NUMA::init(numaNodes, numaConfig, h_volume.data(), gridSize);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Extract one isovalue of a -batch job, the mesh is moved to the MC_BATCH writers
+////////////////////////////////////////////////////////////////////////////////
+static bool extractBatchJob(const MC_BATCH::Job &job, float iso, std::vector<float> &pos, std::vector<float> &normal,
+                            std::vector<uint> &vertexHash)
+{
+    isoValue = iso;
+    bool ok = true;
+    // without roi= computeIsosurface extracts the -roi box, if any
+    if (job.hasROI) {
+        MC_ROI::VoxelBox box;
+        memcpy(box.lo, &job.roi[0], sizeof(box.lo));
+        memcpy(box.hi, &job.roi[3], sizeof(box.hi));
+        MC_ROI::clamp(box, gridSize);
+        ok = extractROI(isoValue, box);
+    } else {
+        computeIsosurface();
+    }
+    clFinish(cqCommandQueue);
+    // the classic engine skips the readback when no voxel is active
+    if (!ok || totalVerts == 0) {
+        h_pos.clear();
+        h_normal.clear();
+        h_VertsHash.clear();
+    }
+    pos.swap(h_pos);
+    normal.swap(h_normal);
+    vertexHash.swap(h_VertsHash);
+    return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Run the jobs of the -batch manifest with the current engine. The program,
+//! buffers and engines stay initialized across jobs, the next volume is loaded
+//! and the meshes are written by the MC_BATCH workers while the device extracts.
+////////////////////////////////////////////////////////////////////////////////
+void runBatch()
+{
+    // roi= is extracted like -roi, on the classic kernels of one linear volume
+    bool roiSupported = (g_engine == ENGINE_CLASSIC && !g_specialize && !g_volumeMorton && !g_labels);
+    MC_BATCH::run(batchManifest, batchWorkers, numVoxels, roiSupported, uploadVolume, extractBatchJob);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Run the classic engine on the dims[0] x dims[1] x dims[2] corner of the
+//! loaded volume, the buffers were sized for the whole grid
+////////////////////////////////////////////////////////////////////////////////
+static void setActiveGrid(const cl_uint dims[3])
+{
+    for (int a = 0; a < 3; a++) {
+        gridSize[a] = gridSizeMask[a] = dims[a];
+    }
+    gridSizeShift[1] = gridSize[0];
+    gridSizeShift[2] = gridSize[0] * gridSize[1];
+    numVoxels = gridSize[0] * gridSize[1] * gridSize[2];
+    if (g_narrow) {
+        occupancyWords = iDivUp(numVoxels, 32);
+    }
+    if (g_signBits) {
+        cornerSignWordsPerRow = iDivUp(gridSize[0], 32);
+        cornerSignWords = cornerSignWordsPerRow * gridSize[1] * gridSize[2];
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Event timestamps of every kernel and readback of the classic engine for
+//! each -profilegrids size and -profileiso value, e.g.
+//! -qatest -profile=mc.json -profilegrids=64,128,256 -profileiso=0.3,0.5
+////////////////////////////////////////////////////////////////////////////////
+void benchmarkProfile()
+{
+    if (g_engine != ENGINE_CLASSIC) {
+        shrLog("-profile needs the classic engine\n");
+        return;
+    }
+
+    std::vector<int> grids;
+    for (const char *c = profileGrids; c && *c; ) {
+        char *end;
+        long n = strtol(c, &end, 10);
+        if (end == c || n <= 0) break;
+        grids.push_back((int)n);
+        c = (*end == ',') ? end + 1 : end;
+    }
+    std::vector<float> isoValues;
+    for (const char *c = profileIsoValues; c && *c; ) {
+        char *end;
+        float v = (float)strtod(c, &end);
+        if (end == c) break;
+        isoValues.push_back(v);
+        c = (*end == ',') ? end + 1 : end;
+    }
+    if (grids.empty()) {
+        grids.push_back(0);		// the whole grid
+    }
+    if (isoValues.empty()) {
+        isoValues.push_back(isoValue);
+    }
+
+    const cl_uint fullGrid[3] = { gridSize[0], gridSize[1], gridSize[2] };
+    const float fullIsoValue = isoValue;
+    uint numCases = 0;
+    MC_PROFILE::reset();
+    for (size_t g = 0; g < grids.size(); g++) {
+        cl_uint dims[3];
+        for (int a = 0; a < 3; a++) {
+            dims[a] = grids[g] ? MIN((cl_uint)grids[g], fullGrid[a]) : fullGrid[a];
+        }
+        if (g_specialize && (dims[0] != fullGrid[0] || dims[1] != fullGrid[1] || dims[2] != fullGrid[2])) {
+            shrLog("profile: -specialize builds the loaded grid into the program, skipping grid %d\n", grids[g]);
+            continue;
+        }
+        setActiveGrid(dims);
+
+        for (size_t i = 0; i < isoValues.size(); i++) {
+            isoValue = isoValues[i];
+            MC_PROFILE::setCase(dims, isoValue);
+            numCases++;
+
+            computeIsosurface();
+            clFinish(cqCommandQueue);
+            for (int it = 0; it < profileIterations; it++) {
+                MC_PROFILE::begin();
+                computeIsosurface();
+                clFinish(cqCommandQueue);
+                ciErrNum = MC_PROFILE::end();
+                oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+            }
+        }
+    }
+    setActiveGrid(fullGrid);
+    isoValue = fullIsoValue;
+
+    char deviceName[256];
+    clGetDeviceInfo(cdDevices[uiDeviceUsed], CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+    bool written = MC_PROFILE::report(profileOutput, deviceName);
+    MC_PROFILE::reset();
+
+    shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes-profile, Cases = %u, Iterations = %d, Output = %s\n",
+             numCases, profileIterations, profileOutput ? (written ? profileOutput : "failed") : "log");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Extract every -regress reference's isovalue with the current engine and
+//! compare counts, topology, Hausdorff distance and throughput, e.g.
+//! -file=OrganImageData.dat -gridx=512 -gridy=512 -gridz=20 -engine=fecpu
+//! -regress=data/OrganImageData.dat_0.149999.obj,data/OrganImageData.dat_0.605000.obj
+//! returns false if any gate fails
+////////////////////////////////////////////////////////////////////////////////
+bool runRegression()
+{
+    std::map<std::string, double> baseline;
+    if (regressBaseline && !MC_REGRESS::loadBaseline(regressBaseline, baseline) && !bRegressUpdate) {
+        shrLog("regress: no baseline '%s', throughput is not checked\n", regressBaseline);
+    }
+    float maxDistance = regressDistance * MIN(MIN(voxelSize[0], voxelSize[1]), voxelSize[2]);
+    const int nIter = 10;
+    float fullIsoValue = isoValue;
+    int failed = 0, numReferences = 0;
+
+    std::string list = regressReferences;
+    for (size_t begin = 0; begin < list.size(); ) {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos) end = list.size();
+        std::string reference = list.substr(begin, end - begin);
+        begin = end + 1;
+        if (reference.empty()) continue;
+        numReferences++;
+
+        MC_REGRESS::Mesh expected, mesh;
+        if (!MC_REGRESS::isoFromName(reference, isoValue)) {
+            shrLog("regress: no isovalue in the name of '%s'\n", reference.c_str());
+            failed++;
+            continue;
+        }
+        if (!MC_REGRESS::loadOBJ(reference.c_str(), expected)) {
+            failed++;
+            continue;
+        }
+
+        computeIsosurface();
+        clFinish(cqCommandQueue);
+        // the classic engine skips the readback when no voxel is active
+        if (totalVerts == 0) {
+            h_pos.clear();
+            h_VertsHash.clear();
+        }
+        MC_REGRESS::weld(h_pos, h_VertsHash, mesh);
+
+        shrDeltaT(1);
+        for (int i = 0; i < nIter; i++) {
+            computeIsosurface();
+        }
+        clFinish(cqCommandQueue);
+        double throughput = (1.0e-6 * numVoxels) / (shrDeltaT(1) / nIter);
+
+        // gates
+        MC_REGRESS::Topology got = MC_REGRESS::topology(mesh), want = MC_REGRESS::topology(expected);
+        uint verts[2] = { (uint)(mesh.verts.size() / 3), (uint)(expected.verts.size() / 3) };
+        uint faces[2] = { got.faces, want.faces };
+        bool countsOk = fabsf((float)verts[0] - verts[1]) <= regressCountTolerance * verts[1] &&
+                        fabsf((float)faces[0] - faces[1]) <= regressCountTolerance * faces[1];
+        bool topologyOk = (got.hash == want.hash);
+        double distance = MC_REGRESS::hausdorff(mesh, expected);
+        bool distanceOk = (distance <= maxDistance);
+
+        std::string key = std::string(engineNames[g_engine]) + ":" + reference.substr(reference.find_last_of("/\\") + 1);
+        bool throughputOk = true;
+        double baselineThroughput = 0.0;
+        if (baseline.count(key)) {
+            baselineThroughput = baseline[key];
+            throughputOk = (throughput >= (1.0 - regressSlowdown) * baselineThroughput);
+        }
+        if (bRegressUpdate) {
+            baseline[key] = throughput;
+        }
+
+        bool ok = countsOk && topologyOk && distanceOk && throughputOk;
+        if (!ok) failed++;
+        if (!topologyOk) {
+            shrLog("regress: topology components %u / %u, boundary edges %u / %u, non-manifold edges %u / %u, euler %d / %d\n",
+                   got.components, want.components, got.boundaryEdges, want.boundaryEdges,
+                   got.nonManifoldEdges, want.nonManifoldEdges, got.euler, want.euler);
+        }
+        shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes-regress, Reference = %s, Engine = %s, Iso = %g, Verts = %u / %u, Faces = %u / %u, "
+                 "Topology = %016llx / %016llx, Hausdorff = %g (max %g), Throughput = %.4f MVoxels/s (baseline %.4f), Result = %s\n",
+                 reference.c_str(), engineNames[g_engine], isoValue, verts[0], verts[1], faces[0], faces[1],
+                 (unsigned long long)got.hash, (unsigned long long)want.hash, distance, maxDistance,
+                 throughput, baselineThroughput, ok ? "PASS" : "FAIL");
+    }
+    isoValue = fullIsoValue;
+
+    if (bRegressUpdate && regressBaseline) {
+        if (!MC_REGRESS::saveBaseline(regressBaseline, baseline)) {
+            shrLog("regress: can't write baseline '%s'\n", regressBaseline);
+            failed++;
+        }
+    }
+    shrLogEx(LOGBOTH | MASTER, 0, "oclMarchingCubes-regress, References = %d, Failed = %d\n", numReferences, failed);
+    return failed == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! -implicit: extract the virtual grid slab by slab with the classic kernels.
+//! Neighbouring slabs share a layer of grid points, their vertices are appended
+//! to the host mesh with the edge hashes moved to the virtual grid, so the
+//! shared edges weld. The hashes are unique while 3 x grid points fit a uint.
+////////////////////////////////////////////////////////////////////////////////
+void computeIsosurfaceImplicit()
+{
+    cl_uint sliceVoxels = implicitGrid[0] * implicitGrid[1];
+    unsigned long long gridPoints = (unsigned long long)sliceVoxels * implicitGrid[2];
+    size_t numVerts = 0;
+    h_pos.clear();
+    h_normal.clear();
+    h_VertsHash.clear();
+
+    for (cl_uint z0 = 0; z0 + 1 < implicitGrid[2]; z0 += implicitSlabDepth) {
+        cl_uint slab[3] = { implicitGrid[0], implicitGrid[1], MIN(z0 + implicitSlabDepth, implicitGrid[2] - 1) - z0 + 1 };
+        setActiveGrid(slab);
+        UpperLeft[2] = implicitUpperLeftZ + z0 * voxelSize[2];
+        cl_float origin[8] = { UpperLeft[0], UpperLeft[1], UpperLeft[2], 0.0f, voxelSize[0], voxelSize[1], voxelSize[2], 0.0f };
+        ciErrNum = clEnqueueWriteBuffer(cqCommandQueue, d_volume, CL_TRUE, 0, sizeof(origin), origin, 0, 0, 0);
+        oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+        compactActiveVoxels();
+        if (activeVoxels == 0) {
+            continue;
+        }
+        enqueueGenerateTriangles(g_emitPerTriangle);
+
+        // generate drops the triangles past maxVerts
+        uint slabVerts = MIN(totalVerts, maxVerts / 3 * 3);
+        if (slabVerts < totalVerts) {
+            shrLog("implicit: the slab at z = %u has %u vertices, keeping %u\n", z0, totalVerts, slabVerts);
+        }
+        h_pos.resize((numVerts + slabVerts) * 4);
+        h_normal.resize((numVerts + slabVerts) * 4);
+        h_VertsHash.resize(numVerts + slabVerts);
+        dumpBuffer(d_pos, &h_pos[numVerts * 4], slabVerts * 4, "readback pos");
+        dumpBuffer(d_normal, &h_normal[numVerts * 4], slabVerts * 4, "readback normal");
+        dumpBuffer(d_VertsHash, &h_VertsHash[numVerts], slabVerts, "readback hash");
+
+        // point + axis * points of the slab, to the same in the virtual grid
+        unsigned long long pointOffset = (unsigned long long)z0 * sliceVoxels;
+        for (size_t v = numVerts; v < numVerts + slabVerts; v++) {
+            uint h = h_VertsHash[v];
+            h_VertsHash[v] = (uint)((h / numVoxels) * gridPoints + (h % numVoxels) + pointOffset);
+        }
+        numVerts += slabVerts;
+    }
+
+    UpperLeft[2] = implicitUpperLeftZ;
+    totalVerts = (uint)numVerts;
+    saveRequestedMesh();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Extract from level "level" of the volume pyramid from now on: its volume,
+//! grid and voxels, and for buffer volumes the program built for its layout
+////////////////////////////////////////////////////////////////////////////////
+void selectLevel(int level)
+{
+    level = CLAMP(level, 0, MC_LOD::count() - 1);
+    if (level == lodLevel) {
+        return;
+    }
+    const MC_LOD::Level &l = MC_LOD::level(level);
+    d_volume = l.volume;
+    setActiveGrid(l.gridSize);
+    for (int a = 0; a < 3; a++) {
+        voxelSize[a] = lodVoxelSize[a] * l.voxelScale;
+        UpperLeft[a] = lodUpperLeft[a] + lodVoxelSize[a] * l.originShift;
+    }
+    if (g_volumeBuffer) {
+        volumeLayout = (level == 0) ? lodLayout : MC_VOLUME::layout(l.gridSize, MC_VOLUME::FORMAT_UCHAR, false);
+        buildMCProgram(g_launch);
+    }
+    lodLevel = level;
+    shrLog("Level %d: %u x %u x %u\n", level, gridSize[0], gridSize[1], gridSize[2]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! -progressive: back to full resolution once the isovalue is still
+////////////////////////////////////////////////////////////////////////////////
+void refineLevel()
+{
+    if (lodLevel == 0) {
+        return;
+    }
+    double still = std::chrono::duration<double>(std::chrono::steady_clock::now() - lastIsoChange).count();
+    if (still >= progressiveDelay) {
+        selectLevel(0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Extract the isosurface "iso" of the voxels of "box" with the classic engine.
+//! The launches, scans and compaction cover the box, the vertices are placed
+//! with the origin of the box and their hashes are moved to the whole grid, so
+//! they match an extraction of the whole grid and those of neighbouring boxes.
+//! The box has to fit the buffers sized for -roi. With -volbuffer the kernels
+//! are built for the layout of the box, boxes of the same size reuse them.
+////////////////////////////////////////////////////////////////////////////////
+bool extractROI(float iso, const MC_ROI::VoxelBox &box)
+{
+    cl_uint fullGrid[3] = { gridSize[0], gridSize[1], gridSize[2] };
+    cl_uint dims[3];
+    unsigned long long boxPoints = 1;
+    for (int a = 0; a < 3; a++) {
+        if (box.lo[a] >= box.hi[a] || box.hi[a] >= fullGrid[a]) {
+            shrLog("extractROI: the box isn't inside the grid\n");
+            return false;
+        }
+        dims[a] = box.hi[a] - box.lo[a] + 1;
+        boxPoints *= dims[a];
+    }
+    if (boxPoints > roiCapacity) {
+        shrLog("extractROI: the box has %llu points, the buffers hold %u\n", boxPoints, roiCapacity);
+        return false;
+    }
+
+    cl_mem boxVolume;
+    ciErrNum = MC_ROI::copyVolume(cxGPUContext, cqCommandQueue, d_volume, fullGrid, g_volumeBuffer ? &volumeLayout : NULL,
+                                  box, boxVolume);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+
+    // the box as the active grid, the buffer kernels are built for its layout
+    cl_mem volume = d_volume;
+    float fullIso = isoValue;
+    cl_float fullUpperLeft[4];
+    memcpy(fullUpperLeft, UpperLeft, sizeof(fullUpperLeft));
+    MC_VOLUME::Layout fullLayout = volumeLayout;
+    d_volume = boxVolume;
+    setActiveGrid(dims);
+    for (int a = 0; a < 3; a++) {
+        UpperLeft[a] += box.lo[a] * voxelSize[a];
+    }
+    isoValue = iso;
+    if (g_volumeBuffer) {
+        volumeLayout = MC_VOLUME::layout(gridSize, volumeBufferFormat, false);
+    }
+
+    // the readback of computeIsosurface would save the hashes of the box, save after the remap
+    bool save = saveMeshFlag;
+    saveMeshFlag = false;
+    roiActive = true;
+    roiActiveBox = box;
+    computeIsosurface();
+    roiActive = false;
+
+    if (activeVoxels == 0) {
+        h_pos.clear();
+        h_normal.clear();
+        h_VertsHash.clear();
+    }
+    MC_ROI::remapHashes(h_VertsHash, box, fullGrid);
+    // like computeIsosurface, a request waits for an extraction with triangles
+    saveMeshFlag = save;
+    if (activeVoxels > 0) {
+        saveRequestedMesh();
+    }
+
+    d_volume = volume;
+    setActiveGrid(fullGrid);
+    memcpy(UpperLeft, fullUpperLeft, sizeof(UpperLeft));
+    isoValue = fullIso;
+    // the kernels of the box stay built, the next extraction of the whole grid rebuilds
+    volumeLayout = fullLayout;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Classify and compact with the path picked on the command line
+////////////////////////////////////////////////////////////////////////////////
+void compactActiveVoxels()
+{
+    if (g_labels) {
+        compactLabelPairs();
+    } else if (g_seeded) {
+        compactVoxelsSeeded();
+    } else if (g_compactAppend) {
+        compactVoxelsAppend();
+    } else if (g_narrow) {
+        compactVoxelsNarrow();
+    } else {
+        compactVoxelsScan();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! -seed: append the cells connected to the seed's cell instead of classifying
+//! the grid, see MC_SEED. The seed is a point of the whole volume, it is moved
+//! to the pyramid level and the box first.
+////////////////////////////////////////////////////////////////////////////////
+void
+compactVoxelsSeeded()
+{
+    cl_int seed[4] = { seedPoint[0] >> lodLevel, seedPoint[1] >> lodLevel, seedPoint[2] >> lodLevel, 0 };
+    if (roiActive) {
+        for (int a = 0; a < 3; a++) {
+            seed[a] -= (cl_int)roiActiveBox.lo[a];
+        }
+    }
+    totalVerts = 0;
+    ciErrNum = MC_SEED::search(cqCommandQueue, seed, d_volume, d_numVertsTable, gridSize, gridSizeShift, gridSizeMask, isoValue,
+                               d_compVoxelArray, d_voxelOccupied, d_appendCount, g_launch.compactThreads, activeVoxels);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+    if (activeVoxels > 0) {
+        scanAppendedVoxels();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! -labels: the (cell, label) pairs of the label map grouped by label, see
+//! MC_LABELS. Sets activeVoxels to the number of pairs and totalVerts.
+////////////////////////////////////////////////////////////////////////////////
+void
+compactLabelPairs()
+{
+    ciErrNum = MC_LABELS::compact(cqCommandQueue, d_volume, d_numVertsTable, gridSize, gridSizeShift, numVoxels,
+                                  d_compVoxelArray, d_compLabels, d_appendCount,
+                                  g_launch.classifyThreads, g_launch.compactThreads, maxVerts, activeVoxels, totalVerts);
+    oclCheckErrorEX(ciErrNum, CL_SUCCESS, pCleanup);
+}
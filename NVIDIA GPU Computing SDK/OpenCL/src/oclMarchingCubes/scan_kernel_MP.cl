@@ -407,4 +407,121 @@ uint address = mul24(group_id, (group_size << 1)) + base_index + local_id;
 output_data[address] += shared_data[0];
 if ((local_id + group_size) < n)
 output_data[address + group_size] += shared_data[0];
-}//
\ No newline at end of file
+}//
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Narrow input variants: the first level reads uchar elements, the output and the
+// partial sums stay DataType so the upper levels and UniformAdd are shared
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void
+LoadLocalFromGlobalU8(
+__local DataType *shared_data,
+__global const uchar *input_data,
+const uint4 address_pair,
+const uint n)
+{
+	const uint local_index_a = address_pair.z;
+	const uint local_index_b = address_pair.w;
+
+	shared_data[local_index_a + MEMORY_BANK_OFFSET(local_index_a)] = input_data[address_pair.x];
+	shared_data[local_index_b + MEMORY_BANK_OFFSET(local_index_b)] = input_data[address_pair.y];
+}//
+
+void
+LoadLocalFromGlobalNonPowerOfTwoU8(
+__local DataType *shared_data,
+__global const uchar *input_data,
+const uint4 address_pair,
+const uint n)
+{
+	const uint local_index_a = address_pair.z;
+	const uint local_index_b = address_pair.w;
+
+	shared_data[local_index_a + MEMORY_BANK_OFFSET(local_index_a)] = input_data[address_pair.x];
+	shared_data[local_index_b + MEMORY_BANK_OFFSET(local_index_b)] = (local_index_b < n) ? input_data[address_pair.y] : 0;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+}//
+
+__kernel void
+PreScanKernelU8(
+__global DataType *output_data,
+__global const uchar *input_data,
+__local DataType* shared_data,
+const uint  group_index,
+const uint  base_index,
+const uint  n)
+{
+	const uint group_id = get_global_id(0) / get_local_size(0);
+	const uint group_size = get_local_size(0);
+
+	uint local_index = (base_index == 0) ? mul24(group_id, (group_size << 1)) : base_index;
+	uint4 address_pair = GetAddressMapping(local_index);
+
+	LoadLocalFromGlobalU8(shared_data, input_data, address_pair, n);
+	PreScanGroup(shared_data, group_index);
+	StoreLocalToGlobal(output_data, shared_data, address_pair, n);
+}//
+
+__kernel void
+PreScanStoreSumKernelU8(
+__global DataType *output_data,
+__global const uchar *input_data,
+__global DataType *partial_sums,
+__local DataType* shared_data,
+const uint group_index,
+const uint base_index,
+const uint n)
+{
+	const uint group_id = get_global_id(0) / get_local_size(0);
+	const uint group_size = get_local_size(0);
+
+	uint local_index = (base_index == 0) ? mul24(group_id, (group_size << 1)) : base_index;
+	uint4 address_pair = GetAddressMapping(local_index);
+
+	LoadLocalFromGlobalU8(shared_data, input_data, address_pair, n);
+	PreScanGroupStoreSum(partial_sums, shared_data, group_index);
+	StoreLocalToGlobal(output_data, shared_data, address_pair, n);
+}//
+
+__kernel void
+PreScanStoreSumNonPowerOfTwoKernelU8(
+__global DataType *output_data,
+__global const uchar *input_data,
+__global DataType *partial_sums,
+__local DataType* shared_data,
+const uint group_index,
+const uint base_index,
+const uint n)
+{
+	const uint group_id = get_global_id(0) / get_local_size(0);
+	const uint group_size = get_local_size(0);
+
+	uint local_index = (base_index == 0) ? mul24(group_id, (group_size << 1)) : base_index;
+	uint4 address_pair = GetAddressMapping(local_index);
+
+	LoadLocalFromGlobalNonPowerOfTwoU8(shared_data, input_data, address_pair, n);
+	PreScanGroupStoreSum(partial_sums, shared_data, group_index);
+	StoreLocalToGlobalNonPowerOfTwo(output_data, shared_data, address_pair, n);
+}//
+
+__kernel void
+PreScanNonPowerOfTwoKernelU8(
+__global DataType *output_data,
+__global const uchar *input_data,
+__local DataType* shared_data,
+const uint group_index,
+const uint base_index,
+const uint n)
+{
+	const uint group_id = get_global_id(0) / get_local_size(0);
+	const uint group_size = get_local_size(0);
+
+	uint local_index = (base_index == 0) ? mul24(group_id, (group_size << 1)) : base_index;
+	uint4 address_pair = GetAddressMapping(local_index);
+
+	LoadLocalFromGlobalNonPowerOfTwoU8(shared_data, input_data, address_pair, n);
+	PreScanGroup(shared_data, group_index);
+	StoreLocalToGlobalNonPowerOfTwo(output_data, shared_data, address_pair, n);
+}//